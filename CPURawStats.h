@@ -13,11 +13,40 @@ typedef struct Stats{
     uint32_t irq;
     uint32_t sortirq;
     uint32_t steal;
+    uint64_t run_delay; // ns spent waiting on the run-queue - /proc/schedstat
 }Stats;
 
+// /proc/loadavg
+typedef struct LoadAvg{
+    double avg[3];  // 1, 5 and 15 minutes
+    uint32_t runnable;
+    uint32_t threads;
+} LoadAvg;
+
+// /proc/pressure/cpu - share of time in % some (or all) tasks were stalled waiting for cpu
+typedef struct Pressure{
+    double some_avg[3]; // 10, 60 and 300 seconds
+    double full_avg[3];
+    uint64_t some_total;    // us
+    uint64_t full_total;
+} Pressure;
+
+typedef enum{
+    SYSLOAD_LOADAVG = 1,
+    SYSLOAD_PSI = 2,
+    SYSLOAD_SCHEDSTAT = 4
+} SysLoadSource;
+
+typedef struct SysLoad{
+    LoadAvg load;
+    Pressure psi;
+    uint32_t sources;   // SysLoadSource bits of available data
+} SysLoad;
+
 typedef struct CPURawStats{
     Stats total;
     Stats* cpus;
+    SysLoad sys;
 } CPURawStats;
 
 
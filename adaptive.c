@@ -0,0 +1,85 @@
+#include <stdlib.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "adaptive.h"
+
+enum{ADAPTIVE_BACKOFF = 2};
+enum{ADAPTIVE_START_MS = 1000};
+
+/**
+ * Sets up adaptive interval, starts from 1 s (within the limits).
+ * @param min_ms - fastest sampling, > 0
+ * @param max_ms - slowest sampling, >= min_ms
+ * @return False on invalid limits or allocation error.
+ */
+bool adaptive_init(AdaptiveRate* const ar, const size_t no_cpus, const uint32_t min_ms, const uint32_t max_ms)
+{
+    if(ar == NULL || no_cpus == 0 || min_ms == 0 || max_ms < min_ms)
+        return false;
+    *ar = (AdaptiveRate){.min_ms = min_ms,
+                         .max_ms = max_ms,
+                         .interval_ms = ADAPTIVE_START_MS < min_ms ? min_ms :
+                                        (ADAPTIVE_START_MS > max_ms ? max_ms : ADAPTIVE_START_MS),
+                         .no_cpus = no_cpus,
+                         .ticks_per_s = (double)sysconf(_SC_CLK_TCK),
+                         .first = true
+                        };
+    ar->prev_cores = calloc(no_cpus, sizeof(uint16_t));
+    return ar->prev_cores != NULL;
+}
+
+void adaptive_destroy(AdaptiveRate* const ar)
+{
+    if(ar == NULL)
+        return;
+    free(ar->prev_cores);
+    ar->prev_cores = NULL;
+}
+
+/**
+ * Picks the interval to the next sample from the change since the previous one.
+ * @param cores_bp - usage of every core in the newest sample in basis points
+ * @return Interval in ms.
+ */
+uint32_t adaptive_update(AdaptiveRate* const ar, const uint16_t* const cores_bp)
+{
+    uint32_t max_delta_bp = 0;
+    uint64_t sum_delta_bp = 0;
+    for (size_t j = 0; j < ar->no_cpus; j++)
+    {
+        const uint32_t delta = cores_bp[j] > ar->prev_cores[j] ? cores_bp[j] - ar->prev_cores[j] :
+                                                                ar->prev_cores[j] - cores_bp[j];
+        max_delta_bp = delta > max_delta_bp ? delta : max_delta_bp;
+        sum_delta_bp += delta;
+        ar->prev_cores[j] = cores_bp[j];
+    }
+    const double max_delta = (double)max_delta_bp / 100;
+    const double sum_delta = (double)sum_delta_bp / 100;
+    if(ar->first)
+    {
+        ar->first = false;
+        return ar->interval_ms;
+    }
+
+    // One clock tick more or less on a core is this many percentage points - not a change
+    const double tick_pp = 100.0 * 1000.0 / ((double)ar->interval_ms * ar->ticks_per_s);
+    const double jump_pp = fmax(ADAPTIVE_JUMP_PP, 3 * tick_pp);
+    const double stable_pp = fmax(ADAPTIVE_STABLE_PP, 2 * tick_pp);
+
+    const double mean = sum_delta / (double)ar->no_cpus;
+    const double dev = mean - ar->mean_delta;
+    const bool jump = max_delta >= jump_pp || dev > 3 * sqrt(ar->var_delta) + stable_pp;
+    const double alpha = 0.2;
+    ar->mean_delta += alpha * dev;
+    ar->var_delta = (1 - alpha) * (ar->var_delta + alpha * dev * dev);
+
+    if(jump)
+        ar->interval_ms = ar->min_ms;
+    else if(max_delta < stable_pp)
+    {
+        const uint64_t slower = (uint64_t)ar->interval_ms * ADAPTIVE_BACKOFF;
+        ar->interval_ms = slower > ar->max_ms ? ar->max_ms : (uint32_t)slower;
+    }
+    return ar->interval_ms;
+}
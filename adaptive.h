@@ -0,0 +1,33 @@
+
+#ifndef CPU_USAGE_TRACKER_ADAPTIVE_H
+#define CPU_USAGE_TRACKER_ADAPTIVE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define ADAPTIVE_JUMP_PP 10.0       // change of a core that always means "sample faster"
+#define ADAPTIVE_STABLE_PP 2.0      // every core moved less than this - back off
+
+/**
+ * Sampling interval driven by observed change. Jumps to min_ms when per-core deltas or the spread of
+ * deltas jump, doubles up to max_ms while every core is stable.
+ */
+typedef struct AdaptiveRate{
+    uint32_t min_ms;
+    uint32_t max_ms;
+    uint32_t interval_ms;   // current interval
+    size_t no_cpus;
+    uint16_t* prev_cores;   // basis points
+    double mean_delta;      // exponential average of the mean per-core delta
+    double var_delta;       // and its variance
+    double ticks_per_s;     // resolution of /proc/stat - short intervals are noisier
+    bool first;
+} AdaptiveRate;
+
+bool adaptive_init(AdaptiveRate* ar, size_t no_cpus, uint32_t min_ms, uint32_t max_ms);
+void adaptive_destroy(AdaptiveRate* ar);
+
+uint32_t adaptive_update(AdaptiveRate* ar, const uint16_t* cores_bp);
+
+#endif //CPU_USAGE_TRACKER_ADAPTIVE_H
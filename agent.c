@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "agent.h"
+#include "wire.h"
+#include "collector.h"
+#include "logger.h"
+
+/**
+ *  out HOLDS AT MOST ONE FRAME - THE HELLO/KEY FRAME AFTER A CONNECT OR THE SAMPLE THE SOCKET DID NOT TAKE
+ *  COMPLETELY. ITS REST IS SENT BEFORE ANYTHING ELSE, THE FRAME BOUNDARIES OF THE STREAM MUST NOT BREAK.
+ */
+struct Agent{
+    WireAddr addr;
+    char name[WIRE_NAME_LEN];
+    uint32_t interval_ms;   // advertised in HELLO
+    int fd;                 // -1 while disconnected
+    bool connecting;        // connect of fd goes on in the background
+    uint64_t retry_ns;      // next connect attempt, deadline of the pending one while connecting
+    bool logged;            // connection failure was logged
+    WireEncoder enc;
+    size_t out_cap;
+    size_t out_len;
+    size_t out_sent;
+    uint8_t* out;
+};
+
+/**
+ * FNV-1a of the host name - default host id, stable across restarts.
+ */
+uint32_t agent_default_id(const char* const name)
+{
+    uint32_t hash = 2166136261u;
+    for (const char* c = name; *c != '\0'; c++)
+        hash = (hash ^ (uint8_t)*c) * 16777619u;
+    return hash;
+}
+
+static void agent_disconnect(Agent* const a, const char* const msg)
+{
+    if(a->fd >= 0)
+        close(a->fd);
+    a->fd = -1;
+    a->connecting = false;
+    a->out_len = 0;
+    a->out_sent = 0;
+    a->retry_ns = collector_now_ns() + (uint64_t)AGENT_RETRY_MS * 1000000u;
+    if(!a->logged)
+        logger_write(msg, LOG_WARNING);
+    a->logged = true;
+}
+
+/**
+ * Sends the rest of out.
+ * @return True when out is empty, false if the socket is full or the connection was lost.
+ */
+static bool agent_flush(Agent* const a)
+{
+    while(a->out_sent < a->out_len)
+    {
+        const ssize_t n = send(a->fd, a->out + a->out_sent, a->out_len - a->out_sent, MSG_NOSIGNAL);
+        if(n < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            if(errno != EAGAIN && errno != EWOULDBLOCK)
+                agent_disconnect(a, "Agent lost connection to the collector");
+            return false;
+        }
+        a->out_sent += (size_t)n;
+    }
+    a->out_len = 0;
+    a->out_sent = 0;
+    return true;
+}
+
+/**
+ * Starts a connect when the retry time has come and queues HELLO once it completes. Never waits for the collector.
+ * @return True if connected.
+ */
+static bool agent_connect(Agent* const a)
+{
+    if(a->fd >= 0 && !a->connecting)
+        return true;
+    const uint64_t now = collector_now_ns();
+    if(a->fd < 0)
+    {
+        if(now < a->retry_ns)
+            return false;
+        a->fd = wire_connect(&a->addr, &a->connecting);
+        if(a->fd < 0)
+        {
+            agent_disconnect(a, "Agent failed to connect to the collector");
+            return false;
+        }
+        a->retry_ns = now + (uint64_t)AGENT_CONNECT_TIMEOUT_MS * 1000000u;
+    }
+    if(a->connecting)
+    {
+        const int err = wire_connect_result(a->fd);
+        if(err == EINPROGRESS && now < a->retry_ns)
+            return false;   // sample is skipped, the connect goes on
+        if(err != 0)
+        {
+            agent_disconnect(a, "Agent failed to connect to the collector");
+            return false;
+        }
+        a->connecting = false;
+    }
+    if(a->logged)
+        logger_write("Agent connected to the collector", LOG_INFO);
+    a->logged = false;
+    wire_encoder_reset(&a->enc);
+    a->out_len = wire_encode_hello(&a->enc, a->name, a->interval_ms, a->out, a->out_cap);
+    a->out_sent = 0;
+    return true;
+}
+
+/**
+ * Creates agent, the collector is connected by the first publish.
+ * @param addr - collector address, unix socket path or HOST:PORT
+ * @param host_id - id of this host in the fleet, agent_default_id(name) if not configured
+ * @param name - host name shown by the collector
+ * @param no_cpus - number of cores in every sample
+ * @param interval_ms - longest interval between samples - the collector sees a silent host by it
+ * @return Pointer to the new agent, NULL on error or if the address cannot be resolved.
+ */
+Agent* agent_create(const char* const addr, const uint32_t host_id, const char* const name, const size_t no_cpus,
+                    const uint32_t interval_ms)
+{
+    if(addr == NULL || name == NULL)
+        return NULL;
+    Agent* const a = calloc(1, sizeof(*a));
+    if(a == NULL)
+        return NULL;
+    a->fd = -1;
+    a->interval_ms = interval_ms;
+    a->out_cap = wire_max_frame(no_cpus);
+    a->out = malloc(a->out_cap);
+    snprintf(a->name, sizeof(a->name), "%s", name);
+    if(!wire_resolve(addr, &a->addr) || a->out == NULL || !wire_encoder_init(&a->enc, host_id, no_cpus))
+    {
+        free(a->out);
+        free(a);
+        return NULL;
+    }
+    return a;
+}
+
+void agent_delete(Agent* const a)
+{
+    if(a == NULL)
+        return;
+    if(a->fd >= 0)
+        close(a->fd);
+    wire_encoder_destroy(&a->enc);
+    free(a->out);
+    free(a);
+}
+
+/**
+ * Encodes and sends one sample. Called by the export consumer after every sample.
+ * @param a - agent, NULL if disabled
+ * @param timestamp_ms - wall clock time of the sample
+ * @param data - analyzed sample
+ * @return True if the sample was sent (possibly partially, the rest goes before the next one).
+ */
+bool agent_publish(Agent* const a, const uint64_t timestamp_ms, const UsagePercentage* const data)
+{
+    if(a == NULL || data == NULL || !agent_connect(a) || !agent_flush(a))
+        return false;
+    a->out_len = wire_encode_sample(&a->enc, timestamp_ms, data->total_bp, data->effective_bp, data->cores_bp, a->out,
+                                    a->out_cap);
+    a->out_sent = 0;
+    agent_flush(a);
+    return a->fd >= 0;
+}
@@ -0,0 +1,27 @@
+
+#ifndef CPU_USAGE_TRACKER_AGENT_H
+#define CPU_USAGE_TRACKER_AGENT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "analyzer.h"
+
+/**
+ * Streams every analyzed sample to a fleet collector. Sending never blocks - while the socket is full new
+ * samples are skipped, the delta encoding stays consistent because only sent frames advance the encoder.
+ * A lost connection is retried every AGENT_RETRY_MS and starts with HELLO and a key frame. The collector address
+ * is resolved once by agent_create, a connect goes on in the background for at most AGENT_CONNECT_TIMEOUT_MS.
+ */
+#define AGENT_RETRY_MS 2000
+#define AGENT_CONNECT_TIMEOUT_MS 5000
+
+typedef struct Agent Agent;   // Forward declaration
+
+Agent* agent_create(const char* addr, uint32_t host_id, const char* name, size_t no_cpus, uint32_t interval_ms);
+void agent_delete(Agent* a);
+
+bool agent_publish(Agent* a, uint64_t timestamp_ms, const UsagePercentage* data);
+uint32_t agent_default_id(const char* name);
+
+#endif //CPU_USAGE_TRACKER_AGENT_H
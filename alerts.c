@@ -0,0 +1,636 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <spawn.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/wait.h>
+
+#include "alerts.h"
+#include "logger.h"
+#include "queue.h"
+
+extern char** environ;
+
+typedef enum{
+    ALERT_METRIC_USAGE = 0,
+    ALERT_METRIC_STEAL = 1,
+    ALERT_METRIC_EFFECTIVE = 2
+} AlertMetric;
+
+// Rule as parsed from the command line, expanded into one slot per monitored entry
+typedef struct AlertRule{
+    AlertMetric metric;
+    size_t first_entry;     // 0 - total, 1..no_cpus - cores
+    size_t end_entry;
+    double threshold;
+    double clear;
+    double avg_s;
+    double cooldown_s;
+    uint32_t for_n;
+} AlertRule;
+
+/**
+ *  SAMPLES OF THE LAST avg SECONDS OF ONE RULE. EVERY SLOT OF THE RULE SEES THE SAME INTERVALS, SO THEY SHARE
+ *  ONE RING OF INTERVALS AND KEEP A ROW OF VALUES EACH. RUNNING SUMS OF value * interval AND OF THE INTERVALS
+ *  GIVE THE MEAN IN O(SLOTS) PER SAMPLE - THE OLDEST SAMPLE LEAVES ONCE THE NEWER ONES SPAN THE WINDOW.
+ */
+typedef struct AlertWindow{
+    double window_s;
+    size_t first_slot;
+    size_t no_slots;
+    size_t capacity;        // enough for the window at the shortest sampling interval
+    size_t head;            // oldest sample
+    size_t count;
+    double sum_dt;
+    double* dt;             // [capacity]
+    double* values;         // [capacity][no_slots]
+    double* sum;            // [no_slots] value * interval of the samples in the window
+} AlertWindow;
+
+// Sent to the dispatcher thread which runs the hook and writes to the FIFO
+typedef struct AlertEvent{
+    uint32_t slot;
+    bool fired;
+    double value;
+} AlertEvent;
+
+struct AlertEngine{
+    size_t no_cpus;
+    size_t no_rules;
+    const char* rules[ALERTS_MAX_RULES];
+    bool uses_steal;
+    bool uses_effective;
+    double now_s;
+    size_t no_active;
+
+    // Current value of every metric: [usage: total, cpu1..cpuN][steal: total, cpu1..cpuN][effective: total, cpu1..cpuN]
+    double* values;
+
+    // Compiled rules - flat arrays indexed by slot
+    size_t no_slots;
+    double* threshold;
+    double* clear;
+    double* avg_s;
+    double* cooldown_s;
+    double* avg;            // value of a slot with a window - the mean of the window
+    double* ready_at;
+    uint32_t* value_idx;
+    uint32_t* for_n;
+    uint32_t* streak;
+    uint16_t* rule_idx;
+    uint8_t* active;
+
+    // Windows of the rules with avg, only those allocate memory
+    size_t no_windows;
+    AlertWindow windows[ALERTS_MAX_RULES];
+
+    // Off the hot path delivery, only when hook or fifo is given - by the dispatcher thread, or without a thread
+    // by the evaluating one, which never waits for a hook
+    const char* hook;
+    const char* fifo_path;
+    int fifo_fd;
+    Queue* events;
+    pthread_t dispatch_th;
+    atomic_bool term_flag;
+    size_t dropped;
+    // Without the dispatcher thread one hook runs at a time, so the hook sees the events in order
+    pid_t hook_pid;                             // running hook, 0 if none
+    AlertEvent pending[ALERTS_PENDING_HOOKS];   // ring of the events waiting for it
+    size_t pending_head;
+    size_t no_pending;
+};
+
+/**
+ * Parses METRIC>THRESHOLD[,key=value...]
+ * @return False on invalid rule.
+ */
+static bool alerts_parse_rule(const char* text, const size_t no_cpus, AlertRule* const rule)
+{
+    *rule = (AlertRule){.metric = ALERT_METRIC_USAGE,
+                        .first_entry = 0,
+                        .end_entry = 1,
+                        .for_n = 1
+                       };
+    if(strncmp(text, "steal", 5) == 0)
+    {
+        rule->metric = ALERT_METRIC_STEAL;
+        text += 5;
+        if(*text == '_')
+            text++;
+    }
+    else if(strncmp(text, "eff_", 4) == 0)
+    {
+        rule->metric = ALERT_METRIC_EFFECTIVE;
+        text += 4;
+    }
+    if(strncmp(text, "total", 5) == 0)
+        text += 5;
+    else if(strncmp(text, "cpu", 3) == 0)
+    {
+        text += 3;
+        if(*text >= '0' && *text <= '9')
+        {
+            char* end;
+            const unsigned long cpu = strtoul(text, &end, 10);
+            if(cpu == 0 || cpu > no_cpus)
+                return false;
+            rule->first_entry = cpu;
+            rule->end_entry = cpu + 1;
+            text = end;
+        }
+        else
+        {
+            rule->first_entry = 1;
+            rule->end_entry = no_cpus + 1;
+        }
+    }
+    else if(rule->metric != ALERT_METRIC_STEAL)     // bare "steal" is total steal
+        return false;
+
+    if(*text++ != '>')
+        return false;
+    char* end;
+    rule->threshold = strtod(text, &end);
+    if(end == text || rule->threshold < 0 || rule->threshold > 100)
+        return false;
+    rule->clear = rule->threshold > ALERTS_DEFAULT_HYSTERESIS ? rule->threshold - ALERTS_DEFAULT_HYSTERESIS : 0;
+    text = end;
+
+    while(*text == ',')
+    {
+        text++;
+        const char* const eq = strchr(text, '=');
+        if(eq == NULL)
+            return false;
+        const double value = strtod(eq + 1, &end);
+        if(end == eq + 1 || value < 0)
+            return false;
+        const size_t key_len = (size_t)(eq - text);
+        if(key_len == 3 && strncmp(text, "for", 3) == 0 && value >= 1)
+            rule->for_n = (uint32_t)value;
+        else if(key_len == 3 && strncmp(text, "avg", 3) == 0)
+            rule->avg_s = value;
+        else if(key_len == 5 && strncmp(text, "clear", 5) == 0 && value <= rule->threshold)
+            rule->clear = value;
+        else if(key_len == 8 && strncmp(text, "cooldown", 8) == 0)
+            rule->cooldown_s = value;
+        else
+            return false;
+        text = end;
+    }
+    return *text == '\0';
+}
+
+/**
+ * Formats one line describing the event, e.g. "FIRED cpu>95,for=5 cpu3 97.2%".
+ */
+static void alerts_format(const AlertEngine* const ae, const uint32_t slot, const bool fired, const double value,
+                          char* const line, const size_t size)
+{
+    const size_t entry = ae->value_idx[slot] % (ae->no_cpus + 1);
+    char target[24];
+    if(entry == 0)
+        strcpy(target, "total");
+    else
+        snprintf(target, sizeof(target), "cpu%zu", entry);
+    snprintf(line, size, "%s %s %s %.1f%%", fired ? "FIRED" : "RESOLVED", ae->rules[ae->rule_idx[slot]], target,
+             value);
+}
+
+/**
+ * Writes the line to the FIFO. Events are dropped while nobody reads it.
+ * SIGPIPE is blocked only for the write - a reader that went away fails it with EPIPE instead of killing us,
+ * the signal mask of the caller stays as it was.
+ */
+static void alerts_write_fifo(AlertEngine* const ae, const char* const line)
+{
+    if(ae->fifo_fd < 0)
+        ae->fifo_fd = open(ae->fifo_path, O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+    if(ae->fifo_fd < 0)
+        return;
+    char buffer[320];
+    const int len = snprintf(buffer, sizeof(buffer), "%s\n", line);
+    sigset_t sigpipe, old_mask, pending;
+    sigemptyset(&sigpipe);
+    sigaddset(&sigpipe, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &sigpipe, &old_mask);
+    sigpending(&pending);
+    const bool was_pending = sigismember(&pending, SIGPIPE);
+    if(write(ae->fifo_fd, buffer, (size_t)len) < 0 && errno == EPIPE)
+    {
+        // Consume our SIGPIPE before unblocking it, one raised by somebody else stays pending
+        if(!was_pending)
+        {
+            const struct timespec no_wait = {0, 0};
+            sigtimedwait(&sigpipe, NULL, &no_wait);
+        }
+        close(ae->fifo_fd);
+        ae->fifo_fd = -1;
+    }
+    pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+}
+
+/**
+ * Starts the hook command with /bin/sh. Event is passed in CUT_ALERT_* environment variables.
+ * @param pid - set to the hook process
+ * @return False if the hook could not be started.
+ */
+static bool alerts_spawn_hook(const AlertEngine* const ae, const AlertEvent* const ev, const char* const line,
+                              pid_t* const pid)
+{
+    enum{NO_EXTRA_ENV = 3};
+    size_t no_env = 0;
+    while(environ[no_env] != NULL)
+        no_env++;
+    char** const envp = malloc(sizeof(char*) * (no_env + NO_EXTRA_ENV + 1));
+    if(envp == NULL)
+        return false;
+    memcpy(envp, environ, sizeof(char*) * no_env);
+    char state[32], value[48], message[320];
+    snprintf(state, sizeof(state), "CUT_ALERT_STATE=%s", ev->fired ? "fired" : "resolved");
+    snprintf(value, sizeof(value), "CUT_ALERT_VALUE=%.2f", ev->value);
+    snprintf(message, sizeof(message), "CUT_ALERT_MESSAGE=%s", line);
+    envp[no_env] = state;
+    envp[no_env + 1] = value;
+    envp[no_env + 2] = message;
+    envp[no_env + NO_EXTRA_ENV] = NULL;
+
+    // The hook should not inherit the signals blocked in our threads
+    posix_spawnattr_t attr;
+    sigset_t no_signals;
+    sigemptyset(&no_signals);
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setsigmask(&attr, &no_signals);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+
+    char* const argv[] = {"sh", "-c", (char*)ae->hook, NULL};
+    const bool spawned = posix_spawn(pid, "/bin/sh", NULL, &attr, argv, envp) == 0;
+    if(!spawned)
+        logger_write("ALERTS - failed to run hook", LOG_WARNING);
+    posix_spawnattr_destroy(&attr);
+    free(envp);
+    return spawned;
+}
+
+/**
+ * Collects the running hook once it finished and starts the one of the next pending event. Only one hook runs
+ * at a time, so it sees the events in the order they happened.
+ * @param wait - wait until every pending event was delivered instead
+ */
+static void alerts_reap_hooks(AlertEngine* const ae, const bool wait)
+{
+    while(ae->hook_pid != 0 || ae->no_pending != 0)
+    {
+        if(ae->hook_pid != 0)
+        {
+            const pid_t done = waitpid(ae->hook_pid, NULL, wait ? 0 : WNOHANG);
+            if(done == 0)
+                return;
+            if(done < 0 && errno == EINTR)
+                continue;
+            ae->hook_pid = 0;
+        }
+        if(ae->no_pending == 0)
+            return;
+        const AlertEvent ev = ae->pending[ae->pending_head];
+        ae->pending_head = (ae->pending_head + 1) % ALERTS_PENDING_HOOKS;
+        ae->no_pending--;
+        char line[256];
+        alerts_format(ae, ev.slot, ev.fired, ev.value, line, sizeof(line));
+        if(!alerts_spawn_hook(ae, &ev, line, &ae->hook_pid))
+        {
+            ae->hook_pid = 0;
+            ae->dropped++;
+        }
+    }
+}
+
+// Dispatcher thread func - slow deliveries never hold the analyzer
+static void* alerts_dispatch_func(void* args)
+{
+    AlertEngine* const ae = args;
+
+    AlertEvent ev;
+    while(atomic_load(&ae->term_flag) == false || !queue_is_empty(ae->events))
+    {
+        if(queue_dequeue(ae->events, &ev, 1) != QSUCCESS)
+            continue;
+        char line[256];
+        alerts_format(ae, ev.slot, ev.fired, ev.value, line, sizeof(line));
+        pid_t pid;
+        if(ae->fifo_path != NULL)
+            alerts_write_fifo(ae, line);
+        if(ae->hook != NULL && alerts_spawn_hook(ae, &ev, line, &pid))
+            waitpid(pid, NULL, 0);
+    }
+    pthread_exit(NULL);
+}
+
+
+/**
+ * Allocates the window of a rule with avg.
+ * @return False on allocation error.
+ */
+static bool alerts_window_init(AlertWindow* const w, const double window_s, const size_t first_slot,
+                               const size_t no_slots, const double min_interval_s)
+{
+    *w = (AlertWindow){.window_s = window_s,
+                       .first_slot = first_slot,
+                       .no_slots = no_slots,
+                       .capacity = (size_t)ceil(window_s / min_interval_s) + 1
+                      };
+    w->dt = malloc(sizeof(double) * w->capacity);
+    w->values = malloc(sizeof(double) * w->capacity * no_slots);
+    w->sum = calloc(no_slots, sizeof(double));
+    return w->dt != NULL && w->values != NULL && w->sum != NULL;
+}
+
+static void alerts_window_destroy(AlertWindow* const w)
+{
+    free(w->dt);
+    free(w->values);
+    free(w->sum);
+}
+
+/**
+ * Adds a sample to the window, drops the ones that fell out of it and writes the mean of every slot.
+ * @param values - current value of every metric
+ * @param value_idx - value of every slot
+ * @param avg - mean of every slot, the slots of the window are written
+ */
+static void alerts_window_push(AlertWindow* const w, const double* const values, const uint32_t* const value_idx,
+                               const double interval_s, double* const avg)
+{
+    // The oldest sample leaves once the newer ones span the window, or to make room
+    while(w->count != 0 && (w->sum_dt + interval_s - w->dt[w->head] >= w->window_s || w->count == w->capacity))
+    {
+        const double* const old = &w->values[w->head * w->no_slots];
+        for (size_t i = 0; i < w->no_slots; i++)
+            w->sum[i] -= old[i] * w->dt[w->head];
+        w->sum_dt -= w->dt[w->head];
+        w->head = (w->head + 1) % w->capacity;
+        w->count--;
+    }
+    // Rounding of the running sums does not outlive an emptied window
+    if(w->count == 0)
+    {
+        w->sum_dt = 0;
+        memset(w->sum, 0, sizeof(double) * w->no_slots);
+    }
+    const size_t tail = (w->head + w->count) % w->capacity;
+    double* const row = &w->values[tail * w->no_slots];
+    w->dt[tail] = interval_s;
+    w->sum_dt += interval_s;
+    w->count++;
+    for (size_t i = 0; i < w->no_slots; i++)
+    {
+        const size_t s = w->first_slot + i;
+        row[i] = values[value_idx[s]];
+        w->sum[i] += row[i] * interval_s;
+        // The first sample has no interval yet - it stands for itself
+        avg[s] = w->sum_dt > 0 ? w->sum[i] / w->sum_dt : row[i];
+    }
+}
+
+/**
+ * Compiles rules into flat arrays - one slot per rule and monitored entry.
+ * @param rules - rule texts, have to outlive the engine
+ * @param no_rules - number of rules, at most ALERTS_MAX_RULES
+ * @param no_cpus - number of cores in every sample
+ * @param min_interval_s - shortest sampling interval, sizes the windows of rules with avg
+ * @param hook - shell command run for every event, NULL if disabled
+ * @param fifo_path - FIFO receiving one line per event, NULL if disabled
+ * @param dispatch_thread - deliver to the hook and FIFO from a thread of the engine, false - the thread calling
+ *                          alerts_evaluate delivers without waiting for the hook, one hook at a time
+ * @return Pointer to the engine, NULL on invalid rule, allocation error or no rules.
+ */
+AlertEngine* alerts_create(const char* const* const rules, const size_t no_rules, const size_t no_cpus,
+                           const double min_interval_s, const char* const hook, const char* const fifo_path,
+                           const bool dispatch_thread)
+{
+    if(rules == NULL || no_rules == 0 || no_rules > ALERTS_MAX_RULES || no_cpus == 0 || min_interval_s <= 0)
+        return NULL;
+    AlertRule parsed[ALERTS_MAX_RULES];
+    size_t no_slots = 0;
+    bool uses_steal = false, uses_effective = false;
+    for (size_t r = 0; r < no_rules; r++)
+    {
+        if(!alerts_parse_rule(rules[r], no_cpus, &parsed[r]))
+        {
+            fprintf(stderr, "Invalid alert rule: %s\n", rules[r]);
+            return NULL;
+        }
+        no_slots += parsed[r].end_entry - parsed[r].first_entry;
+        uses_steal |= parsed[r].metric == ALERT_METRIC_STEAL;
+        uses_effective |= parsed[r].metric == ALERT_METRIC_EFFECTIVE;
+    }
+
+    AlertEngine* const ae = malloc(sizeof(*ae));
+    if(ae == NULL)
+        return NULL;
+    const size_t no_values = 3 * (no_cpus + 1);
+    // One block, widest types first
+    const size_t block_size = sizeof(double) * (6 * no_slots + no_values) + sizeof(uint32_t) * 3 * no_slots +
+                              sizeof(uint16_t) * no_slots + no_slots;
+    uint8_t* const block = calloc(1, block_size);
+    if(block == NULL)
+    {
+        free(ae);
+        return NULL;
+    }
+    *ae = (AlertEngine){.no_cpus = no_cpus,
+                        .no_rules = no_rules,
+                        .uses_steal = uses_steal,
+                        .uses_effective = uses_effective,
+                        .no_slots = no_slots,
+                        .hook = hook,
+                        .fifo_path = fifo_path,
+                        .fifo_fd = -1,
+                        .term_flag = ATOMIC_VAR_INIT(0)
+                       };
+    double* d = (double*)block;
+    ae->values = d;         d += no_values;
+    ae->threshold = d;      d += no_slots;
+    ae->clear = d;          d += no_slots;
+    ae->avg_s = d;          d += no_slots;
+    ae->cooldown_s = d;     d += no_slots;
+    ae->avg = d;            d += no_slots;
+    ae->ready_at = d;       d += no_slots;
+    ae->value_idx = (uint32_t*)d;
+    ae->for_n = ae->value_idx + no_slots;
+    ae->streak = ae->for_n + no_slots;
+    ae->rule_idx = (uint16_t*)(ae->streak + no_slots);
+    ae->active = (uint8_t*)(ae->rule_idx + no_slots);
+
+    size_t s = 0;
+    bool windows_ok = true;
+    for (size_t r = 0; r < no_rules; r++)
+    {
+        ae->rules[r] = rules[r];
+        const size_t base = (size_t)parsed[r].metric * (no_cpus + 1);
+        if(parsed[r].avg_s > 0)
+            windows_ok &= alerts_window_init(&ae->windows[ae->no_windows++], parsed[r].avg_s, s,
+                                             parsed[r].end_entry - parsed[r].first_entry, min_interval_s);
+        for (size_t e = parsed[r].first_entry; e < parsed[r].end_entry; e++, s++)
+        {
+            ae->value_idx[s] = (uint32_t)(base + e);
+            ae->rule_idx[s] = (uint16_t)r;
+            ae->threshold[s] = parsed[r].threshold;
+            ae->clear[s] = parsed[r].clear;
+            ae->avg_s[s] = parsed[r].avg_s;
+            ae->cooldown_s[s] = parsed[r].cooldown_s;
+            ae->for_n[s] = parsed[r].for_n;
+        }
+    }
+
+    if(!windows_ok)
+    {
+        alerts_delete(ae);
+        return NULL;
+    }
+    if((hook != NULL || fifo_path != NULL) && dispatch_thread)
+    {
+        enum{ALERTS_EVENT_CAPACITY = 64};
+        ae->events = queue_create_new(ALERTS_EVENT_CAPACITY, sizeof(AlertEvent));
+        if(ae->events == NULL || pthread_create(&ae->dispatch_th, NULL, alerts_dispatch_func, ae) != 0)
+        {
+            queue_delete(ae->events);
+            ae->events = NULL;
+            alerts_delete(ae);
+            return NULL;
+        }
+    }
+    return ae;
+}
+
+/**
+ * Delivers events still waiting for the hook or FIFO and frees the engine.
+ */
+void alerts_delete(AlertEngine* ae)
+{
+    if(ae == NULL)
+        return;
+    if(ae->events != NULL)
+    {
+        atomic_store(&ae->term_flag, true);
+        queue_close(ae->events);
+        pthread_join(ae->dispatch_th, NULL);
+        queue_delete(ae->events);
+    }
+    alerts_reap_hooks(ae, true);
+    if(ae->dropped != 0)
+        logger_write("ALERTS - some events were not delivered to the hook/fifo", LOG_WARNING);
+    if(ae->fifo_fd >= 0)
+        close(ae->fifo_fd);
+    for (size_t w = 0; w < ae->no_windows; w++)
+        alerts_window_destroy(&ae->windows[w]);
+    free(ae->values);   // start of the block
+    free(ae);
+}
+
+/**
+ * Sends the event to the logger and, without waiting, to the dispatcher thread - or without one to the FIFO and
+ * the hook.
+ */
+static void alerts_emit(AlertEngine* const ae, const uint32_t slot, const bool fired, const double value)
+{
+    char line[256];
+    char message[280];
+    alerts_format(ae, slot, fired, value, line, sizeof(line));
+    snprintf(message, sizeof(message), "ALERT %s", line);
+    logger_write(message, fired ? LOG_WARNING : LOG_INFO);
+    AlertEvent ev = {.slot = slot, .fired = fired, .value = value};
+    if(ae->events != NULL)
+    {
+        if(queue_enqueue(ae->events, &ev, 0) != QSUCCESS)
+            ae->dropped++;
+        return;
+    }
+    // No dispatcher - the FIFO does not block, the hook runs while the sampling goes on, later events wait for it
+    if(ae->fifo_path != NULL)
+        alerts_write_fifo(ae, line);
+    if(ae->hook == NULL)
+        return;
+    if(ae->no_pending == ALERTS_PENDING_HOOKS)
+    {
+        ae->dropped++;
+        return;
+    }
+    ae->pending[(ae->pending_head + ae->no_pending) % ALERTS_PENDING_HOOKS] = ev;
+    ae->no_pending++;
+    alerts_reap_hooks(ae, false);
+}
+
+/**
+ * Evaluates every rule against the new sample. Called once per analyzer tick.
+ * @param usage - analyzed sample
+ * @param steal_pr - steal time of total and every core, used by steal rules, may be NULL
+ * @param interval_s - time since the previous sample
+ * @return Number of events (fired or resolved alerts) generated by this sample.
+ */
+size_t alerts_evaluate(AlertEngine* const ae, const UsagePercentage* const usage, const double* const steal_pr,
+                       const double interval_s)
+{
+    if(ae == NULL || usage == NULL)
+        return 0;
+    if(ae->hook_pid != 0)
+        alerts_reap_hooks(ae, false);
+    double* const values = ae->values;
+    values[0] = usage_bp_to_pr(usage->total_bp);
+    for (size_t j = 0; j < ae->no_cpus; j++)
+        values[j + 1] = usage_bp_to_pr(usage->cores_bp[j]);
+    if(ae->uses_steal && steal_pr != NULL)
+        memcpy(&values[ae->no_cpus + 1], steal_pr, sizeof(double) * (ae->no_cpus + 1));
+    if(ae->uses_effective)
+    {
+        // Without the frequencies of the cores the effective usage is the usage
+        double* const effective = &values[2 * (ae->no_cpus + 1)];
+        effective[0] = usage_bp_to_pr(usage->effective_bp);
+        for (size_t j = 0; j < ae->no_cpus; j++)
+            effective[j + 1] = usage->effective_cores_bp != NULL ? usage_bp_to_pr(usage->effective_cores_bp[j]) :
+                               values[j + 1];
+    }
+    ae->now_s += interval_s;
+    for (size_t w = 0; w < ae->no_windows; w++)
+        alerts_window_push(&ae->windows[w], values, ae->value_idx, interval_s, ae->avg);
+
+    size_t no_events = 0;
+    for (size_t s = 0; s < ae->no_slots; s++)
+    {
+        // Mean of the window, plain value when avg_s is 0
+        const double v = ae->avg_s[s] > 0 ? ae->avg[s] : values[ae->value_idx[s]];
+        const uint32_t above = v > ae->threshold[s];
+        ae->streak[s] = (ae->streak[s] + 1) * above;
+        const uint8_t active = ae->active[s];
+        const bool fire = !active & (ae->streak[s] >= ae->for_n[s]) & (ae->now_s >= ae->ready_at[s]);
+        const bool resolve = active & (v < ae->clear[s]);
+        if(fire | resolve)
+        {
+            ae->active[s] = fire;
+            if(resolve)
+            {
+                ae->ready_at[s] = ae->now_s + ae->cooldown_s[s];
+                ae->no_active--;
+            }
+            else
+                ae->no_active++;
+            alerts_emit(ae, (uint32_t)s, fire, v);
+            no_events++;
+        }
+    }
+    return no_events;
+}
+
+/**
+ * @return Number of currently firing alerts.
+ */
+size_t alerts_active(const AlertEngine* const ae)
+{
+    return ae == NULL ? 0 : ae->no_active;
+}
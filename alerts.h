@@ -0,0 +1,34 @@
+
+#ifndef CPU_USAGE_TRACKER_ALERTS_H
+#define CPU_USAGE_TRACKER_ALERTS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "analyzer.h"
+
+/**
+ * Rule syntax: METRIC>THRESHOLD[,for=N][,avg=W][,clear=C][,cooldown=S]
+ *  METRIC  - total, cpu (every core), cpuN (core as printed, from 1), steal, steal_cpu, steal_cpuN,
+ *            eff_total, eff_cpu, eff_cpuN - usage scaled by the current frequency of the cores
+ *  for     - consecutive samples above the threshold before the alert fires (default 1)
+ *  avg     - value is the mean of the last W seconds, weighted by the interval of every sample (default 0 - raw
+ *            value)
+ *  clear   - alert resolves when value drops below C (default THRESHOLD - 5)
+ *  cooldown- seconds after resolving before the same alert can fire again (default 0)
+ * e.g. "cpu>95,for=5", "total>80,avg=60", "steal>10,clear=2,cooldown=30"
+ */
+#define ALERTS_MAX_RULES 32
+#define ALERTS_DEFAULT_HYSTERESIS 5.0
+#define ALERTS_PENDING_HOOKS 8 // events waiting for the running hook without a dispatcher thread, beyond are dropped
+
+typedef struct AlertEngine AlertEngine;   // Forward declaration
+
+AlertEngine* alerts_create(const char* const* rules, size_t no_rules, size_t no_cpus, double min_interval_s,
+                           const char* hook, const char* fifo_path, bool dispatch_thread);
+void alerts_delete(AlertEngine* ae);
+
+size_t alerts_evaluate(AlertEngine* ae, const UsagePercentage* usage, const double* steal_pr, double interval_s);
+size_t alerts_active(const AlertEngine* ae);
+
+#endif //CPU_USAGE_TRACKER_ALERTS_H
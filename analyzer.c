@@ -1,22 +1,38 @@
+#include <math.h>
+#include <string.h>
+
 #include "analyzer.h"
 
-double analyzer_analyze(uint64_t* restrict prev_total, uint64_t* restrict prev_idle, const Stats data)
+enum{ANALYZER_BALANCE_BUCKETS = 101};    // 1% wide, 100% has its own bucket
+#define ANALYZER_MAX_TICK_JIFFIES 0x7fffffffu   // more in one tick is a counter that went backwards
+
+/**
+ * Calculates usage since previous sample in integer arithmetic from the jiffy deltas. Counters are the low 32 bits
+ * of the kernel's - deltas are taken modulo 2^32, so they stay right when a counter wraps around.
+ * @param prev_total - sum of all counters from previous sample, updated here
+ * @param prev_idle - idle counters from previous sample, updated here
+ * @return Usage in basis points, 0 - USAGE_FULL_BP. 0 if no time passed or a counter went backwards (e.g. cpu
+ *         hotplug) - the next sample measures from the new values.
+ */
+uint16_t analyzer_analyze(uint64_t* restrict prev_total, uint64_t* restrict prev_idle, const Stats data)
 {
-    double percentage;
-    uint64_t idle, non_idle, totald, idled;
+    uint64_t idle, non_idle;
+    uint32_t totald, idled, busyd;
 
-    idle = data.idle + data.iowait;
-    non_idle = data.user + data.nice + data.system + data.irq +
+    idle = (uint64_t)data.idle + data.iowait;
+    non_idle = (uint64_t)data.user + data.nice + data.system + data.irq +
                data.sortirq + data.steal;
-    totald = idle + non_idle - *prev_total;
-    idled = idle - *prev_idle;
+    totald = (uint32_t)(idle + non_idle - *prev_total);
+    idled = (uint32_t)(idle - *prev_idle);
 
-    percentage = totald != 0 ? ((double)(totald - idled) * 100 / (double) totald) : 0;
+    busyd = idled < totald ? totald - idled : 0;     // idle moving faster than total is a counter glitch
 
     *prev_total = idle + non_idle;
     *prev_idle = idle;
 
-    return percentage;
+    if(totald == 0 || totald > ANALYZER_MAX_TICK_JIFFIES)
+        return 0;
+    return (uint16_t)(((uint64_t)busyd * USAGE_FULL_BP + totald / 2) / totald);
 }
 
 void analyzer_update_prev(uint64_t* restrict prev_total, uint64_t* restrict prev_idle, const CPURawStats data, const size_t no_cpus)
@@ -38,3 +54,213 @@ void analyzer_update_prev(uint64_t* restrict prev_total, uint64_t* restrict prev
         prev_idle[j+1] = idle;
     }
 }
+
+/**
+ * Scales usage by the current frequency of the core - share of its full capacity that was used.
+ * @param busy_bp - usage in basis points
+ * @param cur_khz - current frequency of the core
+ * @param max_khz - maximal frequency of the core
+ * @return Effective usage in basis points, busy_bp if the frequency is not known.
+ */
+uint16_t analyzer_effective(const uint16_t busy_bp, const uint32_t cur_khz, const uint32_t max_khz)
+{
+    if(cur_khz == 0 || max_khz == 0)
+        return busy_bp;
+    const uint64_t effective = (uint64_t)busy_bp * cur_khz / max_khz;
+    return effective > USAGE_FULL_BP ? USAGE_FULL_BP : (uint16_t)effective;
+}
+
+/**
+ * Scales usage of every core by its current frequency.
+ * @param cur_khz - current frequency of every core, 0 if not known
+ * @param max_khz - maximal frequency of every core, 0 if not known
+ * @param effective_bp - effective usage of every core in basis points, written here
+ * @return Effective usage of the whole machine - mean of the cores, 0 without cores.
+ */
+uint16_t analyzer_effective_cores(const uint16_t* restrict const cores_bp, const uint32_t* restrict const cur_khz,
+                                  const uint32_t* restrict const max_khz, const size_t no_cpus,
+                                  uint16_t* restrict const effective_bp)
+{
+    if(cores_bp == NULL || cur_khz == NULL || max_khz == NULL || effective_bp == NULL || no_cpus == 0)
+        return 0;
+    uint64_t sum = 0;
+    for (size_t j = 0; j < no_cpus; j++)
+    {
+        effective_bp[j] = analyzer_effective(cores_bp[j], cur_khz[j], max_khz[j]);
+        sum += effective_bp[j];
+    }
+    return (uint16_t)((sum + no_cpus / 2) / no_cpus);
+}
+
+/**
+ * Calculates how long tasks waited for a cpu since previous sample.
+ * @param prev_run_delay - run-queue wait of every core from previous sample, updated here
+ * @param interval_s - time since previous sample in seconds
+ * @return Average wait per cpu in ms per second.
+ */
+double analyzer_runq_wait(uint64_t* restrict prev_run_delay, const CPURawStats data, const size_t no_cpus,
+                          const double interval_s)
+{
+    uint64_t waited = 0;
+    for (size_t j = 0; j < no_cpus; j++)
+    {
+        if(prev_run_delay[j] != 0 && data.cpus[j].run_delay >= prev_run_delay[j])
+            waited += data.cpus[j].run_delay - prev_run_delay[j];
+        prev_run_delay[j] = data.cpus[j].run_delay;
+    }
+    if(no_cpus == 0 || interval_s <= 0)
+        return 0;
+    return (double)waited / 1e6 / interval_s / (double)no_cpus;
+}
+
+/**
+ * Calculates share of time stolen by the hypervisor since previous sample. Deltas are taken modulo 2^32 like
+ * in analyzer_analyze.
+ * @param prev_sum - sum of all counters from previous sample, updated here
+ * @param prev_steal - steal counter from previous sample, updated here
+ * @return Steal time in %, 0 - 100. 0 if no time passed or a counter went backwards.
+ */
+double analyzer_steal(uint64_t* restrict prev_sum, uint64_t* restrict prev_steal, const Stats data)
+{
+    const uint64_t sum = (uint64_t)data.user + data.nice + data.system + data.idle + data.iowait + data.irq +
+                         data.sortirq + data.steal;
+    const uint32_t d_sum = (uint32_t)(sum - *prev_sum);
+    const uint32_t d_steal = (uint32_t)(data.steal - *prev_steal);
+    *prev_sum = sum;
+    *prev_steal = data.steal;
+    if(d_sum == 0 || d_sum > ANALYZER_MAX_TICK_JIFFIES || d_steal > ANALYZER_MAX_TICK_JIFFIES)
+        return 0;
+    return d_steal < d_sum ? (double)d_steal * 100 / (double)d_sum : 100;
+}
+
+/**
+ * Gini coefficient of the cores counted in a histogram of 1% buckets.
+ * @param no_cores - cores counted in hist
+ * @return 0 - even load, USAGE_FULL_BP - one core of many does everything.
+ */
+static uint16_t analyzer_gini(const uint32_t* const hist, const uint32_t no_cores)
+{
+    // Sorted values x(1..n): G = sum((2i - n - 1) * x(i)) / (n * sum(x)), a bucket holds ranks rank+1 .. rank+count
+    const double n = (double)no_cores;
+    double weighted = 0, total = 0;
+    uint64_t rank = 0;
+    for (size_t b = 0; b < ANALYZER_BALANCE_BUCKETS; b++)
+    {
+        const double value = (double)b * 100 * hist[b];
+        weighted += value * ((double)(2 * rank + hist[b]) - n);
+        total += value;
+        rank += hist[b];
+    }
+    const double gini = total > 0 ? weighted / (n * total) : 0;
+    return gini > 0 ? (uint16_t)(gini * USAGE_FULL_BP + 0.5) : 0;
+}
+
+/**
+ * Load is uneven - a high Gini coefficient and a wide gap between the busiest and the idlest core.
+ */
+static bool analyzer_is_imbalance(const uint32_t no_cores, const uint16_t gini_bp, const uint16_t min_bp,
+                                  const uint16_t max_bp)
+{
+    return no_cores > 1 && gini_bp >= ANALYZER_IMBALANCE_GINI_BP && max_bp - min_bp >= ANALYZER_IMBALANCE_SPREAD_BP;
+}
+
+/**
+ * Measures how the load is spread across cores - min/max, standard deviation, Gini coefficient, saturated cores
+ * and saturation streaks - in one pass over the cores, which also sums up every socket. The pass is branch-free
+ * except for the histograms the Gini coefficients are computed from (1% resolution), so the cost stays
+ * O(cores + 101 * sockets).
+ * @param socket_of - socket of every core, 0 .. no_sockets - 1, NULL if the topology is not known
+ * @param no_sockets - sockets in socket_of, the ones above ANALYZER_MAX_SOCKETS count to the last one
+ * @param interval_s - time since previous sample
+ * @param streaks_ms - time every core has been saturated in a row, updated here
+ * @param out - statistics and the hot core / imbalance flags
+ */
+void analyzer_balance(const uint16_t* restrict const cores_bp, const uint16_t* restrict const socket_of,
+                      const size_t no_sockets, const size_t no_cpus, const double interval_s,
+                      uint32_t* restrict const streaks_ms, Balance* restrict const out)
+{
+    *out = (Balance){0};
+    if(cores_bp == NULL || streaks_ms == NULL || no_cpus == 0)
+        return;
+
+    const uint32_t interval_ms = interval_s > 0 ? (uint32_t)(interval_s * 1000 + 0.5) : 0;
+    const size_t no_groups = socket_of == NULL ? 0 :
+                             (no_sockets > ANALYZER_MAX_SOCKETS ? ANALYZER_MAX_SOCKETS : no_sockets);
+    uint32_t hist[ANALYZER_BALANCE_BUCKETS] = {0};
+    uint32_t socket_hist[ANALYZER_MAX_SOCKETS][ANALYZER_BALANCE_BUCKETS];
+    uint64_t socket_sum[ANALYZER_MAX_SOCKETS] = {0};
+    uint32_t socket_cores[ANALYZER_MAX_SOCKETS] = {0};
+    memset(socket_hist, 0, sizeof(socket_hist[0]) * no_groups);
+    for (size_t s = 0; s < no_groups; s++)
+        out->sockets[s].min_bp = USAGE_FULL_BP;
+    uint64_t sum = 0, sum_sq = 0;
+    uint16_t min = USAGE_FULL_BP, max = 0;
+    uint32_t saturated = 0, longest = 0;
+    for (size_t j = 0; j < no_cpus; j++)
+    {
+        const uint16_t bp = cores_bp[j] > USAGE_FULL_BP ? USAGE_FULL_BP : cores_bp[j];
+        const uint32_t is_saturated = bp >= ANALYZER_SATURATED_BP;
+        sum += bp;
+        sum_sq += (uint64_t)bp * bp;
+        min = bp < min ? bp : min;
+        max = bp > max ? bp : max;
+        saturated += is_saturated;
+        // Saturated for 49 days stays saturated instead of wrapping
+        const uint32_t streak = streaks_ms[j] > UINT32_MAX - interval_ms ? UINT32_MAX : streaks_ms[j] + interval_ms;
+        streaks_ms[j] = streak * is_saturated;
+        longest = streaks_ms[j] > longest ? streaks_ms[j] : longest;
+        hist[bp / 100]++;
+        if(no_groups != 0)
+        {
+            const size_t s = socket_of[j] < no_groups ? socket_of[j] : no_groups - 1;
+            SocketBalance* const sb = &out->sockets[s];
+            socket_sum[s] += bp;
+            socket_cores[s]++;
+            sb->min_bp = bp < sb->min_bp ? bp : sb->min_bp;
+            sb->max_bp = bp > sb->max_bp ? bp : sb->max_bp;
+            socket_hist[s][bp / 100]++;
+        }
+    }
+
+    const double n = (double)no_cpus;
+    const double mean = (double)sum / n;
+    const double var = (double)sum_sq / n - mean * mean;
+    out->min_bp = min;
+    out->max_bp = max;
+    out->stddev_bp = var > 0 ? (uint16_t)(sqrt(var) + 0.5) : 0;
+    out->gini_bp = analyzer_gini(hist, (uint32_t)no_cpus);
+    out->no_saturated = saturated;
+    if(longest != 0)
+    {
+        size_t j = 0;
+        while(streaks_ms[j] != longest)
+            j++;
+        out->hot_cpu = (uint32_t)j;
+        out->hot_streak_ms = longest;
+        // The rest of the machine is mostly idle - the core is a bottleneck, not part of a busy machine
+        const double rest_mean = no_cpus > 1 ? ((double)sum - cores_bp[j]) / (n - 1) : USAGE_FULL_BP;
+        out->hot = longest >= ANALYZER_HOT_STREAK_MS && rest_mean < ANALYZER_HOT_REST_BP;
+    }
+    out->imbalance = analyzer_is_imbalance((uint32_t)no_cpus, out->gini_bp, min, max);
+
+    // Sockets without a core (e.g. offline) do not count to the spread between sockets
+    uint16_t socket_min = USAGE_FULL_BP, socket_max = 0;
+    size_t no_populated = 0;
+    for (size_t s = 0; s < no_groups; s++)
+    {
+        SocketBalance* const sb = &out->sockets[s];
+        if(socket_cores[s] == 0)
+        {
+            sb->min_bp = 0;
+            continue;
+        }
+        sb->mean_bp = (uint16_t)((socket_sum[s] + socket_cores[s] / 2) / socket_cores[s]);
+        sb->gini_bp = analyzer_gini(socket_hist[s], socket_cores[s]);
+        sb->imbalance = analyzer_is_imbalance(socket_cores[s], sb->gini_bp, sb->min_bp, sb->max_bp);
+        socket_min = sb->mean_bp < socket_min ? sb->mean_bp : socket_min;
+        socket_max = sb->mean_bp > socket_max ? sb->mean_bp : socket_max;
+        no_populated++;
+    }
+    out->no_sockets = (uint32_t)no_groups;
+    out->socket_imbalance = no_populated > 1 && socket_max - socket_min >= ANALYZER_SOCKET_SPREAD_BP;
+}
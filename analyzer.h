@@ -3,15 +3,72 @@
 #define CPU_USAGE_TRACKER_ANALYZER_H
 
 #include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
 #include "CPURawStats.h"
 
-// CPU usage in % prepared by analyzer for printer
+#define USAGE_FULL_BP 10000     // 100 % in basis points
+#define ANALYZER_SATURATED_BP 9500          // core at or above 95 % is saturated
+#define ANALYZER_HOT_STREAK_MS 5000         // time a core stays saturated before it is a hot core ...
+#define ANALYZER_HOT_REST_BP 5000           // ... while the other cores average below 50 %
+#define ANALYZER_IMBALANCE_GINI_BP 4000     // Gini coefficient 0.4 ...
+#define ANALYZER_IMBALANCE_SPREAD_BP 5000   // ... and 50 % between the busiest and the idlest core
+#define ANALYZER_SOCKET_SPREAD_BP 3000      // 30 % between the means of the busiest and the idlest socket
+#define ANALYZER_MAX_SOCKETS 8              // sockets reported apart - the cores of the rest count to the last one
+
+// Spread of the load across the cores of one socket
+typedef struct SocketBalance{
+    uint16_t mean_bp;
+    uint16_t min_bp;
+    uint16_t max_bp;
+    uint16_t gini_bp;
+    bool imbalance;         // load unevenly spread across the cores of the socket
+} SocketBalance;
+
+// Spread of the load across cores in one sample
+typedef struct Balance{
+    uint16_t min_bp;
+    uint16_t max_bp;
+    uint16_t stddev_bp;     // population standard deviation of the cores
+    uint16_t gini_bp;       // 0 - even load, 10000 - one core of many does everything
+    uint32_t no_saturated;  // cores at or above ANALYZER_SATURATED_BP
+    uint32_t hot_cpu;       // core saturated the longest, 0-based
+    uint32_t hot_streak_ms; // time hot_cpu has been saturated
+    bool hot;               // one core pinned while the rest are mostly idle - single-thread bottleneck
+    bool imbalance;         // load unevenly spread across cores
+    bool socket_imbalance;  // load unevenly spread across sockets
+    uint32_t no_sockets;    // 0 if the topology is not known
+    SocketBalance sockets[ANALYZER_MAX_SOCKETS];
+} Balance;
+
+// CPU usage prepared by analyzer in fixed-point basis points (0.01 %) - converted to % only for display and export
 typedef struct UsagePercentage{
-    double total_pr;
-    double* cores_pr;
+    uint16_t total_bp;
+    uint16_t* cores_bp;     // inline in the analyzer ring slot, caller's buffer in libcut
+    SysLoad sys;            // load average and pressure at the time of the sample
+    double runq_wait_ms;    // average run-queue wait per cpu in ms per second
+    Balance balance;        // filled by the analyzer, zero in libcut samples
+    uint16_t effective_bp;  // share of the full capacity of the cores used at their current frequency - filled by
+                            // the analyzer, total_bp if no frequency is known, zero in libcut samples
+    uint16_t* effective_cores_bp;   // the same for every core - NULL in the analyzer ring and in libcut samples
 } UsagePercentage;
 
-double analyzer_analyze(uint64_t* restrict prev_total, uint64_t* restrict prev_idle, Stats data);
+/**
+ * Converts usage in basis points to % at the display and export edge.
+ */
+static inline double usage_bp_to_pr(const uint16_t bp)
+{
+    return (double)bp / 100.0;
+}
+
+uint16_t analyzer_analyze(uint64_t* restrict prev_total, uint64_t* restrict prev_idle, Stats data);
 void analyzer_update_prev(uint64_t* restrict prev_total, uint64_t* restrict prev_idle, CPURawStats data, size_t no_cpus);
+uint16_t analyzer_effective(uint16_t busy_bp, uint32_t cur_khz, uint32_t max_khz);
+uint16_t analyzer_effective_cores(const uint16_t* restrict cores_bp, const uint32_t* restrict cur_khz,
+                                  const uint32_t* restrict max_khz, size_t no_cpus, uint16_t* restrict effective_bp);
+double analyzer_runq_wait(uint64_t* restrict prev_run_delay, CPURawStats data, size_t no_cpus, double interval_s);
+void analyzer_balance(const uint16_t* restrict cores_bp, const uint16_t* restrict socket_of, size_t no_sockets,
+                      size_t no_cpus, double interval_s, uint32_t* restrict streaks_ms, Balance* restrict out);
+double analyzer_steal(uint64_t* restrict prev_sum, uint64_t* restrict prev_steal, Stats data);
 
 #endif //CPU_USAGE_TRACKER_ANALYZER_H
@@ -0,0 +1,151 @@
+#define _GNU_SOURCE  // RUSAGE_THREAD
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+
+#include "../agent.h"
+#include "../fleet.h"
+
+/*
+ * Fleet ingest benchmark - many synthetic agents in one process stream random-walk usage to a collector, either
+ * the one started here on a unix socket or a running `CUT --collect ADDR`. Reports received frames per second,
+ * bytes per frame against a raw uint16 frame and cpu time of the collector loop.
+ *
+ *     ./bench_fleet [agents] [cpus per agent] [seconds] [collector address]
+ */
+
+enum{BENCH_DEFAULT_AGENTS = 500, BENCH_DEFAULT_CPUS = 64, BENCH_DEFAULT_SECONDS = 5, BENCH_TICK_MS = 100};
+
+typedef struct BenchCollector{
+    Fleet* fleet;
+    int stop_fd;
+    double cpu_s;
+} BenchCollector;
+
+static uint64_t bench_now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+static void* bench_collector(void* args)
+{
+    BenchCollector* const bc = args;
+    while(fleet_poll(bc->fleet, -1) == 0)
+        ;
+    struct rusage usage;
+    getrusage(RUSAGE_THREAD, &usage);
+    bc->cpu_s = (double)usage.ru_utime.tv_sec + (double)usage.ru_utime.tv_usec / 1e6 +
+                (double)usage.ru_stime.tv_sec + (double)usage.ru_stime.tv_usec / 1e6;
+    return NULL;
+}
+
+int main(int argc, char** argv)
+{
+    const size_t no_agents = argc > 1 ? strtoul(argv[1], NULL, 10) : BENCH_DEFAULT_AGENTS;
+    const size_t no_cpus = argc > 2 ? strtoul(argv[2], NULL, 10) : BENCH_DEFAULT_CPUS;
+    const unsigned seconds = argc > 3 ? (unsigned)strtoul(argv[3], NULL, 10) : BENCH_DEFAULT_SECONDS;
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/bench_fleet_%d.sock", (int)getpid());
+    const char* const addr = argc > 4 ? argv[4] : path;
+    if(no_agents == 0 || no_cpus == 0 || no_cpus > WIRE_MAX_CPUS)
+    {
+        fprintf(stderr, "usage: %s [agents] [cpus per agent] [seconds] [collector address]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    BenchCollector bc = {.stop_fd = -1};
+    pthread_t collector_th;
+    if(argc <= 4)
+    {
+        bc.fleet = fleet_create(addr);
+        bc.stop_fd = eventfd(0, EFD_CLOEXEC);
+        if(bc.fleet == NULL || !fleet_watch(bc.fleet, bc.stop_fd) ||
+           pthread_create(&collector_th, NULL, bench_collector, &bc) != 0)
+        {
+            fprintf(stderr, "collector setup error\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    Agent** const agents = calloc(no_agents, sizeof(Agent*));
+    uint16_t* const cores = calloc(no_agents * no_cpus, sizeof(uint16_t));
+    if(agents == NULL || cores == NULL)
+        return EXIT_FAILURE;
+    for (size_t i = 0; i < no_agents; i++)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "bench-%zu", i);
+        agents[i] = agent_create(addr, (uint32_t)(i + 1), name, no_cpus, BENCH_TICK_MS);
+        if(agents[i] == NULL)
+            return EXIT_FAILURE;
+    }
+
+    // Every tick a quarter of the cpus of every agent move a little - typical of a mostly steady fleet
+    srand(1);
+    size_t sent = 0;
+    const uint64_t begin = bench_now_ns();
+    const size_t no_ticks = (size_t)seconds * 1000u / BENCH_TICK_MS;
+    for (size_t t = 0; t < no_ticks; t++)
+    {
+        const uint64_t tick_ns = begin + (uint64_t)t * BENCH_TICK_MS * 1000000u;
+        for (size_t i = 0; i < no_agents; i++)
+        {
+            uint16_t* const row = &cores[i * no_cpus];
+            uint64_t sum = 0;
+            for (size_t j = 0; j < no_cpus; j++)
+            {
+                if(rand() % 4 == 0)
+                {
+                    const int next = row[j] + rand() % 401 - 200;
+                    row[j] = (uint16_t)(next < 0 ? 0 : (next > 10000 ? 10000 : next));
+                }
+                sum += row[j];
+            }
+            const UsagePercentage usage = {.total_bp = (uint16_t)(sum / no_cpus), .cores_bp = row};
+            sent += agent_publish(agents[i], (uint64_t)time(NULL) * 1000u + t * BENCH_TICK_MS, &usage);
+        }
+        const uint64_t now = bench_now_ns();
+        const uint64_t next = tick_ns + BENCH_TICK_MS * 1000000u;
+        if(next > now)
+        {
+            const struct timespec ts = {.tv_sec = 0, .tv_nsec = (long)(next - now)};
+            nanosleep(&ts, NULL);
+        }
+    }
+    const double elapsed_s = (double)(bench_now_ns() - begin) / 1e9;
+    printf("%zu agents x %zu cpus, %zu frames sent in %.2f s (%.0f frames/s)\n", no_agents, no_cpus, sent, elapsed_s,
+           (double)sent / elapsed_s);
+
+    if(bc.fleet != NULL)
+    {
+        usleep(200000);     // let the collector drain the sockets
+        const uint64_t one = 1;
+        if(write(bc.stop_fd, &one, sizeof(one)) != sizeof(one))
+            return EXIT_FAILURE;
+        pthread_join(collector_th, NULL);
+        FleetSummary sum;
+        fleet_summarize(bc.fleet, &sum);
+        const double raw = 3.0 + 1 + 4 + 8 + 2 + 2.0 * (double)(no_cpus + 1);
+        printf("collector: %" PRIu64 " frames, %.1f bytes/frame (raw %.0f, %.1fx smaller), %zu hosts\n",
+               sum.frames, (double)sum.bytes / (double)(sum.frames ? sum.frames : 1), raw,
+               raw * (double)sum.frames / (double)(sum.bytes ? sum.bytes : 1), sum.no_hosts);
+        printf("collector: %.3f s cpu, %.2f%% of one cpu, %.2f us per frame\n", bc.cpu_s, bc.cpu_s / elapsed_s * 100,
+               bc.cpu_s * 1e6 / (double)(sum.frames ? sum.frames : 1));
+        fleet_delete(bc.fleet);
+        close(bc.stop_fd);
+    }
+    for (size_t i = 0; i < no_agents; i++)
+        agent_delete(agents[i]);
+    free(agents);
+    free(cores);
+    return EXIT_SUCCESS;
+}
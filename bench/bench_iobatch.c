@@ -0,0 +1,169 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "../iobatch.h"
+
+/*
+ * Batched read benchmark - the files a tick of the reader rereads (/proc/interrupts, /proc/softirqs, cpufreq and
+ * cpuidle files of every cpu) plus /proc/PID/stat of running processes, every one opened [copies] times to stand
+ * in for a bigger machine. Each tick rereads all of them, once with pread per file and once with io_uring.
+ * Reports syscalls, wall time and process cpu time (io_uring workers included) per tick.
+ *
+ *     ./bench_iobatch [copies] [ticks] [max processes]
+ */
+
+enum{BENCH_DEFAULT_COPIES = 1, BENCH_DEFAULT_TICKS = 200, BENCH_DEFAULT_PROCESSES = 256};
+enum{BENCH_SLOT_SIZE = 4096, BENCH_BIG_SLOT_SIZE = 256 * 1024};
+
+typedef struct BenchFiles{
+    int* fds;
+    size_t* sizes;
+    size_t no_files;
+    size_t cap;
+} BenchFiles;
+
+static uint64_t bench_now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+static double bench_cpu_s(void)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (double)usage.ru_utime.tv_sec + (double)usage.ru_utime.tv_usec / 1e6 +
+           (double)usage.ru_stime.tv_sec + (double)usage.ru_stime.tv_usec / 1e6;
+}
+
+static void bench_open(BenchFiles* const files, const char* const path, const size_t size, const size_t copies)
+{
+    for (size_t i = 0; i < copies; i++)
+    {
+        const int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if(fd < 0)
+            return;
+        if(files->no_files == files->cap)
+        {
+            files->cap = files->cap == 0 ? 256 : files->cap * 2;
+            files->fds = realloc(files->fds, sizeof(int) * files->cap);
+            files->sizes = realloc(files->sizes, sizeof(size_t) * files->cap);
+            if(files->fds == NULL || files->sizes == NULL)
+                exit(EXIT_FAILURE);
+        }
+        files->fds[files->no_files] = fd;
+        files->sizes[files->no_files++] = size;
+    }
+}
+
+static void bench_open_all(BenchFiles* const files, const size_t copies, const size_t max_processes)
+{
+    char path[300];
+    bench_open(files, "/proc/interrupts", BENCH_BIG_SLOT_SIZE, copies);
+    bench_open(files, "/proc/softirqs", BENCH_BIG_SLOT_SIZE, copies);
+    for (size_t cpu = 0; ; cpu++)
+    {
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%zu", cpu);
+        if(access(path, F_OK) != 0)
+            break;
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%zu/cpufreq/scaling_cur_freq", cpu);
+        bench_open(files, path, 32, copies);
+        for (size_t state = 0; state < 10; state++)
+        {
+            snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%zu/cpuidle/state%zu/time", cpu, state);
+            bench_open(files, path, 32, copies);
+        }
+    }
+    DIR* const proc = opendir("/proc");
+    size_t no_processes = 0;
+    for (struct dirent* e; proc != NULL && no_processes < max_processes && (e = readdir(proc)) != NULL; )
+    {
+        if(e->d_name[0] < '1' || e->d_name[0] > '9')
+            continue;
+        snprintf(path, sizeof(path), "/proc/%s/stat", e->d_name);
+        bench_open(files, path, BENCH_SLOT_SIZE, copies);
+        no_processes++;
+    }
+    if(proc != NULL)
+        closedir(proc);
+}
+
+/**
+ * Rereads every file ticks times through the engine and prints cost per tick.
+ */
+static void bench_run(const char* const label, const BenchFiles* const files, const size_t ticks, const bool uring)
+{
+    IoBatch* const b = iobatch_create(files->no_files, uring);
+    if(b == NULL)
+        exit(EXIT_FAILURE);
+    int* const slots = malloc(sizeof(int) * files->no_files);
+    for (size_t i = 0; i < files->no_files; i++)
+        slots[i] = iobatch_add(b, files->fds[i], files->sizes[i]);
+    // Warm-up tick registers files and buffers
+    for (size_t i = 0; i < files->no_files; i++)
+        iobatch_queue(b, slots[i]);
+    iobatch_submit(b);
+
+    IoBatchStats before, after;
+    iobatch_stats(b, &before);
+    const double cpu_begin = bench_cpu_s();
+    const uint64_t begin = bench_now_ns();
+    size_t bytes = 0;
+    for (size_t t = 0; t < ticks; t++)
+    {
+        for (size_t i = 0; i < files->no_files; i++)
+            iobatch_queue(b, slots[i]);
+        iobatch_submit(b);
+        for (size_t i = 0; i < files->no_files; i++)
+        {
+            const long n = iobatch_result(b, slots[i], NULL);
+            bytes += n > 0 ? (size_t)n : 0;
+        }
+    }
+    const double wall_us = (double)(bench_now_ns() - begin) / 1e3 / (double)ticks;
+    const double cpu_us = (bench_cpu_s() - cpu_begin) * 1e6 / (double)ticks;
+    iobatch_stats(b, &after);
+    printf("%-8s %s: %8.1f syscalls/tick %10.1f us wall/tick %10.1f us cpu/tick %8.1f KiB/tick\n", label,
+           iobatch_uses_uring(b) ? "io_uring" : "pread   ", (double)(after.syscalls - before.syscalls) / (double)ticks,
+           wall_us, cpu_us, (double)bytes / 1024.0 / (double)ticks);
+    free(slots);
+    iobatch_delete(b);
+}
+
+int main(int argc, char** argv)
+{
+    const size_t copies = argc > 1 ? strtoul(argv[1], NULL, 10) : BENCH_DEFAULT_COPIES;
+    const size_t ticks = argc > 2 ? strtoul(argv[2], NULL, 10) : BENCH_DEFAULT_TICKS;
+    const size_t max_processes = argc > 3 ? strtoul(argv[3], NULL, 10) : BENCH_DEFAULT_PROCESSES;
+    if(copies == 0 || ticks == 0)
+    {
+        fprintf(stderr, "usage: %s [copies] [ticks] [max processes]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    struct rlimit lim;
+    if(getrlimit(RLIMIT_NOFILE, &lim) == 0)
+    {
+        lim.rlim_cur = lim.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &lim);
+    }
+
+    BenchFiles files = {0};
+    bench_open_all(&files, copies, max_processes);
+    printf("%zu files per tick, %zu ticks\n", files.no_files, ticks);
+    bench_run("fallback", &files, ticks, false);
+    bench_run("batched", &files, ticks, true);
+
+    for (size_t i = 0; i < files.no_files; i++)
+        close(files.fds[i]);
+    free(files.fds);
+    free(files.sizes);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "../queue.h"
+
+/*
+ * Contention benchmark of the logger buffer - 1 to 16 writers and one reader, the same element size and capacity
+ * as the logger. Compares the mutex queue with the lock-free one: throughput and latency of every enqueue call.
+ *
+ *     ./bench_queue [lines per writer]
+ */
+
+enum{BENCH_CAPACITY = 128, BENCH_LINE_SIZE = 260, BENCH_MAX_WRITERS = 16, BENCH_DEFAULT_LINES = 50000};
+
+typedef struct BenchLine{
+    uint8_t data[BENCH_LINE_SIZE];
+} BenchLine;
+
+typedef struct BenchWriter{
+    Queue* q;
+    size_t no_lines;
+    uint32_t* latency_ns;   // [no_lines]
+} BenchWriter;
+
+static uint64_t bench_now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+static void* bench_writer(void* args)
+{
+    BenchWriter* const w = args;
+    BenchLine line;
+    memset(&line, 'x', sizeof(line));
+    for (size_t i = 0; i < w->no_lines; i++)
+    {
+        const uint64_t begin = bench_now_ns();
+        if(queue_enqueue(w->q, &line, 2) != QSUCCESS)
+        {
+            fprintf(stderr, "enqueue timeout\n");
+            exit(EXIT_FAILURE);
+        }
+        const uint64_t ns = bench_now_ns() - begin;
+        w->latency_ns[i] = ns > UINT32_MAX ? UINT32_MAX : (uint32_t)ns;
+    }
+    return NULL;
+}
+
+static void* bench_reader(void* args)
+{
+    BenchWriter* const r = args;    // no_lines is the number of all lines
+    BenchLine line;
+    for (size_t i = 0; i < r->no_lines; i++)
+    {
+        if(queue_dequeue(r->q, &line, 2) != QSUCCESS)
+        {
+            fprintf(stderr, "dequeue timeout\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    return NULL;
+}
+
+static int bench_compare(const void* a, const void* b)
+{
+    const uint32_t x = *(const uint32_t*)a;
+    const uint32_t y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+static double bench_percentile_us(const uint32_t* sorted, const size_t n, const double p)
+{
+    const size_t i = (size_t)(p / 100 * (double)(n - 1));
+    return sorted[i] / 1000.0;
+}
+
+static void bench_run(const QueueKind kind, const size_t no_writers, const size_t no_lines)
+{
+    Queue* const q = queue_create(kind, BENCH_CAPACITY, sizeof(BenchLine));
+    uint32_t* const latency_ns = malloc(sizeof(uint32_t) * no_writers * no_lines);
+    if(q == NULL || latency_ns == NULL)
+    {
+        fprintf(stderr, "allocation error\n");
+        exit(EXIT_FAILURE);
+    }
+    BenchWriter writers[BENCH_MAX_WRITERS];
+    pthread_t writer_th[BENCH_MAX_WRITERS];
+    BenchWriter reader = {.q = q, .no_lines = no_writers * no_lines};
+    pthread_t reader_th;
+
+    const uint64_t begin = bench_now_ns();
+    pthread_create(&reader_th, NULL, bench_reader, &reader);
+    for (size_t i = 0; i < no_writers; i++)
+    {
+        writers[i] = (BenchWriter){.q = q, .no_lines = no_lines, .latency_ns = latency_ns + i * no_lines};
+        pthread_create(&writer_th[i], NULL, bench_writer, &writers[i]);
+    }
+    for (size_t i = 0; i < no_writers; i++)
+        pthread_join(writer_th[i], NULL);
+    pthread_join(reader_th, NULL);
+    const double elapsed_s = (double)(bench_now_ns() - begin) / 1e9;
+
+    const size_t n = no_writers * no_lines;
+    qsort(latency_ns, n, sizeof(uint32_t), bench_compare);
+    printf("%-9s %7zu %12.2f %10.2f %10.2f %10.2f %10.2f\n", kind == QUEUE_LOCKFREE ? "lockfree" : "mutex",
+           no_writers, (double)n / elapsed_s / 1e6, bench_percentile_us(latency_ns, n, 50),
+           bench_percentile_us(latency_ns, n, 99), bench_percentile_us(latency_ns, n, 99.9),
+           latency_ns[n - 1] / 1000.0);
+    free(latency_ns);
+    queue_delete(q);
+}
+
+int main(int argc, char** argv)
+{
+    const size_t no_lines = argc > 1 ? strtoul(argv[1], NULL, 10) : BENCH_DEFAULT_LINES;
+    if(no_lines == 0)
+    {
+        fprintf(stderr, "Usage: %s [lines per writer]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    printf("%-9s %7s %12s %10s %10s %10s %10s\n", "queue", "writers", "Mlines/s", "p50 us", "p99 us", "p99.9 us",
+           "max us");
+    for (size_t no_writers = 1; no_writers <= BENCH_MAX_WRITERS; no_writers *= 2)
+    {
+        bench_run(QUEUE_MUTEX, no_writers, no_lines);
+        bench_run(QUEUE_LOCKFREE, no_writers, no_lines);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,319 @@
+#include <stdlib.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/time.h>
+
+#include "broadcast.h"
+
+#define BROADCAST_NONE UINT64_MAX
+
+/**
+ *  BROADCAST RING IS DESIGNED FOR ONE PRODUCER AND MANY CONSUMERS READING THE SAME ELEMENTS (DISRUPTOR STYLE).
+ *  THE PRODUCER WRITES AN ELEMENT ONCE INTO A PREALLOCATED SLOT, EVERY CONSUMER READS IT IN PLACE AND
+ *  ONLY MOVES ITS OWN CURSOR - NOTHING IS COPIED OR REMOVED PER CONSUMER.
+ *  SEQUENCES ARE ATOMICS, MUTEX AND CONDITION VARIABLES ARE USED ONLY WHEN SOMEBODY HAS TO SLEEP.
+ */
+typedef struct BroadcastCursor{
+    _Atomic uint64_t next;  // next sequence to read - everything below is released
+    _Atomic uint64_t held;  // sequence read right now by a skipping consumer, BROADCAST_NONE between reads
+    _Atomic uint64_t lost;  // elements skipped by a skipping consumer
+    BroadcastPolicy policy;
+    uint8_t pad[64 - 3 * sizeof(uint64_t) - sizeof(BroadcastPolicy)];   // one cache line per consumer
+} BroadcastCursor;
+
+struct Broadcast{
+    pthread_cond_t more_cv;     // 48B - signals if a new element was published or the ring was closed
+    pthread_cond_t less_cv;     // 48B - signals if a consumer released an element
+    pthread_mutex_t mutex;      // 40B - protects only the condition variables
+
+    _Atomic uint64_t published;     // producer sequence - number of published elements
+    _Atomic uint64_t claimed;       // sequence the producer writes (or wrote last)
+    atomic_uint waiting_consumers;
+    atomic_bool producer_waiting;
+    atomic_bool closed;
+
+    size_t capacity;
+    size_t stride;      // element size rounded up to keep doubles in slots aligned
+    size_t no_consumers;
+    BroadcastCursor cursors[BROADCAST_MAX_CONSUMERS];
+    uint8_t slots[];    // Fixed size - FAM
+};
+
+/**
+ * Absolute deadline for condition variable waits.
+ */
+static void broadcast_deadline(struct timespec* const deadline, const uint8_t timeout)
+{
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    deadline->tv_sec = now.tv_sec + timeout;
+    deadline->tv_nsec = now.tv_usec * 1000;
+}
+
+static void* broadcast_slot(const Broadcast* const b, const uint64_t seq)
+{
+    return (void*)&b->slots[(seq % b->capacity) * b->stride];
+}
+
+static bool broadcast_valid_consumer(const Broadcast* const b, const int consumer)
+{
+    return b != NULL && consumer >= 0 && (size_t)consumer < b->no_consumers;
+}
+
+/**
+ * Determines whether the producer can overwrite the slot of given sequence - no blocking consumer is a whole
+ * ring behind and no skipping consumer reads the slot right now.
+ */
+static bool broadcast_can_write(const Broadcast* const b, const uint64_t seq)
+{
+    for (size_t i = 0; i < b->no_consumers; i++)
+    {
+        const BroadcastCursor* const c = &b->cursors[i];
+        if(c->policy == BROADCAST_BLOCK)
+        {
+            if(seq - atomic_load(&c->next) >= b->capacity)
+                return false;
+        }
+        else
+        {
+            const uint64_t held = atomic_load(&c->held);
+            if(held != BROADCAST_NONE && seq - held >= b->capacity)
+                return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Creates a new ring.
+ * @param capacity - number of slots, at least 2
+ * @param elem_size - size of one element
+ * @return Pointer to the newly created ring, NULL on invalid arguments or allocation error.
+ */
+Broadcast* broadcast_create(const size_t capacity, const size_t elem_size)
+{
+    if(capacity < 2 || elem_size == 0)
+        return NULL;
+    const size_t stride = (elem_size + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1);
+    Broadcast* const b = malloc(sizeof(*b) + stride * capacity);   // Flexible Array Member
+    if(b == NULL)
+        return NULL;
+
+    *b = (Broadcast){.mutex = PTHREAD_MUTEX_INITIALIZER,
+                     .more_cv = PTHREAD_COND_INITIALIZER,
+                     .less_cv = PTHREAD_COND_INITIALIZER,
+                     .capacity = capacity,
+                     .stride = stride,
+                     .no_consumers = 0
+                    };
+    atomic_init(&b->published, 0);
+    atomic_init(&b->claimed, 0);
+    atomic_init(&b->waiting_consumers, 0);
+    atomic_init(&b->producer_waiting, false);
+    atomic_init(&b->closed, false);
+    return b;
+}
+
+/**
+ * Deletes the ring and frees memory. Nobody may use it anymore.
+ */
+void broadcast_delete(Broadcast* b)
+{
+    if(b == NULL)
+        return;
+    pthread_mutex_destroy(&b->mutex);
+    pthread_cond_destroy(&b->more_cv);
+    pthread_cond_destroy(&b->less_cv);
+    free(b);
+}
+
+/**
+ * Registers a consumer, it sees elements published from now on. Has to be called before the producer starts.
+ * @param policy - what happens when the consumer falls a whole ring behind
+ * @return Id of the consumer, -1 if there are too many consumers.
+ */
+int broadcast_add_consumer(Broadcast* const b, const BroadcastPolicy policy)
+{
+    if(b == NULL || b->no_consumers == BROADCAST_MAX_CONSUMERS)
+        return -1;
+    BroadcastCursor* const c = &b->cursors[b->no_consumers];
+    atomic_init(&c->next, atomic_load(&b->published));
+    atomic_init(&c->held, BROADCAST_NONE);
+    atomic_init(&c->lost, 0);
+    c->policy = policy;
+    return (int)b->no_consumers++;
+}
+
+/**
+ * Closes the ring - waiting producer and consumers wake up, consumers still get elements published before.
+ */
+void broadcast_close(Broadcast* const b)
+{
+    if(b == NULL)
+        return;
+    atomic_store(&b->closed, true);
+    pthread_mutex_lock(&b->mutex);
+    pthread_cond_broadcast(&b->more_cv);
+    pthread_cond_broadcast(&b->less_cv);
+    pthread_mutex_unlock(&b->mutex);
+}
+
+/**
+ * Gives the producer the next slot to write into. Waits while a blocking consumer is a whole ring behind.
+ * @param slot - set to the slot, valid until broadcast_publish
+ * @param timeout - max time in seconds to wait for the slot
+ * @return BSUCCESS, BTIMEOUT on timeout, BCLOSED if the ring was closed and BERROR on different error.
+ */
+BroadcastErrorCode broadcast_claim(Broadcast* const b, void** const slot, const uint8_t timeout)
+{
+    if(b == NULL || slot == NULL)
+        return BERROR;
+    const uint64_t seq = atomic_load_explicit(&b->published, memory_order_relaxed);
+    // Announced before the cursors are checked - a skipping consumer either is seen here or sees this
+    atomic_store(&b->claimed, seq);
+    if(!broadcast_can_write(b, seq) && !atomic_load(&b->closed))
+    {
+        struct timespec deadline;
+        broadcast_deadline(&deadline, timeout);
+        pthread_mutex_lock(&b->mutex);
+        atomic_store(&b->producer_waiting, true);
+        while(!broadcast_can_write(b, seq) && !atomic_load(&b->closed))
+        {
+            if(pthread_cond_timedwait(&b->less_cv, &b->mutex, &deadline) != 0)
+            {
+                atomic_store(&b->producer_waiting, false);
+                pthread_mutex_unlock(&b->mutex);
+                return BTIMEOUT;
+            }
+        }
+        atomic_store(&b->producer_waiting, false);
+        pthread_mutex_unlock(&b->mutex);
+    }
+    if(atomic_load(&b->closed))
+        return BCLOSED;
+    *slot = broadcast_slot(b, seq);
+    return BSUCCESS;
+}
+
+/**
+ * Makes the claimed slot visible to every consumer.
+ */
+void broadcast_publish(Broadcast* const b)
+{
+    if(b == NULL)
+        return;
+    atomic_store(&b->published, atomic_load_explicit(&b->published, memory_order_relaxed) + 1);
+    if(atomic_load(&b->waiting_consumers) != 0)
+    {
+        pthread_mutex_lock(&b->mutex);
+        pthread_cond_broadcast(&b->more_cv);
+        pthread_mutex_unlock(&b->mutex);
+    }
+}
+
+/**
+ * Sleeps until an element after next is published or the ring is closed.
+ * @return True if there is an element to read.
+ */
+static bool broadcast_wait_published(Broadcast* const b, const uint64_t next, const uint8_t timeout)
+{
+    struct timespec deadline;
+    broadcast_deadline(&deadline, timeout);
+    pthread_mutex_lock(&b->mutex);
+    atomic_fetch_add(&b->waiting_consumers, 1);
+    while(atomic_load(&b->published) <= next && !atomic_load(&b->closed))
+    {
+        if(pthread_cond_timedwait(&b->more_cv, &b->mutex, &deadline) != 0)
+            break;
+    }
+    atomic_fetch_sub(&b->waiting_consumers, 1);
+    pthread_mutex_unlock(&b->mutex);
+    return atomic_load(&b->published) > next;
+}
+
+/**
+ * Gives the consumer its next element - a skipping consumer that fell a whole ring behind gets the latest one.
+ * The element is read in place and stays valid until broadcast_release.
+ * @param consumer - id returned by broadcast_add_consumer
+ * @param slot - set to the element
+ * @param timeout - max time in seconds to wait for a new element
+ * @return BSUCCESS, BTIMEOUT on timeout, BCLOSED if the ring was closed and drained and BERROR on different error.
+ */
+BroadcastErrorCode broadcast_wait(Broadcast* const b, const int consumer, const void** const slot, const uint8_t timeout)
+{
+    if(!broadcast_valid_consumer(b, consumer) || slot == NULL)
+        return BERROR;
+    BroadcastCursor* const c = &b->cursors[consumer];
+    uint64_t next = atomic_load_explicit(&c->next, memory_order_relaxed);   // written only by this consumer
+    if(atomic_load(&b->published) <= next && !broadcast_wait_published(b, next, timeout))
+        return atomic_load(&b->closed) ? BCLOSED : BTIMEOUT;
+
+    if(c->policy == BROADCAST_SKIP)
+    {
+        // Elements still in the ring are read in order - announced before the producer's sequence is checked,
+        // the producer either sees the held slot or this sees the producer in it
+        atomic_store(&c->held, next);
+        if(atomic_load(&b->claimed) >= next + b->capacity)
+        {
+            // A whole ring behind - hold the latest element, retry if the producer got to its slot in the meantime
+            uint64_t latest;
+            do
+            {
+                latest = atomic_load(&b->published) - 1;
+                atomic_store(&c->held, latest);
+            } while(atomic_load(&b->claimed) >= latest + b->capacity);
+            atomic_fetch_add_explicit(&c->lost, latest - next, memory_order_relaxed);
+            next = latest;
+            atomic_store(&c->next, next);
+        }
+    }
+    *slot = broadcast_slot(b, next);
+    return BSUCCESS;
+}
+
+/**
+ * Moves the consumer past the element given by the last broadcast_wait, its slot can be reused.
+ */
+void broadcast_release(Broadcast* const b, const int consumer)
+{
+    if(!broadcast_valid_consumer(b, consumer))
+        return;
+    BroadcastCursor* const c = &b->cursors[consumer];
+    if(c->policy == BROADCAST_SKIP)
+        atomic_store(&c->held, BROADCAST_NONE);
+    atomic_store(&c->next, atomic_load_explicit(&c->next, memory_order_relaxed) + 1);
+    if(atomic_load(&b->producer_waiting))
+    {
+        pthread_mutex_lock(&b->mutex);
+        pthread_cond_signal(&b->less_cv);
+        pthread_mutex_unlock(&b->mutex);
+    }
+}
+
+/**
+ * @return Number of elements skipped by the consumer, always 0 for a blocking one.
+ */
+uint64_t broadcast_lost(const Broadcast* const b, const int consumer)
+{
+    if(!broadcast_valid_consumer(b, consumer))
+        return 0;
+    return atomic_load_explicit(&b->cursors[consumer].lost, memory_order_relaxed);
+}
+
+/**
+ * Lets the producer tell what the slowest consumer has seen - e.g. to send it what it missed while skipping.
+ * @return The lowest sequence some consumer did not read yet, the number of published elements if every
+ * consumer is up to date.
+ */
+uint64_t broadcast_oldest_unread(const Broadcast* const b)
+{
+    if(b == NULL)
+        return 0;
+    uint64_t oldest = atomic_load(&b->published);
+    for (size_t i = 0; i < b->no_consumers; i++)
+    {
+        const uint64_t next = atomic_load(&b->cursors[i].next);
+        oldest = next < oldest ? next : oldest;
+    }
+    return oldest;
+}
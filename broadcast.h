@@ -0,0 +1,39 @@
+
+#ifndef CPU_USAGE_TRACKER_BROADCAST_H
+#define CPU_USAGE_TRACKER_BROADCAST_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define BROADCAST_MAX_CONSUMERS 8
+
+typedef enum{
+    BSUCCESS = 0,
+    BTIMEOUT = 1,
+    BCLOSED = 2,
+    BERROR = 3
+} BroadcastErrorCode;
+
+// What happens when a consumer falls a whole ring behind the producer
+typedef enum{
+    BROADCAST_BLOCK = 0,    // producer waits - consumer sees every element
+    BROADCAST_SKIP = 1      // consumer jumps to the latest element, the ones it skips are counted as lost
+} BroadcastPolicy;
+
+typedef struct Broadcast Broadcast; // Forward declaration
+
+Broadcast* broadcast_create(size_t capacity, size_t elem_size);
+void broadcast_delete(Broadcast* b);
+int broadcast_add_consumer(Broadcast* b, BroadcastPolicy policy);
+void broadcast_close(Broadcast* b);
+
+BroadcastErrorCode broadcast_claim(Broadcast* b, void** slot, uint8_t timeout);
+void broadcast_publish(Broadcast* b);
+
+BroadcastErrorCode broadcast_wait(Broadcast* b, int consumer, const void** slot, uint8_t timeout);
+void broadcast_release(Broadcast* b, int consumer);
+uint64_t broadcast_lost(const Broadcast* b, int consumer);
+uint64_t broadcast_oldest_unread(const Broadcast* b);
+
+#endif //CPU_USAGE_TRACKER_BROADCAST_H
@@ -0,0 +1,615 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+#include "cgroup.h"
+
+enum{CGROUP_DENTS_SIZE = 16384};
+enum{CGROUP_EVENTS_SIZE = 16384};
+enum{CGROUP_FILE_SIZE = 512};
+enum{CGROUP_LIMITS_REFRESH = 30};   // ticks between limit rereads - effective cpuset changes are not notified
+#define CGROUP_WATCH_MASK (IN_CREATE | IN_DELETE | IN_MODIFY | IN_DELETE_SELF | IN_ONLYDIR)
+
+typedef struct CgroupNode{
+    char* path;         // relative to the mount, "" for root, NULL for free slot
+    int parent;         // index of the parent node, -1 for root
+    int depth;
+    int stat_fd;        // cached cpu.stat, -1 if not readable
+    int wd;             // inotify watch of the directory
+    bool limits_dirty;  // cpu.max or cpuset.cpus.effective has to be reread
+    bool has_prev;
+    double quota_cpus;  // cpu.max quota / period, 0 for max
+    uint32_t allowed_cpus;  // cpuset.cpus.effective
+    uint64_t usage_usec;
+    uint64_t throttled_usec;
+    double usage_cpus;
+    double children_cpus;   // used when cpu.stat is not readable
+    double throttled_ms;
+    double subtree_throttled_ms;
+} CgroupNode;
+
+struct CgroupTracker{
+    pthread_mutex_t mutex;  // protects top - read by printer
+    const char* root_path;  // cgroup2 mount
+    int root_fd;            // owned by the collector
+    int inotify_fd;
+    CgroupNode* nodes;
+    size_t capacity;
+    size_t used;            // high-water mark of nodes
+    size_t no_alive;
+    int* free_slots;
+    size_t no_free;
+    int* order;             // alive nodes from the deepest - children before parents
+    size_t order_len;
+    bool order_dirty;
+    int* wd_map;            // inotify wd -> node
+    size_t wd_cap;
+    int* pending;           // BFS queue of directories to list
+    bool rescan;            // full rescan needed (start or lost events)
+    size_t ticks;
+    uint64_t last_ns;
+    uint32_t no_cpus;
+    char* dents;
+    char* events;
+    size_t top_n;
+    CgroupTopEntry* heap;
+    CgroupTopEntry* top;
+    size_t top_len;
+    size_t top_no_cgroups;  // no_alive published together with top
+};
+
+/**
+ * Counts cpus in a list like "0-3,8,10-11".
+ */
+static uint32_t cgroup_count_cpus(const char* list)
+{
+    uint32_t count = 0;
+    while(*list != '\0' && *list != '\n')
+    {
+        char* end;
+        const unsigned long first = strtoul(list, &end, 10);
+        if(end == list)
+            break;
+        unsigned long last = first;
+        if(*end == '-')
+            last = strtoul(end + 1, &end, 10);
+        if(last >= first)
+            count += (uint32_t)(last - first + 1);
+        list = *end == ',' ? end + 1 : end;
+    }
+    return count;
+}
+
+/**
+ * Reads small file of a cgroup into buf.
+ * @return False if file does not exist or is empty.
+ */
+static bool cgroup_read_file(const CgroupTracker* ct, const CgroupNode* node, const char* name, char* buf, size_t size)
+{
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s%s%s", node->path, node->path[0] != '\0' ? "/" : "", name);
+    const int fd = openat(ct->root_fd, path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+        return false;
+    const ssize_t n = read(fd, buf, size - 1);
+    close(fd);
+    if(n <= 0)
+        return false;
+    buf[n] = '\0';
+    return true;
+}
+
+static void cgroup_read_limits(const CgroupTracker* ct, CgroupNode* node)
+{
+    char buf[CGROUP_FILE_SIZE];
+    unsigned long quota, period;
+    node->quota_cpus = 0;
+    if(cgroup_read_file(ct, node, "cpu.max", buf, sizeof(buf)) && sscanf(buf, "%lu %lu", &quota, &period) == 2 && period != 0)
+        node->quota_cpus = (double)quota / (double)period;  // "max" does not match %lu
+
+    node->allowed_cpus = ct->no_cpus;
+    if(cgroup_read_file(ct, node, "cpuset.cpus.effective", buf, sizeof(buf)))
+    {
+        const uint32_t allowed = cgroup_count_cpus(buf);
+        if(allowed != 0)
+            node->allowed_cpus = allowed;
+    }
+    node->limits_dirty = false;
+}
+
+/**
+ * Adds cgroup directory - opens its cpu.stat and starts watching it.
+ * @return Index of the new node, -1 on error.
+ */
+static int cgroup_add_node(CgroupTracker* ct, const int parent, const char* name)
+{
+    int idx;
+    if(ct->no_free != 0)
+        idx = ct->free_slots[--ct->no_free];
+    else
+    {
+        if(ct->used == ct->capacity)
+        {
+            const size_t cap = ct->capacity != 0 ? ct->capacity * 2 : 256;
+            CgroupNode* const nodes = realloc(ct->nodes, sizeof(CgroupNode) * cap);
+            int* const free_slots = realloc(ct->free_slots, sizeof(int) * cap);
+            int* const order = realloc(ct->order, sizeof(int) * cap);
+            int* const pending = realloc(ct->pending, sizeof(int) * cap);
+            if(nodes != NULL)
+                ct->nodes = nodes;
+            if(free_slots != NULL)
+                ct->free_slots = free_slots;
+            if(order != NULL)
+                ct->order = order;
+            if(pending != NULL)
+                ct->pending = pending;
+            if(nodes == NULL || free_slots == NULL || order == NULL || pending == NULL)
+                return -1;
+            ct->capacity = cap;
+        }
+        idx = (int)ct->used++;
+    }
+
+    CgroupNode* const node = &ct->nodes[idx];
+    *node = (CgroupNode){.parent = parent, .stat_fd = -1, .wd = -1, .limits_dirty = true};
+    if(parent < 0)
+        node->path = strdup("");
+    else
+    {
+        const char* const parent_path = ct->nodes[parent].path;
+        node->path = malloc(strlen(parent_path) + strlen(name) + 2);
+        if(node->path != NULL)
+            sprintf(node->path, "%s%s%s", parent_path, parent_path[0] != '\0' ? "/" : "", name);
+        node->depth = ct->nodes[parent].depth + 1;
+    }
+    if(node->path == NULL)
+    {
+        ct->free_slots[ct->no_free++] = idx;
+        return -1;
+    }
+
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s%scpu.stat", node->path, node->path[0] != '\0' ? "/" : "");
+    node->stat_fd = openat(ct->root_fd, path, O_RDONLY | O_CLOEXEC);
+
+    if(ct->inotify_fd >= 0)
+    {
+        snprintf(path, sizeof(path), "%s/%s", ct->root_path, node->path);
+        node->wd = inotify_add_watch(ct->inotify_fd, path, CGROUP_WATCH_MASK);
+        if(node->wd >= 0)
+        {
+            if((size_t)node->wd >= ct->wd_cap)
+            {
+                size_t cap = ct->wd_cap != 0 ? ct->wd_cap : 256;
+                while(cap <= (size_t)node->wd)
+                    cap *= 2;
+                int* const wd_map = realloc(ct->wd_map, sizeof(int) * cap);
+                if(wd_map == NULL)
+                {
+                    inotify_rm_watch(ct->inotify_fd, node->wd);
+                    node->wd = -1;
+                    ct->rescan = true;  // fall back to full rescans
+                }
+                else
+                {
+                    for (size_t i = ct->wd_cap; i < cap; i++)
+                        wd_map[i] = -1;
+                    ct->wd_map = wd_map;
+                    ct->wd_cap = cap;
+                }
+            }
+            if(node->wd >= 0)
+                ct->wd_map[node->wd] = idx;
+        }
+    }
+    ct->no_alive++;
+    ct->order_dirty = true;
+    return idx;
+}
+
+static void cgroup_remove_node(CgroupTracker* ct, const int idx)
+{
+    CgroupNode* const node = &ct->nodes[idx];
+    if(node->path == NULL)
+        return;
+    if(node->stat_fd >= 0)
+        close(node->stat_fd);
+    if(node->wd >= 0 && (size_t)node->wd < ct->wd_cap)
+    {
+        inotify_rm_watch(ct->inotify_fd, node->wd);
+        ct->wd_map[node->wd] = -1;
+    }
+    free(node->path);
+    node->path = NULL;
+    ct->free_slots[ct->no_free++] = idx;
+    ct->no_alive--;
+    ct->order_dirty = true;
+}
+
+/**
+ * Adds every directory below node - breadth first, so the listing buffer is not shared between levels.
+ */
+static void cgroup_walk(CgroupTracker* ct, const int start)
+{
+    size_t head = 0, tail = 0;
+    ct->pending[tail++] = start;
+    while(head < tail)
+    {
+        const int idx = ct->pending[head++];
+        const int dirfd = openat(ct->root_fd, ct->nodes[idx].path[0] != '\0' ? ct->nodes[idx].path : ".",
+                                 O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if(dirfd < 0)
+            continue;
+        long n;
+        while((n = collector_getdents(dirfd, ct->dents, CGROUP_DENTS_SIZE)) > 0)
+        {
+            for (long off = 0; off < n;)
+            {
+                const CollectorDirent* const d = (const CollectorDirent*)(const void*)(ct->dents + off);
+                off += d->d_reclen;
+                if(d->d_type != DT_DIR || strcmp(d->d_name, ".") == 0 || strcmp(d->d_name, "..") == 0)
+                    continue;
+                const int child = cgroup_add_node(ct, idx, d->d_name);
+                // pending grows together with nodes, so it always has a free place
+                if(child >= 0)
+                    ct->pending[tail++] = child;
+            }
+        }
+        close(dirfd);
+    }
+}
+
+static void cgroup_full_rescan(CgroupTracker* ct)
+{
+    for (size_t i = 0; i < ct->used; i++)
+        cgroup_remove_node(ct, (int)i);
+    ct->used = 0;
+    ct->no_free = 0;
+    ct->rescan = false;
+    const int root = cgroup_add_node(ct, -1, "");
+    if(root >= 0)
+        cgroup_walk(ct, root);
+}
+
+/**
+ * @return Index of the child node of the given name, -1 if it is not tracked.
+ */
+static int cgroup_find_child(const CgroupTracker* ct, const int parent, const char* name)
+{
+    const size_t prefix = strlen(ct->nodes[parent].path);
+    for (size_t i = 0; i < ct->used; i++)
+    {
+        const CgroupNode* const node = &ct->nodes[i];
+        if(node->path != NULL && node->parent == parent &&
+           strcmp(node->path + prefix + (prefix != 0), name) == 0)
+            return (int)i;
+    }
+    return -1;
+}
+
+/**
+ * Applies changes of the hierarchy reported by inotify since previous tick.
+ */
+static void cgroup_handle_events(CgroupTracker* ct)
+{
+    if(ct->inotify_fd < 0)
+    {
+        ct->rescan = true;
+        return;
+    }
+    ssize_t n;
+    while((n = read(ct->inotify_fd, ct->events, CGROUP_EVENTS_SIZE)) > 0)
+    {
+        for (ssize_t off = 0; off < n;)
+        {
+            const struct inotify_event* const ev = (const struct inotify_event*)(const void*)(ct->events + off);
+            off += (ssize_t)(sizeof(*ev) + ev->len);
+            if(ev->mask & IN_Q_OVERFLOW)
+            {
+                ct->rescan = true;
+                continue;
+            }
+            if(ev->wd < 0 || (size_t)ev->wd >= ct->wd_cap || ct->wd_map[ev->wd] < 0)
+                continue;
+            const int idx = ct->wd_map[ev->wd];
+            if(ev->mask & (IN_DELETE_SELF | IN_IGNORED))
+            {
+                cgroup_remove_node(ct, idx);
+            }
+            else if((ev->mask & IN_DELETE) && (ev->mask & IN_ISDIR) && ev->len != 0)
+            {
+                // Our cached cpu.stat keeps the removed directory alive - its IN_DELETE_SELF comes only after close
+                const int child = cgroup_find_child(ct, idx, ev->name);
+                if(child >= 0)
+                    cgroup_remove_node(ct, child);
+            }
+            else if((ev->mask & IN_CREATE) && (ev->mask & IN_ISDIR) && ev->len != 0)
+            {
+                const int child = cgroup_add_node(ct, idx, ev->name);
+                if(child >= 0)
+                    cgroup_walk(ct, child);
+            }
+            else if((ev->mask & IN_MODIFY) && ev->len != 0 &&
+                    (strcmp(ev->name, "cpu.max") == 0 || strcmp(ev->name, "cpuset.cpus.effective") == 0))
+            {
+                ct->nodes[idx].limits_dirty = true;
+            }
+        }
+    }
+}
+
+/**
+ * Orders alive nodes from the deepest, so one pass can sum children into parents.
+ */
+static void cgroup_build_order(CgroupTracker* ct)
+{
+    int max_depth = 0;
+    for (size_t i = 0; i < ct->used; i++)
+    {
+        if(ct->nodes[i].path != NULL && ct->nodes[i].depth > max_depth)
+            max_depth = ct->nodes[i].depth;
+    }
+    ct->order_len = 0;
+    for (int depth = max_depth; depth >= 0; depth--)
+    {
+        for (size_t i = 0; i < ct->used; i++)
+        {
+            if(ct->nodes[i].path != NULL && ct->nodes[i].depth == depth)
+                ct->order[ct->order_len++] = (int)i;
+        }
+    }
+    ct->order_dirty = false;
+}
+
+static void cgroup_update_node(CgroupNode* node, const double interval_s)
+{
+    char buf[CGROUP_FILE_SIZE];
+    node->children_cpus = 0;
+    node->usage_cpus = 0;
+    node->throttled_ms = 0;
+    if(node->stat_fd < 0)
+        return;
+    const ssize_t n = pread(node->stat_fd, buf, sizeof(buf) - 1, 0);
+    if(n <= 0)
+        return;
+    buf[n] = '\0';
+
+    unsigned long usage = 0, throttled = 0;
+    const char* key = strstr(buf, "usage_usec");
+    if(key != NULL)
+        sscanf(key, "usage_usec %lu", &usage);
+    key = strstr(buf, "throttled_usec");
+    if(key != NULL)
+        sscanf(key, "throttled_usec %lu", &throttled);
+
+    if(node->has_prev && interval_s > 0)
+    {
+        if(usage >= node->usage_usec)
+            node->usage_cpus = (double)(usage - node->usage_usec) / 1e6 / interval_s;
+        if(throttled >= node->throttled_usec)
+            node->throttled_ms = (double)(throttled - node->throttled_usec) / 1e3 / interval_s;
+    }
+    node->usage_usec = usage;
+    node->throttled_usec = throttled;
+    node->has_prev = true;
+}
+
+static void cgroup_heap_push(CgroupTopEntry* heap, size_t* len, size_t cap, const CgroupTopEntry* e)
+{
+    size_t i;
+    if(*len < cap)
+    {
+        i = (*len)++;
+        while(i > 0 && heap[(i - 1) / 2].usage_limit_pr > e->usage_limit_pr)
+        {
+            heap[i] = heap[(i - 1) / 2];
+            i = (i - 1) / 2;
+        }
+        heap[i] = *e;
+        return;
+    }
+    if(cap == 0 || e->usage_limit_pr <= heap[0].usage_limit_pr)
+        return;
+    i = 0;
+    while(1)
+    {
+        size_t child = 2 * i + 1;
+        if(child >= *len)
+            break;
+        if(child + 1 < *len && heap[child + 1].usage_limit_pr < heap[child].usage_limit_pr)
+            child++;
+        if(heap[child].usage_limit_pr >= e->usage_limit_pr)
+            break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = *e;
+}
+
+/**
+ * Collector function - applies hierarchy changes, rereads cpu.stat of every cgroup and aggregates bottom-up.
+ */
+static bool cgroup_collect(Collector* const c)
+{
+    CgroupTracker* const ct = c->data;
+    ct->root_fd = c->fd;
+
+    cgroup_handle_events(ct);
+    if(ct->rescan)
+        cgroup_full_rescan(ct);
+    if(ct->order_dirty)
+        cgroup_build_order(ct);
+    const bool refresh_limits = ct->ticks++ % CGROUP_LIMITS_REFRESH == 0;
+
+    const uint64_t now = collector_now_ns();
+    const double interval_s = ct->last_ns != 0 ? (double)(now - ct->last_ns) / 1e9 : 0;
+    ct->last_ns = now;
+
+    for (size_t i = 0; i < ct->order_len; i++)
+    {
+        CgroupNode* const node = &ct->nodes[ct->order[i]];
+        if(node->limits_dirty || refresh_limits)
+            cgroup_read_limits(ct, node);
+        cgroup_update_node(node, interval_s);
+    }
+
+    // Children before parents
+    size_t heap_len = 0;
+    for (size_t i = 0; i < ct->order_len; i++)
+    {
+        CgroupNode* const node = &ct->nodes[ct->order[i]];
+        node->subtree_throttled_ms += node->throttled_ms;
+        if(node->stat_fd < 0)
+            node->usage_cpus = node->children_cpus;
+        if(node->parent >= 0)
+        {
+            CgroupNode* const parent = &ct->nodes[node->parent];
+            parent->subtree_throttled_ms += node->subtree_throttled_ms;
+            parent->children_cpus += node->usage_cpus;
+        }
+        else
+            continue;   // root is the TOTAL bar
+
+        double limit = (double)node->allowed_cpus;
+        if(node->quota_cpus > 0 && node->quota_cpus < limit)
+            limit = node->quota_cpus;
+        CgroupTopEntry e = {.usage_cpus = node->usage_cpus,
+                            .limit_cpus = limit,
+                            .usage_limit_pr = limit > 0 ? node->usage_cpus * 100 / limit : 0,
+                            .throttled_ms = node->throttled_ms,
+                            .subtree_throttled_ms = node->subtree_throttled_ms
+                           };
+        const size_t len = strlen(node->path);
+        if(len < CGROUP_PATH_LEN)
+            memcpy(e.path, node->path, len + 1);
+        else
+            snprintf(e.path, CGROUP_PATH_LEN, "...%s", node->path + len - (CGROUP_PATH_LEN - 4));
+        if(e.usage_cpus > 0 || e.throttled_ms > 0)
+            cgroup_heap_push(ct->heap, &heap_len, ct->top_n, &e);
+    }
+    // Parents were summed in this tick, so subtree sums start from zero again
+    for (size_t i = 0; i < ct->order_len; i++)
+        ct->nodes[ct->order[i]].subtree_throttled_ms = 0;
+
+    for (size_t i = 1; i < heap_len; i++)
+    {
+        const CgroupTopEntry e = ct->heap[i];
+        size_t j = i;
+        for (; j > 0 && ct->heap[j - 1].usage_limit_pr < e.usage_limit_pr; j--)
+            ct->heap[j] = ct->heap[j - 1];
+        ct->heap[j] = e;
+    }
+    pthread_mutex_lock(&ct->mutex);
+    memcpy(ct->top, ct->heap, sizeof(CgroupTopEntry) * heap_len);
+    ct->top_len = heap_len;
+    ct->top_no_cgroups = ct->no_alive;
+    pthread_mutex_unlock(&ct->mutex);
+    return true;
+}
+
+/**
+ * Creates cgroup v2 tracker. Pure cgroup2 mount and the "unified" mount of hybrid systems are supported.
+ * @param top_n - how many of the hottest cgroups are kept
+ * @return Pointer to the new tracker, NULL on error.
+ */
+CgroupTracker* cgroup_create(const size_t top_n)
+{
+    if(top_n == 0)
+        return NULL;
+    CgroupTracker* const ct = calloc(1, sizeof(*ct));
+    if(ct == NULL)
+        return NULL;
+    ct->root_path = access("/sys/fs/cgroup/cgroup.controllers", F_OK) == 0 ? "/sys/fs/cgroup" : "/sys/fs/cgroup/unified";
+    ct->root_fd = -1;
+    ct->top_n = top_n;
+    ct->rescan = true;
+    const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    ct->no_cpus = cpus > 0 ? (uint32_t)cpus : 1;
+    ct->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    ct->dents = malloc(CGROUP_DENTS_SIZE);
+    ct->events = malloc(CGROUP_EVENTS_SIZE);
+    ct->heap = malloc(sizeof(CgroupTopEntry) * top_n);
+    ct->top = malloc(sizeof(CgroupTopEntry) * top_n);
+    if(ct->dents == NULL || ct->events == NULL || ct->heap == NULL || ct->top == NULL)
+    {
+        cgroup_delete(ct);
+        return NULL;
+    }
+    pthread_mutex_init(&ct->mutex, NULL);
+    return ct;
+}
+
+/**
+ * Closes every cached fd and frees the tracker.
+ */
+void cgroup_delete(CgroupTracker* ct)
+{
+    if(ct == NULL)
+        return;
+    for (size_t i = 0; i < ct->used; i++)
+    {
+        if(ct->nodes[i].path != NULL && ct->nodes[i].stat_fd >= 0)
+            close(ct->nodes[i].stat_fd);
+        free(ct->nodes[i].path);
+    }
+    if(ct->inotify_fd >= 0)
+        close(ct->inotify_fd);
+    pthread_mutex_destroy(&ct->mutex);
+    free(ct->nodes);
+    free(ct->free_slots);
+    free(ct->order);
+    free(ct->pending);
+    free(ct->wd_map);
+    free(ct->dents);
+    free(ct->events);
+    free(ct->heap);
+    free(ct->top);
+    free(ct);
+}
+
+/**
+ * Sets up cgroup collector. Its fd is the root of the cgroup2 hierarchy.
+ * @param root - tree of the cgroup2 layout, has to outlive the collector, NULL for the mount found by cgroup_create
+ * @return True if cgroup2 is mounted.
+ */
+bool cgroup_collector_init(Collector* const c, CgroupTracker* const ct, const char* const root)
+{
+    if(ct != NULL && root != NULL)
+        ct->root_path = root;
+    *c = (Collector){.name = "cgroup",
+                     .path = ct != NULL ? ct->root_path : "",
+                     .interval_ms = 1000,
+                     .collect = cgroup_collect,
+                     .fd = -1,
+                     .event_fd = -1,
+                     .data = ct
+                    };
+    if(ct == NULL)
+        return false;
+    return collector_open(c);
+}
+
+/**
+ * Copies the hottest cgroups found by the latest tick.
+ * @param out - array for max entries
+ * @param no_cgroups - set to the number of tracked cgroups, may be NULL
+ * @return Number of entries copied, sorted by usage relative to the limit.
+ */
+size_t cgroup_get_top(CgroupTracker* const ct, CgroupTopEntry* const out, const size_t max, size_t* const no_cgroups)
+{
+    if(ct == NULL || out == NULL)
+        return 0;
+    pthread_mutex_lock(&ct->mutex);
+    const size_t n = ct->top_len < max ? ct->top_len : max;
+    memcpy(out, ct->top, sizeof(CgroupTopEntry) * n);
+    if(no_cgroups != NULL)
+        *no_cgroups = ct->top_no_cgroups;
+    pthread_mutex_unlock(&ct->mutex);
+    return n;
+}
@@ -0,0 +1,31 @@
+
+#ifndef CPU_USAGE_TRACKER_CGROUP_H
+#define CPU_USAGE_TRACKER_CGROUP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "collector.h"
+
+#define CGROUP_DEFAULT_N 5
+#define CGROUP_PATH_LEN 48
+
+// One of the hottest cgroups since previous tick
+typedef struct CgroupTopEntry{
+    char path[CGROUP_PATH_LEN];     // relative to the cgroup2 mount, shortened from the left
+    double usage_cpus;              // cpus used
+    double limit_cpus;              // min(cpu.max quota, cpuset.cpus.effective)
+    double usage_limit_pr;          // usage relative to the limit in %
+    double throttled_ms;            // time throttled by own quota, ms per second
+    double subtree_throttled_ms;    // same summed over the whole subtree
+} CgroupTopEntry;
+
+typedef struct CgroupTracker CgroupTracker;   // Forward declaration
+
+CgroupTracker* cgroup_create(size_t top_n);
+void cgroup_delete(CgroupTracker* ct);
+
+bool cgroup_collector_init(Collector* c, CgroupTracker* ct, const char* root);
+
+size_t cgroup_get_top(CgroupTracker* ct, CgroupTopEntry* out, size_t max, size_t* no_cgroups);
+
+#endif //CPU_USAGE_TRACKER_CGROUP_H
@@ -0,0 +1,288 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "collector.h"
+#include "trace.h"
+
+enum{COLLECTOR_INITIAL_BUFFER = 4096};
+
+/**
+ * @return CLOCK_MONOTONIC time in nanoseconds.
+ */
+uint64_t collector_now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+/**
+ * @return True if collector takes part in collector_wait/collector_run_due.
+ */
+static bool collector_is_active(const Collector* const c)
+{
+    return c->fd >= 0 || (c->path == NULL && c->collect != NULL);
+}
+
+/**
+ * Opens collector's file once for the whole run. Missing source (e.g. kernel without PSI) is not an error,
+ * collector is just disabled.
+ * @param c - collector with path, interval and parse set
+ * @return True if source is available.
+ */
+bool collector_open(Collector* const c)
+{
+    if(c == NULL)
+        return false;
+    c->fd = -1;
+    c->event_fd = -1;
+    c->updated = false;
+    c->len = 0;
+    c->batch_slot = -1;
+    c->batched = false;
+    c->buff_size = COLLECTOR_INITIAL_BUFFER;
+    c->buffer = malloc(c->buff_size);
+    if(c->buffer == NULL)
+        return false;
+
+    c->fd = open(c->path, O_RDONLY | O_CLOEXEC);
+    if(c->fd < 0)
+    {
+        free(c->buffer);
+        c->buffer = NULL;
+        return false;
+    }
+    if(c->arm != NULL && !c->arm(c))
+        c->event_fd = -1;   // Source still works, just without events
+    c->next_due_ns = collector_now_ns();
+    return true;
+}
+
+/**
+ * Closes collector's files and frees its buffer.
+ */
+void collector_close(Collector* const c)
+{
+    if(c == NULL)
+        return;
+    if(c->fd >= 0)
+        close(c->fd);
+    if(c->event_fd >= 0)
+        close(c->event_fd);
+    c->fd = -1;
+    c->event_fd = -1;
+    free(c->buffer);
+    c->buffer = NULL;
+}
+
+/**
+ * Rereads whole file from offset 0 into collector's buffer. Buffer is doubled until file fits.
+ * A short read is not the end - seq_file (most of /proc) returns about a page per read, the file ends with a read
+ * that returns 0.
+ * @return True on success, buffer is null terminated.
+ */
+bool collector_read(Collector* const c)
+{
+    if(c == NULL || c->fd < 0)
+        return false;
+    size_t len = 0;
+    while(1)
+    {
+        if(len == c->buff_size - 1)
+        {
+            char* const bigger = realloc(c->buffer, c->buff_size * 2);
+            if(bigger == NULL)
+                return false;
+            c->buffer = bigger;
+            c->buff_size *= 2;
+        }
+        const ssize_t bytes_read = pread(c->fd, c->buffer + len, c->buff_size - 1 - len, (off_t)len);
+        if(bytes_read < 0 && errno == EINTR)
+            continue;
+        if(bytes_read < 0)
+            return false;
+        if(bytes_read == 0)
+            break;
+        len += (size_t)bytes_read;
+    }
+    c->len = len;
+    c->buffer[c->len] = '\0';
+    return true;
+}
+
+/**
+ * Reads next batch of directory entries - records are laid out as CollectorDirent.
+ * Directory fd can be listed again after lseek to 0.
+ * @return Number of bytes read, 0 at the end of directory, -1 on error.
+ */
+long collector_getdents(const int dirfd, char* const buffer, const size_t size)
+{
+    return syscall(SYS_getdents64, dirfd, buffer, size);
+}
+
+/**
+ * Sleeps until the nearest collector is due or any event fd fires.
+ * Collectors whose event fired (and the collectors they wake) become due immediately.
+ */
+void collector_wait(Collector* const* const collectors, const size_t no_collectors)
+{
+    enum{MAX_EVENT_FDS = 16};
+    struct pollfd fds[MAX_EVENT_FDS];
+    Collector* owners[MAX_EVENT_FDS];
+    size_t no_fds = 0;
+
+    const uint64_t now = collector_now_ns();
+    uint64_t next_due = UINT64_MAX;
+    for (size_t i = 0; i < no_collectors; i++)
+    {
+        Collector* const c = collectors[i];
+        if(!collector_is_active(c))
+            continue;
+        if(c->next_due_ns < next_due)
+            next_due = c->next_due_ns;
+        if(c->event_fd >= 0 && no_fds < MAX_EVENT_FDS)
+        {
+            fds[no_fds] = (struct pollfd){.fd = c->event_fd, .events = c->poll_events != 0 ? c->poll_events : POLLPRI};
+            owners[no_fds++] = c;
+        }
+    }
+    if(next_due == UINT64_MAX)
+        return;
+
+    const int timeout_ms = next_due <= now ? 0 : (int)((next_due - now + 999999) / 1000000);
+    if(poll(fds, no_fds, timeout_ms) <= 0)
+        return;
+
+    for (size_t i = 0; i < no_fds; i++)
+    {
+        if(fds[i].revents & (fds[i].events | POLLERR))
+        {
+            owners[i]->next_due_ns = 0;
+            if(owners[i]->wakes != NULL)
+                owners[i]->wakes->next_due_ns = 0;
+        }
+    }
+}
+
+/**
+ * @return True if collector is active and due at now.
+ */
+static bool collector_is_due(const Collector* const c, const uint64_t now)
+{
+    return collector_is_active(c) && c->next_due_ns <= now;
+}
+
+/**
+ * Marks collector's data as new and schedules its next run.
+ */
+static void collector_finish(Collector* const c, const bool ok, const uint64_t now)
+{
+    if(ok)
+        c->updated = true;
+    // Keep the cadence, but do not try to catch up after a stall or an event
+    const uint64_t interval = (uint64_t)c->interval_ms * 1000000u;
+    c->next_due_ns = c->next_due_ns != 0 && c->next_due_ns + interval > now ? c->next_due_ns + interval : now + interval;
+}
+
+/**
+ * Queues the read of collector's file into the batch, the slot is added on the first use.
+ */
+static void collector_queue(Collector* const c, IoBatch* const batch)
+{
+    if(c->batch_slot < 0)
+        c->batch_slot = iobatch_add(batch, c->fd, c->buff_size);
+    c->batched = c->batch_slot >= 0 && iobatch_queue(batch, c->batch_slot);
+}
+
+/**
+ * Copies the batched read into collector's buffer. A file that filled its slot is reread with pread, which grows
+ * the buffer, and the slot follows the buffer size.
+ * @return True on success, buffer is null terminated.
+ */
+static bool collector_take(Collector* const c, IoBatch* const batch)
+{
+    if(!c->batched)
+        return collector_read(c);
+    c->batched = false;
+    const char* data;
+    const long n = iobatch_result(batch, c->batch_slot, &data);
+    if(n < 0)
+        return false;
+    if((size_t)n + 1 >= iobatch_slot_size(batch, c->batch_slot) || (size_t)n >= c->buff_size)
+    {
+        const bool ok = collector_read(c);
+        iobatch_resize(batch, c->batch_slot, c->buff_size);
+        return ok;
+    }
+    memcpy(c->buffer, data, (size_t)n + 1);
+    c->len = (size_t)n;
+    return true;
+}
+
+/**
+ * Runs every collector that is due - rereads its file and parses it (or runs its own collect function).
+ * @return Number of collectors that produced new data.
+ */
+size_t collector_run_due(Collector* const* const collectors, const size_t no_collectors)
+{
+    size_t updated = 0;
+    const uint64_t now = collector_now_ns();
+    for (size_t i = 0; i < no_collectors; i++)
+    {
+        Collector* const c = collectors[i];
+        if(!collector_is_due(c, now))
+            continue;
+        TRACE_BEGIN(span);
+        const bool ok = c->collect != NULL ? c->collect(c) : collector_read(c) && c->parse(c);
+        TRACE_END(span, c->name);
+        updated += ok;
+        collector_finish(c, ok, now);
+    }
+    return updated;
+}
+
+/**
+ * Runs every collector that is due with all their reads in one batch - files of the collectors and the files
+ * queued by collect sources are read by one iobatch_submit, then every collector parses its part.
+ * @param batch - read engine of the calling thread, NULL - same as collector_run_due
+ * @return Number of collectors that produced new data.
+ */
+size_t collector_run_due_batch(Collector* const* const collectors, const size_t no_collectors, IoBatch* const batch)
+{
+    if(batch == NULL)
+        return collector_run_due(collectors, no_collectors);
+    const uint64_t now = collector_now_ns();
+    for (size_t i = 0; i < no_collectors; i++)
+    {
+        Collector* const c = collectors[i];
+        if(!collector_is_due(c, now))
+            continue;
+        if(c->collect == NULL)
+            collector_queue(c, batch);
+        else if(c->queue != NULL)
+            c->queue(c, batch);
+    }
+    TRACE_BEGIN(submit);
+    iobatch_submit(batch);
+    TRACE_END(submit, "read batch");
+
+    size_t updated = 0;
+    for (size_t i = 0; i < no_collectors; i++)
+    {
+        Collector* const c = collectors[i];
+        if(!collector_is_due(c, now))
+            continue;
+        TRACE_BEGIN(span);
+        const bool ok = c->collect != NULL ? c->collect(c) : collector_take(c, batch) && c->parse(c);
+        TRACE_END(span, c->name);
+        updated += ok;
+        collector_finish(c, ok, now);
+    }
+    return updated;
+}
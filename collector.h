@@ -0,0 +1,65 @@
+
+#ifndef CPU_USAGE_TRACKER_COLLECTOR_H
+#define CPU_USAGE_TRACKER_COLLECTOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "iobatch.h"
+
+typedef struct Collector Collector; // Forward declaration
+
+// Layout of records returned by getdents64
+typedef struct CollectorDirent{
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+} CollectorDirent;
+
+/**
+ * One data source read by the reader thread. Every collector keeps its file open for the whole run
+ * and rereads it with pread, so a tick costs one syscall per source.
+ * Collectors are multiplexed by collector_wait/collector_run_due on a single thread.
+ * Collector without path and with collect set is virtual - it has no file of its own (e.g. libcut sampling)
+ * and is always active, its next_due_ns is set by the owner.
+ * With an IoBatch the reads of every due collector are submitted together - file collectors get a slot of their
+ * own, collect sources with queue set add their reads and find the results in the batch when collect runs.
+ */
+struct Collector{
+    const char* name;
+    const char* path;
+    int fd;                 // persistent fd, -1 when source is not available
+    int event_fd;           // polled for POLLPRI (e.g. PSI trigger), -1 if not used
+    short poll_events;      // events of event_fd, 0 - POLLPRI
+    uint32_t interval_ms;   // how often collector is run
+    uint64_t next_due_ns;   // CLOCK_MONOTONIC time of the next run
+    bool updated;           // set after successful parse, cleared by the consumer of the data
+    Collector* wakes;       // collector run immediately when event_fd fires (e.g. /proc/stat on pressure)
+
+    char* buffer;           // file content, grown when file does not fit
+    size_t buff_size;
+    size_t len;
+    int batch_slot;         // slot of fd in the reader's IoBatch, -1 until the first batched read
+    bool batched;           // read is queued in the running tick's batch
+
+    bool (*parse)(Collector* c);    // parses buffer into data, false on error
+    bool (*collect)(Collector* c);  // optional, replaces read + parse for sources that are not a single file
+    bool (*arm)(Collector* c);      // optional, sets up event_fd after fd is opened
+    bool (*queue)(Collector* c, IoBatch* b);    // optional, queues reads of a collect source into the batch
+    void* data;             // parsed result owned by the source
+};
+
+uint64_t collector_now_ns(void);
+
+bool collector_open(Collector* c);
+void collector_close(Collector* c);
+bool collector_read(Collector* c);
+long collector_getdents(int dirfd, char* buffer, size_t size);
+
+void collector_wait(Collector* const* collectors, size_t no_collectors);
+size_t collector_run_due(Collector* const* collectors, size_t no_collectors);
+size_t collector_run_due_batch(Collector* const* collectors, size_t no_collectors, IoBatch* batch);
+
+#endif //CPU_USAGE_TRACKER_COLLECTOR_H
@@ -0,0 +1,398 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdbool.h>
+
+#include "corestats.h"
+
+// Time constants of the moving averages in seconds
+static const double g_ewma_tau[CORESTATS_NO_EWMA] = {60.0, 300.0, 900.0};
+
+static void corestats_update_entry(CoreStats* cs, size_t entry, size_t row);
+
+/**
+ * @return True if every row of the ring holds the newest value of the series - its sums are not kept then.
+ */
+static inline bool corestats_settled(const CoreStats* const cs, const size_t entry)
+{
+    return (cs->unsettled[entry / 64] & (uint64_t)1 << (entry % 64)) == 0;
+}
+
+/**
+ * Creates statistics for no_entries series with sliding window of given length.
+ * Everything is allocated in one block so the memory per core is fixed.
+ * @param no_entries - number of series (no_cpus + 1)
+ * @param window_s - length of the sliding window in seconds
+ * @param min_interval_s - shortest sampling interval, sizes the ring - when samples come faster the oldest ones
+ *                         leave the window early
+ * @return Pointer to the new structure, NULL on error.
+ */
+CoreStats* corestats_create(const size_t no_entries, const double window_s, const double min_interval_s)
+{
+    if(no_entries == 0 || !(window_s > 0) || !(min_interval_s > 0))
+        return NULL;
+
+    CoreStats* const cs = malloc(sizeof(*cs));
+    if(cs == NULL)
+        return NULL;
+
+    // One more row for the timer jitter
+    const size_t capacity = (size_t)ceil(window_s / min_interval_s) + 1;
+    const size_t words = (no_entries + 63) / 64;
+    const size_t ewma_size = sizeof(double) * (no_entries * (CORESTATS_NO_EWMA + 1) + capacity);
+    const size_t sums_size = sizeof(uint64_t) * (no_entries * 3 + words);
+    const size_t hist_size = sizeof(uint32_t) * no_entries * CORESTATS_NO_BUCKETS;
+    const size_t samples_size = sizeof(uint16_t) * no_entries * (capacity + 1);
+    // Biggest alignment first so every array is properly aligned
+    uint8_t* const block = calloc(1, ewma_size + sums_size + hist_size + samples_size);
+    if(block == NULL)
+    {
+        free(cs);
+        return NULL;
+    }
+
+    *cs = (CoreStats){.mutex = PTHREAD_MUTEX_INITIALIZER,
+                      .no_entries = no_entries,
+                      .window_s = window_s,
+                      .capacity = capacity,
+                      .pos = 0,
+                      .filled = 0
+                     };
+    for (size_t k = 0; k < CORESTATS_NO_EWMA; k++)
+        cs->ewma[k] = (double*)(void*)block + k * no_entries;
+    cs->ewma_time = (double*)(void*)block + CORESTATS_NO_EWMA * no_entries;
+    cs->times = cs->ewma_time + no_entries;
+    cs->sum = (uint64_t*)(void*)(block + ewma_size);
+    cs->sum_sq = cs->sum + no_entries;
+    cs->changed_seq = cs->sum_sq + no_entries;
+    cs->unsettled = cs->changed_seq + no_entries;
+    cs->hist = (uint32_t*)(void*)(block + ewma_size + sums_size);
+    cs->samples = (uint16_t*)(void*)(block + ewma_size + sums_size + hist_size);
+    cs->last = cs->samples + no_entries * capacity;
+    // Every series fills its window first
+    for (size_t e = 0; e < no_entries; e++)
+        cs->unsettled[e / 64] |= (uint64_t)1 << (e % 64);
+    return cs;
+}
+
+/**
+ * Frees statistics.
+ * @param cs - statistics to delete
+ */
+void corestats_delete(CoreStats* cs)
+{
+    if(cs == NULL)
+        return;
+    pthread_mutex_destroy(&cs->mutex);
+    free(cs->ewma[0]);  // start of the block
+    free(cs);
+}
+
+/**
+ * Sets the newest value of one series. The moving averages are updated only when the value changed - the average
+ * of a series holding its value is computed from the time of the change when it is read.
+ * @param decay - per moving average, weight of the previous average for this sample
+ * @param prev_time - time of the previous sample
+ */
+static void corestats_set(CoreStats* const cs, const size_t entry, const uint16_t value_bp, const double* const decay,
+                          const double prev_time)
+{
+    const uint16_t bp = value_bp > 10000 ? 10000 : value_bp;
+    if(cs->seq != 0 && bp == cs->last[entry])
+        return;
+    if(corestats_settled(cs, entry))
+    {
+        // Every sample in the window holds the old value
+        const uint16_t old = cs->last[entry];
+        cs->sum[entry] = (uint64_t)old * cs->filled;
+        cs->sum_sq[entry] = (uint64_t)old * old * cs->filled;
+        cs->hist[entry * CORESTATS_NO_BUCKETS + old / 100] = (uint32_t)cs->filled;
+    }
+    const double x = (double)bp / 100;
+    const double held = (double)cs->last[entry] / 100;
+    for (size_t k = 0; k < CORESTATS_NO_EWMA; k++)
+    {
+        if(cs->seq == 0)
+        {
+            cs->ewma[k][entry] = x;
+            continue;
+        }
+        double ewma = cs->ewma[k][entry];
+        // Decay towards the held value since the last change - nothing to do if it changed in the previous sample
+        if(cs->ewma_time[entry] != prev_time)
+            ewma = held + (ewma - held) * exp((cs->ewma_time[entry] - prev_time) / g_ewma_tau[k]);
+        cs->ewma[k][entry] = x + (ewma - x) * decay[k];
+    }
+    cs->ewma_time[entry] = cs->time_s;
+    cs->last[entry] = bp;
+    cs->changed_seq[entry] = cs->seq;
+    cs->unsettled[entry / 64] |= (uint64_t)1 << (entry % 64);
+}
+
+/**
+ * Adds the newest value of one series to its window.
+ */
+static void corestats_update_entry(CoreStats* const cs, const size_t entry, const size_t row)
+{
+    const uint16_t bp = cs->last[entry];
+    cs->samples[row * cs->no_entries + entry] = bp;
+    cs->sum[entry] += bp;
+    cs->sum_sq[entry] += (uint64_t)bp * bp;
+    cs->hist[entry * CORESTATS_NO_BUCKETS + bp / 100]++;
+}
+
+/**
+ * Removes one row from the windows of the unsettled series - the settled ones have nothing to update.
+ */
+static void corestats_evict(CoreStats* const cs, const size_t row)
+{
+    const uint16_t* const samples = &cs->samples[row * cs->no_entries];
+    for (size_t w = 0; w < (cs->no_entries + 63) / 64; w++)
+    {
+        for (uint64_t bits = cs->unsettled[w]; bits != 0; bits &= bits - 1)
+        {
+            const size_t entry = w * 64 + (size_t)__builtin_ctzll(bits);
+            const uint16_t old = samples[entry];
+            cs->sum[entry] -= old;
+            cs->sum_sq[entry] -= (uint64_t)old * old;
+            cs->hist[entry * CORESTATS_NO_BUCKETS + old / 100]--;
+        }
+    }
+}
+
+/**
+ * Starts a sample - advances the time, computes the weights of the moving averages.
+ * @return Time of the previous sample.
+ */
+static double corestats_begin(CoreStats* const cs, const double interval_s, double* const decay)
+{
+    for (size_t k = 0; k < CORESTATS_NO_EWMA; k++)
+        decay[k] = exp(-interval_s / g_ewma_tau[k]);
+    const double prev_time = cs->time_s;
+    cs->time_s = prev_time + interval_s;
+    return prev_time;
+}
+
+/**
+ * Finishes a sample - samples older than the window leave it, the windows of the series that changed within
+ * the last capacity samples move, the others already hold their value in every row.
+ */
+static void corestats_end(CoreStats* const cs)
+{
+    // The oldest row also leaves when the ring is full - samples came faster than the shortest interval
+    while(cs->filled != 0)
+    {
+        const size_t oldest = (cs->pos + cs->capacity - cs->filled) % cs->capacity;
+        if(cs->filled < cs->capacity && cs->time_s - cs->times[oldest] < cs->window_s)
+            break;
+        corestats_evict(cs, oldest);
+        cs->filled--;
+    }
+    const size_t row = cs->pos;
+    cs->times[row] = cs->time_s;
+    for (size_t w = 0; w < (cs->no_entries + 63) / 64; w++)
+    {
+        for (uint64_t bits = cs->unsettled[w]; bits != 0; bits &= bits - 1)
+        {
+            const size_t entry = w * 64 + (size_t)__builtin_ctzll(bits);
+            corestats_update_entry(cs, entry, row);
+            if(cs->seq + 1 - cs->changed_seq[entry] >= cs->capacity)
+                cs->unsettled[w] &= ~((uint64_t)1 << (entry % 64));
+        }
+    }
+    cs->pos = (cs->pos + 1) % cs->capacity;
+    cs->filled++;
+    cs->seq++;
+}
+
+/**
+ * Adds new sample of every series.
+ * @param cs - statistics
+ * @param total_bp - total usage in basis points
+ * @param cores_bp - usage of every core in basis points, no_entries - 1 values
+ * @param interval_s - time since previous sample in seconds
+ */
+void corestats_push(CoreStats* restrict const cs, const uint16_t total_bp, const uint16_t* restrict const cores_bp,
+                    const double interval_s)
+{
+    if(cs == NULL || cores_bp == NULL)
+        return;
+
+    double decay[CORESTATS_NO_EWMA];
+    pthread_mutex_lock(&cs->mutex);
+    const double prev_time = corestats_begin(cs, interval_s, decay);
+    corestats_set(cs, 0, total_bp, decay, prev_time);
+    for (size_t j = 1; j < cs->no_entries; j++)
+        corestats_set(cs, j, cores_bp[j - 1], decay, prev_time);
+    corestats_end(cs);
+    pthread_mutex_unlock(&cs->mutex);
+}
+
+/**
+ * Adds a sparse sample - only the cores in changed have new values, the other cores repeat their previous ones.
+ * Costs O(1) per core changed within the window.
+ * @param changed - (no_entries + 62) / 64 words, bit j set if core j changed
+ * @param values - values of the changed cores in the order of the bits
+ */
+void corestats_push_delta(CoreStats* restrict const cs, const uint16_t total_bp, const uint64_t* restrict const changed,
+                          const uint16_t* restrict const values, const double interval_s)
+{
+    if(cs == NULL || changed == NULL || values == NULL)
+        return;
+
+    double decay[CORESTATS_NO_EWMA];
+    pthread_mutex_lock(&cs->mutex);
+    const double prev_time = corestats_begin(cs, interval_s, decay);
+    corestats_set(cs, 0, total_bp, decay, prev_time);
+    size_t i = 0;
+    for (size_t w = 0; w < (cs->no_entries + 62) / 64; w++)
+    {
+        for (uint64_t bits = changed[w]; bits != 0; bits &= bits - 1)
+            corestats_set(cs, w * 64 + (size_t)__builtin_ctzll(bits) + 1, values[i++], decay, prev_time);
+    }
+    corestats_end(cs);
+    pthread_mutex_unlock(&cs->mutex);
+}
+
+/**
+ * @param which - 0 for 1 minute, 1 for 5 minutes and 2 for 15 minutes average
+ * @return Exponentially weighted moving average of the series in %.
+ */
+double corestats_ewma(CoreStats* const cs, const size_t entry, const size_t which)
+{
+    if(cs == NULL || entry >= cs->no_entries || which >= CORESTATS_NO_EWMA)
+        return 0;
+    pthread_mutex_lock(&cs->mutex);
+    // Decayed towards the newest value since it was set
+    const double held = (double)cs->last[entry] / 100;
+    const double ret = held + (cs->ewma[which][entry] - held) * exp((cs->ewma_time[entry] - cs->time_s) / g_ewma_tau[which]);
+    pthread_mutex_unlock(&cs->mutex);
+    return ret;
+}
+
+/**
+ * @return Mean of the series over the sliding window in %.
+ */
+double corestats_mean(CoreStats* const cs, const size_t entry)
+{
+    if(cs == NULL || entry >= cs->no_entries)
+        return 0;
+    pthread_mutex_lock(&cs->mutex);
+    double ret = 0;
+    if(cs->filled != 0)
+        ret = corestats_settled(cs, entry) ? (double)cs->last[entry] / 100 :
+              (double)cs->sum[entry] / (double)cs->filled / 100;
+    pthread_mutex_unlock(&cs->mutex);
+    return ret;
+}
+
+/**
+ * @return Standard deviation of the series over the sliding window in %.
+ */
+double corestats_stddev(CoreStats* const cs, const size_t entry)
+{
+    if(cs == NULL || entry >= cs->no_entries)
+        return 0;
+    pthread_mutex_lock(&cs->mutex);
+    double var = 0;
+    if(cs->filled != 0 && !corestats_settled(cs, entry))
+    {
+        // Sums are exact integers so there is no drift from removing old samples
+        const double n = (double)cs->filled;
+        const double mean = (double)cs->sum[entry] / n;
+        var = (double)cs->sum_sq[entry] / n - mean * mean;
+    }
+    pthread_mutex_unlock(&cs->mutex);
+    return var > 0 ? sqrt(var) / 100 : 0;
+}
+
+/**
+ * @param p - percentile, 0 - 100
+ * @return p-th percentile of the series over the sliding window in % with 1% resolution.
+ */
+double corestats_percentile(CoreStats* const cs, const size_t entry, const double p)
+{
+    if(cs == NULL || entry >= cs->no_entries)
+        return 0;
+    pthread_mutex_lock(&cs->mutex);
+    double ret = 0;
+    if(!corestats_settled(cs, entry))
+        ret = corestats_hist_percentile(&cs->hist[entry * CORESTATS_NO_BUCKETS], p);
+    else if(cs->filled != 0)
+        ret = (double)(cs->last[entry] / 100);
+    pthread_mutex_unlock(&cs->mutex);
+    return ret;
+}
+
+/**
+ * Averages the newest samples of a group of series, e.g. for a sparkline of a row of cores.
+ * @param entries - series to average, no_entries of them
+ * @param out - array for max averages in basis points, oldest first
+ * @return Number of averages written, at most the number of samples in the window.
+ */
+size_t corestats_history_mean(CoreStats* restrict const cs, const size_t* restrict const entries, const size_t no_entries,
+                              uint16_t* restrict const out, const size_t max)
+{
+    if(cs == NULL || entries == NULL || out == NULL || no_entries == 0)
+        return 0;
+    pthread_mutex_lock(&cs->mutex);
+    const size_t n = cs->filled < max ? cs->filled : max;
+    for (size_t i = 0; i < n; i++)
+    {
+        // pos is the next row to overwrite - the newest sample is just before it
+        const uint16_t* const row = &cs->samples[((cs->pos + cs->capacity - n + i) % cs->capacity) * cs->no_entries];
+        uint64_t sum = 0;
+        for (size_t e = 0; e < no_entries; e++)
+            sum += entries[e] < cs->no_entries ? row[entries[e]] : 0;
+        out[i] = (uint16_t)(sum / no_entries);
+    }
+    pthread_mutex_unlock(&cs->mutex);
+    return n;
+}
+
+/**
+ * Adds histogram of one series to dst. Histograms of many cores (or many hosts) can be merged this way
+ * and queried with corestats_hist_percentile.
+ * @param dst - CORESTATS_NO_BUCKETS counters
+ */
+void corestats_hist_merge(uint32_t* restrict const dst, CoreStats* restrict const cs, const size_t entry)
+{
+    if(dst == NULL || cs == NULL || entry >= cs->no_entries)
+        return;
+    pthread_mutex_lock(&cs->mutex);
+    const uint32_t* const src = &cs->hist[entry * CORESTATS_NO_BUCKETS];
+    if(corestats_settled(cs, entry))
+        dst[cs->last[entry] / 100] += (uint32_t)cs->filled;
+    else
+    {
+        for (size_t b = 0; b < CORESTATS_NO_BUCKETS; b++)
+            dst[b] += src[b];
+    }
+    pthread_mutex_unlock(&cs->mutex);
+}
+
+/**
+ * @param hist - CORESTATS_NO_BUCKETS counters
+ * @param p - percentile, 0 - 100
+ * @return p-th percentile of the histogram in %. 0 for empty histogram.
+ */
+double corestats_hist_percentile(const uint32_t* const hist, const double p)
+{
+    uint64_t count = 0;
+    for (size_t b = 0; b < CORESTATS_NO_BUCKETS; b++)
+        count += hist[b];
+    if(count == 0)
+        return 0;
+
+    uint64_t rank = (uint64_t)ceil(p / 100 * (double)count);
+    if(rank == 0)
+        rank = 1;
+    uint64_t seen = 0;
+    for (size_t b = 0; b < CORESTATS_NO_BUCKETS; b++)
+    {
+        seen += hist[b];
+        if(seen >= rank)
+            return (double)b;
+    }
+    return 100;
+}
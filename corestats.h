@@ -0,0 +1,61 @@
+
+#ifndef CPU_USAGE_TRACKER_CORESTATS_H
+#define CPU_USAGE_TRACKER_CORESTATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#define CORESTATS_NO_EWMA 3         // 1, 5 and 15 minute time constants - like load average
+#define CORESTATS_NO_BUCKETS 101    // 1% wide histogram buckets, 100% has its own bucket
+#define CORESTATS_DEFAULT_WINDOW_S 300.0    // 5 minutes
+
+/**
+ * Incremental per-core statistics. Every array is laid out SoA with the same indexing as the analyzer's
+ * prev_total/prev_idle arrays - index 0 is the total, index j+1 is core j.
+ * The window is a span of time - a sample leaves it when it gets older than window_s, however many samples came
+ * since, so the statistics cover the same time when the sampling interval changes.
+ * All memory is allocated once in corestats_create. A sample costs O(1) per series that changed within the
+ * window - a series that held one value for the whole ring is not touched, its statistics follow from its value
+ * and its moving averages decay lazily.
+ */
+typedef struct CoreStats{
+    pthread_mutex_t mutex;  // analyzer updates while printer reads
+    size_t no_entries;  // no_cpus + 1
+    double window_s;    // length of the sliding window in seconds
+    size_t capacity;    // rows of the ring - samples of the window at the shortest interval
+    size_t pos;         // next ring row to overwrite
+    size_t filled;      // samples currently in the window, the rows just before pos
+    uint64_t seq;       // samples pushed
+    double time_s;      // time of the newest sample in seconds since the first one
+    double* ewma[CORESTATS_NO_EWMA];    // [no_entries] exponentially weighted moving averages in % at ewma_time
+    double* ewma_time;  // [no_entries] time of the last change of the series
+    uint16_t* last;     // [no_entries] newest sample in basis points
+    uint64_t* changed_seq;  // [no_entries] sample number of the last change of the series
+    uint64_t* unsettled;    // [(no_entries + 63) / 64] bit set if the ring of the series holds different values
+    double* times;      // [capacity] time of every ring row
+    uint16_t* samples;  // [capacity][no_entries] ring of samples in basis points (0.01%)
+    uint64_t* sum;      // [no_entries] sum of samples in the window, kept for unsettled series only
+    uint64_t* sum_sq;   // [no_entries] sum of squared samples in the window, kept for unsettled series only
+    uint32_t* hist;     // [no_entries][CORESTATS_NO_BUCKETS] histogram of samples in the window, unsettled only
+} CoreStats;
+
+CoreStats* corestats_create(size_t no_entries, double window_s, double min_interval_s);
+void corestats_delete(CoreStats* cs);
+
+void corestats_push(CoreStats* restrict cs, uint16_t total_bp, const uint16_t* restrict cores_bp, double interval_s);
+void corestats_push_delta(CoreStats* restrict cs, uint16_t total_bp, const uint64_t* restrict changed,
+                          const uint16_t* restrict values, double interval_s);
+
+double corestats_ewma(CoreStats* cs, size_t entry, size_t which);
+double corestats_mean(CoreStats* cs, size_t entry);
+double corestats_stddev(CoreStats* cs, size_t entry);
+double corestats_percentile(CoreStats* cs, size_t entry, double p);
+
+size_t corestats_history_mean(CoreStats* restrict cs, const size_t* restrict entries, size_t no_entries,
+                              uint16_t* restrict out, size_t max);
+
+void corestats_hist_merge(uint32_t* restrict dst, CoreStats* restrict cs, size_t entry);
+double corestats_hist_percentile(const uint32_t* hist, double p);
+
+#endif //CPU_USAGE_TRACKER_CORESTATS_H
@@ -0,0 +1,359 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "cpufreq.h"
+
+enum{CPUFREQ_VALUE_SIZE = 32};
+enum{CPUFREQ_FD_MARGIN = 256};  // fds left for everything else when the limit is raised
+
+/**
+ *  PER-CPU ARRAYS ARE FLAT - [cpu] OR [cpu * CPUFREQ_MAX_STATES + state].
+ *  SYSFS FILES ARE OPENED ONCE RELATIVE TO /sys/devices/system/cpu AND REREAD WITH PREAD, SO A TICK IS
+ *  no_cpus * (1 + no_states) SMALL READS WITHOUT PATH LOOKUPS OR ALLOCATIONS. WITH THE READER'S IoBatch THEY ARE
+ *  QUEUED BY cpufreq_queue AND DONE BY THE SAME SUBMIT AS THE OTHER COLLECTORS. VALUES ARE READ INTO SCRATCH
+ *  ARRAYS AND PUBLISHED WITH ONE COPY UNDER THE MUTEX.
+ */
+struct CpuFreq{
+    pthread_mutex_t mutex;  // protects cur_khz and residency_bp - read by printer
+    size_t no_cpus;
+    size_t no_states;       // idle states of cpu0
+    char state_names[CPUFREQ_MAX_STATES][CPUFREQ_NAME_LEN];
+    bool available;         // at least one file was opened
+    uint64_t last_ns;
+    int* freq_fds;          // [no_cpus] scaling_cur_freq, -1 if not available
+    int* idle_fds;          // [no_cpus][CPUFREQ_MAX_STATES] stateK/time, -1 if not available
+    IoBatch* batch;         // engine the slots below belong to, NULL before the first batched tick
+    bool batched;           // reads of the running tick are in the batch
+    int* freq_slots;        // [no_cpus] slot of freq_fds in the batch, -1 if not added
+    int* idle_slots;        // [no_cpus][CPUFREQ_MAX_STATES] slot of idle_fds
+    uint32_t* max_khz;      // [no_cpus] cpuinfo_max_freq, read once
+    uint64_t* idle_us;      // [no_cpus][CPUFREQ_MAX_STATES] counters from previous tick
+    uint32_t* next_khz;     // scratch of the running tick
+    uint16_t* next_bp;
+    uint32_t* cur_khz;      // published
+    uint16_t* residency_bp;
+};
+
+/**
+ * Rereads a sysfs file holding one number.
+ * @return False if the file is not open or could not be parsed.
+ */
+static bool cpufreq_pread_u64(const int fd, uint64_t* const value)
+{
+    char buf[CPUFREQ_VALUE_SIZE];
+    if(fd < 0)
+        return false;
+    const ssize_t n = pread(fd, buf, sizeof(buf) - 1, 0);
+    if(n <= 0)
+        return false;
+    buf[n] = '\0';
+    char* end;
+    *value = strtoull(buf, &end, 10);
+    return end != buf;
+}
+
+/**
+ * Value of one file in the running tick - from the batch if it was queued there, otherwise by pread.
+ * @return False if the file is not open or could not be parsed.
+ */
+static bool cpufreq_read_u64(const CpuFreq* const cf, const int fd, const int slot, uint64_t* const value)
+{
+    if(!cf->batched || slot < 0)
+        return cpufreq_pread_u64(fd, value);
+    const char* data;
+    if(iobatch_result(cf->batch, slot, &data) <= 0)
+        return false;
+    char* end;
+    *value = strtoull(data, &end, 10);
+    return end != data;
+}
+
+/**
+ * Reads a file that does not change while the program runs.
+ * @return Number of bytes read into buf (null terminated), 0 on error.
+ */
+static size_t cpufreq_read_once(const int dirfd, const char* const path, char* const buf, const size_t size)
+{
+    const int fd = openat(dirfd, path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+        return 0;
+    const ssize_t n = pread(fd, buf, size - 1, 0);
+    close(fd);
+    buf[n > 0 ? n : 0] = '\0';
+    return n > 0 ? (size_t)n : 0;
+}
+
+/**
+ * Hundreds of cpus with several idle states each need thousands of fds - soft limit is raised to the hard one.
+ */
+static void cpufreq_raise_fd_limit(const size_t no_fds)
+{
+    struct rlimit lim;
+    if(getrlimit(RLIMIT_NOFILE, &lim) != 0 || lim.rlim_cur == RLIM_INFINITY ||
+       lim.rlim_cur >= no_fds + CPUFREQ_FD_MARGIN)
+        return;
+    lim.rlim_cur = lim.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &lim);
+}
+
+/**
+ * Opens scaling_cur_freq and the time of every idle state of every cpu. Idle states are the same on every cpu,
+ * their names are taken from cpu0.
+ * @param dirfd - /sys/devices/system/cpu or a tree of the same layout
+ * @return True if at least one file was opened.
+ */
+static bool cpufreq_open_files(CpuFreq* const cf, const int dirfd)
+{
+    char path[64];
+    char buf[CPUFREQ_VALUE_SIZE];
+    for (cf->no_states = 0; cf->no_states < CPUFREQ_MAX_STATES; cf->no_states++)
+    {
+        char* const name = cf->state_names[cf->no_states];
+        snprintf(path, sizeof(path), "cpu0/cpuidle/state%zu/name", cf->no_states);
+        if(cpufreq_read_once(dirfd, path, name, CPUFREQ_NAME_LEN) == 0)
+            break;
+        name[strcspn(name, "\n")] = '\0';
+    }
+    cpufreq_raise_fd_limit(cf->no_cpus * (1 + cf->no_states));
+
+    for (size_t j = 0; j < cf->no_cpus; j++)
+    {
+        snprintf(path, sizeof(path), "cpu%zu/cpufreq/scaling_cur_freq", j);
+        cf->freq_fds[j] = openat(dirfd, path, O_RDONLY | O_CLOEXEC);
+        cf->available |= cf->freq_fds[j] >= 0;
+        snprintf(path, sizeof(path), "cpu%zu/cpufreq/cpuinfo_max_freq", j);
+        if(cpufreq_read_once(dirfd, path, buf, sizeof(buf)) != 0)
+            cf->max_khz[j] = (uint32_t)strtoul(buf, NULL, 10);
+
+        for (size_t k = 0; k < cf->no_states; k++)
+        {
+            const size_t i = j * CPUFREQ_MAX_STATES + k;
+            snprintf(path, sizeof(path), "cpu%zu/cpuidle/state%zu/time", j, k);
+            cf->idle_fds[i] = openat(dirfd, path, O_RDONLY | O_CLOEXEC);
+            cf->available |= cf->idle_fds[i] >= 0;
+            cpufreq_pread_u64(cf->idle_fds[i], &cf->idle_us[i]);
+        }
+    }
+    cf->last_ns = collector_now_ns();
+    return cf->available;
+}
+
+/**
+ * Queue function - adds every per-cpu file to the reader's batch once and queues them all for this tick.
+ */
+static bool cpufreq_queue(Collector* const c, IoBatch* const b)
+{
+    CpuFreq* const cf = c->data;
+    if(cf->batch != b)
+    {
+        for (size_t j = 0; j < cf->no_cpus; j++)
+        {
+            cf->freq_slots[j] = iobatch_add(b, cf->freq_fds[j], CPUFREQ_VALUE_SIZE);
+            for (size_t k = 0; k < cf->no_states; k++)
+            {
+                const size_t i = j * CPUFREQ_MAX_STATES + k;
+                cf->idle_slots[i] = iobatch_add(b, cf->idle_fds[i], CPUFREQ_VALUE_SIZE);
+            }
+        }
+        cf->batch = b;
+    }
+    for (size_t j = 0; j < cf->no_cpus; j++)
+    {
+        iobatch_queue(b, cf->freq_slots[j]);
+        for (size_t k = 0; k < cf->no_states; k++)
+            iobatch_queue(b, cf->idle_slots[j * CPUFREQ_MAX_STATES + k]);
+    }
+    cf->batched = true;
+    return true;
+}
+
+/**
+ * Collector function - rereads frequency and idle time of every cpu and publishes residency since previous tick.
+ */
+static bool cpufreq_collect(Collector* const c)
+{
+    CpuFreq* const cf = c->data;
+    const uint64_t now = collector_now_ns();
+    const uint64_t interval_us = (now - cf->last_ns) / 1000u;
+    cf->last_ns = now;
+
+    for (size_t j = 0; j < cf->no_cpus; j++)
+    {
+        uint64_t value;
+        cf->next_khz[j] = cpufreq_read_u64(cf, cf->freq_fds[j], cf->freq_slots[j], &value) ? (uint32_t)value : 0;
+        for (size_t k = 0; k < cf->no_states; k++)
+        {
+            const size_t i = j * CPUFREQ_MAX_STATES + k;
+            cf->next_bp[i] = 0;
+            if(!cpufreq_read_u64(cf, cf->idle_fds[i], cf->idle_slots[i], &value))
+                continue;
+            if(value >= cf->idle_us[i] && interval_us != 0)
+            {
+                const uint64_t bp = (value - cf->idle_us[i]) * 10000u / interval_us;
+                cf->next_bp[i] = bp > 10000 ? 10000 : (uint16_t)bp;
+            }
+            cf->idle_us[i] = value;
+        }
+    }
+    cf->batched = false;
+    pthread_mutex_lock(&cf->mutex);
+    memcpy(cf->cur_khz, cf->next_khz, sizeof(uint32_t) * cf->no_cpus);
+    memcpy(cf->residency_bp, cf->next_bp, sizeof(uint16_t) * cf->no_cpus * CPUFREQ_MAX_STATES);
+    pthread_mutex_unlock(&cf->mutex);
+    return true;
+}
+
+/**
+ * Creates frequency and idle-state tracker, files are opened by cpufreq_collector_init.
+ * @param no_cpus - number of cpus, cpu0 .. cpuN-1
+ * @return Pointer to the new tracker, NULL on error.
+ */
+CpuFreq* cpufreq_create(const size_t no_cpus)
+{
+    if(no_cpus == 0)
+        return NULL;
+    CpuFreq* const cf = calloc(1, sizeof(*cf));
+    if(cf == NULL)
+        return NULL;
+    const size_t no_slots = no_cpus * CPUFREQ_MAX_STATES;
+    cf->no_cpus = no_cpus;
+    cf->freq_fds = malloc(sizeof(int) * no_cpus);
+    cf->idle_fds = malloc(sizeof(int) * no_slots);
+    cf->freq_slots = malloc(sizeof(int) * no_cpus);
+    cf->idle_slots = malloc(sizeof(int) * no_slots);
+    cf->max_khz = calloc(no_cpus, sizeof(uint32_t));
+    cf->idle_us = calloc(no_slots, sizeof(uint64_t));
+    cf->next_khz = calloc(no_cpus, sizeof(uint32_t));
+    cf->next_bp = calloc(no_slots, sizeof(uint16_t));
+    cf->cur_khz = calloc(no_cpus, sizeof(uint32_t));
+    cf->residency_bp = calloc(no_slots, sizeof(uint16_t));
+    if(cf->freq_fds == NULL || cf->idle_fds == NULL || cf->freq_slots == NULL || cf->idle_slots == NULL ||
+       cf->max_khz == NULL || cf->idle_us == NULL || cf->next_khz == NULL || cf->next_bp == NULL ||
+       cf->cur_khz == NULL || cf->residency_bp == NULL)
+    {
+        free(cf->freq_fds);
+        free(cf->idle_fds);
+        cf->freq_fds = NULL;
+        cf->idle_fds = NULL;
+        cpufreq_delete(cf);
+        return NULL;
+    }
+    for (size_t j = 0; j < no_cpus; j++)
+        cf->freq_fds[j] = cf->freq_slots[j] = -1;
+    for (size_t i = 0; i < no_slots; i++)
+        cf->idle_fds[i] = cf->idle_slots[i] = -1;
+    pthread_mutex_init(&cf->mutex, NULL);
+    return cf;
+}
+
+/**
+ * Closes every cached fd and frees the tracker.
+ */
+void cpufreq_delete(CpuFreq* cf)
+{
+    if(cf == NULL)
+        return;
+    for (size_t j = 0; cf->freq_fds != NULL && j < cf->no_cpus; j++)
+    {
+        if(cf->freq_fds[j] >= 0)
+            close(cf->freq_fds[j]);
+    }
+    for (size_t i = 0; cf->idle_fds != NULL && i < cf->no_cpus * CPUFREQ_MAX_STATES; i++)
+    {
+        if(cf->idle_fds[i] >= 0)
+            close(cf->idle_fds[i]);
+    }
+    pthread_mutex_destroy(&cf->mutex);
+    free(cf->freq_fds);
+    free(cf->idle_fds);
+    free(cf->freq_slots);
+    free(cf->idle_slots);
+    free(cf->max_khz);
+    free(cf->idle_us);
+    free(cf->next_khz);
+    free(cf->next_bp);
+    free(cf->cur_khz);
+    free(cf->residency_bp);
+    free(cf);
+}
+
+/**
+ * Sets up cpufreq/cpuidle collector. Its fd is the sysfs cpu directory, every per-cpu file is opened here.
+ * @param root - CPUFREQ_SYSFS_ROOT or a tree of the same layout, has to outlive the collector
+ * @param interval_ms - sampling interval - residencies and frequencies are of the same period as the usage
+ * @return True if cpufreq or cpuidle is available.
+ */
+bool cpufreq_collector_init(Collector* const c, CpuFreq* const cf, const char* const root, const uint32_t interval_ms)
+{
+    *c = (Collector){.name = "cpufreq",
+                     .path = root,
+                     .interval_ms = interval_ms,
+                     .collect = cpufreq_collect,
+                     .queue = cpufreq_queue,
+                     .fd = -1,
+                     .event_fd = -1,
+                     .data = cf
+                    };
+    if(cf == NULL || !collector_open(c))
+        return false;
+    if(!cpufreq_open_files(cf, c->fd))
+    {
+        collector_close(c);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @return Number of idle states tracked on every cpu.
+ */
+size_t cpufreq_no_states(const CpuFreq* const cf)
+{
+    return cf == NULL ? 0 : cf->no_states;
+}
+
+/**
+ * @return Name of the idle state (e.g. C6), "" if there is no such state.
+ */
+const char* cpufreq_state_name(const CpuFreq* const cf, const size_t state)
+{
+    return cf == NULL || state >= cf->no_states ? "" : cf->state_names[state];
+}
+
+/**
+ * Copies frequency and idle-state residency of one cpu measured by the latest tick.
+ * @return False if the cpu does not exist or neither cpufreq nor cpuidle is available.
+ */
+bool cpufreq_get_core(CpuFreq* const cf, const size_t cpu, CpuFreqCore* const out)
+{
+    if(cf == NULL || out == NULL || cpu >= cf->no_cpus || !cf->available)
+        return false;
+    out->max_khz = cf->max_khz[cpu];
+    pthread_mutex_lock(&cf->mutex);
+    out->cur_khz = cf->cur_khz[cpu];
+    memcpy(out->residency_bp, &cf->residency_bp[cpu * CPUFREQ_MAX_STATES], sizeof(out->residency_bp));
+    pthread_mutex_unlock(&cf->mutex);
+    return true;
+}
+
+/**
+ * Copies frequencies of every cpu measured by the latest tick.
+ * @param cur_khz - array for no_cpus current frequencies, 0 where cpufreq is not available
+ * @param max_khz - array for no_cpus maximal frequencies
+ * @return False if neither cpufreq nor cpuidle is available.
+ */
+bool cpufreq_get_khz(CpuFreq* const cf, uint32_t* restrict const cur_khz, uint32_t* restrict const max_khz)
+{
+    if(cf == NULL || cur_khz == NULL || max_khz == NULL || !cf->available)
+        return false;
+    memcpy(max_khz, cf->max_khz, sizeof(uint32_t) * cf->no_cpus);
+    pthread_mutex_lock(&cf->mutex);
+    memcpy(cur_khz, cf->cur_khz, sizeof(uint32_t) * cf->no_cpus);
+    pthread_mutex_unlock(&cf->mutex);
+    return true;
+}
@@ -0,0 +1,33 @@
+
+#ifndef CPU_USAGE_TRACKER_CPUFREQ_H
+#define CPU_USAGE_TRACKER_CPUFREQ_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "collector.h"
+
+#define CPUFREQ_MAX_STATES 10   // cpuidle states tracked per cpu
+#define CPUFREQ_NAME_LEN 16
+#define CPUFREQ_SYSFS_ROOT "/sys/devices/system/cpu"
+
+// Frequency and idle-state residency of one cpu since previous tick
+typedef struct CpuFreqCore{
+    uint32_t cur_khz;       // scaling_cur_freq, 0 if cpufreq is not available
+    uint32_t max_khz;       // cpuinfo_max_freq
+    uint16_t residency_bp[CPUFREQ_MAX_STATES];  // share of the interval spent in every idle state, basis points
+} CpuFreqCore;
+
+typedef struct CpuFreq CpuFreq;   // Forward declaration
+
+CpuFreq* cpufreq_create(size_t no_cpus);
+void cpufreq_delete(CpuFreq* cf);
+
+bool cpufreq_collector_init(Collector* c, CpuFreq* cf, const char* root, uint32_t interval_ms);
+
+size_t cpufreq_no_states(const CpuFreq* cf);
+const char* cpufreq_state_name(const CpuFreq* cf, size_t state);
+bool cpufreq_get_core(CpuFreq* cf, size_t cpu, CpuFreqCore* out);
+bool cpufreq_get_khz(CpuFreq* cf, uint32_t* restrict cur_khz, uint32_t* restrict max_khz);
+
+#endif //CPU_USAGE_TRACKER_CPUFREQ_H
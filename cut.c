@@ -0,0 +1,181 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "cut.h"
+#include "reader.h"
+#include "sysload.h"
+#include "collector.h"
+#include "trace.h"
+
+struct CutContext{
+    size_t no_cpus;
+    ReaderProcStat stat;
+    SchedStat sched;
+    SysLoad sys;
+    Collector stat_c, loadavg_c, psi_c, sched_c;
+    Collector* sources[3];  // run when due, /proc/stat is read on every sample
+
+    CPURawStats raw;        // latest sample of every source
+    uint64_t last_ns;
+
+    // Previous values - [0] total, [1..no_cpus] cores
+    uint64_t* prev_total;
+    uint64_t* prev_idle;
+    uint64_t* prev_sum;
+    uint64_t* prev_steal;
+    uint64_t* prev_run_delay;   // [no_cpus]
+};
+
+/**
+ * Rereads /proc/stat and every other source that is due, merges them into ctx->raw.
+ * @return False if /proc/stat could not be read.
+ */
+static bool cut_refresh(CutContext* const ctx)
+{
+    TRACE_BEGIN(read_span);
+    if(!collector_read(&ctx->stat_c))
+        return false;
+    TRACE_END(read_span, "read /proc/stat");
+    TRACE_BEGIN(parse_span);
+    if(!ctx->stat_c.parse(&ctx->stat_c))
+        return false;
+    TRACE_END(parse_span, "parse /proc/stat");
+    // Pressure is cheap and its trigger may be the reason of this sample - always fresh
+    ctx->psi_c.next_due_ns = 0;
+    collector_run_due(ctx->sources, sizeof(ctx->sources)/sizeof(ctx->sources[0]));
+
+    ctx->raw.total = ctx->stat.stats.total;
+    memcpy(ctx->raw.cpus, ctx->stat.stats.cpus, sizeof(Stats) * ctx->no_cpus);
+    if(ctx->sys.sources & SYSLOAD_SCHEDSTAT)
+    {
+        for (size_t j = 0; j < ctx->no_cpus; j++)
+            ctx->raw.cpus[j].run_delay = ctx->sched.run_delay[j];
+    }
+    ctx->raw.sys = ctx->sys;
+    return true;
+}
+
+/**
+ * Opens every source and takes the first sample, results of the first cut_sample are relative to it.
+ * @return New context, NULL if /proc/stat is not available or on allocation error.
+ */
+CutContext* cut_open(void)
+{
+    const size_t no_cpus = reader_get_no_cpus();
+    if(no_cpus == 0)
+        return NULL;
+    CutContext* const ctx = malloc(sizeof(*ctx));
+    if(ctx == NULL)
+        return NULL;
+    *ctx = (CutContext){.no_cpus = no_cpus};
+    ctx->raw.cpus = calloc(no_cpus, sizeof(Stats));
+    ctx->prev_total = calloc(4 * (no_cpus + 1) + no_cpus, sizeof(uint64_t));
+    if(ctx->raw.cpus == NULL || ctx->prev_total == NULL)
+        goto error_handler;
+    ctx->prev_idle = ctx->prev_total + no_cpus + 1;
+    ctx->prev_sum = ctx->prev_idle + no_cpus + 1;
+    ctx->prev_steal = ctx->prev_sum + no_cpus + 1;
+    ctx->prev_run_delay = ctx->prev_steal + no_cpus + 1;
+
+    if(!reader_collector_init(&ctx->stat_c, &ctx->stat, no_cpus))
+        goto error_handler;
+    if(sysload_loadavg_init(&ctx->loadavg_c, &ctx->sys.load))
+        ctx->sys.sources |= SYSLOAD_LOADAVG;
+    if(sysload_psi_init(&ctx->psi_c, &ctx->sys.psi, NULL))
+        ctx->sys.sources |= SYSLOAD_PSI;
+    if(sysload_schedstat_init(&ctx->sched_c, &ctx->sched, no_cpus))
+        ctx->sys.sources |= SYSLOAD_SCHEDSTAT;
+    ctx->sources[0] = &ctx->loadavg_c;
+    ctx->sources[1] = &ctx->psi_c;
+    ctx->sources[2] = &ctx->sched_c;
+
+    if(!cut_refresh(ctx))
+    {
+        cut_close(ctx);
+        return NULL;
+    }
+    analyzer_update_prev(ctx->prev_total, ctx->prev_idle, ctx->raw, no_cpus);
+    analyzer_runq_wait(ctx->prev_run_delay, ctx->raw, no_cpus, 1.0);
+    analyzer_steal(&ctx->prev_sum[0], &ctx->prev_steal[0], ctx->raw.total);
+    for (size_t j = 0; j < no_cpus; j++)
+        analyzer_steal(&ctx->prev_sum[j+1], &ctx->prev_steal[j+1], ctx->raw.cpus[j]);
+    ctx->last_ns = collector_now_ns();
+    return ctx;
+
+error_handler:
+    free(ctx->raw.cpus);
+    free(ctx->prev_total);
+    free(ctx);
+    return NULL;
+}
+
+/**
+ * Closes every source and frees the context.
+ */
+void cut_close(CutContext* ctx)
+{
+    if(ctx == NULL)
+        return;
+    reader_collector_destroy(&ctx->stat_c);
+    collector_close(&ctx->loadavg_c);
+    collector_close(&ctx->psi_c);
+    sysload_schedstat_destroy(&ctx->sched_c);
+    free(ctx->raw.cpus);
+    free(ctx->prev_total);
+    free(ctx);
+}
+
+/**
+ * @return Number of cores in every sample.
+ */
+size_t cut_no_cpus(const CutContext* const ctx)
+{
+    return ctx == NULL ? 0 : ctx->no_cpus;
+}
+
+/**
+ * Cpu pressure trigger - becomes ready (POLLPRI) when tasks stall on cpu, so the caller can sample
+ * earlier than its usual interval.
+ * @return File descriptor owned by the context, -1 if pressure triggers are not available.
+ */
+int cut_event_fd(const CutContext* const ctx)
+{
+    return ctx == NULL ? -1 : ctx->psi_c.event_fd;
+}
+
+/**
+ * Takes a new sample and calculates usage since the previous one.
+ * @param out - sample with caller provided buffers, see CutSample
+ * @return CUT_SUCCESS or CUT_ERROR if sources could not be read.
+ */
+CutErrorCode cut_sample(CutContext* const ctx, CutSample* const out)
+{
+    if(ctx == NULL || out == NULL || out->usage.cores_bp == NULL)
+        return CUT_ERROR;
+    if(!cut_refresh(ctx))
+        return CUT_ERROR;
+    const uint64_t now = collector_now_ns();
+    out->timestamp_ns = now;
+    out->interval_s = (double)(now - ctx->last_ns) / 1e9;
+    ctx->last_ns = now;
+
+    const CPURawStats* const raw = &ctx->raw;
+    out->usage.total_bp = analyzer_analyze(&ctx->prev_total[0], &ctx->prev_idle[0], raw->total);
+    for (size_t j = 0; j < ctx->no_cpus; j++)
+        out->usage.cores_bp[j] = analyzer_analyze(&ctx->prev_total[j+1], &ctx->prev_idle[j+1], raw->cpus[j]);
+
+    // Steal counters have to move on every sample, even when caller does not want them
+    const double steal = analyzer_steal(&ctx->prev_sum[0], &ctx->prev_steal[0], raw->total);
+    if(out->steal_pr != NULL)
+        out->steal_pr[0] = steal;
+    for (size_t j = 0; j < ctx->no_cpus; j++)
+    {
+        const double core_steal = analyzer_steal(&ctx->prev_sum[j+1], &ctx->prev_steal[j+1], raw->cpus[j]);
+        if(out->steal_pr != NULL)
+            out->steal_pr[j+1] = core_steal;
+    }
+
+    out->usage.sys = raw->sys;
+    out->usage.runq_wait_ms = analyzer_runq_wait(ctx->prev_run_delay, *raw, ctx->no_cpus, out->interval_s);
+    return CUT_SUCCESS;
+}
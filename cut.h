@@ -0,0 +1,46 @@
+
+#ifndef CPU_USAGE_TRACKER_CUT_H
+#define CPU_USAGE_TRACKER_CUT_H
+
+/**
+ * libcut - synchronous CPU usage sampling for embedding in other programs.
+ * Every context is independent, the library has no global state and starts no threads.
+ * cut_sample allocates nothing - results go to buffers provided by the caller:
+ *
+ *     CutContext* ctx = cut_open();
+ *     uint16_t cores[cut_no_cpus(ctx)];
+ *     CutSample s = {.usage.cores_bp = cores};
+ *     // every interval, e.g. from own timerfd
+ *     if(cut_sample(ctx, &s) == CUT_SUCCESS)
+ *         printf("%.1f%%\n", usage_bp_to_pr(s.usage.total_bp));
+ *     cut_close(ctx);
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include "analyzer.h"
+
+typedef enum{
+    CUT_SUCCESS = 0,
+    CUT_ERROR = 1
+} CutErrorCode;
+
+// Result of one cut_sample call, arrays are owned by the caller
+typedef struct CutSample{
+    uint64_t timestamp_ns;  // CLOCK_MONOTONIC time of the sample
+    double interval_s;      // time since the previous sample (or cut_open)
+    UsagePercentage usage;  // usage.cores_bp - buffer for cut_no_cpus() values
+    double* steal_pr;       // optional buffer for cut_no_cpus()+1 values (total first), NULL if not needed
+} CutSample;
+
+typedef struct CutContext CutContext;   // Forward declaration
+
+CutContext* cut_open(void);
+void cut_close(CutContext* ctx);
+
+size_t cut_no_cpus(const CutContext* ctx);
+int cut_event_fd(const CutContext* ctx);
+
+CutErrorCode cut_sample(CutContext* ctx, CutSample* out);
+
+#endif //CPU_USAGE_TRACKER_CUT_H
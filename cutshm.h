@@ -0,0 +1,136 @@
+
+#ifndef CPU_USAGE_TRACKER_CUTSHM_H
+#define CPU_USAGE_TRACKER_CUTSHM_H
+
+/**
+ * Header-only client of the latest sample published by CUT in POSIX shared memory (--shm NAME).
+ * The segment is protected by a seqlock - readers never block the tracker and do not make any syscalls
+ * after cutshm_open. Usage:
+ *
+ *     CutShmClient client;
+ *     if(cutshm_open(&client, "/cut") == 0)
+ *     {
+ *         double cores[256];
+ *         CutShmSample sample;
+ *         if(cutshm_read(&client, &sample, cores, 256))
+ *             printf("%.1f%%\n", sample.total_pr);
+ *         cutshm_close(&client);
+ *     }
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define CUTSHM_DEFAULT_NAME "/cut"
+#define CUTSHM_MAGIC 0x31545543u   // "CUT1"
+#define CUTSHM_VERSION 2u
+#define CUTSHM_MAX_RETRIES 1000
+
+// Layout of the shared segment, followed by no_cpus doubles
+typedef struct CutShmHeader{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t no_cpus;
+    uint32_t reserved;
+    _Atomic uint64_t seq;   // seqlock - odd while the tracker writes
+    uint64_t sample_no;     // number of the sample, starts from 1
+    uint64_t timestamp_ns;  // CLOCK_REALTIME of the sample
+    double total_pr;
+    double effective_pr;    // total usage scaled by the current frequency of the cores
+    double cores_pr[];
+} CutShmHeader;
+
+// Consistent copy of the header fields
+typedef struct CutShmSample{
+    uint64_t sample_no;
+    uint64_t timestamp_ns;
+    uint32_t no_cpus;
+    double total_pr;
+    double effective_pr;
+} CutShmSample;
+
+typedef struct CutShmClient{
+    const CutShmHeader* hdr;
+    size_t map_size;
+} CutShmClient;
+
+/**
+ * Maps the segment read-only.
+ * @param name - shared memory name given to CUT, e.g. "/cut"
+ * @return 0 on success, -1 if segment does not exist or has unknown layout.
+ */
+static inline int cutshm_open(CutShmClient* const client, const char* const name)
+{
+    client->hdr = NULL;
+    const int fd = shm_open(name, O_RDONLY, 0);
+    if(fd < 0)
+        return -1;
+    struct stat st;
+    if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(CutShmHeader))
+    {
+        close(fd);
+        return -1;
+    }
+    void* const map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED)
+        return -1;
+    const CutShmHeader* const hdr = map;
+    if(hdr->magic != CUTSHM_MAGIC || hdr->version != CUTSHM_VERSION ||
+       sizeof(CutShmHeader) + sizeof(double) * hdr->no_cpus > (size_t)st.st_size)
+    {
+        munmap(map, (size_t)st.st_size);
+        return -1;
+    }
+    client->hdr = hdr;
+    client->map_size = (size_t)st.st_size;
+    return 0;
+}
+
+static inline void cutshm_close(CutShmClient* const client)
+{
+    if(client->hdr != NULL)
+        munmap((void*)(uintptr_t)client->hdr, client->map_size);
+    client->hdr = NULL;
+}
+
+/**
+ * Copies the latest sample. Retries while the tracker is in the middle of an update.
+ * @param out - header fields of the sample
+ * @param cores_pr - array for max_cores values, may be NULL
+ * @return False if no sample was published yet or no consistent copy was made.
+ */
+static inline bool cutshm_read(const CutShmClient* const client, CutShmSample* const out, double* const cores_pr,
+                               const size_t max_cores)
+{
+    const CutShmHeader* const hdr = client->hdr;
+    if(hdr == NULL)
+        return false;
+    const size_t n = hdr->no_cpus < max_cores ? hdr->no_cpus : max_cores;
+    for (int i = 0; i < CUTSHM_MAX_RETRIES; i++)
+    {
+        const uint64_t begin = atomic_load_explicit(&hdr->seq, memory_order_acquire);
+        if(begin & 1u)
+            continue;
+        out->sample_no = hdr->sample_no;
+        out->timestamp_ns = hdr->timestamp_ns;
+        out->no_cpus = hdr->no_cpus;
+        out->total_pr = hdr->total_pr;
+        out->effective_pr = hdr->effective_pr;
+        if(cores_pr != NULL)
+            memcpy(cores_pr, hdr->cores_pr, sizeof(double) * n);
+        atomic_thread_fence(memory_order_acquire);
+        if(atomic_load_explicit(&hdr->seq, memory_order_relaxed) == begin)
+            return out->sample_no != 0;
+    }
+    return false;
+}
+
+#endif //CPU_USAGE_TRACKER_CUTSHM_H
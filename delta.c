@@ -0,0 +1,197 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "delta.h"
+
+/**
+ *  SPARSE CORE UPDATES - A BITMAP OF CORES THAT MOVED BEYOND THE THRESHOLD SINCE THEY WERE SENT LAST, AND THE
+ *  VALUES OF THOSE CORES ONLY, PACKED IN THE ORDER OF THE BITS. THE SENDER KEEPS A SHADOW OF WHAT RECEIVERS HAVE,
+ *  SO SMALL MOVES DO NOT ADD UP TO A DRIFT - A CORE IS SENT ONCE IT IS MORE THAN THE THRESHOLD FROM ITS SHADOW.
+ *  RECEIVERS WALK THE SET BITS ONLY, A WORD OF 64 IDLE CORES COSTS ONE TEST.
+ */
+
+/**
+ * Compares new usage with the shadow and packs the cores that moved beyond the threshold.
+ * @param cores_bp - usage of every core
+ * @param shadow_bp - usage receivers have, updated for the sent cores, DELTA_UNKNOWN_BP before the first encode
+ * @param threshold_bp - smallest move that is not sent, 0 - every change is sent
+ * @param changed - DELTA_WORDS(no_cpus) words, bit j set if core j is sent
+ * @param values - no_cpus values, the first (return value) are filled
+ * @return Number of sent cores.
+ */
+size_t delta_encode(const uint16_t* restrict const cores_bp, uint16_t* restrict const shadow_bp, const size_t no_cpus,
+                    const uint16_t threshold_bp, uint64_t* restrict const changed, uint16_t* restrict const values)
+{
+    size_t no_changed = 0;
+    for (size_t w = 0; w < DELTA_WORDS(no_cpus); w++)
+    {
+        const size_t end = (w + 1) * 64 < no_cpus ? (w + 1) * 64 : no_cpus;
+        uint64_t bits = 0;
+        for (size_t j = w * 64; j < end; j++)
+        {
+            // Branchless - the value is always stored, the count moves only for a sent core
+            const uint16_t cur = cores_bp[j];
+            const int diff = (int)cur - (int)shadow_bp[j];
+            const bool moved = diff > threshold_bp || -diff > threshold_bp;
+            bits |= (uint64_t)moved << (j - w * 64);
+            values[no_changed] = cur;
+            no_changed += moved;
+            shadow_bp[j] = moved ? cur : shadow_bp[j];
+        }
+        changed[w] = bits;
+    }
+    return no_changed;
+}
+
+/**
+ * Packs every core from the shadow - lets a receiver that missed updates start over.
+ * @return no_cpus
+ */
+size_t delta_keyframe(const uint16_t* restrict const shadow_bp, const size_t no_cpus, uint64_t* restrict const changed,
+                      uint16_t* restrict const values)
+{
+    for (size_t w = 0; w < DELTA_WORDS(no_cpus); w++)
+    {
+        const size_t bits = no_cpus - w * 64;
+        changed[w] = bits >= 64 ? UINT64_MAX : ((uint64_t)1 << bits) - 1;
+    }
+    memcpy(values, shadow_bp, sizeof(uint16_t) * no_cpus);
+    return no_cpus;
+}
+
+/**
+ * Writes the sent cores into the receiver's state.
+ * @param state_bp - usage of every core, other cores keep their values
+ */
+void delta_apply(uint16_t* restrict const state_bp, const uint64_t* restrict const changed,
+                 const uint16_t* restrict const values, const size_t no_cpus)
+{
+    size_t i = 0;
+    for (size_t w = 0; w < DELTA_WORDS(no_cpus); w++)
+    {
+        for (uint64_t bits = changed[w]; bits != 0; bits &= bits - 1)
+            state_bp[w * 64 + (size_t)__builtin_ctzll(bits)] = values[i++];
+    }
+}
+
+/**
+ * @return False on allocation error.
+ */
+bool delta_copies_init(DeltaCopies* const dc, const size_t no_cpus)
+{
+    if(dc == NULL)
+        return false;
+    *dc = (DeltaCopies){.no_cpus = no_cpus, .no_copies = 0};
+    dc->dirty = calloc(DELTA_MAX_COPIES * DELTA_WORDS(no_cpus), sizeof(uint64_t));
+    return dc->dirty != NULL;
+}
+
+void delta_copies_destroy(DeltaCopies* const dc)
+{
+    if(dc == NULL)
+        return;
+    free(dc->dirty);
+    dc->dirty = NULL;
+}
+
+/**
+ * Marks the cores of an update as stale in every copy.
+ */
+void delta_copies_mark(DeltaCopies* restrict const dc, const uint64_t* restrict const changed)
+{
+    const size_t words = DELTA_WORDS(dc->no_cpus);
+    for (size_t c = 0; c < dc->no_copies; c++)
+    {
+        uint64_t* const dirty = &dc->dirty[c * words];
+        for (size_t w = 0; w < words; w++)
+            dirty[w] |= changed[w];
+    }
+}
+
+/**
+ * Brings a copy up to date - only its stale cores are written. A copy seen the first time is written whole
+ * and tracked from then on.
+ * @param copy - cores of the copy, identified by this address
+ * @param state_bp - current usage of every core
+ */
+void delta_copies_sync(DeltaCopies* restrict const dc, uint16_t* restrict const copy, const uint16_t* restrict const state_bp)
+{
+    const size_t words = DELTA_WORDS(dc->no_cpus);
+    size_t c = 0;
+    while(c < dc->no_copies && dc->copy[c] != copy)
+        c++;
+    if(c == dc->no_copies)
+    {
+        memcpy(copy, state_bp, sizeof(uint16_t) * dc->no_cpus);
+        if(dc->no_copies < DELTA_MAX_COPIES)
+        {
+            dc->copy[dc->no_copies++] = copy;
+            memset(&dc->dirty[c * words], 0, sizeof(uint64_t) * words);
+        }
+        return;
+    }
+    uint64_t* const dirty = &dc->dirty[c * words];
+    for (size_t w = 0; w < words; w++)
+    {
+        for (uint64_t bits = dirty[w]; bits != 0; bits &= bits - 1)
+        {
+            const size_t j = w * 64 + (size_t)__builtin_ctzll(bits);
+            copy[j] = state_bp[j];
+        }
+        dirty[w] = 0;
+    }
+}
+
+/**
+ * @param depth - number of samples remembered, a receiver further behind gets every core
+ * @return False on allocation error.
+ */
+bool delta_log_init(DeltaLog* const dl, const size_t no_cpus, const size_t depth)
+{
+    if(dl == NULL || depth == 0)
+        return false;
+    *dl = (DeltaLog){.no_cpus = no_cpus, .depth = depth};
+    dl->changed = calloc(depth * DELTA_WORDS(no_cpus), sizeof(uint64_t));
+    return dl->changed != NULL;
+}
+
+void delta_log_destroy(DeltaLog* const dl)
+{
+    if(dl == NULL)
+        return;
+    free(dl->changed);
+    dl->changed = NULL;
+}
+
+/**
+ * Records the update of sample seq and packs the cores changed in samples from..seq with their current values.
+ * Sending more cores than changed is harmless - a receiver up to date already gets the values it has.
+ * @param seq - sequence of this sample, encoded into changed by delta_encode
+ * @param from - oldest sample some receiver did not read yet, from <= seq
+ * @param shadow_bp - usage receivers have after this sample
+ * @param changed - update of this sample on input, the union on output
+ * @param values - no_cpus values, the first (return value) are filled
+ * @return Number of packed cores.
+ */
+size_t delta_log_since(DeltaLog* restrict const dl, const uint64_t seq, const uint64_t from,
+                       const uint16_t* restrict const shadow_bp, uint64_t* restrict const changed,
+                       uint16_t* restrict const values)
+{
+    const size_t words = DELTA_WORDS(dl->no_cpus);
+    memcpy(&dl->changed[(seq % dl->depth) * words], changed, sizeof(uint64_t) * words);
+    if(seq - from >= dl->depth)
+        return delta_keyframe(shadow_bp, dl->no_cpus, changed, values);
+    for (uint64_t s = from; s < seq; s++)
+    {
+        const uint64_t* const missed = &dl->changed[(s % dl->depth) * words];
+        for (size_t w = 0; w < words; w++)
+            changed[w] |= missed[w];
+    }
+    size_t no_changed = 0;
+    for (size_t w = 0; w < words; w++)
+    {
+        for (uint64_t bits = changed[w]; bits != 0; bits &= bits - 1)
+            values[no_changed++] = shadow_bp[w * 64 + (size_t)__builtin_ctzll(bits)];
+    }
+    return no_changed;
+}
@@ -0,0 +1,52 @@
+
+#ifndef CPU_USAGE_TRACKER_DELTA_H
+#define CPU_USAGE_TRACKER_DELTA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define DELTA_WORDS(no_cpus) (((no_cpus) + 63) / 64)    // 64-bit words of the changed-core bitmap
+#define DELTA_DEFAULT_THRESHOLD_BP 10   // 0.1% - resolution of the display
+#define DELTA_MAX_COPIES 4
+#define DELTA_UNKNOWN_BP UINT16_MAX     // shadow of a core never sent - the first encode sends every core
+
+/**
+ * Copies of the core state kept by other buffers (e.g. the printer mailbox). Every copy remembers which cores
+ * changed since it was brought up to date last, so bringing it up to date costs the changed cores only.
+ */
+typedef struct DeltaCopies{
+    size_t no_cpus;
+    size_t no_copies;
+    const uint16_t* copy[DELTA_MAX_COPIES];     // cores of the copy, NULL for a free entry
+    uint64_t* dirty;                            // [DELTA_MAX_COPIES][DELTA_WORDS(no_cpus)]
+} DeltaCopies;
+
+/**
+ * Updates of the last depth samples. A receiver that skipped samples is brought up to date by the union of
+ * the updates it missed - the slot it reads next carries every core changed since the receiver read last.
+ */
+typedef struct DeltaLog{
+    size_t no_cpus;
+    size_t depth;
+    uint64_t* changed;                          // [depth][DELTA_WORDS(no_cpus)], sample seq at seq % depth
+} DeltaLog;
+
+size_t delta_encode(const uint16_t* restrict cores_bp, uint16_t* restrict shadow_bp, size_t no_cpus,
+                    uint16_t threshold_bp, uint64_t* restrict changed, uint16_t* restrict values);
+size_t delta_keyframe(const uint16_t* restrict shadow_bp, size_t no_cpus, uint64_t* restrict changed,
+                      uint16_t* restrict values);
+void delta_apply(uint16_t* restrict state_bp, const uint64_t* restrict changed, const uint16_t* restrict values,
+                 size_t no_cpus);
+
+bool delta_copies_init(DeltaCopies* dc, size_t no_cpus);
+void delta_copies_destroy(DeltaCopies* dc);
+void delta_copies_mark(DeltaCopies* restrict dc, const uint64_t* restrict changed);
+void delta_copies_sync(DeltaCopies* restrict dc, uint16_t* restrict copy, const uint16_t* restrict state_bp);
+
+bool delta_log_init(DeltaLog* dl, size_t no_cpus, size_t depth);
+void delta_log_destroy(DeltaLog* dl);
+size_t delta_log_since(DeltaLog* restrict dl, uint64_t seq, uint64_t from, const uint16_t* restrict shadow_bp,
+                       uint64_t* restrict changed, uint16_t* restrict values);
+
+#endif //CPU_USAGE_TRACKER_DELTA_H
@@ -0,0 +1,551 @@
+#define _GNU_SOURCE  // accept4
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "exporter.h"
+#include "logger.h"
+
+enum{EXPORTER_HEADER_RESERVE = 160};    // room for the HTTP header in front of the body
+enum{EXPORTER_REQUEST_SIZE = 1024};
+enum{EXPORTER_MAX_CONNECTIONS = 1024};
+enum{EXPORTER_MAX_EVENTS = 64};
+
+/**
+ * Complete HTTP response rendered by the analyzer. Served by the exporter thread without any copying,
+ * every connection sending it holds a reference.
+ */
+typedef struct Snapshot{
+    size_t capacity;        // size of text
+    const char* response;   // start of the header inside text
+    size_t response_len;
+    unsigned refs;          // only touched by the exporter thread
+    char text[];
+} Snapshot;
+
+typedef struct Connection{
+    int fd;
+    bool listening;
+    const char* out;        // response being sent
+    size_t out_len;
+    size_t sent;
+    Snapshot* snap;         // referenced snapshot, NULL for static responses
+    size_t req_len;
+    char req[EXPORTER_REQUEST_SIZE];
+    struct Connection* prev;
+    struct Connection* next;
+} Connection;
+
+struct Exporter{
+    pthread_t thread;
+    int epoll_fd;
+    int stop_fd;                    // eventfd written by exporter_delete
+    Connection* listeners[2];
+    const char* unix_path;
+    Connection* connections;        // list of open client connections
+    size_t no_connections;
+    int spare_fd;                   // /dev/null, given up out of fds to accept and drop a pending connection
+    bool out_of_fds;                // logged, until a connection is accepted again
+    _Atomic(Snapshot*) pending;     // newest snapshot not yet taken by the exporter thread
+    _Atomic(Snapshot*) spare;       // released snapshot reused by the next publish
+    Snapshot* current;              // snapshot served to new scrapes
+    size_t body_size;               // longest body rendered so far - only touched by the publishing thread
+};
+
+static const char g_not_found[] = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+static const char g_unavailable[] = "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+
+static void* exporter_func(void* args);
+
+typedef struct UsageRender{
+    const UsagePercentage* data;
+    size_t no_cpus;
+} UsageRender;
+
+/**
+ * Renders metrics of a sample in Prometheus text format.
+ * @param ctx - UsageRender
+ * @return Length of the body, size or more if it did not fit.
+ */
+static size_t exporter_render_usage(char* const body, const size_t size, const void* const ctx)
+{
+    const UsagePercentage* const data = ((const UsageRender*)ctx)->data;
+    const size_t no_cpus = ((const UsageRender*)ctx)->no_cpus;
+    size_t len = 0;
+    // Past the end of the buffer the lines are only counted
+#define EXPORTER_APPEND(...) \
+    do { const int n = snprintf(body + (len < size ? len : size), len < size ? size - len : 0, __VA_ARGS__); \
+         if(n > 0) len += (size_t)n; } while(0)
+
+    EXPORTER_APPEND("# HELP cut_cpu_usage_percent CPU usage since the previous sample.\n"
+                    "# TYPE cut_cpu_usage_percent gauge\n"
+                    "cut_cpu_usage_percent{cpu=\"total\"} %.2f\n", usage_bp_to_pr(data->total_bp));
+    // Cores numbered from 1, as printed and named in the alert rules
+    for (size_t j = 0; j < no_cpus; j++)
+        EXPORTER_APPEND("cut_cpu_usage_percent{cpu=\"%zu\"} %.2f\n", j + 1, usage_bp_to_pr(data->cores_bp[j]));
+    EXPORTER_APPEND("# HELP cut_cpu_effective_percent CPU usage scaled by the current frequency of the cores.\n"
+                    "# TYPE cut_cpu_effective_percent gauge\n"
+                    "cut_cpu_effective_percent{cpu=\"total\"} %.2f\n", usage_bp_to_pr(data->effective_bp));
+    for (size_t j = 0; data->effective_cores_bp != NULL && j < no_cpus; j++)
+        EXPORTER_APPEND("cut_cpu_effective_percent{cpu=\"%zu\"} %.2f\n", j + 1,
+                        usage_bp_to_pr(data->effective_cores_bp[j]));
+
+    const SysLoad* const sys = &data->sys;
+    if(sys->sources & SYSLOAD_LOADAVG)
+    {
+        EXPORTER_APPEND("# HELP cut_load_average System load average.\n"
+                        "# TYPE cut_load_average gauge\n"
+                        "cut_load_average{period=\"1m\"} %.2f\n"
+                        "cut_load_average{period=\"5m\"} %.2f\n"
+                        "cut_load_average{period=\"15m\"} %.2f\n",
+                        sys->load.avg[0], sys->load.avg[1], sys->load.avg[2]);
+    }
+    if(sys->sources & SYSLOAD_PSI)
+    {
+        EXPORTER_APPEND("# HELP cut_cpu_pressure_percent Share of time tasks were stalled waiting for cpu.\n"
+                        "# TYPE cut_cpu_pressure_percent gauge\n"
+                        "cut_cpu_pressure_percent{kind=\"some\",window=\"10s\"} %.2f\n"
+                        "cut_cpu_pressure_percent{kind=\"some\",window=\"60s\"} %.2f\n"
+                        "cut_cpu_pressure_percent{kind=\"some\",window=\"300s\"} %.2f\n"
+                        "cut_cpu_pressure_percent{kind=\"full\",window=\"10s\"} %.2f\n"
+                        "cut_cpu_pressure_percent{kind=\"full\",window=\"60s\"} %.2f\n"
+                        "cut_cpu_pressure_percent{kind=\"full\",window=\"300s\"} %.2f\n"
+                        "# HELP cut_cpu_pressure_stall_seconds_total Total time tasks were stalled waiting for cpu.\n"
+                        "# TYPE cut_cpu_pressure_stall_seconds_total counter\n"
+                        "cut_cpu_pressure_stall_seconds_total{kind=\"some\"} %.6f\n"
+                        "cut_cpu_pressure_stall_seconds_total{kind=\"full\"} %.6f\n",
+                        sys->psi.some_avg[0], sys->psi.some_avg[1], sys->psi.some_avg[2],
+                        sys->psi.full_avg[0], sys->psi.full_avg[1], sys->psi.full_avg[2],
+                        (double)sys->psi.some_total / 1e6, (double)sys->psi.full_total / 1e6);
+    }
+    if(sys->sources & SYSLOAD_SCHEDSTAT)
+    {
+        EXPORTER_APPEND("# HELP cut_runqueue_wait_ms_per_second Average run-queue wait per cpu.\n"
+                        "# TYPE cut_runqueue_wait_ms_per_second gauge\n"
+                        "cut_runqueue_wait_ms_per_second %.3f\n", data->runq_wait_ms);
+    }
+#undef EXPORTER_APPEND
+    return len;
+}
+
+/**
+ * Puts the header right in front of the rendered body.
+ * @param len - length of the body
+ */
+static void exporter_frame(Snapshot* const snap, const size_t len)
+{
+    char* const body = snap->text + EXPORTER_HEADER_RESERVE;
+    char header[EXPORTER_HEADER_RESERVE];
+    const int header_len = snprintf(header, sizeof(header), "HTTP/1.1 200 OK\r\n"
+                                                            "Content-Type: text/plain; version=0.0.4\r\n"
+                                                            "Content-Length: %zu\r\n"
+                                                            "Connection: close\r\n\r\n", len);
+    char* const start = body - header_len;
+    memcpy(start, header, (size_t)header_len);
+    snap->response = start;
+    snap->response_len = (size_t)header_len + len;
+}
+
+/**
+ * Renders new sample and swaps it in - never blocks, scrapes in progress keep their old snapshot.
+ * Called by the analyzer after every sample.
+ * @param e - exporter, NULL if disabled
+ * @param data - analyzed sample
+ * @param no_cpus - number of cores in data
+ */
+void exporter_publish(Exporter* const e, const UsagePercentage* const data, const size_t no_cpus)
+{
+    if(data == NULL)
+        return;
+    const UsageRender ctx = {.data = data, .no_cpus = no_cpus};
+    exporter_publish_with(e, 2048 + (no_cpus + 1) * 128, exporter_render_usage, &ctx);
+}
+
+/**
+ * Same as exporter_publish for metrics rendered by the caller (fleet collector).
+ * @param body_size - expected body length, a longer body is rendered again into a bigger snapshot and every
+ * later snapshot is allocated for it
+ * @param render - writes the body, returns its length
+ * @param ctx - passed to render
+ */
+void exporter_publish_with(Exporter* const e, const size_t body_size, const ExporterRender render, const void* const ctx)
+{
+    if(e == NULL || render == NULL)
+        return;
+    size_t needed = EXPORTER_HEADER_RESERVE + (body_size > e->body_size ? body_size : e->body_size);
+    Snapshot* snap = atomic_exchange(&e->spare, NULL);
+    while(1)
+    {
+        if(snap == NULL || snap->capacity < needed)
+        {
+            free(snap);
+            snap = malloc(sizeof(*snap) + needed);
+            if(snap == NULL)
+            {
+                logger_write("Exporter allocation error, metrics not updated", LOG_ERROR);
+                return;
+            }
+            snap->capacity = needed;
+        }
+        const size_t size = snap->capacity - EXPORTER_HEADER_RESERVE;
+        const size_t len = render(snap->text + EXPORTER_HEADER_RESERVE, size, ctx);
+        if(len < size)
+        {
+            exporter_frame(snap, len);
+            break;
+        }
+        e->body_size = len + 1;
+        needed = EXPORTER_HEADER_RESERVE + e->body_size;
+    }
+    snap->refs = 0;
+
+    // Snapshot that was never taken by the exporter thread can be freed right away
+    Snapshot* const old = atomic_exchange(&e->pending, snap);
+    free(old);
+}
+
+/**
+ * Drops a reference held by a connection or by current. Unused snapshot becomes the spare one.
+ */
+static void exporter_release(Exporter* const e, Snapshot* const snap)
+{
+    if(snap == NULL || --snap->refs != 0)
+        return;
+    Snapshot* const old = atomic_exchange(&e->spare, snap);
+    free(old);
+}
+
+static Snapshot* exporter_current(Exporter* const e)
+{
+    Snapshot* const newest = atomic_exchange(&e->pending, NULL);
+    if(newest != NULL)
+    {
+        newest->refs = 1;   // held by current
+        Snapshot* const prev = e->current;
+        e->current = newest;
+        exporter_release(e, prev);
+    }
+    return e->current;
+}
+
+static void exporter_close_connection(Exporter* const e, Connection* const conn)
+{
+    epoll_ctl(e->epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    exporter_release(e, conn->snap);
+    if(conn->prev != NULL)
+        conn->prev->next = conn->next;
+    else
+        e->connections = conn->next;
+    if(conn->next != NULL)
+        conn->next->prev = conn->prev;
+    e->no_connections--;
+    free(conn);
+}
+
+/**
+ * Sends as much of the response as the socket accepts.
+ * @return True when the connection is finished and was closed.
+ */
+static bool exporter_send(Exporter* const e, Connection* const conn)
+{
+    while(conn->sent < conn->out_len)
+    {
+        const ssize_t n = send(conn->fd, conn->out + conn->sent, conn->out_len - conn->sent, MSG_NOSIGNAL);
+        if(n < 0)
+        {
+            if((errno == EAGAIN || errno == EWOULDBLOCK))
+            {
+                struct epoll_event ev = {.events = EPOLLOUT, .data.ptr = conn};
+                epoll_ctl(e->epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev);
+                return false;
+            }
+            break;
+        }
+        conn->sent += (size_t)n;
+    }
+    exporter_close_connection(e, conn);
+    return true;
+}
+
+/**
+ * Reads request until the end of the header, then starts the response.
+ */
+static void exporter_handle_request(Exporter* const e, Connection* const conn)
+{
+    const ssize_t n = recv(conn->fd, conn->req + conn->req_len, sizeof(conn->req) - 1 - conn->req_len, 0);
+    if(n <= 0)
+    {
+        if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return;
+        exporter_close_connection(e, conn);
+        return;
+    }
+    conn->req_len += (size_t)n;
+    conn->req[conn->req_len] = '\0';
+    if(strstr(conn->req, "\r\n\r\n") == NULL && strstr(conn->req, "\n\n") == NULL &&
+       conn->req_len < sizeof(conn->req) - 1)
+        return;     // header not complete yet
+
+    if(strncmp(conn->req, "GET /metrics ", 13) == 0 || strncmp(conn->req, "GET /metrics?", 13) == 0)
+    {
+        Snapshot* const snap = exporter_current(e);
+        if(snap != NULL)
+        {
+            snap->refs++;
+            conn->snap = snap;
+            conn->out = snap->response;
+            conn->out_len = snap->response_len;
+        }
+        else
+        {
+            conn->out = g_unavailable;
+            conn->out_len = sizeof(g_unavailable) - 1;
+        }
+    }
+    else
+    {
+        conn->out = g_not_found;
+        conn->out_len = sizeof(g_not_found) - 1;
+    }
+    exporter_send(e, conn);
+}
+
+static void exporter_accept(Exporter* const e, const Connection* const listener)
+{
+    while(1)
+    {
+        const int fd = accept4(listener->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(fd < 0 && (errno == EMFILE || errno == ENFILE) && e->spare_fd >= 0)
+        {
+            // The pending connection would keep the level-triggered listener readable - drop it instead of spinning
+            if(!e->out_of_fds)
+                logger_write("Exporter out of file descriptors, connections are dropped", LOG_ERROR);
+            e->out_of_fds = true;
+            close(e->spare_fd);
+            const int drop = accept4(listener->fd, NULL, NULL, SOCK_CLOEXEC);
+            e->spare_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+            if(drop < 0)
+                return;
+            close(drop);
+            continue;
+        }
+        if(fd < 0)
+            return;
+        e->out_of_fds = false;
+        Connection* const conn = e->no_connections < EXPORTER_MAX_CONNECTIONS ? calloc(1, sizeof(*conn)) : NULL;
+        if(conn == NULL)
+        {
+            close(fd);
+            continue;
+        }
+        conn->fd = fd;
+        struct epoll_event ev = {.events = EPOLLIN, .data.ptr = conn};
+        if(epoll_ctl(e->epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0)
+        {
+            close(fd);
+            free(conn);
+            continue;
+        }
+        conn->next = e->connections;
+        if(e->connections != NULL)
+            e->connections->prev = conn;
+        e->connections = conn;
+        e->no_connections++;
+    }
+}
+
+/**
+ * Exporter thread function - one epoll loop serving every listener and connection.
+ */
+static void* exporter_func(void* args)
+{
+    Exporter* const e = args;
+    struct epoll_event events[EXPORTER_MAX_EVENTS];
+    while(1)
+    {
+        const int n = epoll_wait(e->epoll_fd, events, EXPORTER_MAX_EVENTS, -1);
+        for (int i = 0; i < n; i++)
+        {
+            if(events[i].data.ptr == NULL)
+                pthread_exit(NULL);     // stop_fd
+            Connection* const conn = events[i].data.ptr;
+            if(conn->listening)
+                exporter_accept(e, conn);
+            else if(events[i].events & (EPOLLERR | EPOLLHUP) && conn->out == NULL)
+                exporter_close_connection(e, conn);
+            else if(conn->out != NULL)
+                exporter_send(e, conn);
+            else
+                exporter_handle_request(e, conn);
+        }
+    }
+}
+
+/**
+ * Removes a socket left at the path by a previous run. Anything else stays - a mistyped path must not delete a file.
+ * @return False if the path exists and is not a socket.
+ */
+static bool exporter_unlink_socket(const char* const path)
+{
+    struct stat st;
+    if(lstat(path, &st) != 0)
+        return errno == ENOENT;
+    if(!S_ISSOCK(st.st_mode))
+        return false;
+    return unlink(path) == 0 || errno == ENOENT;
+}
+
+/**
+ * Creates listening socket and registers it in epoll.
+ * @return True on success.
+ */
+static bool exporter_listen(Exporter* const e, const size_t slot, const int fd, const struct sockaddr* addr, const socklen_t len)
+{
+    if(fd < 0)
+        return false;
+    const int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    Connection* const listener = calloc(1, sizeof(*listener));
+    if(listener == NULL || bind(fd, addr, len) != 0 || listen(fd, 128) != 0)
+    {
+        free(listener);
+        close(fd);
+        return false;
+    }
+    listener->fd = fd;
+    listener->listening = true;
+    struct epoll_event ev = {.events = EPOLLIN, .data.ptr = listener};
+    if(epoll_ctl(e->epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0)
+    {
+        free(listener);
+        close(fd);
+        return false;
+    }
+    e->listeners[slot] = listener;
+    return true;
+}
+
+/**
+ * Starts exporter thread serving /metrics.
+ * @param unix_path - unix socket path, replaced if it is a socket, NULL to disable
+ * @param tcp_port - port on 127.0.0.1, 0 to disable
+ * @return Pointer to the exporter, NULL if disabled or on error.
+ */
+Exporter* exporter_create(const char* const unix_path, const uint16_t tcp_port)
+{
+    if(unix_path == NULL && tcp_port == 0)
+        return NULL;
+    Exporter* const e = calloc(1, sizeof(*e));
+    if(e == NULL)
+        return NULL;
+    atomic_init(&e->pending, NULL);
+    atomic_init(&e->spare, NULL);
+    e->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    e->stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    e->spare_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    if(e->epoll_fd < 0 || e->stop_fd < 0 || e->spare_fd < 0)
+        goto error_handler;
+    struct epoll_event ev = {.events = EPOLLIN, .data.ptr = NULL};
+    if(epoll_ctl(e->epoll_fd, EPOLL_CTL_ADD, e->stop_fd, &ev) != 0)
+        goto error_handler;
+
+    if(unix_path != NULL)
+    {
+        struct sockaddr_un addr = {.sun_family = AF_UNIX};
+        if(strlen(unix_path) >= sizeof(addr.sun_path))
+            goto error_handler;
+        strcpy(addr.sun_path, unix_path);
+        if(!exporter_unlink_socket(unix_path))
+        {
+            logger_write("Exporter socket path exists and is not a socket", LOG_ERROR);
+            goto error_handler;
+        }
+        if(!exporter_listen(e, 0, socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0),
+                            (const struct sockaddr*)&addr, sizeof(addr)))
+        {
+            logger_write("Exporter failed to listen on unix socket", LOG_ERROR);
+            goto error_handler;
+        }
+        e->unix_path = unix_path;
+    }
+    if(tcp_port != 0)
+    {
+        struct sockaddr_in addr = {.sin_family = AF_INET, .sin_port = htons(tcp_port)};
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if(!exporter_listen(e, 1, socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0),
+                            (const struct sockaddr*)&addr, sizeof(addr)))
+        {
+            logger_write("Exporter failed to listen on tcp port", LOG_ERROR);
+            goto error_handler;
+        }
+    }
+    if(pthread_create(&e->thread, NULL, exporter_func, e) != 0)
+        goto error_handler;
+    return e;
+
+    error_handler:
+        for (size_t i = 0; i < 2; i++)
+        {
+            if(e->listeners[i] != NULL)
+            {
+                close(e->listeners[i]->fd);
+                free(e->listeners[i]);
+            }
+        }
+        if(e->unix_path != NULL)
+            unlink(e->unix_path);
+        if(e->epoll_fd >= 0)
+            close(e->epoll_fd);
+        if(e->stop_fd >= 0)
+            close(e->stop_fd);
+        if(e->spare_fd >= 0)
+            close(e->spare_fd);
+        free(e);
+        return NULL;
+}
+
+/**
+ * Stops exporter thread, closes every connection and frees snapshots.
+ */
+void exporter_delete(Exporter* e)
+{
+    if(e == NULL)
+        return;
+    const uint64_t one = 1;
+    if(write(e->stop_fd, &one, sizeof(one)) == sizeof(one))
+        pthread_join(e->thread, NULL);
+
+    while(e->connections != NULL)
+        exporter_close_connection(e, e->connections);
+    for (size_t i = 0; i < 2; i++)
+    {
+        if(e->listeners[i] != NULL)
+        {
+            close(e->listeners[i]->fd);
+            free(e->listeners[i]);
+        }
+    }
+    if(e->unix_path != NULL)
+        unlink(e->unix_path);
+    exporter_release(e, e->current);
+    free(atomic_exchange(&e->pending, NULL));
+    free(atomic_exchange(&e->spare, NULL));
+    close(e->epoll_fd);
+    close(e->stop_fd);
+    if(e->spare_fd >= 0)
+        close(e->spare_fd);
+    free(e);
+}
@@ -0,0 +1,21 @@
+
+#ifndef CPU_USAGE_TRACKER_EXPORTER_H
+#define CPU_USAGE_TRACKER_EXPORTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "analyzer.h"
+
+typedef struct Exporter Exporter;   // Forward declaration
+
+// Writes a metrics body into size bytes, returns its length like snprintf - a length >= size means the body did
+// not fit and is rendered again into a buffer of length + 1 bytes
+typedef size_t (*ExporterRender)(char* body, size_t size, const void* ctx);
+
+Exporter* exporter_create(const char* unix_path, uint16_t tcp_port);
+void exporter_delete(Exporter* e);
+
+void exporter_publish(Exporter* e, const UsagePercentage* data, size_t no_cpus);
+void exporter_publish_with(Exporter* e, size_t body_size, ExporterRender render, const void* ctx);
+
+#endif //CPU_USAGE_TRACKER_EXPORTER_H
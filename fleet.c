@@ -0,0 +1,747 @@
+#define _GNU_SOURCE  // accept4
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+
+#include "fleet.h"
+#include "analyzer.h"
+#include "collector.h"
+#include "corestats.h"
+#include "logger.h"
+
+enum{FLEET_RX_INITIAL = 4096};
+enum{FLEET_MAX_CONNECTIONS = 8192};
+enum{FLEET_MAX_EVENTS = 128};
+enum{FLEET_FD_MARGIN = 64};
+enum{FLEET_LINE_SIZE = 128};
+
+/**
+ *  HOSTS LIVE IN ONE ARRAY OF AT MOST FLEET_MAX_HOSTS, CONNECTIONS REFER TO A HOST BY INDEX. A FORGOTTEN HOST
+ *  (DISCONNECTED AND SILENT) IS REPLACED BY THE LAST ONE - ITS CONNECTIONS ARE MOVED TO THE NEW INDEX AND THE HASH
+ *  IS REBUILT, BOTH RARE.
+ *  slots IS AN OPEN ADDRESSING HASH (LINEAR PROBING, AT MOST HALF FULL) FROM HOST ID TO index + 1, 0 IS EMPTY.
+ *  EVERY CONNECTION HAS ITS OWN RECEIVE BUFFER, FRAMES ARE DECODED IN PLACE ONCE COMPLETE AND APPLIED STRAIGHT
+ *  TO THE TABLE OF THEIR HOST - THE TABLE IS THE PREVIOUS FRAME THE NEXT DELTA IS RELATIVE TO.
+ */
+typedef struct FleetConn{
+    int fd;
+    bool listening;
+    bool need_key;          // deltas are dropped until a key frame arrives
+    size_t host;            // index + 1 of the bound host, 0 before the first frame
+    size_t rx_len;
+    size_t rx_cap;
+    uint8_t* rx;
+    struct FleetConn* prev;
+    struct FleetConn* next;
+} FleetConn;
+
+struct Fleet{
+    int epoll_fd;
+    FleetConn listener;
+    const char* unix_path;
+    FleetConn* connections;
+    size_t no_connections;
+    int spare_fd;           // /dev/null, given up out of fds to accept and drop a pending connection
+    bool out_of_fds;        // logged, until an agent is accepted again
+    FleetHost* hosts;
+    size_t no_hosts;
+    size_t hosts_cap;
+    uint32_t* slots;
+    size_t slots_mask;
+    uint64_t frames;
+    uint64_t bytes;
+    uint64_t expired_ns;    // last look for hosts to forget
+    char* frame;            // terminal frame of fleet_render
+    size_t frame_cap;
+};
+
+static size_t fleet_slot(const uint32_t host_id, const size_t mask)
+{
+    return (size_t)(host_id * 2654435761u) & mask;
+}
+
+/**
+ * @return Index + 1 of the host, 0 if it is not known.
+ */
+static size_t fleet_lookup(const Fleet* const f, const uint32_t host_id)
+{
+    for (size_t s = fleet_slot(host_id, f->slots_mask); f->slots[s] != 0; s = (s + 1) & f->slots_mask)
+    {
+        if(f->hosts[f->slots[s] - 1].host_id == host_id)
+            return f->slots[s];
+    }
+    return 0;
+}
+
+/**
+ * Inserts every host into an empty hash.
+ */
+static void fleet_fill_slots(const Fleet* const f, uint32_t* const slots, const size_t mask)
+{
+    for (size_t i = 0; i < f->no_hosts; i++)
+    {
+        size_t s = fleet_slot(f->hosts[i].host_id, mask);
+        while(slots[s] != 0)
+            s = (s + 1) & mask;
+        slots[s] = (uint32_t)(i + 1);
+    }
+}
+
+/**
+ * Doubles the hash when it would get more than half full.
+ */
+static bool fleet_grow_slots(Fleet* const f)
+{
+    if((f->no_hosts + 1) * 2 <= f->slots_mask + 1)
+        return true;
+    const size_t mask = f->slots_mask * 2 + 1;
+    uint32_t* const slots = calloc(mask + 1, sizeof(uint32_t));
+    if(slots == NULL)
+        return false;
+    fleet_fill_slots(f, slots, mask);
+    free(f->slots);
+    f->slots = slots;
+    f->slots_mask = mask;
+    return true;
+}
+
+/**
+ * Removes a host without connections, the last host takes its index. The hash has to be rebuilt afterwards.
+ */
+static void fleet_forget(Fleet* const f, const size_t i)
+{
+    free(f->hosts[i].values);
+    const size_t last = --f->no_hosts;
+    if(i == last)
+        return;
+    f->hosts[i] = f->hosts[last];
+    if(f->hosts[i].connections == 0)
+        return;
+    for (FleetConn* conn = f->connections; conn != NULL; conn = conn->next)
+    {
+        if(conn->host == last + 1)
+            conn->host = i + 1;
+    }
+}
+
+static void fleet_rebuild_slots(Fleet* const f)
+{
+    memset(f->slots, 0, sizeof(uint32_t) * (f->slots_mask + 1));
+    fleet_fill_slots(f, f->slots, f->slots_mask);
+}
+
+/**
+ * Forgets disconnected hosts silent for FLEET_FORGET_MS, or - when the table is full - the one silent the longest.
+ * @param full - make room for a new host
+ * @return True if a host was forgotten.
+ */
+static bool fleet_expire(Fleet* const f, const uint64_t now, const bool full)
+{
+    bool forgot = false;
+    size_t oldest = SIZE_MAX;
+    for (size_t i = 0; i < f->no_hosts; )
+    {
+        const FleetHost* const host = &f->hosts[i];
+        if(host->connections != 0)
+        {
+            i++;
+            continue;
+        }
+        if(now - host->received_ns >= (uint64_t)FLEET_FORGET_MS * 1000000u)
+        {
+            fleet_forget(f, i);
+            forgot = true;
+            continue;   // the last host moved here
+        }
+        if(oldest == SIZE_MAX || host->received_ns < f->hosts[oldest].received_ns)
+            oldest = i;
+        i++;
+    }
+    if(full && !forgot && oldest != SIZE_MAX)
+    {
+        fleet_forget(f, oldest);
+        forgot = true;
+    }
+    if(forgot)
+        fleet_rebuild_slots(f);
+    return forgot;
+}
+
+/**
+ * Finds the host or adds it to the table with no_cpus zeroed cores. Known host is resized if no_cpus changed.
+ * @return Index + 1 of the host, 0 on allocation failure.
+ */
+static size_t fleet_get_host(Fleet* const f, const uint32_t host_id, const size_t no_cpus)
+{
+    size_t idx = fleet_lookup(f, host_id);
+    if(idx == 0)
+    {
+        if(f->no_hosts == FLEET_MAX_HOSTS && !fleet_expire(f, collector_now_ns(), true))
+        {
+            logger_write("Fleet collector host table is full, agent dropped", LOG_WARNING);
+            return 0;
+        }
+        if(f->no_hosts == f->hosts_cap)
+        {
+            const size_t cap = f->hosts_cap * 2;
+            FleetHost* const hosts = realloc(f->hosts, sizeof(FleetHost) * cap);
+            if(hosts == NULL)
+                return 0;
+            f->hosts = hosts;
+            f->hosts_cap = cap;
+        }
+        if(!fleet_grow_slots(f))
+            return 0;
+        FleetHost* const host = &f->hosts[f->no_hosts];
+        *host = (FleetHost){.host_id = host_id};
+        snprintf(host->name, sizeof(host->name), "host-%u", host_id);
+        size_t s = fleet_slot(host_id, f->slots_mask);
+        while(f->slots[s] != 0)
+            s = (s + 1) & f->slots_mask;
+        idx = ++f->no_hosts;
+        f->slots[s] = (uint32_t)idx;
+    }
+    FleetHost* const host = &f->hosts[idx - 1];
+    if(host->no_cpus != no_cpus)
+    {
+        uint16_t* const values = calloc(no_cpus + 1, sizeof(uint16_t));
+        if(values == NULL)
+            return 0;
+        free(host->values);
+        host->values = values;
+        host->no_cpus = no_cpus;
+    }
+    return idx;
+}
+
+/**
+ * Binds connection to a host - the first frame decides which host the connection streams.
+ */
+static void fleet_bind(Fleet* const f, FleetConn* const conn, const size_t idx)
+{
+    if(conn->host == idx)
+        return;
+    if(conn->host != 0)
+        f->hosts[conn->host - 1].connections--;
+    conn->host = idx;
+    f->hosts[idx - 1].connections++;
+}
+
+/**
+ * Names end up in terminal output and metric labels - anything that is not plain printable ASCII is replaced.
+ */
+static void fleet_set_name(FleetHost* const host, const char* const name)
+{
+    if(name[0] == '\0')
+        return;
+    size_t i = 0;
+    for (; name[i] != '\0' && i < sizeof(host->name) - 1; i++)
+        host->name[i] = name[i] > ' ' && name[i] <= '~' && name[i] != '"' && name[i] != '\\' ? name[i] : '_';
+    host->name[i] = '\0';
+}
+
+/**
+ * Applies one decoded frame to the host table.
+ * @return False if the stream is malformed and the connection has to be closed.
+ */
+static bool fleet_apply(Fleet* const f, FleetConn* const conn, const WireMessage* const msg)
+{
+    if(msg->type == WIRE_HELLO)
+    {
+        const size_t idx = fleet_get_host(f, msg->host_id, msg->no_values);
+        if(idx == 0)
+            return false;
+        fleet_bind(f, conn, idx);
+        fleet_set_name(&f->hosts[idx - 1], msg->name);
+        f->hosts[idx - 1].interval_ms = msg->interval_ms;
+        conn->need_key = true;
+        return true;
+    }
+
+    size_t idx = conn->host;
+    if(idx == 0 || f->hosts[idx - 1].host_id != msg->host_id || f->hosts[idx - 1].no_cpus + 1 != msg->no_values)
+    {
+        if(!msg->key)
+            return true;    // delta against a frame this table does not hold - wait for a key frame
+        idx = fleet_get_host(f, msg->host_id, msg->no_values - 1);
+        if(idx == 0)
+            return false;
+        fleet_bind(f, conn, idx);
+    }
+    if(!msg->key && conn->need_key)
+        return true;
+    FleetHost* const host = &f->hosts[idx - 1];
+    if(!wire_apply_values(msg, host->values, host->no_cpus + 1))
+        return false;
+    conn->need_key = false;
+    host->effective_bp = msg->effective_bp;
+    host->timestamp_ms = msg->key ? msg->timestamp : host->timestamp_ms + msg->timestamp;
+    host->received_ns = collector_now_ns();
+    f->frames++;
+    return true;
+}
+
+static void fleet_close(Fleet* const f, FleetConn* const conn)
+{
+    epoll_ctl(f->epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    if(conn->host != 0)
+        f->hosts[conn->host - 1].connections--;
+    if(conn->prev != NULL)
+        conn->prev->next = conn->next;
+    else
+        f->connections = conn->next;
+    if(conn->next != NULL)
+        conn->next->prev = conn->prev;
+    f->no_connections--;
+    free(conn->rx);
+    free(conn);
+}
+
+/**
+ * Reads what the agent sent and applies every complete frame.
+ */
+static void fleet_receive(Fleet* const f, FleetConn* const conn)
+{
+    while(1)
+    {
+        if(conn->rx_len == conn->rx_cap)
+        {
+            // Only a frame longer than the buffer fills it completely - grow to the announced length
+            const size_t needed = WIRE_HEADER_LEN + ((size_t)conn->rx[0] | (size_t)conn->rx[1] << 8);
+            uint8_t* const rx = needed > conn->rx_cap ? realloc(conn->rx, needed) : NULL;
+            if(rx == NULL)
+            {
+                fleet_close(f, conn);
+                return;
+            }
+            conn->rx = rx;
+            conn->rx_cap = needed;
+        }
+        const ssize_t n = recv(conn->fd, conn->rx + conn->rx_len, conn->rx_cap - conn->rx_len, 0);
+        if(n <= 0)
+        {
+            if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+                return;
+            fleet_close(f, conn);
+            return;
+        }
+        conn->rx_len += (size_t)n;
+        f->bytes += (uint64_t)n;
+
+        size_t off = 0;
+        WireMessage msg;
+        long len;
+        while((len = wire_decode(conn->rx + off, conn->rx_len - off, &msg)) > 0)
+        {
+            if(!fleet_apply(f, conn, &msg))
+                len = -1;
+            if(len < 0)
+                break;
+            off += (size_t)len;
+        }
+        if(len < 0)
+        {
+            logger_write("Fleet collector dropped agent sending malformed frames", LOG_WARNING);
+            fleet_close(f, conn);
+            return;
+        }
+        memmove(conn->rx, conn->rx + off, conn->rx_len - off);
+        conn->rx_len -= off;
+    }
+}
+
+static void fleet_accept(Fleet* const f)
+{
+    while(1)
+    {
+        const int fd = accept4(f->listener.fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(fd < 0 && (errno == EMFILE || errno == ENFILE) && f->spare_fd >= 0)
+        {
+            // The pending agent would keep the level-triggered listener readable - drop it instead of spinning,
+            // it reconnects later
+            if(!f->out_of_fds)
+                logger_write("Fleet collector out of file descriptors, agents are dropped", LOG_ERROR);
+            f->out_of_fds = true;
+            close(f->spare_fd);
+            const int drop = accept4(f->listener.fd, NULL, NULL, SOCK_CLOEXEC);
+            f->spare_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+            if(drop < 0)
+                return;
+            close(drop);
+            continue;
+        }
+        if(fd < 0)
+            return;
+        f->out_of_fds = false;
+        FleetConn* const conn = f->no_connections < FLEET_MAX_CONNECTIONS ? calloc(1, sizeof(*conn)) : NULL;
+        uint8_t* const rx = conn != NULL ? malloc(FLEET_RX_INITIAL) : NULL;
+        struct epoll_event ev = {.events = EPOLLIN, .data.ptr = conn};
+        if(rx == NULL || epoll_ctl(f->epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0)
+        {
+            close(fd);
+            free(rx);
+            free(conn);
+            continue;
+        }
+        *conn = (FleetConn){.fd = fd, .need_key = true, .rx = rx, .rx_cap = FLEET_RX_INITIAL, .next = f->connections};
+        if(f->connections != NULL)
+            f->connections->prev = conn;
+        f->connections = conn;
+        f->no_connections++;
+    }
+}
+
+/**
+ * Hundreds of agents need as many fds - soft limit is raised to the hard one.
+ */
+static void fleet_raise_fd_limit(void)
+{
+    struct rlimit lim;
+    if(getrlimit(RLIMIT_NOFILE, &lim) != 0 || lim.rlim_cur == RLIM_INFINITY ||
+       lim.rlim_cur >= FLEET_MAX_CONNECTIONS + FLEET_FD_MARGIN)
+        return;
+    lim.rlim_cur = lim.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &lim);
+}
+
+/**
+ * Creates collector listening for agents.
+ * @param addr - unix socket path or [HOST:]PORT, see wire_listen
+ * @return Pointer to the collector, NULL on error.
+ */
+Fleet* fleet_create(const char* const addr)
+{
+    if(addr == NULL)
+        return NULL;
+    Fleet* const f = calloc(1, sizeof(*f));
+    if(f == NULL)
+        return NULL;
+    f->listener = (FleetConn){.fd = -1, .listening = true};
+    f->hosts_cap = 64;
+    f->slots_mask = 127;
+    f->hosts = malloc(sizeof(FleetHost) * f->hosts_cap);
+    f->slots = calloc(f->slots_mask + 1, sizeof(uint32_t));
+    f->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    f->spare_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    if(f->hosts == NULL || f->slots == NULL || f->epoll_fd < 0 || f->spare_fd < 0)
+        goto error_handler;
+    fleet_raise_fd_limit();
+    f->listener.fd = wire_listen(addr);
+    struct epoll_event ev = {.events = EPOLLIN, .data.ptr = &f->listener};
+    if(f->listener.fd < 0 || epoll_ctl(f->epoll_fd, EPOLL_CTL_ADD, f->listener.fd, &ev) != 0)
+    {
+        logger_write("Fleet collector failed to listen", LOG_ERROR);
+        goto error_handler;
+    }
+    if(strchr(addr, '/') != NULL)
+        f->unix_path = addr;
+    return f;
+
+    error_handler:
+        if(f->listener.fd >= 0)
+            close(f->listener.fd);
+        if(f->epoll_fd >= 0)
+            close(f->epoll_fd);
+        if(f->spare_fd >= 0)
+            close(f->spare_fd);
+        free(f->hosts);
+        free(f->slots);
+        free(f);
+        return NULL;
+}
+
+void fleet_delete(Fleet* const f)
+{
+    if(f == NULL)
+        return;
+    while(f->connections != NULL)
+        fleet_close(f, f->connections);
+    close(f->listener.fd);
+    close(f->epoll_fd);
+    if(f->spare_fd >= 0)
+        close(f->spare_fd);
+    if(f->unix_path != NULL)
+        unlink(f->unix_path);
+    for (size_t i = 0; i < f->no_hosts; i++)
+        free(f->hosts[i].values);
+    free(f->hosts);
+    free(f->slots);
+    free(f->frame);
+    free(f);
+}
+
+/**
+ * Adds fd (signalfd, timerfd) to the loop - fleet_poll returns when it is readable, reading it is up to the caller.
+ * @return True on success.
+ */
+bool fleet_watch(Fleet* const f, const int fd)
+{
+    struct epoll_event ev = {.events = EPOLLIN, .data.ptr = NULL};
+    return f != NULL && fd >= 0 && epoll_ctl(f->epoll_fd, EPOLL_CTL_ADD, fd, &ev) == 0;
+}
+
+/**
+ * Waits for agents once and handles every ready connection.
+ * @param timeout_ms - longest wait, -1 for none
+ * @return 1 if a watched fd is readable, 0 otherwise, -1 on error.
+ */
+int fleet_poll(Fleet* const f, const int timeout_ms)
+{
+    struct epoll_event events[FLEET_MAX_EVENTS];
+    const int n = epoll_wait(f->epoll_fd, events, FLEET_MAX_EVENTS, timeout_ms);
+    if(n < 0)
+        return errno == EINTR ? 0 : -1;
+    const uint64_t now = collector_now_ns();
+    if(now - f->expired_ns >= 1000000000u)
+    {
+        fleet_expire(f, now, false);
+        f->expired_ns = now;
+    }
+    int ret = 0;
+    for (int i = 0; i < n; i++)
+    {
+        FleetConn* const conn = events[i].data.ptr;
+        if(conn == NULL)
+            ret = 1;
+        else if(conn->listening)
+            fleet_accept(f);
+        else
+            fleet_receive(f, conn);     // EPOLLHUP/EPOLLERR show up as a failing recv
+    }
+    return ret;
+}
+
+size_t fleet_no_hosts(const Fleet* const f)
+{
+    return f == NULL ? 0 : f->no_hosts;
+}
+
+/**
+ * @return Host in the order hosts were first seen - until a host is forgotten, NULL if there is no such host.
+ */
+const FleetHost* fleet_host(const Fleet* const f, const size_t i)
+{
+    return f == NULL || i >= f->no_hosts ? NULL : &f->hosts[i];
+}
+
+const FleetHost* fleet_find(const Fleet* const f, const uint32_t host_id)
+{
+    const size_t idx = f == NULL ? 0 : fleet_lookup(f, host_id);
+    return idx == 0 ? NULL : &f->hosts[idx - 1];
+}
+
+/**
+ * @return True if the host sent a sample within FLEET_STALE_INTERVALS of its advertised interval.
+ */
+static bool fleet_fresh(const FleetHost* const host, const uint64_t now)
+{
+    uint64_t stale_ms = host->interval_ms != 0 ? (uint64_t)host->interval_ms * FLEET_STALE_INTERVALS : FLEET_STALE_MS;
+    stale_ms = stale_ms < FLEET_STALE_MIN_MS ? FLEET_STALE_MIN_MS : stale_ms;
+    return host->received_ns != 0 && now - host->received_ns < stale_ms * 1000000u;
+}
+
+/**
+ * Aggregates latest values of every fresh host - O(hosts * cpus).
+ */
+void fleet_summarize(const Fleet* const f, FleetSummary* const out)
+{
+    *out = (FleetSummary){0};
+    if(f == NULL)
+        return;
+    const uint64_t now = collector_now_ns();
+    uint32_t hist[CORESTATS_NO_BUCKETS] = {0};
+    uint64_t weighted = 0, weighted_effective = 0;
+    uint16_t max_bp = 0;
+    out->no_hosts = f->no_hosts;
+    out->frames = f->frames;
+    out->bytes = f->bytes;
+    for (size_t i = 0; i < f->no_hosts; i++)
+    {
+        const FleetHost* const host = &f->hosts[i];
+        out->no_connected += host->connections != 0;
+        if(!fleet_fresh(host, now))
+            continue;
+        const uint16_t total_bp = host->values[0] > USAGE_FULL_BP ? USAGE_FULL_BP : host->values[0];
+        out->no_fresh++;
+        out->no_cpus += host->no_cpus;
+        weighted += (uint64_t)total_bp * host->no_cpus;
+        weighted_effective += (uint64_t)(host->effective_bp > USAGE_FULL_BP ? USAGE_FULL_BP : host->effective_bp) *
+                              host->no_cpus;
+        max_bp = total_bp > max_bp ? total_bp : max_bp;
+        hist[total_bp / 100]++;
+        for (size_t j = 1; j <= host->no_cpus; j++)
+            out->no_hot_cores += host->values[j] >= FLEET_HOT_BP;
+    }
+    if(out->no_fresh == 0)
+        return;
+    out->mean_pr = usage_bp_to_pr((uint16_t)(weighted / out->no_cpus));
+    out->effective_pr = usage_bp_to_pr((uint16_t)(weighted_effective / out->no_cpus));
+    out->max_pr = usage_bp_to_pr(max_bp);
+    out->p50_pr = corestats_hist_percentile(hist, 50);
+    out->p95_pr = corestats_hist_percentile(hist, 95);
+}
+
+// Past the end of the buffer the output is only counted - the length tells how much room it needs
+#define FLEET_APPEND(...) \
+    do { const int n = snprintf(out + (len < size ? len : size), len < size ? size - len : 0, __VA_ARGS__); \
+         if(n > 0) len += (size_t)n; } while(0)
+
+/**
+ * Renders fleet aggregates and the busiest hosts for the terminal.
+ * @return Length of the frame, size or more if it did not fit.
+ */
+static size_t fleet_render_frame(const Fleet* const f, char* const out, const size_t size)
+{
+    FleetSummary sum;
+    fleet_summarize(f, &sum);
+    const uint64_t now = collector_now_ns();
+    size_t len = 0;
+
+    FLEET_APPEND("\033[HFLEET  hosts %zu  connected %zu  fresh %zu  cpus %zu  hot cores %zu\033[K\n",
+                 sum.no_hosts, sum.no_connected, sum.no_fresh, sum.no_cpus, sum.no_hot_cores);
+    FLEET_APPEND("usage  mean %5.1f%%  eff %5.1f%%  p50 %5.1f%%  p95 %5.1f%%  max %5.1f%%   "
+                 "frames %" PRIu64 "  bytes %" PRIu64 "\033[K\n\033[K\n",
+                 sum.mean_pr, sum.effective_pr, sum.p50_pr, sum.p95_pr, sum.max_pr, sum.frames, sum.bytes);
+    FLEET_APPEND("%-24s %10s %5s %7s %7s %7s %4s %6s\033[K\n", "host", "id", "cpus", "total", "eff", "maxcpu", "hot",
+                 "age");
+
+    // Busiest fresh hosts - selection by repeated scans, k is small
+    size_t shown[FLEET_TOP_HOSTS];
+    size_t no_shown = 0;
+    while(no_shown < FLEET_TOP_HOSTS)
+    {
+        size_t best = SIZE_MAX;
+        for (size_t i = 0; i < f->no_hosts; i++)
+        {
+            bool taken = !fleet_fresh(&f->hosts[i], now);
+            for (size_t k = 0; k < no_shown && !taken; k++)
+                taken = shown[k] == i;
+            if(!taken && (best == SIZE_MAX || f->hosts[i].values[0] > f->hosts[best].values[0]))
+                best = i;
+        }
+        if(best == SIZE_MAX)
+            break;
+        shown[no_shown++] = best;
+        const FleetHost* const host = &f->hosts[best];
+        uint16_t max_bp = 0;
+        size_t hot = 0;
+        for (size_t j = 1; j <= host->no_cpus; j++)
+        {
+            max_bp = host->values[j] > max_bp ? host->values[j] : max_bp;
+            hot += host->values[j] >= FLEET_HOT_BP;
+        }
+        FLEET_APPEND("%-24s %10u %5zu %6.1f%% %6.1f%% %6.1f%% %4zu %5.1fs\033[K\n", host->name, host->host_id,
+                     host->no_cpus, usage_bp_to_pr(host->values[0]), usage_bp_to_pr(host->effective_bp),
+                     usage_bp_to_pr(max_bp), hot,
+                     (double)(now - host->received_ns) / 1e9);
+    }
+    FLEET_APPEND("\033[J");
+    return len;
+}
+
+/**
+ * Renders fleet aggregates and the busiest hosts for the terminal. The frame buffer grows with the fleet and
+ * is reused, the caller writes the frame at once.
+ * @param frame - set to the rendered frame
+ * @return Length of the frame, 0 on allocation error.
+ */
+size_t fleet_render(Fleet* const f, const char** const frame)
+{
+    size_t needed = (FLEET_TOP_HOSTS + 8) * FLEET_LINE_SIZE;
+    while(1)
+    {
+        if(f->frame_cap < needed)
+        {
+            char* const buf = realloc(f->frame, needed);
+            if(buf == NULL)
+                return 0;
+            f->frame = buf;
+            f->frame_cap = needed;
+        }
+        const size_t len = fleet_render_frame(f, f->frame, f->frame_cap);
+        if(len < f->frame_cap)
+        {
+            *frame = f->frame;
+            return len;
+        }
+        needed = len + 1;
+    }
+}
+
+/**
+ * @return Upper bound of the metrics body length for fleet_render_metrics.
+ */
+size_t fleet_metrics_size(const Fleet* const f)
+{
+    return 2048 + (f == NULL ? 0 : f->no_hosts) * 3 * (FLEET_LINE_SIZE + WIRE_NAME_LEN);
+}
+
+/**
+ * Renders fleet aggregates and the total usage of every fresh host in Prometheus text format.
+ * Passed to exporter_publish_with.
+ * @param fleet - Fleet
+ * @return Length of the body, size or more if it did not fit.
+ */
+size_t fleet_render_metrics(char* const out, const size_t size, const void* const fleet)
+{
+    const Fleet* const f = fleet;
+    FleetSummary sum;
+    fleet_summarize(f, &sum);
+    const uint64_t now = collector_now_ns();
+    size_t len = 0;
+
+    FLEET_APPEND("# HELP cut_fleet_hosts Hosts known to the collector.\n"
+                 "# TYPE cut_fleet_hosts gauge\n"
+                 "cut_fleet_hosts{state=\"known\"} %zu\n"
+                 "cut_fleet_hosts{state=\"connected\"} %zu\n"
+                 "cut_fleet_hosts{state=\"fresh\"} %zu\n"
+                 "# HELP cut_fleet_cpus Cpus of fresh hosts.\n"
+                 "# TYPE cut_fleet_cpus gauge\n"
+                 "cut_fleet_cpus %zu\n"
+                 "# HELP cut_fleet_hot_cores Cores of fresh hosts at or above 90%%.\n"
+                 "# TYPE cut_fleet_hot_cores gauge\n"
+                 "cut_fleet_hot_cores %zu\n"
+                 "# HELP cut_fleet_usage_percent CPU usage over fresh hosts.\n"
+                 "# TYPE cut_fleet_usage_percent gauge\n"
+                 "cut_fleet_usage_percent{stat=\"mean\"} %.2f\n"
+                 "cut_fleet_usage_percent{stat=\"effective\"} %.2f\n"
+                 "cut_fleet_usage_percent{stat=\"p50\"} %.2f\n"
+                 "cut_fleet_usage_percent{stat=\"p95\"} %.2f\n"
+                 "cut_fleet_usage_percent{stat=\"max\"} %.2f\n"
+                 "# HELP cut_fleet_frames_total Frames received from agents.\n"
+                 "# TYPE cut_fleet_frames_total counter\n"
+                 "cut_fleet_frames_total %" PRIu64 "\n"
+                 "# HELP cut_fleet_bytes_total Bytes received from agents.\n"
+                 "# TYPE cut_fleet_bytes_total counter\n"
+                 "cut_fleet_bytes_total %" PRIu64 "\n",
+                 sum.no_hosts, sum.no_connected, sum.no_fresh, sum.no_cpus, sum.no_hot_cores,
+                 sum.mean_pr, sum.effective_pr, sum.p50_pr, sum.p95_pr, sum.max_pr,
+                 sum.frames, sum.bytes);
+    FLEET_APPEND("# HELP cut_host_usage_percent CPU usage of every fresh host.\n"
+                 "# TYPE cut_host_usage_percent gauge\n");
+    for (size_t i = 0; i < f->no_hosts; i++)
+    {
+        const FleetHost* const host = &f->hosts[i];
+        if(!fleet_fresh(host, now))
+            continue;
+        uint16_t max_bp = 0;
+        for (size_t j = 1; j <= host->no_cpus; j++)
+            max_bp = host->values[j] > max_bp ? host->values[j] : max_bp;
+        FLEET_APPEND("cut_host_usage_percent{host=\"%s\",id=\"%u\",cpu=\"total\"} %.2f\n"
+                     "cut_host_usage_percent{host=\"%s\",id=\"%u\",cpu=\"effective\"} %.2f\n"
+                     "cut_host_usage_percent{host=\"%s\",id=\"%u\",cpu=\"max\"} %.2f\n",
+                     host->name, host->host_id, usage_bp_to_pr(host->values[0]),
+                     host->name, host->host_id, usage_bp_to_pr(host->effective_bp),
+                     host->name, host->host_id, usage_bp_to_pr(max_bp));
+    }
+#undef FLEET_APPEND
+    return len;
+}
@@ -0,0 +1,68 @@
+
+#ifndef CPU_USAGE_TRACKER_FLEET_H
+#define CPU_USAGE_TRACKER_FLEET_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "wire.h"
+
+#define FLEET_STALE_INTERVALS 5 // host that missed this many of its samples is left out of the aggregates
+#define FLEET_STALE_MIN_MS 1000 // but not sooner - network jitter
+#define FLEET_STALE_MS 5000     // staleness of a host that did not advertise its interval
+#define FLEET_MAX_HOSTS 16384   // host table limit - disconnected hosts silent the longest make room
+#define FLEET_FORGET_MS 600000  // disconnected host silent for this long is removed from the table
+#define FLEET_HOT_BP 9000       // cores at or above 90% are counted as hot
+#define FLEET_TOP_HOSTS 20      // busiest hosts listed by fleet_render
+
+/**
+ * Fleet collector - one epoll loop accepting agents and decoding their streams into a latest-value table per
+ * host. Everything runs in the thread calling fleet_poll, no locks.
+ */
+typedef struct Fleet Fleet;   // Forward declaration
+
+// Latest values of one host
+typedef struct FleetHost{
+    uint32_t host_id;
+    char name[WIRE_NAME_LEN];
+    size_t no_cpus;
+    unsigned connections;   // open connections streaming this host
+    uint32_t interval_ms;   // longest interval between samples advertised by the agent, 0 if not known
+    uint64_t timestamp_ms;  // wall clock time of the latest sample on the host
+    uint64_t received_ns;   // CLOCK_MONOTONIC arrival of the latest sample, 0 before the first one
+    uint16_t effective_bp;  // total usage scaled by the frequency of the cores
+    uint16_t* values;       // [no_cpus + 1] usage in basis points, total first
+} FleetHost;
+
+// Aggregates over hosts that are not stale
+typedef struct FleetSummary{
+    size_t no_hosts;        // ever seen
+    size_t no_connected;
+    size_t no_fresh;
+    size_t no_cpus;         // cpus of fresh hosts
+    size_t no_hot_cores;
+    double mean_pr;         // cpu weighted mean usage
+    double effective_pr;    // cpu weighted mean usage scaled by the frequency of the cores
+    double p50_pr;          // percentiles of host total usage, 1% resolution
+    double p95_pr;
+    double max_pr;
+    uint64_t frames;        // decoded since fleet_create
+    uint64_t bytes;
+} FleetSummary;
+
+Fleet* fleet_create(const char* addr);
+void fleet_delete(Fleet* f);
+
+bool fleet_watch(Fleet* f, int fd);
+int fleet_poll(Fleet* f, int timeout_ms);
+
+size_t fleet_no_hosts(const Fleet* f);
+const FleetHost* fleet_host(const Fleet* f, size_t i);
+const FleetHost* fleet_find(const Fleet* f, uint32_t host_id);
+void fleet_summarize(const Fleet* f, FleetSummary* out);
+
+size_t fleet_render(Fleet* f, const char** frame);
+size_t fleet_metrics_size(const Fleet* f);
+size_t fleet_render_metrics(char* out, size_t size, const void* fleet);
+
+#endif //CPU_USAGE_TRACKER_FLEET_H
@@ -0,0 +1,327 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include "heatmap.h"
+#include "shutdown.h"
+
+enum{HEATMAP_NO_COLORS = 11};       // 10% wide buckets, 100% has its own
+enum{HEATMAP_LABEL_WIDTH = 5};      // "p0   " in front of the first row of every package
+enum{HEATMAP_HEADER_LINES = 2};     // title and legend
+enum{HEATMAP_FOOTER_LINES = 1};     // busiest cpus
+enum{HEATMAP_CELL_BYTES = 16};      // color change and the widest cell
+enum{HEATMAP_ROW_BYTES = 48};       // label, color reset, cursor moves and clears of one row
+enum{HEATMAP_FIXED_BYTES = 1024};   // title, legend, busiest cpus and balance flags
+enum{HEATMAP_SPARK_BYTES = 3};      // UTF-8 length of a sparkline character
+
+// 256-color backgrounds from idle blue to saturated red
+static const unsigned char g_heatmap_colors[HEATMAP_NO_COLORS] = {17, 19, 25, 31, 37, 71, 142, 178, 208, 202, 196};
+static const char* const g_heatmap_spark[] = {"▁", "▂", "▃", "▄", "▅", "▆", "▇", "█"};
+
+typedef struct HeatmapCpu{
+    int package;
+    int core;
+    size_t cpu;
+} HeatmapCpu;
+
+struct Heatmap{
+    size_t no_cpus;
+    size_t* entries;        // [no_cpus] corestats entry (cpu + 1) of every cell in display order
+    int* packages;          // [no_cpus] package of every cell
+    size_t* row_start;      // [no_cpus + 1] first cell of every grid row, the last one is no_cpus
+    size_t no_rows;
+    size_t per_row;         // cells in the longest row
+    unsigned rows;          // terminal size
+    unsigned cols;
+    size_t cell_width;      // 2 while the grid fits on the screen, 1 otherwise
+    size_t spark_len;
+    size_t top_k;
+    char colors[HEATMAP_NO_COLORS][HEATMAP_CELL_BYTES];
+    size_t color_len[HEATMAP_NO_COLORS];
+    uint16_t spark[HEATMAP_SPARK_MAX];
+    char* frame;            // allocated once - O(cpus) bytes
+    size_t frame_size;
+    atomic_bool resized;    // set on SIGWINCH, the next frame asks the terminal for its size
+    int resize_hook;        // shutdown signal hook id, -1 if not watching
+};
+
+/**
+ * Reads one topology id of the cpu.
+ * @return The id, fallback if topology is not available.
+ */
+static int heatmap_read_id(const size_t cpu, const char* const name, const int fallback)
+{
+    char path[96];
+    char buf[16];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%zu/topology/%s", cpu, name);
+    const int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+        return fallback;
+    const ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if(n <= 0)
+        return fallback;
+    buf[n] = '\0';
+    return atoi(buf);
+}
+
+/**
+ * Orders cpus by package, then by core - SMT siblings end up next to each other.
+ */
+static int heatmap_compare(const void* a, const void* b)
+{
+    const HeatmapCpu* const x = a;
+    const HeatmapCpu* const y = b;
+    if(x->package != y->package)
+        return x->package < y->package ? -1 : 1;
+    if(x->core != y->core)
+        return x->core < y->core ? -1 : 1;
+    return x->cpu < y->cpu ? -1 : (x->cpu > y->cpu);
+}
+
+/**
+ * Splits cells into rows - a package always starts a new row. Cells are 2 columns wide while the whole grid
+ * fits on the screen.
+ */
+static void heatmap_layout(Heatmap* const hm)
+{
+    hm->spark_len = hm->cols / 4 < HEATMAP_SPARK_MAX ? hm->cols / 4 : HEATMAP_SPARK_MAX;
+    const size_t reserved = HEATMAP_LABEL_WIDTH + 1 + hm->spark_len;
+    const size_t grid_cols = hm->cols > reserved + 1 ? hm->cols - reserved : 1;
+    const size_t grid_rows = hm->rows > HEATMAP_HEADER_LINES + HEATMAP_FOOTER_LINES + 1 ?
+                             hm->rows - HEATMAP_HEADER_LINES - HEATMAP_FOOTER_LINES : 1;
+    for (hm->cell_width = 2; ; hm->cell_width--)
+    {
+        hm->per_row = grid_cols / hm->cell_width > 0 ? grid_cols / hm->cell_width : 1;
+        hm->no_rows = 0;
+        for (size_t i = 0; i < hm->no_cpus; i++)
+        {
+            if(i == 0 || hm->packages[i] != hm->packages[i - 1] || i - hm->row_start[hm->no_rows - 1] == hm->per_row)
+                hm->row_start[hm->no_rows++] = i;
+        }
+        hm->row_start[hm->no_rows] = hm->no_cpus;
+        if(hm->no_rows <= grid_rows || hm->cell_width == 1)
+            break;
+    }
+    // Sparklines start right after the longest row
+    size_t longest = 1;
+    for (size_t r = 0; r < hm->no_rows; r++)
+    {
+        if(hm->row_start[r + 1] - hm->row_start[r] > longest)
+            longest = hm->row_start[r + 1] - hm->row_start[r];
+    }
+    hm->per_row = longest;
+    hm->top_k = hm->cols / 16 == 0 ? 1 : (hm->cols / 16 < HEATMAP_TOP_K ? hm->cols / 16 : HEATMAP_TOP_K);
+}
+
+/**
+ * Creates the heatmap - reads cpu topology once and allocates the frame buffer.
+ * Terminal size is taken from stdout, 24x80 if it is not a terminal.
+ * @return Pointer to the new heatmap, NULL on error.
+ */
+Heatmap* heatmap_create(const size_t no_cpus)
+{
+    if(no_cpus == 0)
+        return NULL;
+    Heatmap* const hm = calloc(1, sizeof(*hm));
+    HeatmapCpu* const cpus = malloc(sizeof(HeatmapCpu) * no_cpus);
+    if(hm == NULL || cpus == NULL)
+    {
+        free(hm);
+        free(cpus);
+        return NULL;
+    }
+    hm->no_cpus = no_cpus;
+    hm->resize_hook = -1;
+    atomic_init(&hm->resized, false);
+    hm->frame_size = no_cpus * (HEATMAP_CELL_BYTES + HEATMAP_ROW_BYTES + HEATMAP_SPARK_MAX * HEATMAP_SPARK_BYTES) +
+                     HEATMAP_FIXED_BYTES;
+    hm->entries = malloc(sizeof(size_t) * no_cpus);
+    hm->packages = malloc(sizeof(int) * no_cpus);
+    hm->row_start = malloc(sizeof(size_t) * (no_cpus + 1));
+    hm->frame = malloc(hm->frame_size);
+    if(hm->entries == NULL || hm->packages == NULL || hm->row_start == NULL || hm->frame == NULL)
+    {
+        free(cpus);
+        heatmap_delete(hm);
+        return NULL;
+    }
+
+    for (size_t j = 0; j < no_cpus; j++)
+        cpus[j] = (HeatmapCpu){.package = heatmap_read_id(j, "physical_package_id", 0),
+                               .core = heatmap_read_id(j, "core_id", (int)j),
+                               .cpu = j
+                              };
+    qsort(cpus, no_cpus, sizeof(HeatmapCpu), heatmap_compare);
+    for (size_t i = 0; i < no_cpus; i++)
+    {
+        hm->entries[i] = cpus[i].cpu + 1;
+        hm->packages[i] = cpus[i].package;
+    }
+    free(cpus);
+
+    for (size_t b = 0; b < HEATMAP_NO_COLORS; b++)
+    {
+        const int n = snprintf(hm->colors[b], HEATMAP_CELL_BYTES, "\033[48;5;%um", g_heatmap_colors[b]);
+        hm->color_len[b] = n > 0 ? (size_t)n : 0;
+    }
+    hm->rows = 24;
+    hm->cols = 80;
+    struct winsize ws;
+    if(ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_row != 0 && ws.ws_col != 0)
+    {
+        hm->rows = ws.ws_row;
+        hm->cols = ws.ws_col;
+    }
+    heatmap_layout(hm);
+    return hm;
+}
+
+void heatmap_delete(Heatmap* hm)
+{
+    if(hm == NULL)
+        return;
+    shutdown_remove_signal_hook(hm->resize_hook);
+    free(hm->entries);
+    free(hm->packages);
+    free(hm->row_start);
+    free(hm->frame);
+    free(hm);
+}
+
+static void heatmap_resize_hook(void* const arg)
+{
+    Heatmap* const hm = arg;
+    atomic_store(&hm->resized, true);
+}
+
+/**
+ * Watches SIGWINCH read from the shutdown signalfd - the next frame is laid out for the new terminal size.
+ * @return False if the signal hook could not be registered.
+ */
+bool heatmap_watch_resize(Heatmap* const hm)
+{
+    if(hm == NULL)
+        return false;
+    if(hm->resize_hook < 0)
+        hm->resize_hook = shutdown_add_signal_hook(SIGWINCH, heatmap_resize_hook, hm);
+    return hm->resize_hook >= 0;
+}
+
+/**
+ * Lays the grid out for a terminal of given size.
+ */
+void heatmap_resize(Heatmap* const hm, const unsigned rows, const unsigned cols)
+{
+    if(hm == NULL || rows == 0 || cols == 0)
+        return;
+    hm->rows = rows;
+    hm->cols = cols;
+    heatmap_layout(hm);
+}
+
+/**
+ * Builds one frame - title, legend, grid with a sparkline of every row and the busiest cpus.
+ * The frame overwrites the previous one in place and is meant to be written with a single write.
+ * @param cs - statistics providing the sparklines, may be NULL
+ * @param frame - set to the frame, valid until the next call
+ * @return Length of the frame in bytes.
+ */
+size_t heatmap_render(Heatmap* const hm, const UsagePercentage* const usage, CoreStats* const cs,
+                      const char** const frame)
+{
+    if(hm == NULL || usage == NULL || frame == NULL)
+        return 0;
+    if(atomic_exchange(&hm->resized, false))
+    {
+        struct winsize ws;
+        if(ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0)
+            heatmap_resize(hm, ws.ws_row, ws.ws_col);
+    }
+    char* const out = hm->frame;
+    const size_t size = hm->frame_size;
+    size_t len = 0;
+
+#define HEATMAP_APPEND(...) \
+    do { int n = snprintf(out + len, size - len, __VA_ARGS__); if(n > 0) len += (size_t)n; if(len >= size) len = size - 1; } while(0)
+#define HEATMAP_PUT(str, n) \
+    do { if(len + (n) < size) { memcpy(out + len, (str), (n)); len += (n); } } while(0)
+
+    // Cursor home instead of clearing the screen - no flicker
+    HEATMAP_APPEND("\033[H\033[1;33mCUT\033[0m  %zu cpus  total %5.1f%%  avg1m %5.1f%%  p95 %3.0f%%\033[K\n",
+                   hm->no_cpus, usage_bp_to_pr(usage->total_bp), corestats_ewma(cs, 0, 0),
+                   corestats_percentile(cs, 0, 95));
+    HEATMAP_PUT("      ", HEATMAP_LABEL_WIDTH + 1);
+    for (size_t b = 0; b < HEATMAP_NO_COLORS; b++)
+    {
+        HEATMAP_PUT(hm->colors[b], hm->color_len[b]);
+        HEATMAP_PUT("  ", 2);
+    }
+    HEATMAP_APPEND("\033[0m 0 - 100%%\033[K\n");
+
+    for (size_t r = 0; r < hm->no_rows; r++)
+    {
+        const size_t first = hm->row_start[r];
+        const size_t last = hm->row_start[r + 1];
+        if(first == 0 || hm->packages[first] != hm->packages[first - 1])
+            HEATMAP_APPEND("p%-4d ", hm->packages[first]);
+        else
+            HEATMAP_PUT("      ", HEATMAP_LABEL_WIDTH + 1);
+
+        // Color escape only where the bucket changes
+        size_t prev = HEATMAP_NO_COLORS;
+        for (size_t i = first; i < last; i++)
+        {
+            const uint16_t bp = usage->cores_bp[hm->entries[i] - 1];
+            const size_t bucket = bp >= USAGE_FULL_BP ? HEATMAP_NO_COLORS - 1 : bp / 1000u;
+            if(bucket != prev)
+                HEATMAP_PUT(hm->colors[bucket], hm->color_len[bucket]);
+            HEATMAP_PUT("  ", hm->cell_width);
+            prev = bucket;
+        }
+        // Sparklines of every row start in the same column
+        HEATMAP_APPEND("\033[0m\033[K\033[%zuG", HEATMAP_LABEL_WIDTH + 1 + hm->per_row * hm->cell_width + 2);
+        const size_t n = corestats_history_mean(cs, &hm->entries[first], last - first, hm->spark, hm->spark_len);
+        for (size_t k = 0; k < n; k++)
+        {
+            const uint16_t bp = hm->spark[k] > USAGE_FULL_BP ? USAGE_FULL_BP : hm->spark[k];
+            HEATMAP_PUT(g_heatmap_spark[bp * 7u / USAGE_FULL_BP], HEATMAP_SPARK_BYTES);
+        }
+        HEATMAP_PUT("\n", 1);
+    }
+
+    // Busiest cpus - insertion into a short sorted list, O(cpus * top_k)
+    size_t top[HEATMAP_TOP_K];
+    size_t no_top = 0;
+    for (size_t j = 0; j < hm->no_cpus; j++)
+    {
+        size_t i = no_top < hm->top_k ? no_top++ : hm->top_k;
+        for (; i > 0 && usage->cores_bp[top[i - 1]] < usage->cores_bp[j]; i--)
+        {
+            if(i < hm->top_k)
+                top[i] = top[i - 1];
+        }
+        if(i < hm->top_k)
+            top[i] = j;
+    }
+    HEATMAP_APPEND("top:");
+    for (size_t i = 0; i < no_top; i++)
+        HEATMAP_APPEND(" cpu%zu %5.1f%%", top[i] + 1, usage_bp_to_pr(usage->cores_bp[top[i]]));
+    if(usage->balance.hot)
+        HEATMAP_APPEND("  \033[1;31mHOT CORE cpu%u\033[0m", usage->balance.hot_cpu + 1);
+    if(usage->balance.imbalance)
+        HEATMAP_APPEND("  \033[1;33mIMBALANCE gini %.2f\033[0m", (double)usage->balance.gini_bp / USAGE_FULL_BP);
+    if(usage->balance.socket_imbalance)
+        HEATMAP_APPEND("  \033[1;33mSOCKET IMBALANCE\033[0m");
+    HEATMAP_APPEND("\033[K\n\033[J");
+
+#undef HEATMAP_APPEND
+#undef HEATMAP_PUT
+    *frame = out;
+    return len;
+}
@@ -0,0 +1,27 @@
+
+#ifndef CPU_USAGE_TRACKER_HEATMAP_H
+#define CPU_USAGE_TRACKER_HEATMAP_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "analyzer.h"
+#include "corestats.h"
+
+#define HEATMAP_SPARK_MAX 32    // samples in the sparkline of a row
+#define HEATMAP_TOP_K 8         // busiest cpus listed below the grid
+
+/**
+ * Compact display for many-core hosts - one colored cell per cpu, cpus of a package next to each other and
+ * SMT siblings side by side, rows wrapped to the terminal width. Every row ends with a sparkline of its
+ * average usage. The frame is built in a buffer allocated once (O(cpus) bytes) and written at once.
+ */
+typedef struct Heatmap Heatmap;   // Forward declaration
+
+Heatmap* heatmap_create(size_t no_cpus);
+void heatmap_delete(Heatmap* hm);
+
+bool heatmap_watch_resize(Heatmap* hm);
+void heatmap_resize(Heatmap* hm, unsigned rows, unsigned cols);
+size_t heatmap_render(Heatmap* hm, const UsagePercentage* usage, CoreStats* cs, const char** frame);
+
+#endif //CPU_USAGE_TRACKER_HEATMAP_H
@@ -0,0 +1,473 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+
+#include "iobatch.h"
+
+enum{IOBATCH_INITIAL_SLOTS = 64};
+enum{IOBATCH_INITIAL_ARENA = 64 * 1024};
+enum{IOBATCH_PAGE = 4096};
+
+typedef struct IoBatchSlot{
+    int fd;
+    size_t offset;          // in the arena
+    size_t size;            // a read fills at most size - 1 bytes, the rest is the terminator
+    size_t filled;          // bytes read so far in this submit, the next read continues at this offset
+    long result;            // bytes read by the last read, -errno on error
+} IoBatchSlot;
+
+/**
+ *  SLOTS ARE FILES READ EVERY TICK FROM OFFSET 0. SLOT i IS ENTRY i OF THE REGISTERED FILE TABLE AND OWNS
+ *  A RANGE OF ONE REGISTERED BUFFER (THE ARENA). BOTH ARE REGISTERED AGAIN ONLY WHEN A SLOT IS ADDED OR
+ *  THE ARENA GROWS - BETWEEN TICKS, NEVER WITH READS IN FLIGHT.
+ *  A TICK FILLS ONE SQE PER QUEUED SLOT AND SUBMITS AND REAPS ALL OF THEM WITH ONE io_uring_enter.
+ *  A SHORT READ IS NOT THE END OF A FILE (SEQ_FILE RETURNS ABOUT A PAGE PER READ) - SLOTS THAT GOT DATA ARE
+ *  READ AGAIN AT THE OFFSET THEY REACHED, ALL OF THEM IN THE NEXT ROUND, UNTIL A READ RETURNS 0 OR THE SLOT IS FULL.
+ */
+struct IoBatch{
+    int ring_fd;            // -1 - io_uring is not available, slots are read with pread
+    unsigned entries;
+    void* sq_ring;
+    size_t sq_ring_size;
+    void* cq_ring;          // same mapping as sq_ring with IORING_FEAT_SINGLE_MMAP
+    size_t cq_ring_size;
+    struct io_uring_sqe* sqes;
+    size_t sqes_size;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    struct io_uring_cqe* cqes;
+
+    bool fixed_files;       // registration succeeded, otherwise plain fds
+    bool fixed_buffers;     // otherwise IORING_OP_READ into the same arena
+    bool files_dirty;       // slot added since the last registration
+    bool buffers_dirty;     // arena reallocated since the last registration
+
+    IoBatchSlot* slots;
+    size_t no_slots;
+    size_t slots_cap;
+    int* fds;               // [slots_cap] file table as registered
+    int* pending;           // [slots_cap] slots queued for the next submit
+    size_t no_pending;
+    char* arena;
+    size_t arena_used;
+    size_t arena_size;
+    IoBatchStats stats;
+};
+
+static int iobatch_setup(const unsigned entries, struct io_uring_params* const p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int iobatch_enter(const int fd, const unsigned to_submit, const unsigned min_complete)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, IORING_ENTER_GETEVENTS, NULL, 0);
+}
+
+static int iobatch_register(const int fd, const unsigned opcode, const void* const arg, const unsigned nr_args)
+{
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/**
+ * Creates the ring and maps its queues.
+ * @return False if io_uring is not available (old kernel, seccomp, io_uring_disabled).
+ */
+static bool iobatch_ring_init(IoBatch* const b, const unsigned entries)
+{
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    b->ring_fd = iobatch_setup(entries, &p);
+    if(b->ring_fd < 0)
+        return false;
+    b->entries = p.sq_entries;
+    b->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    b->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    const bool single_mmap = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if(single_mmap && b->cq_ring_size > b->sq_ring_size)
+        b->sq_ring_size = b->cq_ring_size;
+
+    b->sq_ring = mmap(NULL, b->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, b->ring_fd,
+                      IORING_OFF_SQ_RING);
+    if(b->sq_ring == MAP_FAILED)
+        goto error_handler;
+    b->cq_ring = single_mmap ? b->sq_ring : mmap(NULL, b->cq_ring_size, PROT_READ | PROT_WRITE,
+                                                 MAP_SHARED | MAP_POPULATE, b->ring_fd, IORING_OFF_CQ_RING);
+    if(b->cq_ring == MAP_FAILED)
+        goto error_handler;
+    b->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    b->sqes = mmap(NULL, b->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, b->ring_fd,
+                   IORING_OFF_SQES);
+    if(b->sqes == MAP_FAILED)
+        goto error_handler;
+
+    char* const sq = b->sq_ring;
+    char* const cq = b->cq_ring;
+    b->sq_tail = (unsigned*)(sq + p.sq_off.tail);
+    b->sq_mask = (unsigned*)(sq + p.sq_off.ring_mask);
+    b->sq_array = (unsigned*)(sq + p.sq_off.array);
+    b->cq_head = (unsigned*)(cq + p.cq_off.head);
+    b->cq_tail = (unsigned*)(cq + p.cq_off.tail);
+    b->cq_mask = (unsigned*)(cq + p.cq_off.ring_mask);
+    b->cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+    return true;
+
+    error_handler:
+        if(b->sqes != NULL && b->sqes != MAP_FAILED)
+            munmap(b->sqes, b->sqes_size);
+        if(b->cq_ring != NULL && b->cq_ring != MAP_FAILED && b->cq_ring != b->sq_ring)
+            munmap(b->cq_ring, b->cq_ring_size);
+        if(b->sq_ring != NULL && b->sq_ring != MAP_FAILED)
+            munmap(b->sq_ring, b->sq_ring_size);
+        b->sqes = NULL;
+        b->cq_ring = NULL;
+        b->sq_ring = NULL;
+        close(b->ring_fd);
+        b->ring_fd = -1;
+        return false;
+}
+
+/**
+ * Unmaps and closes the ring, the registered files and buffers go with it. The engine falls back to pread.
+ */
+static void iobatch_ring_close(IoBatch* const b)
+{
+    munmap(b->sqes, b->sqes_size);
+    if(b->cq_ring != b->sq_ring)
+        munmap(b->cq_ring, b->cq_ring_size);
+    munmap(b->sq_ring, b->sq_ring_size);
+    close(b->ring_fd);
+    b->ring_fd = -1;
+}
+
+/**
+ * Creates read engine. io_uring is used when the kernel allows it, otherwise every slot is read with pread.
+ * @param entries - expected number of reads per tick, sizes the submission ring
+ * @param uring - false forces the pread fallback
+ * @return Pointer to the new engine, NULL on allocation error.
+ */
+IoBatch* iobatch_create(const size_t entries, const bool uring)
+{
+    IoBatch* const b = calloc(1, sizeof(*b));
+    if(b == NULL)
+        return NULL;
+    b->ring_fd = -1;
+    b->slots_cap = IOBATCH_INITIAL_SLOTS;
+    b->slots = malloc(sizeof(IoBatchSlot) * b->slots_cap);
+    b->fds = malloc(sizeof(int) * b->slots_cap);
+    b->pending = malloc(sizeof(int) * b->slots_cap);
+    b->arena_size = IOBATCH_INITIAL_ARENA;
+    if(posix_memalign((void**)&b->arena, IOBATCH_PAGE, b->arena_size) != 0)
+        b->arena = NULL;
+    if(b->slots == NULL || b->fds == NULL || b->pending == NULL || b->arena == NULL)
+    {
+        iobatch_delete(b);
+        return NULL;
+    }
+    const size_t n = entries == 0 ? 1 : (entries > IOBATCH_MAX_ENTRIES ? IOBATCH_MAX_ENTRIES : entries);
+    if(uring)
+        iobatch_ring_init(b, (unsigned)n);
+    b->files_dirty = true;
+    b->buffers_dirty = true;
+    return b;
+}
+
+void iobatch_delete(IoBatch* const b)
+{
+    if(b == NULL)
+        return;
+    if(b->ring_fd >= 0)
+        iobatch_ring_close(b);
+    free(b->slots);
+    free(b->fds);
+    free(b->pending);
+    free(b->arena);
+    free(b);
+}
+
+/**
+ * @return True if reads go through io_uring, false if through pread.
+ */
+bool iobatch_uses_uring(const IoBatch* const b)
+{
+    return b != NULL && b->ring_fd >= 0;
+}
+
+/**
+ * Takes size bytes of the arena, the arena is doubled when they do not fit. Offsets of the slots stay valid,
+ * the new arena is registered before the next submit.
+ * @return Offset of the range, SIZE_MAX on allocation error.
+ */
+static size_t iobatch_carve(IoBatch* const b, const size_t size)
+{
+    if(b->arena_used + size > b->arena_size)
+    {
+        size_t arena_size = b->arena_size;
+        while(b->arena_used + size > arena_size)
+            arena_size *= 2;
+        char* arena;
+        if(posix_memalign((void**)&arena, IOBATCH_PAGE, arena_size) != 0)
+            return SIZE_MAX;
+        free(b->arena);     // results are per tick, nothing to keep
+        b->arena = arena;
+        b->arena_size = arena_size;
+        b->buffers_dirty = true;
+    }
+    const size_t offset = b->arena_used;
+    b->arena_used += (size + 63) & ~(size_t)63;     // keep slots on their own cache lines
+    return offset;
+}
+
+/**
+ * Adds a file read from offset 0 on every tick it is queued.
+ * @param fd - open file, owned by the caller and kept open while the engine exists
+ * @param size - buffer of the slot, including the terminator
+ * @return Slot of the file, -1 on error.
+ */
+int iobatch_add(IoBatch* const b, const int fd, const size_t size)
+{
+    if(b == NULL || fd < 0 || size < 2 || b->no_slots >= INT32_MAX)
+        return -1;
+    if(b->no_slots == b->slots_cap)
+    {
+        const size_t cap = b->slots_cap * 2;
+        IoBatchSlot* const slots = realloc(b->slots, sizeof(IoBatchSlot) * cap);
+        if(slots == NULL)
+            return -1;
+        b->slots = slots;
+        int* const fds = realloc(b->fds, sizeof(int) * cap);
+        if(fds == NULL)
+            return -1;
+        b->fds = fds;
+        int* const pending = realloc(b->pending, sizeof(int) * cap);
+        if(pending == NULL)
+            return -1;
+        b->pending = pending;
+        b->slots_cap = cap;
+    }
+    const size_t offset = iobatch_carve(b, size);
+    if(offset == SIZE_MAX)
+        return -1;
+    const int slot = (int)b->no_slots++;
+    b->slots[slot] = (IoBatchSlot){.fd = fd, .offset = offset, .size = size, .filled = 0, .result = -EAGAIN};
+    b->fds[slot] = fd;
+    b->files_dirty = true;
+    return slot;
+}
+
+/**
+ * Moves the slot to a bigger buffer - a file that filled its slot may be truncated.
+ * The old range is not reused.
+ * @return False on allocation error, the slot is left unchanged.
+ */
+bool iobatch_resize(IoBatch* const b, const int slot, const size_t size)
+{
+    if(b == NULL || slot < 0 || (size_t)slot >= b->no_slots)
+        return false;
+    if(size <= b->slots[slot].size)
+        return true;
+    const size_t offset = iobatch_carve(b, size);
+    if(offset == SIZE_MAX)
+        return false;
+    b->slots[slot].offset = offset;
+    b->slots[slot].size = size;
+    return true;
+}
+
+/**
+ * @return Buffer size of the slot, 0 if there is no such slot.
+ */
+size_t iobatch_slot_size(const IoBatch* const b, const int slot)
+{
+    return b == NULL || slot < 0 || (size_t)slot >= b->no_slots ? 0 : b->slots[slot].size;
+}
+
+/**
+ * Queues a read of the slot for the next submit. A slot is queued at most once per tick.
+ * @return False if there is no such slot.
+ */
+bool iobatch_queue(IoBatch* const b, const int slot)
+{
+    if(b == NULL || slot < 0 || (size_t)slot >= b->no_slots || b->no_pending == b->slots_cap)
+        return false;
+    b->pending[b->no_pending++] = slot;
+    return true;
+}
+
+/**
+ * Registers the file table and the arena again after they changed. Failure is not an error, reads
+ * just go without fixed files or buffers.
+ */
+static void iobatch_register_all(IoBatch* const b)
+{
+    if(b->files_dirty)
+    {
+        if(b->fixed_files)
+            iobatch_register(b->ring_fd, IORING_UNREGISTER_FILES, NULL, 0);
+        b->fixed_files = iobatch_register(b->ring_fd, IORING_REGISTER_FILES, b->fds, (unsigned)b->no_slots) == 0;
+        b->files_dirty = false;
+    }
+    if(b->buffers_dirty)
+    {
+        if(b->fixed_buffers)
+            iobatch_register(b->ring_fd, IORING_UNREGISTER_BUFFERS, NULL, 0);
+        // Pinned pages count against RLIMIT_MEMLOCK on older kernels
+        const struct iovec iov = {.iov_base = b->arena, .iov_len = b->arena_size};
+        b->fixed_buffers = iobatch_register(b->ring_fd, IORING_REGISTER_BUFFERS, &iov, 1) == 0;
+        b->buffers_dirty = false;
+    }
+}
+
+static void iobatch_prep_read(IoBatch* const b, struct io_uring_sqe* const sqe, const int slot)
+{
+    const IoBatchSlot* const s = &b->slots[slot];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = b->fixed_buffers ? IORING_OP_READ_FIXED : IORING_OP_READ;
+    sqe->fd = b->fixed_files ? slot : s->fd;
+    sqe->flags = b->fixed_files ? IOSQE_FIXED_FILE : 0;
+    sqe->addr = (uint64_t)(uintptr_t)(b->arena + s->offset + s->filled);
+    sqe->len = (uint32_t)(s->size - 1 - s->filled);
+    sqe->off = s->filled;
+    sqe->buf_index = 0;
+    sqe->user_data = (uint64_t)slot;
+}
+
+/**
+ * Submits queued reads in chunks of the ring size - one io_uring_enter submits a chunk and waits for it.
+ * @return Number of reads completed, the rest keep -errno of the failure.
+ */
+static size_t iobatch_submit_uring(IoBatch* const b)
+{
+    size_t done = 0;
+    for (size_t first = 0; first < b->no_pending; )
+    {
+        const unsigned chunk = (unsigned)(b->no_pending - first < b->entries ? b->no_pending - first : b->entries);
+        const unsigned mask = *b->sq_mask;
+        unsigned tail = *b->sq_tail;    // only this thread produces
+        for (unsigned i = 0; i < chunk; i++, tail++)
+        {
+            const unsigned idx = tail & mask;
+            iobatch_prep_read(b, &b->sqes[idx], b->pending[first + i]);
+            b->sq_array[idx] = idx;
+        }
+        __atomic_store_n(b->sq_tail, tail, __ATOMIC_RELEASE);
+
+        unsigned submitted = 0;
+        unsigned reaped = 0;
+        while(reaped < chunk)
+        {
+            const unsigned to_submit = chunk - submitted;
+            const unsigned in_flight = submitted - reaped + to_submit;
+            const int ret = iobatch_enter(b->ring_fd, to_submit, in_flight);
+            b->stats.syscalls++;
+            if(ret < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+            {
+                // Ring is unusable - the rest of this tick and every later one is read with pread
+                iobatch_ring_close(b);
+                return done;
+            }
+            if(ret > 0)
+                submitted += (unsigned)ret;
+
+            unsigned head = *b->cq_head;
+            const unsigned cq_tail = __atomic_load_n(b->cq_tail, __ATOMIC_ACQUIRE);
+            for (; head != cq_tail; head++, reaped++)
+            {
+                const struct io_uring_cqe* const cqe = &b->cqes[head & *b->cq_mask];
+                if(cqe->user_data < b->no_slots)
+                    b->slots[cqe->user_data].result = cqe->res;
+                done += cqe->res >= 0;
+            }
+            __atomic_store_n(b->cq_head, head, __ATOMIC_RELEASE);
+        }
+        first += chunk;
+    }
+    return done;
+}
+
+/**
+ * Reads every queued slot whole - with io_uring one io_uring_enter per round (per IOBATCH_MAX_ENTRIES reads), with
+ * the fallback one pread per slot and round. A round reads every slot that got data in the previous one, a file
+ * is read in two rounds unless it is bigger than a read returns. A read io_uring could not do (e.g. a file
+ * without read_iter) is retried with pread.
+ * @return Number of slots read.
+ */
+size_t iobatch_submit(IoBatch* const b)
+{
+    if(b == NULL || b->no_pending == 0)
+        return 0;
+    for (size_t i = 0; i < b->no_pending; i++)
+        b->slots[b->pending[i]].filled = 0;
+
+    size_t done = 0;
+    while(b->no_pending != 0)
+    {
+        for (size_t i = 0; i < b->no_pending; i++)
+            b->slots[b->pending[i]].result = -ECANCELED;
+        if(b->ring_fd >= 0)
+        {
+            iobatch_register_all(b);
+            iobatch_submit_uring(b);
+        }
+
+        // Slots that got data stay queued for the next round
+        size_t no_pending = 0;
+        for (size_t i = 0; i < b->no_pending; i++)
+        {
+            IoBatchSlot* const s = &b->slots[b->pending[i]];
+            if(s->result < 0)
+            {
+                const ssize_t n = pread(s->fd, b->arena + s->offset + s->filled, s->size - 1 - s->filled,
+                                        (off_t)s->filled);
+                s->result = n < 0 ? -errno : (long)n;
+                b->stats.syscalls++;
+            }
+            if(s->result < 0)
+                continue;
+            s->filled += (size_t)s->result;
+            if(s->result != 0 && s->filled < s->size - 1)
+            {
+                b->pending[no_pending++] = b->pending[i];
+                continue;
+            }
+            b->arena[s->offset + s->filled] = '\0';
+            s->result = (long)s->filled;
+            done++;
+        }
+        b->no_pending = no_pending;
+    }
+    b->stats.reads += done;
+    b->stats.ticks++;
+    return done;
+}
+
+/**
+ * Result of the slot's read in the last submit.
+ * @param data - set to the content, null terminated and valid until the next submit
+ * @return Bytes of the whole file, -errno on error. size - 1 bytes means the file may not fit the slot.
+ */
+long iobatch_result(const IoBatch* const b, const int slot, const char** const data)
+{
+    if(b == NULL || slot < 0 || (size_t)slot >= b->no_slots)
+        return -EINVAL;
+    const IoBatchSlot* const s = &b->slots[slot];
+    if(data != NULL)
+        *data = b->arena + s->offset;
+    return s->result;
+}
+
+void iobatch_stats(const IoBatch* const b, IoBatchStats* const out)
+{
+    if(b == NULL || out == NULL)
+        return;
+    *out = b->stats;
+}
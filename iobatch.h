@@ -0,0 +1,34 @@
+
+#ifndef CPU_USAGE_TRACKER_IOBATCH_H
+#define CPU_USAGE_TRACKER_IOBATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define IOBATCH_MAX_ENTRIES 4096    // submission ring size limit, larger batches take several io_uring_enter
+
+// Counters since the engine was created
+typedef struct IoBatchStats{
+    uint64_t syscalls;      // io_uring_enter calls, or preads of the fallback
+    uint64_t reads;         // completed reads
+    uint64_t ticks;         // iobatch_submit calls with at least one read
+} IoBatchStats;
+
+typedef struct IoBatch IoBatch;   // Forward declaration
+
+IoBatch* iobatch_create(size_t entries, bool uring);
+void iobatch_delete(IoBatch* b);
+bool iobatch_uses_uring(const IoBatch* b);
+
+int iobatch_add(IoBatch* b, int fd, size_t size);
+bool iobatch_resize(IoBatch* b, int slot, size_t size);
+size_t iobatch_slot_size(const IoBatch* b, int slot);
+
+bool iobatch_queue(IoBatch* b, int slot);
+size_t iobatch_submit(IoBatch* b);
+long iobatch_result(const IoBatch* b, int slot, const char** data);
+
+void iobatch_stats(const IoBatch* b, IoBatchStats* out);
+
+#endif //CPU_USAGE_TRACKER_IOBATCH_H
@@ -0,0 +1,399 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "irqstat.h"
+
+enum{IRQSTAT_LABEL_LEN = 16};
+enum{IRQSTAT_INITIAL_SOURCES = 32};
+enum{IRQSTAT_NO_KINDS = 2};
+
+typedef struct IrqSource{
+    char label[IRQSTAT_LABEL_LEN];  // row label before ':' - "24", "LOC", "NET_RX"
+    char name[IRQSTAT_NAME_LEN];
+    bool has_prev;                  // prev holds counters of this source
+} IrqSource;
+
+/**
+ *  ONE TABLE PER FILE. THE LAYOUT OF THE PREVIOUS TICK IS KEPT - THE HEADER IS ONLY HASHED WHILE IT IS UNCHANGED
+ *  (COLUMN -> CPU MAPPING IS REUSED) AND ROW i IS EXPECTED TO BE THE SOURCE IT WAS (ONE LABEL COMPARE). ONLY A
+ *  CHANGED LAYOUT (HOTPLUG, NEW IRQ) SEARCHES OR ADDS SOURCES, AND ONLY A NEW SOURCE OR COLUMN ALLOCATES.
+ *  PER-SOURCE ARRAYS ARE FLAT - [source * no_cpus + cpu].
+ */
+typedef struct IrqTable{
+    uint64_t header_hash;
+    size_t no_columns;
+    size_t columns_cap;
+    int32_t* column_cpu;    // [columns_cap] cpu of every column, -1 for cpus beyond no_cpus
+    uint64_t* values;       // [columns_cap] counters of the row being parsed
+    size_t no_rows;
+    size_t rows_cap;
+    size_t* row_source;     // [rows_cap] source of every row of the previous tick
+    IrqSource* sources;
+    size_t no_sources;
+    size_t cap;             // capacity of sources and the per-source arrays
+    uint64_t* prev;         // counters of the previous tick
+    uint32_t* next_rate;    // scratch of the running tick
+    uint32_t* rate;         // published
+    size_t no_published;    // sources in rate
+    uint64_t last_ns;
+} IrqTable;
+
+struct IrqStat{
+    pthread_mutex_t mutex;  // protects sources, rate and no_published of both tables - read by printer
+    size_t no_cpus;
+    IrqTable tables[IRQSTAT_NO_KINDS];
+};
+
+static const char* const g_irqstat_paths[IRQSTAT_NO_KINDS] = {"/proc/interrupts", "/proc/softirqs"};
+
+/**
+ * Grows per-source arrays of the table. Called only when a new source shows up.
+ * @return False on allocation failure, the table is left unchanged.
+ */
+static bool irqstat_grow_sources(IrqStat* const is, IrqTable* const t)
+{
+    const size_t cap = t->cap == 0 ? IRQSTAT_INITIAL_SOURCES : t->cap * 2;
+    const size_t n = cap * is->no_cpus;
+    uint64_t* const prev = realloc(t->prev, sizeof(uint64_t) * n);
+    if(prev == NULL)
+        return false;
+    t->prev = prev;
+    uint32_t* const next_rate = realloc(t->next_rate, sizeof(uint32_t) * n);
+    if(next_rate == NULL)
+        return false;
+    t->next_rate = next_rate;
+
+    pthread_mutex_lock(&is->mutex);
+    IrqSource* const sources = realloc(t->sources, sizeof(IrqSource) * cap);
+    uint32_t* const rate = sources != NULL ? realloc(t->rate, sizeof(uint32_t) * n) : NULL;
+    if(sources != NULL)
+        t->sources = sources;
+    if(rate != NULL)
+    {
+        t->rate = rate;
+        t->cap = cap;
+    }
+    pthread_mutex_unlock(&is->mutex);
+    return rate != NULL;
+}
+
+static uint64_t irqstat_hash(const char* const begin, const char* const end)
+{
+    uint64_t hash = 14695981039346656037u;
+    for (const char* c = begin; c < end; c++)
+        hash = (hash ^ (uint8_t)*c) * 1099511628211u;
+    return hash;
+}
+
+/**
+ * Maps columns to cpus from the header line ("CPU0 CPU1 CPU4 ..." - offline cpus have no column).
+ * Unchanged header costs one hash, a changed one forgets every previous counter.
+ * @return False on allocation failure or a header without cpus.
+ */
+static bool irqstat_map_columns(IrqStat* const is, IrqTable* const t, const char* const line, const char* const eol)
+{
+    const uint64_t hash = irqstat_hash(line, eol);
+    if(hash == t->header_hash && t->no_columns != 0)
+        return true;
+
+    size_t no_columns = 0;
+    for (const char* p = line; (p = strstr(p, "CPU")) != NULL && p < eol; p += 3)
+        no_columns++;
+    if(no_columns == 0)
+        return false;
+    if(no_columns > t->columns_cap)
+    {
+        int32_t* const column_cpu = realloc(t->column_cpu, sizeof(int32_t) * no_columns);
+        if(column_cpu == NULL)
+            return false;
+        t->column_cpu = column_cpu;
+        uint64_t* const values = realloc(t->values, sizeof(uint64_t) * no_columns);
+        if(values == NULL)
+            return false;
+        t->values = values;
+        t->columns_cap = no_columns;
+    }
+    size_t col = 0;
+    for (const char* p = line; (p = strstr(p, "CPU")) != NULL && p < eol; p += 3)
+    {
+        const unsigned long cpu = strtoul(p + 3, NULL, 10);
+        t->column_cpu[col++] = cpu < is->no_cpus ? (int32_t)cpu : -1;
+    }
+    t->no_columns = no_columns;
+    t->header_hash = hash;
+    t->no_rows = 0;
+    for (size_t s = 0; s < t->no_sources; s++)
+        t->sources[s].has_prev = false;
+    return true;
+}
+
+/**
+ * Name of a new source - the last word of the description for numbered irqs (the device), the label otherwise.
+ */
+static void irqstat_name(IrqSource* const src, const char* desc, const char* const eol)
+{
+    const bool numbered = src->label[0] >= '0' && src->label[0] <= '9';
+    const char* end = eol;
+    while(end > desc && (end[-1] == ' ' || end[-1] == '\t'))
+        end--;
+    const char* begin = end;
+    while(begin > desc && begin[-1] != ' ' && begin[-1] != '\t')
+        begin--;
+    if(!numbered || begin == end)
+    {
+        snprintf(src->name, sizeof(src->name), "%s", src->label);
+        return;
+    }
+    const size_t len = (size_t)(end - begin) < sizeof(src->name) - 1 ? (size_t)(end - begin) : sizeof(src->name) - 1;
+    memcpy(src->name, begin, len);
+    src->name[len] = '\0';
+}
+
+/**
+ * Finds source of the row - normally the one the row had on the previous tick.
+ * @return Index of the source, SIZE_MAX on allocation failure.
+ */
+static size_t irqstat_row_source(IrqStat* const is, IrqTable* const t, const size_t row, const char* const label,
+                                 const size_t label_len, const char* const desc, const char* const eol)
+{
+    if(row < t->no_rows)
+    {
+        const IrqSource* const src = &t->sources[t->row_source[row]];
+        if(strncmp(src->label, label, label_len) == 0 && src->label[label_len] == '\0')
+            return t->row_source[row];
+    }
+    if(row >= t->rows_cap)
+    {
+        const size_t cap = t->rows_cap == 0 ? IRQSTAT_INITIAL_SOURCES : t->rows_cap * 2;
+        size_t* const row_source = realloc(t->row_source, sizeof(size_t) * cap);
+        if(row_source == NULL)
+            return SIZE_MAX;
+        t->row_source = row_source;
+        t->rows_cap = cap;
+    }
+    // Layout changed - search every source, add the row if it is new
+    size_t s = 0;
+    while(s < t->no_sources && !(strncmp(t->sources[s].label, label, label_len) == 0 &&
+                                 t->sources[s].label[label_len] == '\0'))
+        s++;
+    if(s == t->no_sources)
+    {
+        if(t->no_sources == t->cap && !irqstat_grow_sources(is, t))
+            return SIZE_MAX;
+        // The tick cleared rates of the sources it started with only
+        memset(&t->next_rate[s * is->no_cpus], 0, sizeof(uint32_t) * is->no_cpus);
+        IrqSource* const src = &t->sources[s];
+        pthread_mutex_lock(&is->mutex);
+        memcpy(src->label, label, label_len);
+        src->label[label_len] = '\0';
+        src->has_prev = false;
+        irqstat_name(src, desc, eol);
+        t->no_sources++;
+        pthread_mutex_unlock(&is->mutex);
+    }
+    t->row_source[row] = s;
+    return s;
+}
+
+/**
+ * Parses /proc/interrupts or /proc/softirqs in one pass and publishes per-cpu rate of every source.
+ * Rows without a counter per column (ERR, MIS) are not per-cpu and are skipped.
+ * @param text - whole file, null terminated
+ * @param now_ns - CLOCK_MONOTONIC time of the read
+ * @return False if the text is not such a table or on allocation failure.
+ */
+bool irqstat_parse(IrqStat* const is, const IrqKind kind, const char* const text, const uint64_t now_ns)
+{
+    if(is == NULL || text == NULL || kind > IRQSTAT_SOFT)
+        return false;
+    IrqTable* const t = &is->tables[kind];
+    const char* eol = strchr(text, '\n');
+    if(eol == NULL || !irqstat_map_columns(is, t, text, eol))
+        return false;
+    const double interval_s = t->last_ns != 0 && now_ns > t->last_ns ? (double)(now_ns - t->last_ns) / 1e9 : 0;
+    t->last_ns = now_ns;
+    if(t->no_sources != 0)
+        memset(t->next_rate, 0, sizeof(uint32_t) * t->no_sources * is->no_cpus);
+
+    size_t row = 0;
+    for (const char* p = eol + 1; *p != '\0'; p++)
+    {
+        while(*p == ' ')
+            p++;
+        const char* const label = p;
+        while(*p != ':' && *p != '\n' && *p != '\0')
+            p++;
+        if(*p != ':' || p == label || (size_t)(p - label) >= IRQSTAT_LABEL_LEN)
+        {
+            p += strcspn(p, "\n");
+            if(*p == '\0')
+                break;
+            continue;
+        }
+        const size_t label_len = (size_t)(p - label);
+        p++;
+
+        size_t col = 0;
+        for (; col < t->no_columns; col++)
+        {
+            while(*p == ' ')
+                p++;
+            if(*p < '0' || *p > '9')
+                break;
+            uint64_t value = 0;
+            while(*p >= '0' && *p <= '9')
+                value = value * 10 + (uint64_t)(*p++ - '0');
+            t->values[col] = value;
+        }
+        const char* const desc = p;
+        p += strcspn(p, "\n");
+        // ERR and MIS are system-wide counters even on a single cpu
+        const bool global = label_len == 3 && (strncmp(label, "ERR", 3) == 0 || strncmp(label, "MIS", 3) == 0);
+        if(col == t->no_columns && !global)
+        {
+            const size_t s = irqstat_row_source(is, t, row++, label, label_len, desc, p);
+            if(s == SIZE_MAX)
+                return false;
+            IrqSource* const src = &t->sources[s];
+            uint64_t* const prev = &t->prev[s * is->no_cpus];
+            uint32_t* const next_rate = &t->next_rate[s * is->no_cpus];
+            for (size_t c = 0; c < t->no_columns; c++)
+            {
+                const int32_t cpu = t->column_cpu[c];
+                if(cpu < 0)
+                    continue;
+                const uint64_t value = t->values[c];
+                if(src->has_prev && interval_s > 0 && value >= prev[cpu])
+                {
+                    const double rate = (double)(value - prev[cpu]) / interval_s;
+                    next_rate[cpu] = rate > UINT32_MAX ? UINT32_MAX : (uint32_t)rate;
+                }
+                prev[cpu] = value;
+            }
+            src->has_prev = true;
+        }
+        if(*p == '\0')
+            break;
+    }
+    t->no_rows = row;
+
+    pthread_mutex_lock(&is->mutex);
+    if(t->no_sources != 0)
+        memcpy(t->rate, t->next_rate, sizeof(uint32_t) * t->no_sources * is->no_cpus);
+    t->no_published = t->no_sources;
+    pthread_mutex_unlock(&is->mutex);
+    return true;
+}
+
+static bool irqstat_parse_hard(Collector* const c)
+{
+    return irqstat_parse(c->data, IRQSTAT_HARD, c->buffer, collector_now_ns());
+}
+
+static bool irqstat_parse_soft(Collector* const c)
+{
+    return irqstat_parse(c->data, IRQSTAT_SOFT, c->buffer, collector_now_ns());
+}
+
+/**
+ * Creates interrupt tracker, tables are sized by the first parse.
+ * @param no_cpus - number of cpus, columns of higher cpus are ignored
+ * @return Pointer to the new tracker, NULL on error.
+ */
+IrqStat* irqstat_create(const size_t no_cpus)
+{
+    if(no_cpus == 0)
+        return NULL;
+    IrqStat* const is = calloc(1, sizeof(*is));
+    if(is == NULL)
+        return NULL;
+    is->no_cpus = no_cpus;
+    pthread_mutex_init(&is->mutex, NULL);
+    return is;
+}
+
+void irqstat_delete(IrqStat* const is)
+{
+    if(is == NULL)
+        return;
+    for (size_t k = 0; k < IRQSTAT_NO_KINDS; k++)
+    {
+        IrqTable* const t = &is->tables[k];
+        free(t->column_cpu);
+        free(t->values);
+        free(t->row_source);
+        free(t->sources);
+        free(t->prev);
+        free(t->next_rate);
+        free(t->rate);
+    }
+    pthread_mutex_destroy(&is->mutex);
+    free(is);
+}
+
+/**
+ * Sets up collector of /proc/interrupts or /proc/softirqs - one collector per file, both fill the same tracker.
+ * @return True if the file is available.
+ */
+bool irqstat_collector_init(Collector* const c, IrqStat* const is, const IrqKind kind)
+{
+    *c = (Collector){.name = kind == IRQSTAT_HARD ? "interrupts" : "softirqs",
+                     .path = g_irqstat_paths[kind == IRQSTAT_HARD ? IRQSTAT_HARD : IRQSTAT_SOFT],
+                     .interval_ms = 1000,
+                     .parse = kind == IRQSTAT_HARD ? irqstat_parse_hard : irqstat_parse_soft,
+                     .fd = -1,
+                     .event_fd = -1,
+                     .data = is
+                    };
+    return is != NULL && collector_open(c);
+}
+
+/**
+ * Ranks interrupt and softirq sources of one cpu by their rate.
+ * @param out - array for max sources, busiest first
+ * @return Number of sources written, sources without interrupts are left out.
+ */
+size_t irqstat_top(IrqStat* const is, const size_t cpu, IrqTop* const out, const size_t max)
+{
+    if(is == NULL || out == NULL || cpu >= is->no_cpus || max == 0)
+        return 0;
+    size_t n = 0;
+    pthread_mutex_lock(&is->mutex);
+    for (size_t k = 0; k < IRQSTAT_NO_KINDS; k++)
+    {
+        const IrqTable* const t = &is->tables[k];
+        for (size_t s = 0; s < t->no_published; s++)
+        {
+            const uint32_t rate = t->rate[s * is->no_cpus + cpu];
+            if(rate == 0 || (n == max && rate <= out[n - 1].rate))
+                continue;
+            // Insertion into the sorted list - max is small
+            size_t i = n < max ? n++ : max - 1;
+            for (; i > 0 && out[i - 1].rate < rate; i--)
+                out[i] = out[i - 1];
+            out[i].rate = rate;
+            out[i].kind = (IrqKind)k;
+            memcpy(out[i].name, t->sources[s].name, sizeof(out[i].name));
+        }
+    }
+    pthread_mutex_unlock(&is->mutex);
+    return n;
+}
+
+/**
+ * @return Interrupts (or softirqs) per second of one cpu since previous tick.
+ */
+uint64_t irqstat_cpu_rate(IrqStat* const is, const size_t cpu, const IrqKind kind)
+{
+    if(is == NULL || cpu >= is->no_cpus || kind > IRQSTAT_SOFT)
+        return 0;
+    uint64_t sum = 0;
+    pthread_mutex_lock(&is->mutex);
+    const IrqTable* const t = &is->tables[kind];
+    for (size_t s = 0; s < t->no_published; s++)
+        sum += t->rate[s * is->no_cpus + cpu];
+    pthread_mutex_unlock(&is->mutex);
+    return sum;
+}
@@ -0,0 +1,37 @@
+
+#ifndef CPU_USAGE_TRACKER_IRQSTAT_H
+#define CPU_USAGE_TRACKER_IRQSTAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "collector.h"
+
+#define IRQSTAT_NAME_LEN 24
+#define IRQSTAT_TOP_N 3         // sources shown for a hot core
+#define IRQSTAT_HOT_BP 9000     // cores at or above 90% get their busiest sources ranked
+
+typedef enum{
+    IRQSTAT_HARD = 0,   // /proc/interrupts
+    IRQSTAT_SOFT = 1    // /proc/softirqs
+} IrqKind;
+
+// One interrupt source of one cpu
+typedef struct IrqTop{
+    char name[IRQSTAT_NAME_LEN];    // device of a numbered irq (e.g. eth0-rx-0), row label otherwise (LOC, NET_RX)
+    uint32_t rate;                  // per second since previous tick
+    IrqKind kind;
+} IrqTop;
+
+typedef struct IrqStat IrqStat;   // Forward declaration
+
+IrqStat* irqstat_create(size_t no_cpus);
+void irqstat_delete(IrqStat* is);
+
+bool irqstat_collector_init(Collector* c, IrqStat* is, IrqKind kind);
+bool irqstat_parse(IrqStat* is, IrqKind kind, const char* text, uint64_t now_ns);
+
+size_t irqstat_top(IrqStat* is, size_t cpu, IrqTop* out, size_t max);
+uint64_t irqstat_cpu_rate(IrqStat* is, size_t cpu, IrqKind kind);
+
+#endif //CPU_USAGE_TRACKER_IRQSTAT_H
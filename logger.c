@@ -2,9 +2,11 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdatomic.h>
+#include <stdbool.h>
 #include <pthread.h>
 
 #include "logger.h"
+#include "trace.h"
 
 #define LOGGER_MSG_MAX_SIZE 255 // 256-th is null terminator
 
@@ -18,7 +20,9 @@ typedef struct log_line{
 typedef struct Logger{
     pthread_t log_thread;   // 8B
     atomic_bool term_flag; // 1B
-     // 7B padding
+    bool sync;             // 1B - no thread, lines are written by the caller
+     // 6B padding
+    char filename[256];    // log file of the sync logger
 } Logger;
 #pragma GCC diagnostic pop
 
@@ -43,11 +47,53 @@ static void createLogFileName(char* fileName)
     free(timeInfo);
 }
 
+/**
+ * Appends one line to the log file.
+ * @return False if file could not be opened.
+ */
+static bool logger_append(const char* filename, const log_line_t* new_log)
+{
+    char prefix[32];
+    switch (new_log->log_level) {
+        case LOG_INFO:
+            strcpy(prefix, "[INFO]\t");
+            break;
+        case LOG_WARNING:
+            strcpy(prefix, "[WARNING]");
+            break;
+        case LOG_ERROR:
+            strcpy(prefix, "[ERROR]\t");
+            break;
+        case LOG_STARTUP:
+            strcpy(prefix, "[STARTUP]");
+            break;
+        case LOG_DEBUG:
+            strcpy(prefix, "[DEBUG]\t");
+            break;
+    }
+    time_t currentTime;
+    struct tm localTime;
+    char dateTime[20];
+    currentTime = time(NULL);
+    localtime_r(&currentTime, &localTime);
+    strftime(dateTime, sizeof(dateTime), "%Y-%m-%d %H:%M:%S", &localTime);
+
+    FILE* log_file = fopen(filename, "a+");
+    if(log_file == NULL)
+        return false;
+    fprintf(log_file, "[%s]", dateTime);
+    fprintf(log_file, "%s\t", prefix);
+    fprintf(log_file, "%s\n", new_log->message);
+    fclose(log_file);
+    return true;
+}
+
 // Logger thread func - appends logs to the file
 static void* logger_func(void* args)
 {
     (void)args;
     char filename[256];
+    TRACE_THREAD("logger");
 
     createLogFileName(filename);
     log_line_t* new_log = malloc(sizeof(log_line_t));
@@ -56,48 +102,19 @@ static void* logger_func(void* args)
         pthread_exit(NULL);
     }
 
-    while(atomic_load(&logger_instance->term_flag) == false || !queue_is_empty(g_buffer))
+    // logger_destroy closes the buffer - lines still in it are written, then dequeue returns QCLOSED
+    QueueErrorCode ret;
+    while((ret = queue_dequeue(g_buffer, new_log, 2)) != QCLOSED)
     {
-        QueueErrorCode ret = QTIMEOUT;
-        while (atomic_load(&logger_instance->term_flag) == false && ret == QTIMEOUT)
-            ret = queue_dequeue(g_buffer, new_log, 2);  // CHECK every 2 seconds if termination flag is not up
-
-        char prefix[32];
-        switch (new_log->log_level) {
-            case LOG_INFO:
-                strcpy(prefix, "[INFO]\t");
-                break;
-            case LOG_WARNING:
-                strcpy(prefix, "[WARNING]");
-                break;
-            case LOG_ERROR:
-                strcpy(prefix, "[ERROR]\t");
-                break;
-            case LOG_STARTUP:
-                strcpy(prefix, "[STARTUP]");
-                break;
-            case LOG_DEBUG:
-                strcpy(prefix, "[DEBUG]\t");
-                break;
-        }
-        time_t currentTime;
-        struct tm* localTime = malloc(sizeof(*localTime));
-        char dateTime[20];
-        currentTime = time(NULL);
-        localtime_r(&currentTime, localTime);
-        strftime(dateTime, sizeof(dateTime), "%Y-%m-%d %H:%M:%S", localTime);
-
-        FILE* log_file = fopen(filename, "a+");
-        if(log_file == NULL)
+        if(ret != QSUCCESS)
+            continue;
+        TRACE_BEGIN(flush);
+        if(!logger_append(filename, new_log))
         {
             perror("Logger failed to create new file.");
             pthread_exit(NULL);
         }
-        fprintf(log_file, "[%s]", dateTime);
-        fprintf(log_file, "%s\t", prefix);
-        fprintf(log_file, "%s\n", new_log->message);
-        fclose(log_file);
-        free(localTime);
+        TRACE_END(flush, "log flush");
     }
     free(new_log);
     pthread_exit(NULL);
@@ -108,12 +125,22 @@ static void* logger_func(void* args)
  * @return return LINIT_SUCCESS on success, else LINIT_ERROR
  */
 LoggerErrorCode logger_init(void)
+{
+    return logger_init_queue(QUEUE_MUTEX);
+}
+
+/**
+ * Creates logger thread with given buffer implementation - QUEUE_LOCKFREE lets many writers add lines
+ * without serializing on one mutex. If one thread is already running no action performed.
+ * @return return LINIT_SUCCESS on success, else LINIT_ERROR
+ */
+LoggerErrorCode logger_init_queue(const QueueKind kind)
 {
     if(atomic_flag_test_and_set(&g_logger_initialized) == 0)
     {
         enum{LOGGER_BUFFER_CAPACITY = 128};
 
-        g_buffer = queue_create_new(LOGGER_BUFFER_CAPACITY, sizeof(log_line_t));
+        g_buffer = queue_create(kind, LOGGER_BUFFER_CAPACITY, sizeof(log_line_t));
         logger_instance = malloc(sizeof(Logger));
         *logger_instance = (Logger){
             .term_flag = ATOMIC_VAR_INIT(0)
@@ -131,13 +158,44 @@ LoggerErrorCode logger_init(void)
 }
 
 /**
- * Stops current logger thread.
+ * Creates logger without its own thread - every logger_write appends to the file directly.
+ * Meant for the single-threaded mode, where nothing else could block on the file.
+ * @return return LINIT_SUCCESS on success, else LINIT_ERROR
+ */
+LoggerErrorCode logger_init_sync(void)
+{
+    if(atomic_flag_test_and_set(&g_logger_initialized) == 0)
+    {
+        logger_instance = malloc(sizeof(Logger));
+        if(logger_instance == NULL)
+        {
+            atomic_flag_clear(&g_logger_initialized);
+            return LINIT_ERROR;
+        }
+        *logger_instance = (Logger){
+            .term_flag = ATOMIC_VAR_INIT(0),
+            .sync = true
+        };
+        createLogFileName(logger_instance->filename);
+        return LINIT_SUCCESS;
+    }
+    return LINIT_ERROR;
+}
+
+/**
+ * Stops current logger thread - it writes every line still in the buffer and exits without waiting for a timeout.
  */
 void logger_destroy(void)
 {
+    if(logger_instance != NULL && logger_instance->sync)
+    {
+        free(logger_instance);
+        logger_instance = NULL;
+    }
     if(logger_instance != NULL)
     {
         atomic_store(&logger_instance->term_flag, true);
+        queue_close(g_buffer);
         pthread_join(logger_instance->log_thread, NULL);
         free(logger_instance);
         queue_delete(g_buffer);
@@ -155,7 +213,7 @@ void logger_write(const char* msg, log_level_t log_level)
         return;
     if(atomic_load(&logger_instance->term_flag) != false)     // Logger is closed for receiving new messages
         return;
-    if(g_buffer == NULL)
+    if(g_buffer == NULL && !logger_instance->sync)
         return;
     log_line_t new_log;
     if(strlen(msg) > LOGGER_MSG_MAX_SIZE)
@@ -167,5 +225,12 @@ void logger_write(const char* msg, log_level_t log_level)
     }
 
     new_log.log_level = log_level;
-    queue_enqueue(g_buffer, &new_log, 2);
+    if(logger_instance->sync)
+    {
+        TRACE_BEGIN(flush);
+        logger_append(logger_instance->filename, &new_log);
+        TRACE_END(flush, "log flush");
+    }
+    else
+        queue_enqueue(g_buffer, &new_log, 2);
 }
@@ -20,6 +20,8 @@ typedef enum
 } LoggerErrorCode;
 
 LoggerErrorCode logger_init(void);
+LoggerErrorCode logger_init_queue(QueueKind kind);
+LoggerErrorCode logger_init_sync(void);
 
 void logger_write(const char* msg, log_level_t log_level);
 
@@ -0,0 +1,120 @@
+#include <stdlib.h>
+#include <stdatomic.h>
+
+#include "mailbox.h"
+
+#define MAILBOX_FRESH ((uintptr_t)1)
+
+/**
+ *  LATEST-VALUE MAILBOX FOR ONE WRITER AND ONE READER (TRIPLE BUFFER).
+ *  THREE PREALLOCATED BUFFERS - THE WRITER OWNS ONE (BACK), THE READER OWNS ONE (FRONT), THE THIRD ONE IS
+ *  IN THE MAILBOX. PUBLISH SWAPS BACK WITH THE MAILBOX, TAKE SWAPS FRONT WITH IT - ONE ATOMIC EXCHANGE OF
+ *  A POINTER EACH, THE LOWEST BIT OF THE POINTER MARKS A BUFFER NOT TAKEN YET.
+ *  NOBODY EVER WAITS - A NEWER ELEMENT REPLACES ONE THE READER DID NOT TAKE, THE READER KEEPS ITS FRONT
+ *  UNTIL THERE IS A NEWER ONE.
+ */
+struct Mailbox{
+    _Atomic uintptr_t middle;       // buffer in the mailbox | MAILBOX_FRESH
+    uint8_t pad_middle[64 - sizeof(uintptr_t)];
+    void* back;                     // writer's
+    _Atomic uint64_t published;
+    uint8_t pad_back[64 - sizeof(void*) - sizeof(uint64_t)];
+    void* front;                    // reader's, NULL until the first take
+    _Atomic uint64_t taken;
+    uint8_t pad_front[64 - sizeof(void*) - sizeof(uint64_t)];
+    size_t stride;
+    uint8_t buffers[];  // Fixed size - FAM
+};
+
+/**
+ * Creates a new mailbox.
+ * @param elem_size - size of one element
+ * @return Pointer to the newly created mailbox, NULL on invalid argument or allocation error.
+ */
+Mailbox* mailbox_create(const size_t elem_size)
+{
+    if(elem_size == 0)
+        return NULL;
+    // Aligned buffers keep the lowest bit of their addresses free for the flag
+    const size_t stride = (elem_size + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1);
+    Mailbox* const m = calloc(1, sizeof(*m) + 3 * stride);   // Flexible Array Member
+    if(m == NULL)
+        return NULL;
+    m->stride = stride;
+    m->back = &m->buffers[0];
+    m->front = NULL;
+    atomic_init(&m->middle, (uintptr_t)&m->buffers[stride]);
+    atomic_init(&m->published, 0);
+    atomic_init(&m->taken, 0);
+    return m;
+}
+
+/**
+ * Deletes the mailbox and frees memory. Nobody may use it anymore.
+ */
+void mailbox_delete(Mailbox* m)
+{
+    free(m);
+}
+
+/**
+ * @return Buffer the writer fills before mailbox_publish - a different one after every publish.
+ */
+void* mailbox_back(Mailbox* const m)
+{
+    return m == NULL ? NULL : m->back;
+}
+
+/**
+ * Makes the filled back buffer the latest element. Called only by the writer, never waits.
+ */
+void mailbox_publish(Mailbox* const m)
+{
+    if(m == NULL)
+        return;
+    const uintptr_t old = atomic_exchange(&m->middle, (uintptr_t)m->back | MAILBOX_FRESH);
+    m->back = (void*)(old & ~MAILBOX_FRESH);
+    atomic_store_explicit(&m->published, atomic_load_explicit(&m->published, memory_order_relaxed) + 1,
+                          memory_order_relaxed);
+}
+
+/**
+ * Gives the reader the latest published element, it stays valid and unchanged until the next call.
+ * Called only by the reader, never waits.
+ * @param fresh - set to true if the element was published since the previous call, may be NULL
+ * @return The latest element, NULL if nothing was published yet.
+ */
+const void* mailbox_latest(Mailbox* const m, bool* const fresh)
+{
+    if(fresh != NULL)
+        *fresh = false;
+    if(m == NULL)
+        return NULL;
+    if((atomic_load(&m->middle) & MAILBOX_FRESH) == 0)
+        return m->front;
+    // Front is empty only before the first take - the third buffer goes to the mailbox then
+    void* const give = m->front != NULL ? m->front : &m->buffers[2 * m->stride];
+    const uintptr_t taken = atomic_exchange(&m->middle, (uintptr_t)give);
+    m->front = (void*)(taken & ~MAILBOX_FRESH);
+    atomic_store_explicit(&m->taken, atomic_load_explicit(&m->taken, memory_order_relaxed) + 1,
+                          memory_order_relaxed);
+    if(fresh != NULL)
+        *fresh = true;
+    return m->front;
+}
+
+/**
+ * @return Number of published elements.
+ */
+uint64_t mailbox_published(const Mailbox* const m)
+{
+    return m == NULL ? 0 : atomic_load(&m->published);
+}
+
+/**
+ * @return Number of elements the reader took - the rest were replaced by newer ones before it looked.
+ */
+uint64_t mailbox_taken(const Mailbox* const m)
+{
+    return m == NULL ? 0 : atomic_load(&m->taken);
+}
@@ -0,0 +1,21 @@
+
+#ifndef CPU_USAGE_TRACKER_MAILBOX_H
+#define CPU_USAGE_TRACKER_MAILBOX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct Mailbox Mailbox;   // Forward declaration
+
+Mailbox* mailbox_create(size_t elem_size);
+void mailbox_delete(Mailbox* m);
+
+void* mailbox_back(Mailbox* m);
+void mailbox_publish(Mailbox* m);
+const void* mailbox_latest(Mailbox* m, bool* fresh);
+
+uint64_t mailbox_published(const Mailbox* m);
+uint64_t mailbox_taken(const Mailbox* m);
+
+#endif //CPU_USAGE_TRACKER_MAILBOX_H
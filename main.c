@@ -1,17 +1,49 @@
 #include <stdio.h>
+#include <inttypes.h>
 #include <stdlib.h>
 #include <signal.h>
 #include <sys/time.h>
+#include <time.h>
 #include <string.h>
 #include <stdatomic.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <poll.h>
 
 #include "queue.h"
-#include "reader.h"
 #include "analyzer.h"
 #include "logger.h"
 #include "watchdog.h"
+#include "corestats.h"
+#include "collector.h"
+#include "iobatch.h"
+#include "proctop.h"
+#include "cgroup.h"
+#include "cpufreq.h"
+#include "irqstat.h"
+#include "heatmap.h"
+#include "exporter.h"
+#include "options.h"
+#include "shmpub.h"
+#include "alerts.h"
+#include "cut.h"
+#include "selfstat.h"
+#include "adaptive.h"
+#include "broadcast.h"
+#include "mailbox.h"
+#include "delta.h"
+#include "recorder.h"
+#include "shutdown.h"
+#include "agent.h"
+#include "fleet.h"
+#include "trace.h"
+#include "reader.h"
 
-// SIGNAL HANDLER
+// TERMINATION FLAG
+// Set by the shutdown hook on SIGTERM/SIGINT (read from a signalfd) or when one of the pipeline threads stops.
+// Sleeping threads are woken by the other shutdown hooks and the shutdown eventfd, the flag tells them to exit.
 // volatile sig_atomic_t can be used to communicate only with a handler running in the same thread, it does not support multithreaded execution .
 // C11 states that the use of the signal function in a multithreaded program is undefined behavior
 // This solution succeeds on platforms where the atomic_bool type is always lock-free
@@ -32,129 +64,731 @@ static flag_type g_termination_flag = ATOMIC_VAR_INIT(0);
 // Reader - Analyzer : Producer - Consumer problem
 static Queue* g_reader_analyzer_queue;
 
-// Analyzer - Printer : Producer - Consumer problem
-static Queue* g_analyzer_printer_queue;
+// Analyzer - Recorder, exporter : one producer, every consumer reads the same samples at its own pace
+static Broadcast* g_analyzer_ring;
+static int g_recorder_consumer = -1;    // sees every sample, -1 if recording is disabled
+static int g_export_consumer = -1;      // skips to the latest sample a ring behind, -1 if nothing to export
+
+// Analyzer output in the ring - only the cores that moved beyond the threshold since the slowest consumer read
+// last, consumers apply them to their own copy of the cores (delta.h). usage.cores_bp is NULL in the ring.
+typedef struct RingSample{
+    uint64_t timestamp_ns;      // CLOCK_REALTIME of the sample
+    UsagePercentage usage;
+    uint32_t no_changed;
+    uint64_t changed[];         // [DELTA_WORDS(g_no_cpus)] bitmap, then no_changed values - see ring_values
+} RingSample;
+
+enum{ANALYZER_RING_CAPACITY = 16};
+
+// Smallest move of a core that is sent downstream
+static uint16_t g_delta_threshold_bp = DELTA_DEFAULT_THRESHOLD_BP;
+
+// Analyzer output in the mailbox - usage.cores_bp and usage.effective_cores_bp point to cores_bp of the same buffer
+typedef struct FrameSample{
+    uint64_t timestamp_ns;      // CLOCK_REALTIME of the sample
+    UsagePercentage usage;
+    uint16_t cores_bp[];        // [2 * g_no_cpus] usage of every core, then its effective usage
+} FrameSample;
+
+// Analyzer - Printer : latest sample only, the printer draws it at its frame rate and never holds the analyzer
+static Mailbox* g_printer_mailbox;
+
+enum{PRINTER_FRAME_NS = 100000000};     // 10 fps
+
+// Sampling library context - used only by reader
+static CutContext* g_cut;
 
 // Number of cpus
 static size_t g_no_cpus;
 
+// Socket of every cpu and number of sockets - read once at start, used by analyzer, NULL/0 if not known
+static uint16_t* g_socket_of;
+static size_t g_no_sockets;
+
+// Sliding window statistics of every core - updated by analyzer, read by printer
+static CoreStats* g_core_stats;
+
+// The busiest processes - updated by reader's per-process collector, read by printer
+static ProcTop* g_proc_top;
+
+// The hottest cgroups - updated by reader's cgroup collector, read by printer
+static CgroupTracker* g_cgroups;
+
+// Frequency and idle-state residency of every core - updated by reader's cpufreq collector, read by analyzer
+// and printer
+static CpuFreq* g_cpufreq;
+
+// Interrupt and softirq rates per cpu - collected by the sampling thread, read by printer, NULL if not available
+static IrqStat* g_irqstat;
+
+// Sampling loop reads its files through io_uring instead of one pread per file
+static bool g_io_uring;
+
+// Compact display mode - used only by printer, NULL if every cpu gets its bar
+static Heatmap* g_heatmap;
+
+// Prometheus endpoint - exporter thread publishes the latest sample to it, NULL if disabled
+static Exporter* g_exporter;
+
+// Shared memory with the latest sample - written by exporter thread, NULL if disabled
+static ShmPublisher* g_shm;
+
+// Stream to the fleet collector - written by exporter thread, NULL if disabled
+static Agent* g_agent;
+
+// CSV recording of every sample - written by the recorder thread, NULL if disabled
+static Recorder* g_recorder;
+
+// Alert rules - evaluated by analyzer once per sample, NULL if no rules given
+static AlertEngine* g_alerts;
+
+// Adaptive sampling interval - used only by the sampling thread, NULL if interval is fixed
+static AdaptiveRate* g_adaptive;
+
+// Current sampling interval - set by the sampling thread, scales printer and watchdog timeouts
+static atomic_uint g_interval_ms = ATOMIC_VAR_INIT(1000);
+
+// Tracker's own overhead - sampled by printer for every frame
+static SelfStat* g_self;
+
 // Watchdog flag to make sure only one watchdog can execute exit() function which is not thread-safe
 static atomic_flag g_wd_flag = ATOMIC_FLAG_INIT;
 
 
-// SIGTERM sets termination flag which tells all the threads to clean data and exit
-static void signal_handler(int signum)
+// Shutdown hook - termination flag tells all the threads to clean data and exit
+static void termination_hook(void* args)
+{
+    (void) args;
+    g_termination_flag = 1;
+}
+
+// Shutdown hook - wakes threads waiting on the queue, the consumer still drains it
+static void queue_close_hook(void* args)
+{
+    queue_close(args);
+}
+
+// Shutdown hook - wakes the watchdog, so it does not wait out its timeout
+static void watchdog_wake_hook(void* args)
+{
+    WDCommunication* const wdc = args;
+    pthread_mutex_lock(&wdc->mutex);
+    pthread_cond_broadcast(&wdc->signal_cv);
+    pthread_mutex_unlock(&wdc->mutex);
+}
+
+
+/**
+ * Timeout of queue waits and watchdogs - two sampling intervals and a second of margin, at least 2 seconds.
+ * @return Timeout in seconds.
+ */
+static uint8_t wait_timeout_s(void)
 {
-    if(signum == SIGTERM)
-        g_termination_flag = 1;
+    const unsigned timeout = (2 * atomic_load(&g_interval_ms) + 999) / 1000 + 1;
+    return (uint8_t)(timeout < 2 ? 2 : (timeout > UINT8_MAX ? UINT8_MAX : timeout));
 }
 
+/**
+ * @return CLOCK_REALTIME in ns.
+ */
+static uint64_t realtime_now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+/**
+ * Picks the interval to the next sample from the change seen in this one.
+ * @return Interval in ms.
+ */
+static uint32_t sampling_adapt(const CutSample* const sample)
+{
+    const uint32_t interval_ms = adaptive_update(g_adaptive, sample->usage.cores_bp);
+    atomic_store(&g_interval_ms, interval_ms);
+    return interval_ms;
+}
+
+/**
+ * Allocates buffers for the next sample in one block - steal time of total and every core followed by usage of
+ * every core. The block starts at steal_pr and is handed over to the analyzer together with the sample.
+ * @return False on allocation error.
+ */
+static bool sample_alloc(CutSample* const sample)
+{
+    sample->steal_pr = malloc(sizeof(double) * (g_no_cpus + 1) + sizeof(uint16_t) * g_no_cpus);
+    sample->usage.cores_bp = sample->steal_pr == NULL ? NULL : (uint16_t*)(sample->steal_pr + g_no_cpus + 1);
+    return sample->steal_pr != NULL;
+}
+
+// libcut seen by the reader as one more collector
+static bool reader_cut_collect(Collector* const c)
+{
+    return cut_sample(g_cut, c->data) == CUT_SUCCESS;
+}
+
+// Shutdown eventfd seen by the reader as a collector - only wakes its sleep, produces no data
+static bool reader_stop_collect(Collector* const c)
+{
+    (void) c;
+    return false;
+}
+
+/**
+ * Creates read engine of the sampling loop - due files of every tick (interrupts, softirqs and every cpufreq/cpuidle
+ * file) are read by one io_uring_enter per round of reads.
+ * @return Engine, NULL if io_uring is not enabled or on allocation error - collectors then read with pread.
+ */
+static IoBatch* reader_batch_create(const size_t no_collectors)
+{
+    if(!g_io_uring)
+        return NULL;
+    return iobatch_create(no_collectors + g_no_cpus * (1 + cpufreq_no_states(g_cpufreq)), true);
+}
 
 /**
  * Reader thread function
+ * Multiplexes libcut sampling and the per-process and cgroup collectors on this thread.
+ * Every new sample is sent to the analyzer.
  */
 static void* reader_func(void* args)
 {
     WDCommunication * wdc = (WDCommunication *) args;
+    CutSample sample = {0};
+    Collector cut_c, top_c, cgroup_c, freq_c, irq_c, softirq_c, stop_c;
+    Collector* const collectors[] = {&cut_c, &top_c, &cgroup_c, &freq_c, &irq_c, &softirq_c, &stop_c};
+    const size_t no_collectors = sizeof(collectors)/sizeof(collectors[0]);
+    TRACE_THREAD("reader");
+
+    // Virtual collector - no path, sampled on pressure events too
+    cut_c = (Collector){.name = "cut",
+                        .interval_ms = atomic_load(&g_interval_ms),
+                        .fd = -1,
+                        .event_fd = cut_event_fd(g_cut),
+                        .collect = reader_cut_collect,
+                        .data = &sample
+                       };
+    cut_c.next_due_ns = collector_now_ns() + (uint64_t)cut_c.interval_ms * 1000000u;
+    stop_c = (Collector){.name = "shutdown",
+                         .interval_ms = UINT32_MAX,
+                         .next_due_ns = UINT64_MAX,
+                         .fd = -1,
+                         .event_fd = shutdown_fd(),
+                         .poll_events = POLLIN,
+                         .collect = reader_stop_collect
+                        };
+    if(cut_c.event_fd >= 0)
+        logger_write("READER - PSI trigger armed", LOG_STARTUP);
+    if(!proctop_collector_init(&top_c, g_proc_top, PROCTOP_PROC_ROOT))
+        logger_write("READER - per-process collector not available", LOG_WARNING);
+    if(!cgroup_collector_init(&cgroup_c, g_cgroups, NULL))
+        logger_write("READER - cgroup v2 collector not available", LOG_WARNING);
+    if(!cpufreq_collector_init(&freq_c, g_cpufreq, CPUFREQ_SYSFS_ROOT, cut_c.interval_ms))
+        logger_write("READER - cpufreq/cpuidle collector not available", LOG_WARNING);
+    const bool irq_available = irqstat_collector_init(&irq_c, g_irqstat, IRQSTAT_HARD);
+    if(!irqstat_collector_init(&softirq_c, g_irqstat, IRQSTAT_SOFT) || !irq_available)
+        logger_write("READER - interrupts/softirqs collector not available", LOG_WARNING);
+    IoBatch* const batch = reader_batch_create(no_collectors);
+    if(iobatch_uses_uring(batch))
+        logger_write("READER - files are read with io_uring", LOG_STARTUP);
+    else if(g_io_uring)
+        logger_write("READER - io_uring not available, files are read with pread", LOG_WARNING);
+
     while(1)
     {
-        // Produce
-        CPURawStats data = reader_load_data(g_no_cpus);
-        // Add to the buffer
-        if(queue_enqueue(g_reader_analyzer_queue, &data, 2) != QSUCCESS)
+        if(sample.steal_pr == NULL && !sample_alloc(&sample))
         {
-            logger_write("Reader error while adding data to the buffer", LOG_ERROR);
-            pthread_exit(NULL);
+            logger_write("Reader allocation error", LOG_ERROR);
+            break;
+        }
+        collector_run_due_batch(collectors, no_collectors, batch);
+        if(cut_c.updated)
+        {
+            cut_c.updated = false;
+            if(g_adaptive != NULL)
+            {
+                cut_c.interval_ms = sampling_adapt(&sample);
+                cut_c.next_due_ns = sample.timestamp_ns + (uint64_t)cut_c.interval_ms * 1000000u;
+                // Frequencies are measured over the same period as the usage they scale
+                freq_c.interval_ms = cut_c.interval_ms;
+                freq_c.next_due_ns = cut_c.next_due_ns;
+            }
+            // Add to the buffer - analyzer takes over the sample buffers
+            TRACE_BEGIN(enqueue);
+            TRACE_FLOW_START("sample", sample.timestamp_ns);
+            const QueueErrorCode ret = queue_enqueue(g_reader_analyzer_queue, &sample, 2);
+            TRACE_END(enqueue, "queue put");
+            if(ret != QSUCCESS)
+            {
+                if(ret != QCLOSED)
+                    logger_write("Reader error while adding data to the buffer", LOG_ERROR);
+                break;
+            }
+            sample.usage.cores_bp = NULL;
+            sample.steal_pr = NULL;
+            logger_write("READER - new data to analyze sent", LOG_INFO);
         }
-        logger_write("READER - new data to analyze sent", LOG_INFO);
 
         if(compare_flag(g_termination_flag, 1))
             break;
 
         logger_write("READER - goes to sleep", LOG_INFO);
         watchdog_send_signal(wdc);
-
-        // sleep 1 second
-        struct timespec sleepTime;
-        sleepTime.tv_sec = 1;
-        sleepTime.tv_nsec = 0;
-        nanosleep(&sleepTime, NULL);
+        // sleep until the nearest collector is due or pressure event
+        collector_wait(collectors, no_collectors);
     }
+    free(sample.steal_pr);
+    iobatch_delete(batch);
+    // cut_c and stop_c have no files of their own
+    collector_close(&top_c);
+    collector_close(&cgroup_c);
+    collector_close(&freq_c);
+    collector_close(&irq_c);
+    collector_close(&softirq_c);
+    shutdown_request();     // no-op on shutdown, stops the pipeline on error
     pthread_exit(NULL);
 }
 
 /**
- * Analyzer thread function
- * Responsible for calculating the percentage of CPU usage from the prepared structure and
- * sending the results to the printer.
+ * Measures the spread of the load across cores and sockets and logs when a hot core or an imbalance shows up or
+ * goes away.
+ * @param interval_s - time since previous sample
+ * @param streaks_ms - saturation streak of every core, kept by the caller
+ * @param prev - balance of the previous sample, updated here
  */
-static void* analyzer_func(void* args)
+static void analyzer_check_balance(UsagePercentage* const usage, const double interval_s, uint32_t* const streaks_ms,
+                                   Balance* const prev)
 {
-    WDCommunication* wdc = (WDCommunication *) args;
-    CPURawStats* data = malloc(sizeof(Stats)*(g_no_cpus+1));
+    analyzer_balance(usage->cores_bp, g_socket_of, g_no_sockets, g_no_cpus, interval_s, streaks_ms, &usage->balance);
+    const Balance* const b = &usage->balance;
+    char msg[128];
+    if(b->hot && (!prev->hot || b->hot_cpu != prev->hot_cpu))
+    {
+        snprintf(msg, sizeof(msg), "ANALYZER - hot core: cpu%u saturated for %.1f s, other cores mostly idle",
+                 b->hot_cpu + 1, (double)b->hot_streak_ms / 1000);
+        logger_write(msg, LOG_WARNING);
+    }
+    else if(!b->hot && prev->hot)
+        logger_write("ANALYZER - hot core cleared", LOG_WARNING);
+    if(b->imbalance && !prev->imbalance)
+    {
+        snprintf(msg, sizeof(msg), "ANALYZER - load imbalance: gini %.2f stddev %.1f%% max %.1f%% min %.1f%%",
+                 (double)b->gini_bp / USAGE_FULL_BP, usage_bp_to_pr(b->stddev_bp), usage_bp_to_pr(b->max_bp),
+                 usage_bp_to_pr(b->min_bp));
+        logger_write(msg, LOG_WARNING);
+    }
+    else if(!b->imbalance && prev->imbalance)
+        logger_write("ANALYZER - load imbalance cleared", LOG_WARNING);
+    if(b->socket_imbalance && !prev->socket_imbalance)
+    {
+        int len = snprintf(msg, sizeof(msg), "ANALYZER - socket imbalance:");
+        for (uint32_t s = 0; s < b->no_sockets && len > 0 && (size_t)len < sizeof(msg); s++)
+            len += snprintf(msg + len, sizeof(msg) - (size_t)len, " socket%u %.1f%%", s,
+                            usage_bp_to_pr(b->sockets[s].mean_bp));
+        logger_write(msg, LOG_WARNING);
+    }
+    else if(!b->socket_imbalance && prev->socket_imbalance)
+        logger_write("ANALYZER - socket imbalance cleared", LOG_WARNING);
+    for (uint32_t s = 0; s < b->no_sockets; s++)
+    {
+        const SocketBalance* const sb = &b->sockets[s];
+        if(sb->imbalance && !prev->sockets[s].imbalance)
+        {
+            snprintf(msg, sizeof(msg), "ANALYZER - load imbalance in socket%u: gini %.2f max %.1f%% min %.1f%%", s,
+                     (double)sb->gini_bp / USAGE_FULL_BP, usage_bp_to_pr(sb->max_bp), usage_bp_to_pr(sb->min_bp));
+            logger_write(msg, LOG_WARNING);
+        }
+        else if(!sb->imbalance && prev->sockets[s].imbalance)
+        {
+            snprintf(msg, sizeof(msg), "ANALYZER - load imbalance in socket%u cleared", s);
+            logger_write(msg, LOG_WARNING);
+        }
+    }
+    *prev = *b;
+}
 
-    bool first_iter = true;
+/**
+ * Scales usage of every core by its current frequency - a busy core at half its frequency used half its capacity.
+ * @param khz - scratch for the current and the maximal frequency of every core, 2 * g_no_cpus values
+ * @param effective - effective usage of every core, usage->effective_cores_bp points to it
+ */
+static void analyzer_scale_frequency(UsagePercentage* const usage, uint32_t* const khz, uint16_t* const effective)
+{
+    usage->effective_cores_bp = effective;
+    if(cpufreq_get_khz(g_cpufreq, khz, khz + g_no_cpus))
+        usage->effective_bp = analyzer_effective_cores(usage->cores_bp, khz, khz + g_no_cpus, g_no_cpus, effective);
+    else
+    {
+        memcpy(effective, usage->cores_bp, sizeof(uint16_t) * g_no_cpus);
+        usage->effective_bp = usage->total_bp;
+    }
+}
+
+/**
+ * @return Values of the changed cores of a ring sample, they follow its bitmap.
+ */
+static uint16_t* ring_values(const RingSample* const sample)
+{
+    return (uint16_t*)(void*)&sample->changed[DELTA_WORDS(g_no_cpus)];
+}
 
-    uint64_t* prev_total = calloc(g_no_cpus+1 ,sizeof(uint64_t));
-    uint64_t* prev_idle = calloc(g_no_cpus+1 ,sizeof(uint64_t));
+/**
+ * Applies a ring sample to the consumer's copy of the cores.
+ * @param cores - consumer's copy of every core
+ * @param usage - set to the sample with cores_bp pointing to the copy
+ */
+static void ring_apply(const RingSample* const sample, uint16_t* const cores, UsagePercentage* const usage)
+{
+    delta_apply(cores, sample->changed, ring_values(sample), g_no_cpus);
+    *usage = sample->usage;
+    usage->cores_bp = cores;
+}
 
-    if(prev_total == NULL || prev_idle == NULL)
+/**
+ * Analyzer thread function
+ * Feeds every sample to the statistics and alerts and publishes the cores that moved in the ring for the
+ * recorder and exporter and the latest sample in the mailbox for the printer.
+ */
+static void* analyzer_func(void* args)
+{
+    WDCommunication* wdc = (WDCommunication *) args;
+    CutSample* data = malloc(sizeof(*data));
+    uint32_t* const streaks = calloc(g_no_cpus, sizeof(uint32_t));
+    uint16_t* const shadow = malloc(sizeof(uint16_t) * g_no_cpus);
+    uint32_t* const khz = malloc(sizeof(uint32_t) * 2 * g_no_cpus);
+    uint16_t* const effective = malloc(sizeof(uint16_t) * g_no_cpus);
+    Balance balance = {0};
+    DeltaCopies copies;
+    DeltaLog log;
+    const bool copies_ok = delta_copies_init(&copies, g_no_cpus);
+    const bool log_ok = delta_log_init(&log, g_no_cpus, ANALYZER_RING_CAPACITY);
+    if(!copies_ok || !log_ok || data == NULL || streaks == NULL || shadow == NULL || khz == NULL || effective == NULL)
     {
+        free(data);
+        free(streaks);
+        free(shadow);
+        free(khz);
+        free(effective);
+        delta_copies_destroy(&copies);
+        delta_log_destroy(&log);
         logger_write("Allocation error", LOG_ERROR);
-        // One of the pointers is possibly not NULL, free(ptr) - If ptr is NULL, no operation is performed.
-        free(prev_idle);
-        free(prev_total);
         pthread_exit(NULL);
     }
-    while(compare_flag(g_termination_flag, 0))
+    // Nothing sent yet - the first sample sends every core
+    for (size_t j = 0; j < g_no_cpus; j++)
+        shadow[j] = DELTA_UNKNOWN_BP;
+    uint64_t no_samples = 0, no_sent = 0;
+    TRACE_THREAD("analyzer");
+    while(1)
     {
-        // Pop from buffer
+        // Pop from buffer - after shutdown the queue is closed and drained
         // Queue structure is thread safe
-        if (queue_dequeue(g_reader_analyzer_queue, data, 2) != QSUCCESS)
+        TRACE_BEGIN(wait);
+        const QueueErrorCode ret = queue_dequeue(g_reader_analyzer_queue, data, wait_timeout_s());
+        TRACE_END(wait, "queue wait");
+        if(ret == QCLOSED)
+            break;
+        if(ret != QSUCCESS)
         {
             logger_write("Analyzer error while removing data from the buffer", LOG_ERROR);
             break;
         }
         logger_write("ANALYZER - new data to analyze received", LOG_INFO);
 
-        // Consume / Analyze
-        if (first_iter)
+        TRACE_BEGIN(analyze);
+        TRACE_FLOW_END("sample", data->timestamp_ns);
+        analyzer_scale_frequency(&data->usage, khz, effective);
+        // Write the only copy into the ring - consumers read it in place
+        void* slot;
+        if(broadcast_claim(g_analyzer_ring, &slot, wait_timeout_s()) != BSUCCESS)
         {
-            analyzer_update_prev(prev_total, prev_idle, *data, g_no_cpus);
-            first_iter = false;
+            free(data->steal_pr);
+            logger_write("Analyzer error while adding data to the ring", LOG_ERROR);
+            break;
         }
-        else
-        {
-            UsagePercentage to_print;
-            to_print.cores_pr = malloc(sizeof(double)*(g_no_cpus));
-            //Total
-            to_print.total_pr =  analyzer_analyze(&prev_total[0], &prev_idle[0], data->total);
-
-            // Cores
-            for (size_t j = 0; j < g_no_cpus; ++j)
-                to_print.cores_pr[j] =  analyzer_analyze(&prev_total[j+1], &prev_idle[j+1], data->cpus[j]);
+        // Only the cores that moved go downstream - together with the ones a skipping consumer missed, the
+        // history takes the same update
+        RingSample* const out = slot;
+        out->timestamp_ns = realtime_now_ns();
+        out->usage = data->usage;
+        out->usage.cores_bp = NULL;
+        out->usage.effective_cores_bp = NULL;
+        delta_encode(data->usage.cores_bp, shadow, g_no_cpus, g_delta_threshold_bp, out->changed, ring_values(out));
+        delta_copies_mark(&copies, out->changed);
+        out->no_changed = (uint32_t)delta_log_since(&log, no_samples++, broadcast_oldest_unread(g_analyzer_ring),
+                                                    shadow, out->changed, ring_values(out));
+        no_sent += out->no_changed;
+        corestats_push_delta(g_core_stats, data->usage.total_bp, out->changed, ring_values(out), data->interval_s);
+        analyzer_check_balance(&data->usage, data->interval_s, streaks, &balance);
+        alerts_evaluate(g_alerts, &data->usage, data->steal_pr, data->interval_s);
+        out->usage.balance = data->usage.balance;
 
-            // Send to print
-            if(queue_enqueue(g_analyzer_printer_queue, &to_print, 2) != QSUCCESS)
-            {
-                logger_write("Analyzer error while adding data to the buffer", LOG_ERROR);
-                break;
-            }
-            logger_write("ANALYZER - new data to print sent", LOG_INFO);
-        }
-        free(data->cpus);
+        // Replaces the sample the printer did not draw yet - its buffer gets the cores changed since it was filled
+        FrameSample* const latest = mailbox_back(g_printer_mailbox);
+        latest->timestamp_ns = out->timestamp_ns;
+        latest->usage = out->usage;
+        latest->usage.cores_bp = latest->cores_bp;
+        latest->usage.effective_cores_bp = latest->cores_bp + g_no_cpus;
+        delta_copies_sync(&copies, latest->cores_bp, shadow);
+        memcpy(latest->usage.effective_cores_bp, effective, sizeof(uint16_t) * g_no_cpus);
+        TRACE_FLOW_START("frame", latest->timestamp_ns);
+        mailbox_publish(g_printer_mailbox);
+        broadcast_publish(g_analyzer_ring);
+        TRACE_END(analyze, "analyze");
+        free(data->steal_pr);
+        logger_write("ANALYZER - new data to print sent", LOG_INFO);
         watchdog_send_signal(wdc);
     }
-    // Cleanup
+    if(no_samples != 0)
+    {
+        char msg[128];
+        snprintf(msg, sizeof(msg), "ANALYZER - %.1f of %zu cores sent downstream per sample on average",
+                 (double)no_sent / (double)no_samples, g_no_cpus);
+        logger_write(msg, LOG_INFO);
+    }
+    // Consumers drain what was published and finish
+    broadcast_close(g_analyzer_ring);
+    shutdown_request();
     free(data);
-    free(prev_total);
-    free(prev_idle);
+    free(streaks);
+    free(shadow);
+    free(khz);
+    free(effective);
+    delta_copies_destroy(&copies);
+    delta_log_destroy(&log);
     pthread_exit(NULL);
 }
 
+/**
+ * Prints load average, cpu pressure and run-queue wait - only sources available on this kernel.
+ */
+static void printer_print_sysload(const UsagePercentage* to_print)
+{
+    const SysLoad* const sys = &to_print->sys;
+    if(sys->sources & SYSLOAD_LOADAVG)
+        printf("load: %.2f %.2f %.2f (%u/%u)\t", sys->load.avg[0], sys->load.avg[1], sys->load.avg[2],
+               sys->load.runnable, sys->load.threads);
+    if(sys->sources & SYSLOAD_PSI)
+        printf("psi some: %.2f%% full: %.2f%%\t", sys->psi.some_avg[0], sys->psi.full_avg[0]);
+    if(sys->sources & SYSLOAD_SCHEDSTAT)
+        printf("runq wait: %.2f ms/s", to_print->runq_wait_ms);
+    printf("\n");
+}
+
+/**
+ * Prints spread of the load across cores, hot core and imbalance are highlighted.
+ */
+static void printer_print_balance(const UsagePercentage* to_print)
+{
+    const Balance* const b = &to_print->balance;
+    printf("balance: min %.1f%% max %.1f%% stddev %.1f%% gini %.2f saturated %u", usage_bp_to_pr(b->min_bp),
+           usage_bp_to_pr(b->max_bp), usage_bp_to_pr(b->stddev_bp), (double)b->gini_bp / USAGE_FULL_BP,
+           b->no_saturated);
+    if(b->hot)
+        printf("\t\033[1;31mHOT CORE cpu%u (%.0f s)\033[0m", b->hot_cpu + 1, (double)b->hot_streak_ms / 1000);
+    if(b->imbalance)
+        printf("\t\033[1;33mIMBALANCE\033[0m");
+    printf("\n");
+    // One socket is the whole machine - nothing more to show
+    if(b->no_sockets < 2)
+        return;
+    printf("sockets:");
+    for (uint32_t s = 0; s < b->no_sockets; s++)
+    {
+        const SocketBalance* const sb = &b->sockets[s];
+        printf(" socket%u %.1f%% (gini %.2f)%s", s, usage_bp_to_pr(sb->mean_bp), (double)sb->gini_bp / USAGE_FULL_BP,
+               sb->imbalance ? " \033[1;33mIMBALANCE\033[0m" : "");
+    }
+    if(b->socket_imbalance)
+        printf("\t\033[1;33mSOCKET IMBALANCE\033[0m");
+    printf("\n");
+}
+
+/**
+ * Prints cpu time, memory and context switches of the tracker itself, so its effect can be subtracted.
+ */
+static void printer_print_self(void)
+{
+    SelfUsage self;
+    if(!selfstat_sample(g_self, &self))
+        return;
+    printf("self:\t cpu %.2f%% (%.0f ms total)  rss %.1f MB  ctx switches %.1f vol/s %.1f invol/s\n", self.cpu_pr,
+           self.cpu_ms, (double)self.rss_kb / 1024, self.vol_cs_s, self.invol_cs_s);
+}
+
+/**
+ * Prints one of the busiest processes next to the bar in given row and ends the line.
+ */
+static void printer_print_top_row(const ProcTopEntry* top, size_t no_top, size_t row)
+{
+    if(row < no_top)
+        printf("\033[0m\t%7d %-15s %5.1f%%", top[row].pid, top[row].comm, top[row].cpu_pr);
+    printf("\n");
+}
+
+/**
+ * Prints the hottest cgroups - usage relative to quota and allowed cpus, and throttling.
+ */
+static void printer_print_cgroups(void)
+{
+    CgroupTopEntry top[CGROUP_DEFAULT_N];
+    size_t no_cgroups = 0;
+    const size_t no_top = cgroup_get_top(g_cgroups, top, CGROUP_DEFAULT_N, &no_cgroups);
+    if(no_top == 0)
+        return;
+    printf("\n%-48s %8s %8s %7s %12s %12s\t(%zu cgroups)\n", "CGROUP", "CPUS", "LIMIT", "USE", "THR ms/s",
+           "SUBTREE THR", no_cgroups);
+    for (size_t i = 0; i < no_top; i++)
+        printf("%-48s %8.2f %8.2f %6.1f%% %12.1f %12.1f\n", top[i].path, top[i].usage_cpus, top[i].limit_cpus,
+               top[i].usage_limit_pr, top[i].throttled_ms, top[i].subtree_throttled_ms);
+}
+
+/**
+ * Prints frequency, frequency-scaled usage and residency of the deepest idle state of the core.
+ */
+static void printer_print_freq(const UsagePercentage* to_print, const size_t cpu)
+{
+    CpuFreqCore core;
+    if(!cpufreq_get_core(g_cpufreq, cpu, &core))
+        return;
+    if(core.cur_khz != 0 && to_print->effective_cores_bp != NULL)
+        printf(" %4.2fGHz eff %5.1f%%", (double)core.cur_khz / 1e6, usage_bp_to_pr(to_print->effective_cores_bp[cpu]));
+    const size_t no_states = cpufreq_no_states(g_cpufreq);
+    if(no_states != 0)
+        printf(" %s %3.0f%%", cpufreq_state_name(g_cpufreq, no_states - 1),
+               usage_bp_to_pr(core.residency_bp[no_states - 1]));
+}
+
+/**
+ * Busiest interrupt and softirq sources of a hot core - shows which device or softirq vector keeps it busy.
+ */
+static void printer_print_irqs(const UsagePercentage* to_print, const size_t cpu)
+{
+    IrqTop top[IRQSTAT_TOP_N];
+    if(to_print->cores_bp[cpu] < IRQSTAT_HOT_BP)
+        return;
+    const size_t no_top = irqstat_top(g_irqstat, cpu, top, IRQSTAT_TOP_N);
+    for (size_t i = 0; i < no_top; i++)
+    {
+        if(top[i].rate >= 10000)
+            printf(" %s%s %.1fk/s", top[i].kind == IRQSTAT_SOFT ? "si:" : "", top[i].name, top[i].rate / 1000.0);
+        else
+            printf(" %s%s %u/s", top[i].kind == IRQSTAT_SOFT ? "si:" : "", top[i].name, top[i].rate);
+    }
+}
+
+/**
+ * Writes a prerendered frame - usually with a single write, the terminal never shows a half-drawn frame.
+ */
+static void printer_write_frame(const char* frame, size_t len)
+{
+    while(len != 0)
+    {
+        const ssize_t written = write(STDOUT_FILENO, frame, len);
+        if(written <= 0)
+            break;
+        frame += written;
+        len -= (size_t)written;
+    }
+}
+
+/**
+ * Draws one heatmap frame.
+ */
+static void printer_render_heatmap(const UsagePercentage* to_print)
+{
+    const char* frame;
+    const size_t len = heatmap_render(g_heatmap, to_print, g_core_stats, &frame);
+    printer_write_frame(frame, len);
+}
+
+/**
+ * Draws one frame - bars of total and every core with their statistics, load, busiest processes and cgroups.
+ */
+static void printer_render(const UsagePercentage* to_print)
+{
+    if(g_heatmap != NULL)
+    {
+        printer_render_heatmap(to_print);
+        return;
+    }
+    size_t i;
+    ProcTopEntry top[PROCTOP_DEFAULT_N];
+    const size_t no_top = proctop_get(g_proc_top, top, PROCTOP_DEFAULT_N);
+
+    // Print
+    // system("tput cup 1 0");  // - Better than clear, but it's buggy when terminal window is too small
+    system("clear");
+    printf("\t\t\033[3;33m*** CUT - CPU Usage Tracker ~ Sebastian Wozniak ***\033[0m\n"); // print here using clear
+    printf("TOTAL:\t ╠");
+    size_t pr = to_print->total_bp / 100u;
+    for (i = 0; i < pr; i++)
+        printf("▒");
+
+    for (i = 0; i < 100 - pr; i++)
+        printf("-");
+
+    printf("╣ %.1f%% \tavg1m %.1f%% p95 %.0f%%", usage_bp_to_pr(to_print->total_bp),
+           corestats_ewma(g_core_stats, 0, 0), corestats_percentile(g_core_stats, 0, 95));
+    if(no_top != 0)
+        printf("\t%7s %-15s %6s", "PID", "COMMAND", "CPU");
+    printf("\n");
+    printer_print_self();
+    if(g_adaptive != NULL)
+        printf("interval: %u ms\t", atomic_load(&g_interval_ms));
+    printer_print_sysload(to_print);
+    printer_print_balance(to_print);
+
+    for (size_t j = 0; j < g_no_cpus; j++)
+    {
+        printf("\033[0;%zumcpu%zu:\t ╠", 31 + (j % 6), j+1);
+        pr = to_print->cores_bp[j] / 100u;
+        for (i = 0; i < pr; i++)
+            printf("▒");
+
+        for (i = 0; i < 100 - pr; i++)
+            printf("-");
+
+        printf("╣ %.1f%% \tavg1m %.1f%% p95 %.0f%%", usage_bp_to_pr(to_print->cores_bp[j]),
+               corestats_ewma(g_core_stats, j+1, 0), corestats_percentile(g_core_stats, j+1, 95));
+        printer_print_freq(to_print, j);
+        printer_print_irqs(to_print, j);
+        printer_print_top_row(top, no_top, j);
+    }
+    printf("\033[0m");
+    // Fewer cores than processes to show - rest of the list below the bars
+    for (size_t j = g_no_cpus; j < no_top; j++)
+    {
+        printf("\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t");
+        printer_print_top_row(top, no_top, j);
+    }
+    printer_print_cgroups();
+}
+
+/**
+ * Sleeps until the next frame. A frame that took longer than the frame period starts the next one right away,
+ * missed frames are not caught up.
+ */
+static void printer_next_frame(struct timespec* const frame)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    frame->tv_nsec += PRINTER_FRAME_NS;
+    if(frame->tv_nsec >= 1000000000)
+    {
+        frame->tv_sec++;
+        frame->tv_nsec -= 1000000000;
+    }
+    if(frame->tv_sec < now.tv_sec || (frame->tv_sec == now.tv_sec && frame->tv_nsec < now.tv_nsec))
+        *frame = now;
+    else
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, frame, NULL);
+}
+
 /**
  * Printer thread function.
- * Responsible for displaying prepared data in the terminal.
+ * Responsible for displaying prepared data in the terminal. Draws the latest sample at a fixed frame rate -
+ * samples published within one frame replace each other, the recorder and exporter still get every one.
  */
 static void* printer_func(void* args)
 {
@@ -162,61 +796,321 @@ static void* printer_func(void* args)
     // system func - there should not be any problems related to thread safety as long as there are no other threads attempting to call system concurrently.
     system("clear");
     // printf("\t\t\033[3;33m*** CUT - CPU Usage Tracker ~ Sebastian Wozniak ***\033[0m\n");  // print here using tput
-    UsagePercentage* to_print = malloc(sizeof(double)*(g_no_cpus+1));
-    if(to_print == NULL)
+    TRACE_THREAD("printer");
+    struct timespec frame;
+    clock_gettime(CLOCK_MONOTONIC, &frame);
+    while(compare_flag(g_termination_flag, 0))
     {
-        logger_write("Allocation error in printer thread", LOG_ERROR);
+        // Nothing new - the frame on the screen stays
+        bool fresh;
+        const FrameSample* const sample = mailbox_latest(g_printer_mailbox, &fresh);
+        if(fresh)
+        {
+            logger_write("PRINTER - new data to print received", LOG_INFO);
+            TRACE_BEGIN(render);
+            TRACE_FLOW_END("frame", sample->timestamp_ns);
+            printer_render(&sample->usage);
+            fflush(stdout);
+            TRACE_END(render, "render");
+        }
+        watchdog_send_signal(wdc);
+        TRACE_BEGIN(wait);
+        printer_next_frame(&frame);
+        TRACE_END(wait, "frame wait");
+    }
+    const uint64_t not_drawn = mailbox_published(g_printer_mailbox) - mailbox_taken(g_printer_mailbox);
+    if(not_drawn != 0)
+    {
+        char msg[128];
+        snprintf(msg, sizeof(msg), "PRINTER - %" PRIu64 " samples replaced by newer ones within a frame were not "
+                 "drawn", not_drawn);
+        logger_write(msg, LOG_INFO);
+    }
+    shutdown_request();
+    pthread_exit(NULL);
+}
+
+/**
+ * Recorder thread function
+ * Writes every sample to the recording - the analyzer waits rather than a sample is missed.
+ */
+static void* recorder_func(void* args)
+{
+    (void) args;
+    const void* slot;
+    BroadcastErrorCode ret;
+    uint16_t* const cores = calloc(g_no_cpus, sizeof(uint16_t));
+    if(cores == NULL)
+    {
+        logger_write("Recorder allocation error", LOG_ERROR);
         pthread_exit(NULL);
     }
-    while(compare_flag(g_termination_flag, 0))
+    TRACE_THREAD("recorder");
+    while((ret = broadcast_wait(g_analyzer_ring, g_recorder_consumer, &slot, wait_timeout_s())) != BCLOSED)
     {
-        size_t i;
-        // Remove from buffer
-        if (queue_dequeue(g_analyzer_printer_queue, to_print, 2) != QSUCCESS)
-        {
-            logger_write("Printer error while removing data from the buffer", LOG_ERROR);
+        if(ret == BTIMEOUT)
+            continue;   // analyzer is watched by its watchdog and closes the ring when it finishes
+        if(ret != BSUCCESS)
             break;
-        }
-        logger_write("PRINTER - new data to print received", LOG_INFO);
-
-        // Print
-        // system("tput cup 1 0");  // - Better than clear, but it's buggy when terminal window is too small
-        system("clear");
-        printf("\t\t\033[3;33m*** CUT - CPU Usage Tracker ~ Sebastian Wozniak ***\033[0m\n"); // print here using clear
-        printf("TOTAL:\t ╠");
-        size_t pr = (size_t) to_print->total_pr;
-        for (i = 0; i < pr; i++)
-            printf("▒");
+        const RingSample* const sample = slot;
+        UsagePercentage usage;
+        TRACE_BEGIN(record);
+        ring_apply(sample, cores, &usage);
+        if(!recorder_write(g_recorder, sample->timestamp_ns, &usage))
+            logger_write("Recorder write error", LOG_ERROR);
+        TRACE_END(record, "record");
+        broadcast_release(g_analyzer_ring, g_recorder_consumer);
+    }
+    free(cores);
+    pthread_exit(NULL);
+}
 
-        for (i = 0; i < 100 - pr; i++)
-            printf("-");
+/**
+ * Exporter thread function
+ * Publishes the latest sample to the Prometheus endpoint, shared memory and the fleet collector.
+ * The sample it jumps to carries the cores changed in the skipped ones too.
+ */
+static void* export_func(void* args)
+{
+    (void) args;
+    const void* slot;
+    BroadcastErrorCode ret;
+    uint16_t* const cores = calloc(g_no_cpus, sizeof(uint16_t));
+    if(cores == NULL)
+    {
+        logger_write("Exporter allocation error", LOG_ERROR);
+        pthread_exit(NULL);
+    }
+    TRACE_THREAD("exporter");
+    while((ret = broadcast_wait(g_analyzer_ring, g_export_consumer, &slot, wait_timeout_s())) != BCLOSED)
+    {
+        if(ret == BTIMEOUT)
+            continue;
+        if(ret != BSUCCESS)
+            break;
+        const RingSample* const sample = slot;
+        UsagePercentage usage;
+        TRACE_BEGIN(export);
+        ring_apply(sample, cores, &usage);
+        exporter_publish(g_exporter, &usage, g_no_cpus);
+        shmpub_publish(g_shm, &usage);
+        agent_publish(g_agent, sample->timestamp_ns / 1000000u, &usage);
+        TRACE_END(export, "export");
+        broadcast_release(g_analyzer_ring, g_export_consumer);
+    }
+    free(cores);
+    pthread_exit(NULL);
+}
 
-        printf("╣ %.1f%% \n", to_print->total_pr);
+/**
+ * Restarts the periodic sampling timer with new interval.
+ */
+static bool single_thread_set_timer(const int timer_fd, const uint32_t interval_ms)
+{
+    const struct timespec ts = {.tv_sec = interval_ms / 1000, .tv_nsec = (long)(interval_ms % 1000) * 1000000};
+    const struct itimerspec period = {.it_interval = ts, .it_value = ts};
+    return timerfd_settime(timer_fd, 0, &period, NULL) == 0;
+}
 
-        for (size_t j = 0; j < g_no_cpus; j++)
-        {
-            printf("\033[0;%zumcpu%zu:\t ╠", 31 + (j % 6), j+1);
-            pr = (size_t) to_print->cores_pr[j];
-            for (i = 0; i < pr; i++)
-                printf("▒");
+/**
+ * Single-threaded mode - one epoll loop on a timerfd (and cpu pressure trigger) samples, analyzes, prints
+ * and logs in sequence. No queues, no watchdogs, sample buffers are allocated once.
+ * @return EXIT_SUCCESS after SIGTERM, EXIT_FAILURE on error.
+ */
+static int single_thread_run(void)
+{
+    int ret = EXIT_FAILURE;
+    TRACE_THREAD("main");
+    Collector top_c, cgroup_c, freq_c, irq_c, softirq_c;
+    Collector* const collectors[] = {&top_c, &cgroup_c, &freq_c, &irq_c, &softirq_c};
+    const size_t no_collectors = sizeof(collectors)/sizeof(collectors[0]);
+    CutSample sample = {0};
+    sample_alloc(&sample);
+    uint32_t* const streaks = calloc(g_no_cpus, sizeof(uint32_t));
+    uint32_t* const khz = malloc(sizeof(uint32_t) * 2 * g_no_cpus);
+    uint16_t* const effective = malloc(sizeof(uint16_t) * g_no_cpus);
+    Balance balance = {0};
+    const int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    const int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    const int event_fd = cut_event_fd(g_cut);
 
-            for (i = 0; i < 100 - pr; i++)
-                printf("-");
+    if(!proctop_collector_init(&top_c, g_proc_top, PROCTOP_PROC_ROOT))
+        logger_write("MAIN - per-process collector not available", LOG_WARNING);
+    if(!cgroup_collector_init(&cgroup_c, g_cgroups, NULL))
+        logger_write("MAIN - cgroup v2 collector not available", LOG_WARNING);
+    if(!cpufreq_collector_init(&freq_c, g_cpufreq, CPUFREQ_SYSFS_ROOT, atomic_load(&g_interval_ms)))
+        logger_write("MAIN - cpufreq/cpuidle collector not available", LOG_WARNING);
+    const bool irq_available = irqstat_collector_init(&irq_c, g_irqstat, IRQSTAT_HARD);
+    if(!irqstat_collector_init(&softirq_c, g_irqstat, IRQSTAT_SOFT) || !irq_available)
+        logger_write("MAIN - interrupts/softirqs collector not available", LOG_WARNING);
+    IoBatch* const batch = reader_batch_create(no_collectors);
+    if(iobatch_uses_uring(batch))
+        logger_write("MAIN - files are read with io_uring", LOG_STARTUP);
+    else if(g_io_uring)
+        logger_write("MAIN - io_uring not available, files are read with pread", LOG_WARNING);
+    if(sample.steal_pr == NULL || streaks == NULL || khz == NULL || effective == NULL || epoll_fd < 0 || timer_fd < 0)
+    {
+        logger_write("Single-thread loop setup error", LOG_ERROR);
+        goto error_handler;
+    }
+    struct epoll_event ev = {.events = EPOLLIN, .data.fd = timer_fd};
+    if(!single_thread_set_timer(timer_fd, atomic_load(&g_interval_ms)) ||
+       epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &ev) != 0)
+    {
+        logger_write("Single-thread timer setup error", LOG_ERROR);
+        goto error_handler;
+    }
+    ev = (struct epoll_event){.events = EPOLLPRI, .data.fd = event_fd};
+    if(event_fd >= 0 && epoll_ctl(epoll_fd, EPOLL_CTL_ADD, event_fd, &ev) == 0)
+        logger_write("MAIN - PSI trigger armed", LOG_STARTUP);
+    ev = (struct epoll_event){.events = EPOLLIN, .data.fd = shutdown_signal_fd()};
+    if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, shutdown_signal_fd(), &ev) != 0)
+    {
+        logger_write("Single-thread signal setup error", LOG_ERROR);
+        goto error_handler;
+    }
+    logger_write("MAIN - single-thread loop started", LOG_STARTUP);
 
-            printf("╣ %.1f%% \n", to_print->cores_pr[j]);
+    system("clear");
+    while(compare_flag(g_termination_flag, 0))
+    {
+        struct epoll_event events[3];
+        const int n = epoll_wait(epoll_fd, events, 3, -1);
+        if(n < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            logger_write("Single-thread loop wait error", LOG_ERROR);
+            goto error_handler;
         }
-        printf("\033[0m");
-        free(to_print->cores_pr);
+        // Only the timer and the PSI trigger take a sample - a resize alone would add one with a short interval
+        bool due = false;
+        for (int i = 0; i < n; i++)
+        {
+            if(events[i].data.fd == timer_fd)
+            {
+                uint64_t expirations;
+                due |= read(timer_fd, &expirations, sizeof(expirations)) > 0;
+            }
+            else if(events[i].data.fd == event_fd)
+                due = true;
+            else if(events[i].data.fd == shutdown_signal_fd() && shutdown_read_signal() != 0)
+                shutdown_request();
+        }
+        if(compare_flag(g_termination_flag, 1))
+            break;  // SIGTERM/SIGINT - no more samples
+        if(!due)
+            continue;
+        collector_run_due_batch(collectors, no_collectors, batch);
+        if(cut_sample(g_cut, &sample) != CUT_SUCCESS)
+        {
+            logger_write("Single-thread sampling error", LOG_ERROR);
+            goto error_handler;
+        }
+        TRACE_BEGIN(analyze);
+        analyzer_scale_frequency(&sample.usage, khz, effective);
+        corestats_push(g_core_stats, sample.usage.total_bp, sample.usage.cores_bp, sample.interval_s);
+        analyzer_check_balance(&sample.usage, sample.interval_s, streaks, &balance);
+        TRACE_END(analyze, "analyze");
+        TRACE_BEGIN(export);
+        exporter_publish(g_exporter, &sample.usage, g_no_cpus);
+        shmpub_publish(g_shm, &sample.usage);
+        agent_publish(g_agent, realtime_now_ns() / 1000000u, &sample.usage);
+        if(g_recorder != NULL && !recorder_write(g_recorder, realtime_now_ns(), &sample.usage))
+            logger_write("Recorder write error", LOG_ERROR);
+        TRACE_END(export, "export");
+        alerts_evaluate(g_alerts, &sample.usage, sample.steal_pr, sample.interval_s);
+        if(g_adaptive != NULL)
+        {
+            const uint32_t interval_ms = atomic_load(&g_interval_ms);
+            if(sampling_adapt(&sample) != interval_ms)
+            {
+                single_thread_set_timer(timer_fd, atomic_load(&g_interval_ms));
+                // Frequencies are measured over the same period as the usage, from the next tick on
+                freq_c.interval_ms = atomic_load(&g_interval_ms);
+                freq_c.next_due_ns = 0;
+            }
+        }
+        TRACE_BEGIN(render);
+        printer_render(&sample.usage);
+        fflush(stdout);
+        TRACE_END(render, "render");
+        logger_write("MAIN - new data printed", LOG_INFO);
+    }
+    ret = EXIT_SUCCESS;
 
-        watchdog_send_signal(wdc);
+    error_handler:
+        iobatch_delete(batch);
+        collector_close(&top_c);
+        collector_close(&cgroup_c);
+        collector_close(&freq_c);
+        collector_close(&irq_c);
+        collector_close(&softirq_c);
+        if(timer_fd >= 0)
+            close(timer_fd);
+        if(epoll_fd >= 0)
+            close(epoll_fd);
+        free(sample.steal_pr);
+        free(streaks);
+        free(khz);
+        free(effective);
+        return ret;
+}
+
+/**
+ * Fleet collector mode - one epoll loop accepts agents and merges their streams, the fleet view is drawn and
+ * the fleet metrics are published once a second. No local sampling, no pipeline threads.
+ * @return EXIT_SUCCESS after SIGTERM, EXIT_FAILURE on error.
+ */
+static int fleet_run(const Options* const opts)
+{
+    Fleet* const fleet = fleet_create(opts->collect_addr);
+    if(fleet == NULL || !fleet_watch(fleet, shutdown_signal_fd()))
+    {
+        logger_write("Fleet collector create error", LOG_ERROR);
+        fleet_delete(fleet);
+        shutdown_cleanup();
+        return EXIT_FAILURE;
     }
-    free(to_print);
-    pthread_exit(NULL);
+    g_exporter = exporter_create(opts->metrics_socket, opts->metrics_port);
+    if(g_exporter == NULL && (opts->metrics_socket != NULL || opts->metrics_port != 0))
+        logger_write("Metrics exporter create error", LOG_WARNING);
+    logger_write("MAIN - fleet collector started", LOG_STARTUP);
+
+    int ret = EXIT_SUCCESS;
+    uint64_t next_ns = collector_now_ns();
+    system("clear");
+    while(compare_flag(g_termination_flag, 0))
+    {
+        const uint64_t now = collector_now_ns();
+        if(now >= next_ns)
+        {
+            const char* frame;
+            const size_t len = fleet_render(fleet, &frame);
+            printer_write_frame(frame, len);
+            exporter_publish_with(g_exporter, fleet_metrics_size(fleet), fleet_render_metrics, fleet);
+            next_ns = now + 1000000000u;
+        }
+        const int polled = fleet_poll(fleet, (int)((next_ns - now) / 1000000u) + 1);
+        if(polled < 0)
+        {
+            logger_write("Fleet collector wait error", LOG_ERROR);
+            ret = EXIT_FAILURE;
+            break;
+        }
+        if(polled == 1 && shutdown_read_signal() != 0)
+            shutdown_request();
+    }
+    exporter_delete(g_exporter);
+    fleet_delete(fleet);
+    shutdown_cleanup();
+    return ret;
 }
 
 /**
  * Watchdog thread uses passed as parameters mutex and condition variable to communicate with one thread.
- * After not receiving any signal for 2 seconds he assumes that the thread is jammed and terminates the program.
+ * After not receiving any signal for two sampling intervals (at least 2 seconds) he assumes that the thread is jammed
+ * and terminates the program.
  */
 static void* watchdog_func(void* args)
 {
@@ -224,14 +1118,15 @@ static void* watchdog_func(void* args)
     struct timespec timeout;
     struct timeval now;
 
+    const int hook = shutdown_add_hook(watchdog_wake_hook, wdc);
     pthread_mutex_lock(&wdc->mutex);
     gettimeofday(&now, NULL);
-    timeout.tv_sec = now.tv_sec + 2;  // Timeout set to 2 seconds
+    timeout.tv_sec = now.tv_sec + wait_timeout_s();  // Timeout scales with the sampling interval
     timeout.tv_nsec = now.tv_usec * 1000;
 
     while(compare_flag(g_termination_flag, 0))
     {
-        // Wait 2 seconds for signal
+        // Wait for signal
         int result = pthread_cond_timedwait(&wdc->signal_cv, &wdc->mutex, &timeout);
         if (result != 0 && compare_flag(g_termination_flag, 0))
         {
@@ -250,35 +1145,65 @@ static void* watchdog_func(void* args)
         } else
         {   // Timeout reset
             gettimeofday(&now, NULL);
-            timeout.tv_sec = now.tv_sec + 2;
+            timeout.tv_sec = now.tv_sec + wait_timeout_s();
             timeout.tv_nsec = now.tv_usec * 1000;
         }
     }
+    // Unlocked first - the hook takes this mutex while holding the shutdown one
+    pthread_mutex_unlock(&wdc->mutex);
+    shutdown_remove_hook(hook);
     pthread_mutex_destroy(&wdc->mutex);
     pthread_cond_destroy(&wdc->signal_cv);
     free(wdc);
     pthread_exit(NULL);
 }
 
+/**
+ * Logs how long threads waited on the queue - shows the latency/cpu trade-off of its wait strategy.
+ */
+static void log_queue_waits(const char* name, const Queue* q)
+{
+    QueueWaitStats stats;
+    queue_get_wait_stats(q, &stats);
+    char message[200];
+    snprintf(message, sizeof(message), "%s queue waits: %" PRIu64 ", avg %.1f us, max %.1f us, "
+             "spin hits %" PRIu64 ", yields %" PRIu64 ", parks %" PRIu64, name, stats.waits,
+             stats.waits == 0 ? 0.0 : (double)stats.wait_ns / (double)stats.waits / 1000,
+             (double)stats.max_wait_ns / 1000, stats.spin_hits, stats.yields, stats.parks);
+    logger_write(message, LOG_INFO);
+}
+
 /**
  * Frees every element that is currently in the queue and destroys queues.
  */
 static void queues_cleanup(void)
 {
-    CPURawStats to_free_1;
-    while(!queue_is_empty(g_reader_analyzer_queue))
+    CutSample to_free_1;
+    // No queues in single-thread mode
+    while(g_reader_analyzer_queue != NULL && !queue_is_empty(g_reader_analyzer_queue))
     {
         queue_dequeue(g_reader_analyzer_queue, &to_free_1, 2);
-        free(to_free_1.cpus);
-    }
-    UsagePercentage to_free_2;
-    while(!queue_is_empty(g_analyzer_printer_queue))
-    {
-        queue_dequeue(g_analyzer_printer_queue,&to_free_2, 2);
-        free(to_free_2.cores_pr);
+        free(to_free_1.steal_pr);
     }
     queue_delete(g_reader_analyzer_queue);
-    queue_delete(g_analyzer_printer_queue);
+    broadcast_delete(g_analyzer_ring);
+    mailbox_delete(g_printer_mailbox);
+    recorder_delete(g_recorder);
+    corestats_delete(g_core_stats);
+    proctop_delete(g_proc_top);
+    cgroup_delete(g_cgroups);
+    cpufreq_delete(g_cpufreq);
+    irqstat_delete(g_irqstat);
+    free(g_socket_of);
+    heatmap_delete(g_heatmap);
+    exporter_delete(g_exporter);
+    shmpub_delete(g_shm);
+    agent_delete(g_agent);
+    alerts_delete(g_alerts);
+    cut_close(g_cut);
+    selfstat_delete(g_self);
+    adaptive_destroy(g_adaptive);
+    shutdown_cleanup();
 }
 
 static void thread_join_create_error(const char* msg)
@@ -288,44 +1213,214 @@ static void thread_join_create_error(const char* msg)
     logger_destroy();
 }
 
-int main(void)
+int main(int argc, char** argv)
 {
     pthread_t reader_th;
     pthread_t analyzer_th;
     pthread_t printer_th;
+    pthread_t recorder_th;
+    pthread_t export_th;
+    Options opts;
+
+    const OptionsErrorCode opts_ret = options_parse(&opts, argc, argv);
+    if(opts_ret != OPTIONS_SUCCESS)
+    {
+        options_usage(argv[0]);
+        return opts_ret == OPTIONS_HELP ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
 
-    if(signal(SIGTERM, signal_handler)== SIG_ERR)
+    // Every thread created later inherits affinity and scheduling of the main thread
+    if(!selfstat_apply_placement(opts.housekeeping_cpus, opts.sched_policy, opts.nice))
+        return EXIT_FAILURE;
+    // SIGTERM and SIGINT are blocked here, before any thread (logger too) is created, and read from a signalfd
+    if(!shutdown_init() || shutdown_add_hook(termination_hook, NULL) < 0)
         return EXIT_FAILURE;
-    // Create logger
-    if(logger_init() == LINIT_ERROR)
+    // Create logger - single-thread mode writes logs directly
+    const QueueKind log_queue = opts.log_lockfree ? QUEUE_LOCKFREE : QUEUE_MUTEX;
+    if((opts.single_thread ? logger_init_sync() : logger_init_queue(log_queue)) == LINIT_ERROR)
     {
         perror("Logger init error");
         return EXIT_FAILURE;
     }
+    if(opts.trace_path != NULL && !TRACE_START(opts.trace_path))
+        logger_write("Trace not started - tracing needs a build with -DCUT_TRACE=ON", LOG_WARNING);
+    // Collector mode only merges what agents send
+    if(opts.collect_addr != NULL)
+    {
+        const int ret = fleet_run(&opts);
+        printf("exit\n");
+        logger_write("Closing program", LOG_INFO);
+        logger_destroy();
+        return ret;
+    }
 
     // Assign global variables
-    g_no_cpus = reader_get_no_cpus();
-    if(g_no_cpus == 0)
+    g_cut = cut_open();
+    if(g_cut == NULL)
     {
-        logger_write("Error while getting information about no cores", LOG_ERROR);
+        logger_write("Error while opening cpu statistics", LOG_ERROR);
         logger_destroy();
         return EXIT_FAILURE;
     }
-    g_reader_analyzer_queue = queue_create_new(10, sizeof(Stats)*(g_no_cpus+1));
-    if(g_reader_analyzer_queue == NULL)
+    g_no_cpus = cut_no_cpus(g_cut);
+    // Windows span the same time at every interval --adaptive picks
+    const uint32_t min_interval_ms = opts.adaptive_max_ms != 0 ? opts.adaptive_min_ms : atomic_load(&g_interval_ms);
+    if(opts.no_alert_rules != 0)
     {
+        g_alerts = alerts_create(opts.alert_rules, opts.no_alert_rules, g_no_cpus, (double)min_interval_ms / 1000,
+                                 opts.alert_hook, opts.alert_fifo, !opts.single_thread);
+        if(g_alerts == NULL)
+        {
+            cut_close(g_cut);
+            logger_write("Alert rules compilation error", LOG_ERROR);
+            logger_destroy();
+            return EXIT_FAILURE;
+        }
+    }
+    // Single-thread mode passes samples directly
+    if(!opts.single_thread)
+        g_reader_analyzer_queue = queue_create_new(10, sizeof(CutSample));
+    if(g_reader_analyzer_queue != NULL)
+    {
+        queue_set_wait(g_reader_analyzer_queue, opts.queue_wait, opts.queue_spin_budget);
+        shutdown_add_hook(queue_close_hook, g_reader_analyzer_queue);
+    }
+    if(g_reader_analyzer_queue == NULL && !opts.single_thread)
+    {
+        alerts_delete(g_alerts);
+        cut_close(g_cut);
         logger_write("Create new queue error", LOG_ERROR);
         logger_destroy();
         return EXIT_FAILURE;
     }
-    g_analyzer_printer_queue = queue_create_new(10, sizeof(double)*(g_no_cpus+1));
-    if(g_analyzer_printer_queue == NULL)
+    if(!opts.single_thread)
+    {
+        g_analyzer_ring = broadcast_create(ANALYZER_RING_CAPACITY, sizeof(RingSample) +
+                                           sizeof(uint64_t) * DELTA_WORDS(g_no_cpus) + sizeof(uint16_t) * g_no_cpus);
+        g_printer_mailbox = mailbox_create(sizeof(FrameSample) + sizeof(uint16_t) * 2 * g_no_cpus);
+    }
+    if((g_analyzer_ring == NULL || g_printer_mailbox == NULL) && !opts.single_thread)
     {
         queue_delete(g_reader_analyzer_queue);
-        logger_write("Create new queue error", LOG_ERROR);
+        broadcast_delete(g_analyzer_ring);
+        mailbox_delete(g_printer_mailbox);
+        alerts_delete(g_alerts);
+        cut_close(g_cut);
+        logger_write("Create new ring error", LOG_ERROR);
         logger_destroy();
         return EXIT_FAILURE;
     }
+    // Small pool - one worker per 8 cpus, at most 4, no pool in single-thread mode
+    size_t no_top_workers = g_no_cpus / 8;
+    no_top_workers = no_top_workers == 0 ? 1 : (no_top_workers > 4 ? 4 : no_top_workers);
+    no_top_workers = opts.single_thread ? 0 : no_top_workers;
+    g_proc_top = proctop_create(PROCTOP_DEFAULT_N, no_top_workers);
+    if(g_proc_top == NULL)
+        logger_write("Per-process tracker create error", LOG_WARNING);
+    g_exporter = exporter_create(opts.metrics_socket, opts.metrics_port);
+    if(g_exporter == NULL && (opts.metrics_socket != NULL || opts.metrics_port != 0))
+        logger_write("Metrics exporter create error", LOG_WARNING);
+    g_shm = shmpub_create(opts.shm_name, g_no_cpus);
+    if(g_shm == NULL && opts.shm_name != NULL)
+        logger_write("Shared memory publisher create error", LOG_WARNING);
+    g_recorder = recorder_create(opts.record_path, g_no_cpus);
+    if(g_recorder == NULL && opts.record_path != NULL)
+        logger_write("Recorder create error", LOG_WARNING);
+    if(opts.agent_addr != NULL)
+    {
+        char name[WIRE_NAME_LEN] = "";
+        if(opts.host_name != NULL)
+            snprintf(name, sizeof(name), "%s", opts.host_name);
+        else
+            gethostname(name, sizeof(name) - 1);
+        const uint32_t host_id = opts.host_id != 0 ? opts.host_id : agent_default_id(name);
+        // Adaptive sampling is never slower than its maximum interval
+        const uint32_t interval_ms = opts.adaptive_max_ms != 0 ? opts.adaptive_max_ms : atomic_load(&g_interval_ms);
+        g_agent = agent_create(opts.agent_addr, host_id, name, g_no_cpus, interval_ms);
+        if(g_agent == NULL)
+            logger_write("Fleet agent create error", LOG_WARNING);
+    }
+    // Consumers are registered before the analyzer starts publishing
+    if(g_recorder != NULL)
+        g_recorder_consumer = broadcast_add_consumer(g_analyzer_ring, BROADCAST_BLOCK);
+    if(g_exporter != NULL || g_shm != NULL || g_agent != NULL)
+        g_export_consumer = broadcast_add_consumer(g_analyzer_ring, BROADCAST_SKIP);
+    // main outlives every thread using it
+    AdaptiveRate adaptive;
+    if(opts.adaptive_max_ms != 0)
+    {
+        if(adaptive_init(&adaptive, g_no_cpus, opts.adaptive_min_ms, opts.adaptive_max_ms))
+        {
+            g_adaptive = &adaptive;
+            atomic_store(&g_interval_ms, adaptive.interval_ms);
+        }
+        else
+            logger_write("Adaptive interval init error - sampling every second", LOG_WARNING);
+    }
+    g_self = selfstat_create();
+    if(g_self == NULL)
+        logger_write("Self overhead measurement not available", LOG_WARNING);
+    g_cgroups = cgroup_create(CGROUP_DEFAULT_N);
+    if(g_cgroups == NULL)
+        logger_write("Cgroup tracker create error", LOG_WARNING);
+    g_cpufreq = cpufreq_create(g_no_cpus);
+    if(g_cpufreq == NULL)
+        logger_write("Cpufreq tracker create error", LOG_WARNING);
+    g_irqstat = irqstat_create(g_no_cpus);
+    if(g_irqstat == NULL)
+        logger_write("Interrupt tracker create error", LOG_WARNING);
+    g_socket_of = malloc(sizeof(uint16_t) * g_no_cpus);
+    g_no_sockets = reader_get_sockets(READER_SYSFS_CPU_ROOT, g_socket_of, g_no_cpus);
+    if(g_no_sockets == 0)
+    {
+        free(g_socket_of);
+        g_socket_of = NULL;
+        logger_write("CPU topology not available - no per-socket balance", LOG_WARNING);
+    }
+    g_io_uring = opts.io_uring;
+    g_delta_threshold_bp = opts.delta_threshold_bp;
+    if(opts.heatmap)
+    {
+        g_heatmap = heatmap_create(g_no_cpus);
+        if(g_heatmap == NULL)
+            logger_write("Heatmap create error - showing bars", LOG_WARNING);
+        else if(!heatmap_watch_resize(g_heatmap))
+            logger_write("Heatmap resize watch error - keeping the initial size", LOG_WARNING);
+    }
+    g_core_stats = corestats_create(g_no_cpus+1, CORESTATS_DEFAULT_WINDOW_S, (double)min_interval_ms / 1000);
+    if(g_core_stats == NULL)
+    {
+        queue_delete(g_reader_analyzer_queue);
+        broadcast_delete(g_analyzer_ring);
+        mailbox_delete(g_printer_mailbox);
+        recorder_delete(g_recorder);
+        proctop_delete(g_proc_top);
+        cgroup_delete(g_cgroups);
+        cpufreq_delete(g_cpufreq);
+        irqstat_delete(g_irqstat);
+        free(g_socket_of);
+        heatmap_delete(g_heatmap);
+        exporter_delete(g_exporter);
+        shmpub_delete(g_shm);
+        agent_delete(g_agent);
+        alerts_delete(g_alerts);
+        cut_close(g_cut);
+        selfstat_delete(g_self);
+        adaptive_destroy(g_adaptive);
+        logger_write("Core statistics allocation error", LOG_ERROR);
+        logger_destroy();
+        return EXIT_FAILURE;
+    }
+    if(opts.single_thread)
+    {
+        const int ret = single_thread_run();
+        printf("exit\n");
+        queues_cleanup();
+        logger_write("Closing program", LOG_INFO);
+        logger_destroy();
+        TRACE_FINISH();
+        return ret;
+    }
     pthread_t watchdogs[3];
 
     // Create Reader thread
@@ -349,6 +1444,22 @@ int main(void)
         return EXIT_FAILURE;
     }
     logger_write("MAIN - Printer thread created", LOG_STARTUP);
+    // Sink threads have no watchdogs - they wait for the analyzer, which has one
+    if(g_recorder_consumer >= 0 && pthread_create(&recorder_th, NULL, recorder_func, NULL) != 0)
+    {
+        thread_join_create_error("Failed to create recorder thread");
+        return EXIT_FAILURE;
+    }
+    if(g_export_consumer >= 0 && pthread_create(&export_th, NULL, export_func, NULL) != 0)
+    {
+        thread_join_create_error("Failed to create exporter thread");
+        return EXIT_FAILURE;
+    }
+
+    // Sleep until SIGTERM/SIGINT or until a pipeline thread stops
+    const int signum = shutdown_wait();
+    if(signum != 0)
+        logger_write(signum == SIGINT ? "MAIN - SIGINT received" : "MAIN - SIGTERM received", LOG_INFO);
 
     if(pthread_join(reader_th, NULL) != 0)
     {
@@ -368,6 +1479,16 @@ int main(void)
         return EXIT_FAILURE;
     }
     logger_write("Printer thread finished", LOG_WARNING);
+    if(g_recorder_consumer >= 0 && pthread_join(recorder_th, NULL) != 0)
+    {
+        thread_join_create_error("Failed to join recorder thread");
+        return EXIT_FAILURE;
+    }
+    if(g_export_consumer >= 0 && pthread_join(export_th, NULL) != 0)
+    {
+        thread_join_create_error("Failed to join exporter thread");
+        return EXIT_FAILURE;
+    }
 
     for(size_t i = 0; i < 3; i++)
     {
@@ -378,11 +1499,13 @@ int main(void)
     }
 
     printf("exit\n");
+    log_queue_waits("Reader-Analyzer", g_reader_analyzer_queue);
 
     // Cleanup data and destroy logger
     queues_cleanup();
     logger_write("Closing program", LOG_INFO);
     logger_destroy();
+    TRACE_FINISH();
 
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,265 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "options.h"
+#include "delta.h"
+
+/**
+ * Prints available options.
+ * @param prog - name of the program
+ */
+void options_usage(const char* prog)
+{
+    printf("Usage: %s [options]\n", prog);
+    printf("  --metrics-socket PATH   serve Prometheus /metrics on unix socket PATH\n");
+    printf("  --metrics-port PORT     serve Prometheus /metrics on 127.0.0.1:PORT\n");
+    printf("  --shm NAME              publish latest sample in shared memory NAME (e.g. /cut), see cutshm.h\n");
+    printf("  --alert RULE            alert rule e.g. cpu>95,for=5 or total>80,avg=60 (repeatable), see alerts.h\n");
+    printf("  --alert-hook CMD        run CMD with /bin/sh on every alert event\n");
+    printf("  --alert-fifo PATH       write every alert event as a line to FIFO PATH\n");
+    printf("  --single-thread         sample, analyze, print and log in one event loop thread\n");
+    printf("  --housekeeping-cpus LIST pin every tracker thread to cpus LIST, e.g. 0 or 0,2-3\n");
+    printf("  --sched-policy POLICY   run tracker threads under SCHED_IDLE (idle), SCHED_BATCH (batch) or other\n");
+    printf("  --nice N                run tracker threads with nice level N\n");
+    printf("  --adaptive MIN,MAX      sample every MIN..MAX ms - faster when usage changes, slower when stable\n");
+    printf("  --record PATH           write every sample as a CSV line to PATH\n");
+    printf("  --log-queue KIND        logger buffer: mutex (default) or lockfree\n");
+    printf("  --queue-wait S[,SPINS]  pipeline queue wait: block (default), spin, yield or park, SPINS retries first\n");
+    printf("  --heatmap               compact heatmap of every cpu with sparklines, sized to the terminal\n");
+    printf("  --agent ADDR            stream every sample to the fleet collector at unix socket path or HOST:PORT\n");
+    printf("  --host-name NAME        name of this host in the fleet (default: hostname)\n");
+    printf("  --host-id N             id of this host in the fleet (default: hash of the name)\n");
+    printf("  --collect ADDR          run as fleet collector on unix socket path or [HOST:]PORT, no local sampling\n");
+    printf("  --io-uring              read the files of every tick with one io_uring submit instead of pread per file\n");
+    printf("  --trace PATH            write a Chrome/Perfetto trace of the pipeline stages to PATH at exit\n");
+    printf("  --delta-threshold BP    send a core downstream when it moved more than BP 0.01%% (default %d)\n",
+           DELTA_DEFAULT_THRESHOLD_BP);
+    printf("  -h, --help              show this message\n");
+}
+
+/**
+ * Parses wait strategy of the pipeline queue - STRATEGY[,SPINS].
+ * @return False on unknown strategy or invalid spin budget.
+ */
+static bool options_parse_queue_wait(Options* const opts, const char* const arg)
+{
+    static const char* const names[] = {"block", "spin", "yield", "park"};
+    const size_t len = strcspn(arg, ",");
+    for (size_t i = 0; i < sizeof(names)/sizeof(names[0]); i++)
+    {
+        if(strlen(names[i]) != len || strncmp(arg, names[i], len) != 0)
+            continue;
+        opts->queue_wait = (QueueWaitStrategy)i;
+        if(arg[len] == '\0')
+            return true;
+        char* end;
+        const long spins = strtol(arg + len + 1, &end, 10);
+        if(*end != '\0' || end == arg + len + 1 || spins < 0 || spins > 10000000)
+            return false;
+        opts->queue_spin_budget = (uint32_t)spins;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Parses command line arguments. Options not given keep their default values.
+ * @param opts - options to fill
+ * @return OPTIONS_SUCCESS, OPTIONS_HELP if help was requested or OPTIONS_ERROR on invalid argument.
+ */
+OptionsErrorCode options_parse(Options* const opts, const int argc, char** const argv)
+{
+    enum{OPT_METRICS_SOCKET = 256, OPT_METRICS_PORT, OPT_SHM, OPT_ALERT, OPT_ALERT_HOOK, OPT_ALERT_FIFO, OPT_SINGLE_THREAD, OPT_HOUSEKEEPING_CPUS,
+         OPT_SCHED_POLICY, OPT_NICE, OPT_ADAPTIVE, OPT_RECORD, OPT_LOG_QUEUE, OPT_QUEUE_WAIT,
+         OPT_HEATMAP, OPT_AGENT, OPT_HOST_NAME, OPT_HOST_ID, OPT_COLLECT, OPT_IO_URING, OPT_TRACE,
+         OPT_DELTA_THRESHOLD};
+    static const struct option long_options[] = {
+        {"metrics-socket", required_argument, NULL, OPT_METRICS_SOCKET},
+        {"metrics-port", required_argument, NULL, OPT_METRICS_PORT},
+        {"shm", required_argument, NULL, OPT_SHM},
+        {"alert", required_argument, NULL, OPT_ALERT},
+        {"alert-hook", required_argument, NULL, OPT_ALERT_HOOK},
+        {"alert-fifo", required_argument, NULL, OPT_ALERT_FIFO},
+        {"single-thread", no_argument, NULL, OPT_SINGLE_THREAD},
+        {"housekeeping-cpus", required_argument, NULL, OPT_HOUSEKEEPING_CPUS},
+        {"sched-policy", required_argument, NULL, OPT_SCHED_POLICY},
+        {"nice", required_argument, NULL, OPT_NICE},
+        {"adaptive", required_argument, NULL, OPT_ADAPTIVE},
+        {"record", required_argument, NULL, OPT_RECORD},
+        {"log-queue", required_argument, NULL, OPT_LOG_QUEUE},
+        {"queue-wait", required_argument, NULL, OPT_QUEUE_WAIT},
+        {"heatmap", no_argument, NULL, OPT_HEATMAP},
+        {"agent", required_argument, NULL, OPT_AGENT},
+        {"host-name", required_argument, NULL, OPT_HOST_NAME},
+        {"host-id", required_argument, NULL, OPT_HOST_ID},
+        {"collect", required_argument, NULL, OPT_COLLECT},
+        {"io-uring", no_argument, NULL, OPT_IO_URING},
+        {"trace", required_argument, NULL, OPT_TRACE},
+        {"delta-threshold", required_argument, NULL, OPT_DELTA_THRESHOLD},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+
+    *opts = (Options){.metrics_socket = NULL,
+                      .metrics_port = 0,
+                      .shm_name = NULL,
+                      .no_alert_rules = 0,
+                      .alert_hook = NULL,
+                      .alert_fifo = NULL,
+                      .single_thread = false,
+                      .housekeeping_cpus = NULL,
+                      .sched_policy = NULL,
+                      .nice = 0,
+                      .adaptive_min_ms = 0,
+                      .adaptive_max_ms = 0,
+                      .record_path = NULL,
+                      .log_lockfree = false,
+                      .queue_wait = QUEUE_WAIT_BLOCK,
+                      .queue_spin_budget = QUEUE_DEFAULT_SPIN_BUDGET,
+                      .heatmap = false,
+                      .agent_addr = NULL,
+                      .host_name = NULL,
+                      .host_id = 0,
+                      .collect_addr = NULL,
+                      .io_uring = false,
+                      .trace_path = NULL,
+                      .delta_threshold_bp = DELTA_DEFAULT_THRESHOLD_BP
+                     };
+    int opt;
+    while((opt = getopt_long(argc, argv, "h", long_options, NULL)) != -1)
+    {
+        char* end;
+        long value;
+        switch (opt) {
+            case OPT_METRICS_SOCKET:
+                opts->metrics_socket = optarg;
+                break;
+            case OPT_METRICS_PORT:
+                value = strtol(optarg, &end, 10);
+                if(*end != '\0' || value <= 0 || value > 65535)
+                {
+                    fprintf(stderr, "Invalid port: %s\n", optarg);
+                    return OPTIONS_ERROR;
+                }
+                opts->metrics_port = (uint16_t)value;
+                break;
+            case OPT_SHM:
+                if(optarg[0] != '/')
+                {
+                    fprintf(stderr, "Shared memory name has to start with '/': %s\n", optarg);
+                    return OPTIONS_ERROR;
+                }
+                opts->shm_name = optarg;
+                break;
+            case OPT_ALERT:
+                if(opts->no_alert_rules == OPTIONS_MAX_ALERTS)
+                {
+                    fprintf(stderr, "Too many alert rules, at most %d\n", OPTIONS_MAX_ALERTS);
+                    return OPTIONS_ERROR;
+                }
+                opts->alert_rules[opts->no_alert_rules++] = optarg;
+                break;
+            case OPT_ALERT_HOOK:
+                opts->alert_hook = optarg;
+                break;
+            case OPT_ALERT_FIFO:
+                opts->alert_fifo = optarg;
+                break;
+            case OPT_SINGLE_THREAD:
+                opts->single_thread = true;
+                break;
+            case OPT_HOUSEKEEPING_CPUS:
+                opts->housekeeping_cpus = optarg;
+                break;
+            case OPT_SCHED_POLICY:
+                opts->sched_policy = optarg;
+                break;
+            case OPT_NICE:
+                value = strtol(optarg, &end, 10);
+                if(*end != '\0' || value < -20 || value > 19)
+                {
+                    fprintf(stderr, "Invalid nice level: %s\n", optarg);
+                    return OPTIONS_ERROR;
+                }
+                opts->nice = (int)value;
+                break;
+            case OPT_ADAPTIVE:
+                value = strtol(optarg, &end, 10);
+                if(*end != ',' || value < 10 || value > 60000)
+                {
+                    fprintf(stderr, "Invalid adaptive interval: %s\n", optarg);
+                    return OPTIONS_ERROR;
+                }
+                opts->adaptive_min_ms = (uint32_t)value;
+                value = strtol(end + 1, &end, 10);
+                if(*end != '\0' || value < opts->adaptive_min_ms || value > 60000)
+                {
+                    fprintf(stderr, "Invalid adaptive interval: %s\n", optarg);
+                    return OPTIONS_ERROR;
+                }
+                opts->adaptive_max_ms = (uint32_t)value;
+                break;
+            case OPT_RECORD:
+                opts->record_path = optarg;
+                break;
+            case OPT_LOG_QUEUE:
+                if(strcmp(optarg, "mutex") != 0 && strcmp(optarg, "lockfree") != 0)
+                {
+                    fprintf(stderr, "Invalid log queue: %s\n", optarg);
+                    return OPTIONS_ERROR;
+                }
+                opts->log_lockfree = strcmp(optarg, "lockfree") == 0;
+                break;
+            case OPT_QUEUE_WAIT:
+                if(!options_parse_queue_wait(opts, optarg))
+                {
+                    fprintf(stderr, "Invalid queue wait strategy: %s\n", optarg);
+                    return OPTIONS_ERROR;
+                }
+                break;
+            case OPT_HEATMAP:
+                opts->heatmap = true;
+                break;
+            case OPT_AGENT:
+                opts->agent_addr = optarg;
+                break;
+            case OPT_HOST_NAME:
+                opts->host_name = optarg;
+                break;
+            case OPT_HOST_ID:
+                value = strtol(optarg, &end, 10);
+                if(*end != '\0' || value <= 0 || value > UINT32_MAX)
+                {
+                    fprintf(stderr, "Invalid host id: %s\n", optarg);
+                    return OPTIONS_ERROR;
+                }
+                opts->host_id = (uint32_t)value;
+                break;
+            case OPT_COLLECT:
+                opts->collect_addr = optarg;
+                break;
+            case OPT_IO_URING:
+                opts->io_uring = true;
+                break;
+            case OPT_TRACE:
+                opts->trace_path = optarg;
+                break;
+            case OPT_DELTA_THRESHOLD:
+                value = strtol(optarg, &end, 10);
+                if(*end != '\0' || value < 0 || value > 10000)
+                {
+                    fprintf(stderr, "Invalid delta threshold: %s\n", optarg);
+                    return OPTIONS_ERROR;
+                }
+                opts->delta_threshold_bp = (uint16_t)value;
+                break;
+            case 'h':
+                return OPTIONS_HELP;
+            default:
+                return OPTIONS_ERROR;
+        }
+    }
+    return OPTIONS_SUCCESS;
+}
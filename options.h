@@ -0,0 +1,50 @@
+
+#ifndef CPU_USAGE_TRACKER_OPTIONS_H
+#define CPU_USAGE_TRACKER_OPTIONS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "queue.h"
+
+#define OPTIONS_MAX_ALERTS 32
+
+typedef enum{
+    OPTIONS_SUCCESS = 0,
+    OPTIONS_HELP = 1,
+    OPTIONS_ERROR = 2
+} OptionsErrorCode;
+
+// Command line configuration of the program
+typedef struct Options{
+    const char* metrics_socket;     // unix socket serving /metrics, NULL if disabled
+    uint16_t metrics_port;          // localhost tcp port serving /metrics, 0 if disabled
+    const char* shm_name;           // POSIX shared memory with the latest sample, NULL if disabled
+    const char* alert_rules[OPTIONS_MAX_ALERTS];    // see alerts.h for the syntax
+    size_t no_alert_rules;
+    const char* alert_hook;         // shell command run on every alert event, NULL if disabled
+    const char* alert_fifo;         // FIFO receiving one line per alert event, NULL if disabled
+    bool single_thread;             // one event loop instead of reader/analyzer/printer threads
+    const char* housekeeping_cpus;  // cpu list every tracker thread is pinned to, NULL if not pinned
+    const char* sched_policy;       // idle, batch or other, NULL to keep the default
+    int nice;                       // nice level of every tracker thread, 0 to keep the default
+    uint32_t adaptive_min_ms;       // adaptive sampling limits, 0 - fixed 1 s interval
+    uint32_t adaptive_max_ms;
+    const char* record_path;        // CSV recording of every sample, NULL if disabled
+    bool log_lockfree;              // logger buffer is the lock-free MPMC queue instead of the mutex one
+    QueueWaitStrategy queue_wait;   // how the sampling pipeline waits on its queue
+    uint32_t queue_spin_budget;
+    bool heatmap;                   // one colored cell per cpu instead of a bar per cpu
+    const char* agent_addr;         // fleet collector every sample is streamed to, NULL if disabled
+    const char* host_name;          // name of this host in the fleet, NULL for hostname
+    uint32_t host_id;               // id of this host in the fleet, 0 for a hash of the name
+    const char* collect_addr;       // run as fleet collector listening on this address, NULL for normal mode
+    bool io_uring;                  // reader batches its file reads through io_uring
+    const char* trace_path;         // Chrome trace of the pipeline written at exit, NULL if disabled
+    uint16_t delta_threshold_bp;    // smallest move of a core the analyzer sends downstream, 0 - every change
+} Options;
+
+OptionsErrorCode options_parse(Options* opts, int argc, char** argv);
+void options_usage(const char* prog);
+
+#endif //CPU_USAGE_TRACKER_OPTIONS_H
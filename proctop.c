@@ -0,0 +1,533 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "proctop.h"
+
+enum{PROCTOP_RESERVED_FDS = 256};   // left for the rest of the program
+enum{PROCTOP_FD_SHARE = 4};         // at most 1/4 of the fd limit - cpufreq, the exporter and the fleet use the rest
+enum{PROCTOP_DENTS_SIZE = 32768};
+enum{PROCTOP_MIN_TABLE = 64};
+enum{PROCTOP_STAT_SIZE = 512};
+
+typedef struct ProcEntry{
+    int pid;            // 0 - empty slot, -1 - moved to the next table
+    int fd;             // cached /proc/pid/stat, -1 if not cached
+    uint32_t scans;     // in how many scans the process was seen
+    uint64_t prev_ticks;    // utime + stime
+    char comm[PROCTOP_COMM_LEN];
+} ProcEntry;
+
+// Part of the PID space (pid % no_workers) handled by one worker
+typedef struct ProcShard{
+    pthread_t thread;
+    ProcTop* owner;
+    int* pids;          // pids found by the current scan
+    size_t no_pids;
+    size_t pids_cap;
+    ProcEntry* table;   // processes known from previous scan, open addressing
+    size_t capacity;
+    ProcEntry* next;    // table being built by the current scan
+    size_t next_capacity;
+    ProcTopEntry* heap; // min-heap of the busiest processes of this shard
+    size_t heap_len;
+} ProcShard;
+
+struct ProcTop{
+    pthread_mutex_t mutex;      // protects top - read by printer
+    pthread_mutex_t pool_mutex; // protects generation, pending and stop
+    pthread_cond_t start_cv;    // signals workers that new scan started
+    pthread_cond_t done_cv;     // signals collector that last worker finished
+    uint64_t generation;        // number of the current scan
+    size_t pending;             // workers still scanning
+    bool stop;
+    int dirfd;                  // /proc, owned by the collector
+    size_t top_n;
+    size_t no_workers;
+    bool inline_scan;           // no worker threads - one shard scanned by the collector's thread
+    ProcShard* shards;
+    double elapsed_ticks;       // clock ticks since previous scan
+    uint64_t last_scan_ns;
+    double ticks_per_s;
+    atomic_long fd_budget;      // how many more /proc/pid/stat fds may be cached
+    char* dents;
+    ProcTopEntry* merged;       // scratch heap used when merging shards
+    ProcTopEntry* top;          // latest result sorted from the busiest
+    size_t top_len;
+};
+
+static void* proctop_worker(void* args);
+
+static inline size_t proctop_hash(const int pid, const size_t capacity)
+{
+    return ((uint32_t)pid * 2654435761u) & (capacity - 1);
+}
+
+/**
+ * Adds entry to min-heap of given capacity. When heap is full entry replaces the root if it is bigger.
+ */
+static void proctop_heap_push(ProcTopEntry* const heap, size_t* const len, const size_t cap, const ProcTopEntry* const e)
+{
+    size_t i;
+    if(*len < cap)
+    {
+        // Sift up
+        i = (*len)++;
+        while(i > 0 && heap[(i - 1) / 2].cpu_pr > e->cpu_pr)
+        {
+            heap[i] = heap[(i - 1) / 2];
+            i = (i - 1) / 2;
+        }
+        heap[i] = *e;
+        return;
+    }
+    if(cap == 0 || e->cpu_pr <= heap[0].cpu_pr)
+        return;
+    // Replace root and sift down
+    i = 0;
+    while(1)
+    {
+        size_t child = 2 * i + 1;
+        if(child >= *len)
+            break;
+        if(child + 1 < *len && heap[child + 1].cpu_pr < heap[child].cpu_pr)
+            child++;
+        if(heap[child].cpu_pr >= e->cpu_pr)
+            break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = *e;
+}
+
+/**
+ * Reads /proc/pid/stat - through cached fd or openat on the /proc dirfd.
+ * Processes seen in at least two scans keep their fd while the budget allows it.
+ * @return Number of bytes read, 0 if process is gone.
+ */
+static size_t proctop_read_stat(ProcTop* const pt, ProcEntry* const e, char* const buf, const size_t size)
+{
+    ssize_t n;
+    if(e->fd >= 0)
+    {
+        n = pread(e->fd, buf, size - 1, 0);
+        if(n <= 0)
+        {
+            // Process exited, fd refers to the dead task even if pid is reused
+            close(e->fd);
+            e->fd = -1;
+            atomic_fetch_add(&pt->fd_budget, 1);
+            return 0;
+        }
+        buf[n] = '\0';
+        return (size_t)n;
+    }
+
+    char path[32];
+    snprintf(path, sizeof(path), "%d/stat", e->pid);
+    const int fd = openat(pt->dirfd, path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+        return 0;
+    n = read(fd, buf, size - 1);
+    if(n > 0 && e->scans >= 1 && atomic_fetch_sub(&pt->fd_budget, 1) > 0)
+        e->fd = fd;
+    else
+    {
+        if(n > 0 && e->scans >= 1)
+            atomic_fetch_add(&pt->fd_budget, 1);
+        close(fd);
+    }
+    if(n <= 0)
+        return 0;
+    buf[n] = '\0';
+    return (size_t)n;
+}
+
+/**
+ * Parses name and utime + stime from /proc/pid/stat. Name may contain spaces and parentheses.
+ * @return True on success.
+ */
+static bool proctop_parse_stat(const char* const buf, ProcEntry* const e, uint64_t* const ticks)
+{
+    const char* const open_par = strchr(buf, '(');
+    const char* const close_par = strrchr(buf, ')');
+    if(open_par == NULL || close_par == NULL || close_par < open_par)
+        return false;
+
+    size_t len = (size_t)(close_par - open_par - 1);
+    if(len >= PROCTOP_COMM_LEN)
+        len = PROCTOP_COMM_LEN - 1;
+    memcpy(e->comm, open_par + 1, len);
+    e->comm[len] = '\0';
+
+    unsigned long utime, stime;
+    // state ppid pgrp session tty_nr tpgid flags minflt cminflt majflt cmajflt utime stime
+    if(sscanf(close_par + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime) != 2)
+        return false;
+    *ticks = (uint64_t)utime + stime;
+    return true;
+}
+
+/**
+ * Updates every process of the shard, moves live ones to the next table and keeps the busiest in the heap.
+ */
+static void proctop_scan_shard(ProcShard* const sh)
+{
+    ProcTop* const pt = sh->owner;
+    char buf[PROCTOP_STAT_SIZE];
+
+    size_t needed = PROCTOP_MIN_TABLE;
+    while(needed < sh->no_pids * 2)
+        needed *= 2;
+    if(sh->next_capacity < needed)
+    {
+        ProcEntry* const bigger = realloc(sh->next, sizeof(ProcEntry) * needed);
+        if(bigger == NULL)
+            return;
+        sh->next = bigger;
+        sh->next_capacity = needed;
+    }
+    memset(sh->next, 0, sizeof(ProcEntry) * sh->next_capacity);
+    sh->heap_len = 0;
+
+    for (size_t i = 0; i < sh->no_pids; i++)
+    {
+        const int pid = sh->pids[i];
+        ProcEntry e = {.pid = pid, .fd = -1};
+        // Find process known from previous scan
+        if(sh->capacity != 0)
+        {
+            for (size_t h = proctop_hash(pid, sh->capacity); sh->table[h].pid != 0; h = (h + 1) & (sh->capacity - 1))
+            {
+                if(sh->table[h].pid == pid)
+                {
+                    e = sh->table[h];
+                    sh->table[h].pid = -1;
+                    sh->table[h].fd = -1;
+                    break;
+                }
+            }
+        }
+
+        uint64_t ticks;
+        if(proctop_read_stat(pt, &e, buf, sizeof(buf)) == 0 || !proctop_parse_stat(buf, &e, &ticks))
+        {
+            if(e.fd >= 0)
+            {
+                close(e.fd);
+                atomic_fetch_add(&pt->fd_budget, 1);
+            }
+            continue;
+        }
+        if(e.scans != 0 && pt->elapsed_ticks > 0 && ticks > e.prev_ticks)
+        {
+            ProcTopEntry top = {.pid = pid, .cpu_pr = (double)(ticks - e.prev_ticks) * 100 / pt->elapsed_ticks};
+            memcpy(top.comm, e.comm, PROCTOP_COMM_LEN);
+            proctop_heap_push(sh->heap, &sh->heap_len, pt->top_n, &top);
+        }
+        e.prev_ticks = ticks;
+        e.scans++;
+
+        size_t h = proctop_hash(pid, sh->next_capacity);
+        while(sh->next[h].pid != 0)
+            h = (h + 1) & (sh->next_capacity - 1);
+        sh->next[h] = e;
+    }
+
+    // Processes that were not found anymore
+    for (size_t h = 0; h < sh->capacity; h++)
+    {
+        if(sh->table[h].pid > 0 && sh->table[h].fd >= 0)
+        {
+            close(sh->table[h].fd);
+            atomic_fetch_add(&pt->fd_budget, 1);
+        }
+    }
+    ProcEntry* const tmp_table = sh->table;
+    const size_t tmp_capacity = sh->capacity;
+    sh->table = sh->next;
+    sh->capacity = sh->next_capacity;
+    sh->next = tmp_table;
+    sh->next_capacity = tmp_capacity;
+}
+
+/**
+ * Worker thread function - scans its shard every time collector starts a scan.
+ */
+static void* proctop_worker(void* args)
+{
+    ProcShard* const sh = args;
+    ProcTop* const pt = sh->owner;
+    uint64_t seen = 0;
+
+    pthread_mutex_lock(&pt->pool_mutex);
+    while(1)
+    {
+        while(pt->generation == seen && !pt->stop)
+            pthread_cond_wait(&pt->start_cv, &pt->pool_mutex);
+        if(pt->stop)
+            break;
+        seen = pt->generation;
+        pthread_mutex_unlock(&pt->pool_mutex);
+
+        proctop_scan_shard(sh);
+
+        pthread_mutex_lock(&pt->pool_mutex);
+        if(--pt->pending == 0)
+            pthread_cond_signal(&pt->done_cv);
+    }
+    pthread_mutex_unlock(&pt->pool_mutex);
+    pthread_exit(NULL);
+}
+
+/**
+ * Lists /proc with getdents64 on the persistent dirfd and splits pids between shards.
+ * @return False on error.
+ */
+static bool proctop_list_pids(ProcTop* const pt)
+{
+    for (size_t w = 0; w < pt->no_workers; w++)
+        pt->shards[w].no_pids = 0;
+
+    if(lseek(pt->dirfd, 0, SEEK_SET) < 0)
+        return false;
+    long n;
+    while((n = collector_getdents(pt->dirfd, pt->dents, PROCTOP_DENTS_SIZE)) > 0)
+    {
+        for (long off = 0; off < n;)
+        {
+            const CollectorDirent* const d = (const CollectorDirent*)(const void*)(pt->dents + off);
+            off += d->d_reclen;
+            if(d->d_name[0] < '1' || d->d_name[0] > '9')
+                continue;
+            const int pid = atoi(d->d_name);
+            ProcShard* const sh = &pt->shards[(size_t)pid % pt->no_workers];
+            if(sh->no_pids == sh->pids_cap)
+            {
+                const size_t cap = sh->pids_cap != 0 ? sh->pids_cap * 2 : 1024;
+                int* const bigger = realloc(sh->pids, sizeof(int) * cap);
+                if(bigger == NULL)
+                    return false;
+                sh->pids = bigger;
+                sh->pids_cap = cap;
+            }
+            sh->pids[sh->no_pids++] = pid;
+        }
+    }
+    return n == 0;
+}
+
+/**
+ * Collector function - one scan of every process by the worker pool, then top-N of all shards is published.
+ */
+static bool proctop_collect(Collector* const c)
+{
+    ProcTop* const pt = c->data;
+    pt->dirfd = c->fd;
+    if(!proctop_list_pids(pt))
+        return false;
+
+    const uint64_t now = collector_now_ns();
+    pt->elapsed_ticks = pt->last_scan_ns != 0 ? (double)(now - pt->last_scan_ns) / 1e9 * pt->ticks_per_s : 0;
+    pt->last_scan_ns = now;
+
+    if(pt->inline_scan)
+        proctop_scan_shard(&pt->shards[0]);
+    else
+    {
+        pthread_mutex_lock(&pt->pool_mutex);
+        pt->pending = pt->no_workers;
+        pt->generation++;
+        pthread_cond_broadcast(&pt->start_cv);
+        while(pt->pending != 0)
+            pthread_cond_wait(&pt->done_cv, &pt->pool_mutex);
+        pthread_mutex_unlock(&pt->pool_mutex);
+    }
+
+    size_t merged_len = 0;
+    for (size_t w = 0; w < pt->no_workers; w++)
+    {
+        for (size_t i = 0; i < pt->shards[w].heap_len; i++)
+            proctop_heap_push(pt->merged, &merged_len, pt->top_n, &pt->shards[w].heap[i]);
+    }
+    // Only top_n elements - insertion sort from the busiest
+    for (size_t i = 1; i < merged_len; i++)
+    {
+        const ProcTopEntry e = pt->merged[i];
+        size_t j = i;
+        for (; j > 0 && pt->merged[j - 1].cpu_pr < e.cpu_pr; j--)
+            pt->merged[j] = pt->merged[j - 1];
+        pt->merged[j] = e;
+    }
+
+    pthread_mutex_lock(&pt->mutex);
+    memcpy(pt->top, pt->merged, sizeof(ProcTopEntry) * merged_len);
+    pt->top_len = merged_len;
+    pthread_mutex_unlock(&pt->mutex);
+    return true;
+}
+
+/**
+ * Creates per-process tracker with its worker pool. Soft limit of open files is raised to the hard limit,
+ * so long-lived processes can keep their /proc/pid/stat open - in at most a quarter of it.
+ * @param top_n - how many of the busiest processes are kept
+ * @param no_workers - size of the worker pool, 0 - no pool, processes are scanned by the collector's thread
+ * @return Pointer to the new tracker, NULL on error.
+ */
+ProcTop* proctop_create(const size_t top_n, size_t no_workers)
+{
+    if(top_n == 0)
+        return NULL;
+    ProcTop* const pt = calloc(1, sizeof(*pt));
+    if(pt == NULL)
+        return NULL;
+    pt->inline_scan = no_workers == 0;
+    no_workers = pt->inline_scan ? 1 : no_workers;
+    pt->top_n = top_n;
+    pt->no_workers = no_workers;
+    pt->dirfd = -1;
+    pt->ticks_per_s = (double)sysconf(_SC_CLK_TCK);
+    pt->shards = calloc(no_workers, sizeof(ProcShard));
+    pt->dents = malloc(PROCTOP_DENTS_SIZE);
+    pt->merged = malloc(sizeof(ProcTopEntry) * top_n);
+    pt->top = malloc(sizeof(ProcTopEntry) * top_n);
+    if(pt->shards == NULL || pt->dents == NULL || pt->merged == NULL || pt->top == NULL)
+        goto error_handler;
+    for (size_t w = 0; w < no_workers; w++)
+    {
+        pt->shards[w].owner = pt;
+        pt->shards[w].heap = malloc(sizeof(ProcTopEntry) * top_n);
+        if(pt->shards[w].heap == NULL)
+            goto error_handler;
+    }
+
+    struct rlimit limit;
+    long budget = 0;
+    if(getrlimit(RLIMIT_NOFILE, &limit) == 0)
+    {
+        if(limit.rlim_cur < limit.rlim_max)
+        {
+            limit.rlim_cur = limit.rlim_max;
+            if(setrlimit(RLIMIT_NOFILE, &limit) != 0)
+                getrlimit(RLIMIT_NOFILE, &limit);
+        }
+        const long max_fds = limit.rlim_cur == RLIM_INFINITY ? 1L << 20 : (long)limit.rlim_cur;
+        budget = max_fds / PROCTOP_FD_SHARE;
+        if(budget > max_fds - PROCTOP_RESERVED_FDS)
+            budget = max_fds - PROCTOP_RESERVED_FDS;
+    }
+    atomic_init(&pt->fd_budget, budget > 0 ? budget : 0);
+
+    pthread_mutex_init(&pt->mutex, NULL);
+    pthread_mutex_init(&pt->pool_mutex, NULL);
+    pthread_cond_init(&pt->start_cv, NULL);
+    pthread_cond_init(&pt->done_cv, NULL);
+    size_t started = 0;
+    for (; !pt->inline_scan && started < no_workers; started++)
+    {
+        if(pthread_create(&pt->shards[started].thread, NULL, proctop_worker, &pt->shards[started]) != 0)
+            break;
+    }
+    if(!pt->inline_scan && started != no_workers)
+    {
+        // proctop_delete only sees the shards with a thread
+        for (size_t w = started; w < no_workers; w++)
+            free(pt->shards[w].heap);
+        pt->no_workers = started;
+        proctop_delete(pt);
+        return NULL;
+    }
+    return pt;
+
+    error_handler:
+        if(pt->shards != NULL)
+        {
+            for (size_t w = 0; w < no_workers; w++)
+                free(pt->shards[w].heap);
+        }
+        free(pt->shards);
+        free(pt->dents);
+        free(pt->merged);
+        free(pt->top);
+        free(pt);
+        return NULL;
+}
+
+/**
+ * Stops worker pool, closes cached fds and frees the tracker.
+ */
+void proctop_delete(ProcTop* pt)
+{
+    if(pt == NULL)
+        return;
+    pthread_mutex_lock(&pt->pool_mutex);
+    pt->stop = true;
+    pthread_cond_broadcast(&pt->start_cv);
+    pthread_mutex_unlock(&pt->pool_mutex);
+    for (size_t w = 0; !pt->inline_scan && w < pt->no_workers; w++)
+        pthread_join(pt->shards[w].thread, NULL);
+
+    for (size_t w = 0; w < pt->no_workers; w++)
+    {
+        ProcShard* const sh = &pt->shards[w];
+        for (size_t h = 0; h < sh->capacity; h++)
+        {
+            if(sh->table[h].pid > 0 && sh->table[h].fd >= 0)
+                close(sh->table[h].fd);
+        }
+        free(sh->table);
+        free(sh->next);
+        free(sh->pids);
+        free(sh->heap);
+    }
+    pthread_cond_destroy(&pt->start_cv);
+    pthread_cond_destroy(&pt->done_cv);
+    pthread_mutex_destroy(&pt->pool_mutex);
+    pthread_mutex_destroy(&pt->mutex);
+    free(pt->shards);
+    free(pt->dents);
+    free(pt->merged);
+    free(pt->top);
+    free(pt);
+}
+
+/**
+ * Sets up per-process collector. Its fd is the /proc directory listed on every run.
+ * @param root - PROCTOP_PROC_ROOT or a tree of the same layout, has to outlive the collector
+ * @return True on success.
+ */
+bool proctop_collector_init(Collector* const c, ProcTop* const pt, const char* const root)
+{
+    *c = (Collector){.name = "proctop",
+                     .path = root,
+                     .interval_ms = 1000,
+                     .collect = proctop_collect,
+                     .fd = -1,
+                     .event_fd = -1,
+                     .data = pt
+                    };
+    if(pt == NULL || root == NULL)
+        return false;
+    return collector_open(c);
+}
+
+/**
+ * Copies the busiest processes found by the latest scan.
+ * @param out - array for max entries
+ * @return Number of entries copied, sorted from the busiest.
+ */
+size_t proctop_get(ProcTop* const pt, ProcTopEntry* const out, const size_t max)
+{
+    if(pt == NULL || out == NULL)
+        return 0;
+    pthread_mutex_lock(&pt->mutex);
+    const size_t n = pt->top_len < max ? pt->top_len : max;
+    memcpy(out, pt->top, sizeof(ProcTopEntry) * n);
+    pthread_mutex_unlock(&pt->mutex);
+    return n;
+}
@@ -0,0 +1,28 @@
+
+#ifndef CPU_USAGE_TRACKER_PROCTOP_H
+#define CPU_USAGE_TRACKER_PROCTOP_H
+
+#include <stddef.h>
+#include "collector.h"
+
+#define PROCTOP_DEFAULT_N 10
+#define PROCTOP_COMM_LEN 16
+#define PROCTOP_PROC_ROOT "/proc"
+
+// One of the busiest processes since previous scan
+typedef struct ProcTopEntry{
+    int pid;
+    char comm[PROCTOP_COMM_LEN];
+    double cpu_pr;  // % of one cpu, may exceed 100 for multithreaded processes
+} ProcTopEntry;
+
+typedef struct ProcTop ProcTop; // Forward declaration
+
+ProcTop* proctop_create(size_t top_n, size_t no_workers);
+void proctop_delete(ProcTop* pt);
+
+bool proctop_collector_init(Collector* c, ProcTop* pt, const char* root);
+
+size_t proctop_get(ProcTop* pt, ProcTopEntry* out, size_t max);
+
+#endif //CPU_USAGE_TRACKER_PROCTOP_H
@@ -1,8 +1,15 @@
 #include <stdint.h>
 #include <stdlib.h>
+#include <stdatomic.h>
 #include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
 #include <pthread.h>
 #include <sys/time.h>
+#include <sys/syscall.h>
+#include <limits.h>
+#include <linux/futex.h>
 
 #include "queue.h"
 
@@ -13,7 +20,21 @@
  *  QUEUE STRUCTURE IS DESIGNED TO BE USED IN PRODUCER-CONSUMER PROBLEM.
  *  ENQUEUE AND DEQUEUE OPERATIONS ARE THREAD SAFE, PROTECTED BY MUTEX AND CONDITION VARIABLES
  *  QUEUE CAN STORE ALL DATA TYPES.
+ *  LOCK-FREE QUEUE (QUEUE_LOCKFREE) IS A BOUNDED MPMC QUEUE IN THE STYLE OF D. VYUKOV - EVERY SLOT HAS
+ *  A SEQUENCE NUMBER TELLING WHETHER IT IS READY FOR THE NEXT WRITER OR READER, POSITIONS ARE CLAIMED WITH CAS.
+ *  MUTEX AND CONDITION VARIABLES ARE USED ONLY BY THREADS WHICH HAVE TO SLEEP ON FULL OR EMPTY QUEUE.
+ *  WAITING ON FULL OR EMPTY QUEUE OF BOTH KINDS CAN BE CHANGED WITH queue_set_wait - SPIN, YIELD OR FUTEX PARK.
+ *  CLOSED QUEUE WAKES EVERY WAITING THREAD AT ONCE - ELEMENTS ALREADY IN THE QUEUE CAN STILL BE DEQUEUED.
  */
+typedef struct QueueWaitCounters{
+    _Atomic uint64_t waits;
+    _Atomic uint64_t wait_ns;
+    _Atomic uint64_t max_wait_ns;
+    _Atomic uint64_t spin_hits;
+    _Atomic uint64_t yields;
+    _Atomic uint64_t parks;
+} QueueWaitCounters;
+
 struct Queue {
     pthread_cond_t less_cv;     // 48B - signals if there is fewer data in queue now
     pthread_cond_t more_cv;     //48B - signals if there is more data in queue now
@@ -27,9 +48,29 @@ struct Queue {
     size_t capacity;    // 8B
 
     size_t elem_size;   // 8B
+
+    atomic_bool closed;
+    QueueWaitStrategy wait;
+    uint32_t spin_budget;           // retries before a yielding or parking thread gives up the cpu
+    QueueWaitCounters stats;
+    atomic_uint push_futex;         // bumped when an element is removed and a producer is parked
+    atomic_uint pop_futex;          // bumped when an element is added and a consumer is parked
+    atomic_uint push_waiters;       // producers sleeping on less_cv or push_futex
+    atomic_uint pop_waiters;        // consumers sleeping on more_cv or pop_futex
+
+    // Lock-free queue only
+    QueueKind kind;
+    size_t stride;                  // slot - sequence number followed by the element
+    uint8_t pad_enqueue[64];
+    _Atomic size_t enqueue_pos;
+    uint8_t pad_dequeue[64 - sizeof(size_t)];
+    _Atomic size_t dequeue_pos;
+    uint8_t pad_buffer[64 - sizeof(size_t)];
     uint8_t buffer[];   // Fixed size - FAM
 };
 
+#define QUEUE_SLOT_SEQ(slot) ((_Atomic size_t*)(void*)(slot))
+
 /**
  * Creates a new queue.
  * @param capacity - max no elements in the queue
@@ -37,6 +78,18 @@ struct Queue {
  * @return Pointer to the newly created queue.
  */
 Queue* queue_create_new(const size_t capacity, const size_t data_size)
+{
+    return queue_create(QUEUE_MUTEX, capacity, data_size);
+}
+
+/**
+ * Creates a new queue of given implementation.
+ * @param kind - QUEUE_MUTEX or QUEUE_LOCKFREE
+ * @param capacity - max no elements in the queue
+ * @param data_size - size of one element
+ * @return Pointer to the newly created queue.
+ */
+Queue* queue_create(const QueueKind kind, const size_t capacity, const size_t data_size)
 {
     if(capacity == 0)
         return NULL;
@@ -44,7 +97,10 @@ Queue* queue_create_new(const size_t capacity, const size_t data_size)
     if(data_size == 0)
         return NULL;
 
-    Queue* const q = malloc(sizeof(*q) + (data_size*capacity));  // Flexible Array Member
+    // Lock-free slots start with an aligned sequence number
+    const size_t stride = kind == QUEUE_LOCKFREE ?
+                          (sizeof(size_t) + data_size + sizeof(size_t) - 1) & ~(sizeof(size_t) - 1) : data_size;
+    Queue* const q = malloc(sizeof(*q) + (stride*capacity));  // Flexible Array Member
     if(q == NULL)
         return NULL;
 
@@ -56,11 +112,415 @@ Queue* queue_create_new(const size_t capacity, const size_t data_size)
                  .head = 0,
                  .cur_no_elements = 0,
                  .elem_size = data_size,
-                 .capacity = capacity
+                 .capacity = capacity,
+                 .kind = kind,
+                 .stride = stride,
+                 .wait = QUEUE_WAIT_BLOCK,
+                 .spin_budget = QUEUE_DEFAULT_SPIN_BUDGET
                 } ;
+    atomic_init(&q->closed, false);
+    atomic_init(&q->push_futex, 0);
+    atomic_init(&q->pop_futex, 0);
+    atomic_init(&q->push_waiters, 0);
+    atomic_init(&q->pop_waiters, 0);
+    atomic_init(&q->enqueue_pos, 0);
+    atomic_init(&q->dequeue_pos, 0);
+    if(kind == QUEUE_LOCKFREE)
+    {
+        for (size_t i = 0; i < capacity; i++)
+            atomic_init(QUEUE_SLOT_SEQ(&q->buffer[i * stride]), i);
+    }
     return q;
 }
 
+/**
+ * Selects how threads wait on full or empty queue. Has to be called before the queue is shared.
+ * @param strategy - QUEUE_WAIT_BLOCK, QUEUE_WAIT_SPIN, QUEUE_WAIT_YIELD or QUEUE_WAIT_PARK
+ * @param spin_budget - retries before a yielding or parking thread gives up the cpu
+ * @return False on invalid queue or strategy.
+ */
+bool queue_set_wait(Queue* const q, const QueueWaitStrategy strategy, const uint32_t spin_budget)
+{
+    if(queue_is_corrupted(q) || strategy > QUEUE_WAIT_PARK)
+        return false;
+    q->wait = strategy;
+    q->spin_budget = spin_budget;
+    return true;
+}
+
+/**
+ * Copies wait statistics of the queue, zeroes if queue is invalid.
+ */
+void queue_get_wait_stats(const Queue* const q, QueueWaitStats* const stats)
+{
+    if(stats == NULL)
+        return;
+    *stats = (QueueWaitStats){0};
+    if(queue_is_corrupted(q))
+        return;
+    QueueWaitCounters* const c = (QueueWaitCounters*)&q->stats;     // only atomic loads
+    stats->waits = atomic_load_explicit(&c->waits, memory_order_relaxed);
+    stats->wait_ns = atomic_load_explicit(&c->wait_ns, memory_order_relaxed);
+    stats->max_wait_ns = atomic_load_explicit(&c->max_wait_ns, memory_order_relaxed);
+    stats->spin_hits = atomic_load_explicit(&c->spin_hits, memory_order_relaxed);
+    stats->yields = atomic_load_explicit(&c->yields, memory_order_relaxed);
+    stats->parks = atomic_load_explicit(&c->parks, memory_order_relaxed);
+}
+
+static uint64_t queue_now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+/**
+ * Adds one wait which started at begin_ns to the statistics.
+ */
+static void queue_record_wait(Queue* const q, const uint64_t begin_ns)
+{
+    const uint64_t ns = queue_now_ns() - begin_ns;
+    atomic_fetch_add_explicit(&q->stats.waits, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&q->stats.wait_ns, ns, memory_order_relaxed);
+    uint64_t max = atomic_load_explicit(&q->stats.max_wait_ns, memory_order_relaxed);
+    while(ns > max && !atomic_compare_exchange_weak_explicit(&q->stats.max_wait_ns, &max, ns, memory_order_relaxed,
+                                                             memory_order_relaxed))
+        ;
+}
+
+static inline void queue_cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ volatile("yield");
+#endif
+}
+
+static void queue_put(Queue* restrict const q, const void* restrict const elem)
+{
+    uint8_t* const ptr = &q->buffer[q->head*q->elem_size];
+    memcpy(ptr, elem, q->elem_size);
+
+    q->cur_no_elements++;
+    q->head = (q->head + 1) % q->capacity;
+}
+
+static void queue_take(Queue* restrict const q, void* restrict const elem)
+{
+    uint8_t * const ptr = &q->buffer[q->tail * q->elem_size];
+    memcpy(elem, ptr, q->elem_size);
+
+    q->cur_no_elements--;
+    q->tail = (q->tail + 1) % q->capacity;
+}
+
+static uint8_t* queue_slot(Queue* const q, const size_t pos)
+{
+    return &q->buffer[(pos % q->capacity) * q->stride];
+}
+
+/**
+ * Difference between sequence number of the slot at given position and the expected one.
+ * Zero - slot is ready, negative - queue is full (producer) or empty (consumer), positive - position was taken.
+ */
+static intptr_t queue_slot_diff(Queue* const q, const size_t pos, const size_t expected)
+{
+    const size_t seq = atomic_load_explicit(QUEUE_SLOT_SEQ(queue_slot(q, pos)), memory_order_acquire);
+    return (intptr_t)seq - (intptr_t)expected;
+}
+
+/**
+ * Lock-free enqueue without waiting.
+ * @return False if queue is full.
+ */
+static bool queue_try_push(Queue* restrict const q, const void* restrict const elem)
+{
+    size_t pos = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+    while(1)
+    {
+        const intptr_t diff = queue_slot_diff(q, pos, pos);
+        if(diff == 0)
+        {
+            if(atomic_compare_exchange_weak_explicit(&q->enqueue_pos, &pos, pos + 1, memory_order_relaxed,
+                                                     memory_order_relaxed))
+            {
+                uint8_t* const slot = queue_slot(q, pos);
+                memcpy(slot + sizeof(size_t), elem, q->elem_size);
+                atomic_store_explicit(QUEUE_SLOT_SEQ(slot), pos + 1, memory_order_release);
+                return true;
+            }
+        }
+        else if(diff < 0)
+            return false;
+        else
+            pos = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+    }
+}
+
+/**
+ * Lock-free dequeue without waiting.
+ * @return False if queue is empty.
+ */
+static bool queue_try_pop(Queue* restrict const q, void* restrict const elem)
+{
+    size_t pos = atomic_load_explicit(&q->dequeue_pos, memory_order_relaxed);
+    while(1)
+    {
+        const intptr_t diff = queue_slot_diff(q, pos, pos + 1);
+        if(diff == 0)
+        {
+            if(atomic_compare_exchange_weak_explicit(&q->dequeue_pos, &pos, pos + 1, memory_order_relaxed,
+                                                     memory_order_relaxed))
+            {
+                uint8_t* const slot = queue_slot(q, pos);
+                memcpy(elem, slot + sizeof(size_t), q->elem_size);
+                // Slot is free for the producer one lap later
+                atomic_store_explicit(QUEUE_SLOT_SEQ(slot), pos + q->capacity, memory_order_release);
+                return true;
+            }
+        }
+        else if(diff < 0)
+            return false;
+        else
+            pos = atomic_load_explicit(&q->dequeue_pos, memory_order_relaxed);
+    }
+}
+
+/**
+ * Wakes one sleeping thread of the other side - no syscall if nobody sleeps.
+ * The fence pairs with the one in queue_lockfree_wait, so either the sleeper sees the change or we see the sleeper.
+ */
+static void queue_lockfree_wake(Queue* const q, atomic_uint* const waiters, pthread_cond_t* const cv)
+{
+    atomic_thread_fence(memory_order_seq_cst);
+    if(atomic_load_explicit(waiters, memory_order_relaxed) == 0)
+        return;
+    pthread_mutex_lock(&q->mutex);
+    pthread_cond_signal(cv);
+    pthread_mutex_unlock(&q->mutex);
+}
+
+/**
+ * Sleeps on condition variable until the operation succeeds, timeout passes or the queue is closed.
+ * @param push - true for enqueue, false for dequeue
+ * @return QSUCCESS, QTIMEOUT or QCLOSED.
+ */
+static QueueErrorCode queue_lockfree_wait(Queue* restrict const q, void* restrict const elem, const bool push,
+                                          const uint8_t timeout)
+{
+    atomic_uint* const waiters = push ? &q->push_waiters : &q->pop_waiters;
+    pthread_cond_t* const cv = push ? &q->less_cv : &q->more_cv;
+    struct timespec time;
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    time.tv_sec = now.tv_sec + timeout;
+    time.tv_nsec = now.tv_usec * 1000;
+
+    const uint64_t begin = queue_now_ns();
+    QueueErrorCode ret = QSUCCESS;
+    pthread_mutex_lock(&q->mutex);
+    atomic_fetch_add(waiters, 1);
+    atomic_thread_fence(memory_order_seq_cst);
+    while(!(push ? queue_try_push(q, elem) : queue_try_pop(q, elem)))
+    {
+        if(atomic_load(&q->closed))
+        {
+            ret = QCLOSED;
+            break;
+        }
+        atomic_fetch_add_explicit(&q->stats.parks, 1, memory_order_relaxed);
+        if(pthread_cond_timedwait(cv, &q->mutex, &time) != 0)
+        {
+            ret = QTIMEOUT;
+            break;
+        }
+    }
+    atomic_fetch_sub(waiters, 1);
+    pthread_mutex_unlock(&q->mutex);
+    queue_record_wait(q, begin);
+    return ret;
+}
+
+static QueueErrorCode queue_lockfree_enqueue(Queue* restrict const q, void* restrict const elem, const uint8_t timeout)
+{
+    if(!queue_try_push(q, elem))
+    {
+        const QueueErrorCode ret = queue_lockfree_wait(q, elem, true, timeout);
+        if(ret != QSUCCESS)
+            return ret;
+    }
+    queue_lockfree_wake(q, &q->pop_waiters, &q->more_cv);
+    return QSUCCESS;
+}
+
+static QueueErrorCode queue_lockfree_dequeue(Queue* restrict const q, void* restrict const elem, const uint8_t timeout)
+{
+    if(!queue_try_pop(q, elem))
+    {
+        const QueueErrorCode ret = queue_lockfree_wait(q, elem, false, timeout);
+        if(ret != QSUCCESS)
+            return ret;
+    }
+    queue_lockfree_wake(q, &q->push_waiters, &q->less_cv);
+    return QSUCCESS;
+}
+
+/**
+ * Enqueue or dequeue without waiting, for both kinds of queue.
+ * @param push - true for enqueue, false for dequeue
+ * @return False if queue is full (enqueue) or empty (dequeue).
+ */
+static bool queue_try_op(Queue* restrict const q, void* restrict const elem, const bool push)
+{
+    if(q->kind == QUEUE_LOCKFREE)
+        return push ? queue_try_push(q, elem) : queue_try_pop(q, elem);
+    pthread_mutex_lock(&q->mutex);
+    const bool ready = push ? !queue_is_full(q) : !queue_is_empty(q);
+    if(ready && push)
+        queue_put(q, elem);
+    else if(ready)
+        queue_take(q, elem);
+    pthread_mutex_unlock(&q->mutex);
+    return ready;
+}
+
+/**
+ * Wakes one parked thread of given side - no syscall if nobody is parked.
+ * The fence pairs with the one in queue_strategy_wait, so either the parked thread sees the change or we see it.
+ */
+static void queue_strategy_wake(Queue* const q, const bool push)
+{
+    if(q->wait != QUEUE_WAIT_PARK)
+        return;
+    atomic_thread_fence(memory_order_seq_cst);
+    if(atomic_load_explicit(push ? &q->push_waiters : &q->pop_waiters, memory_order_relaxed) == 0)
+        return;
+    atomic_uint* const futex = push ? &q->push_futex : &q->pop_futex;
+    atomic_fetch_add(futex, 1);
+    syscall(SYS_futex, (void*)futex, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+/**
+ * Sleeps on the futex of given side until it changes or the deadline passes, unless the operation succeeds first.
+ * @return True if the operation succeeded.
+ */
+static bool queue_strategy_park(Queue* restrict const q, void* restrict const elem, const bool push,
+                                const uint64_t deadline_ns)
+{
+    atomic_uint* const waiters = push ? &q->push_waiters : &q->pop_waiters;
+    atomic_uint* const futex = push ? &q->push_futex : &q->pop_futex;
+    atomic_fetch_add(waiters, 1);
+    atomic_thread_fence(memory_order_seq_cst);
+    const unsigned word = atomic_load(futex);
+    const bool done = queue_try_op(q, elem, push);
+    const uint64_t now = queue_now_ns();
+    if(!done && now < deadline_ns && !atomic_load(&q->closed))
+    {
+        const struct timespec remaining = {.tv_sec = (time_t)((deadline_ns - now) / 1000000000u),
+                                           .tv_nsec = (long)((deadline_ns - now) % 1000000000u)};
+        atomic_fetch_add_explicit(&q->stats.parks, 1, memory_order_relaxed);
+        syscall(SYS_futex, (void*)futex, FUTEX_WAIT_PRIVATE, word, &remaining, NULL, 0);
+    }
+    atomic_fetch_sub(waiters, 1);
+    return done;
+}
+
+/**
+ * Waits for the operation with the selected strategy - spin budget first, then spin, yield or park until the deadline
+ * or until the queue is closed.
+ * @return QSUCCESS, QTIMEOUT or QCLOSED.
+ */
+static QueueErrorCode queue_strategy_wait(Queue* restrict const q, void* restrict const elem, const bool push,
+                                          const uint8_t timeout)
+{
+    enum{QUEUE_SPINS_PER_CLOCK_READ = 64};
+    const uint64_t begin = queue_now_ns();
+    const uint64_t deadline = begin + (uint64_t)timeout * 1000000000u;
+    QueueErrorCode ret = QTIMEOUT;
+
+    for (uint32_t i = 0; i < q->spin_budget && q->wait != QUEUE_WAIT_SPIN; i++)
+    {
+        queue_cpu_relax();
+        if(queue_try_op(q, elem, push))
+        {
+            atomic_fetch_add_explicit(&q->stats.spin_hits, 1, memory_order_relaxed);
+            ret = QSUCCESS;
+            goto wait_end;
+        }
+    }
+    do
+    {
+        if(atomic_load(&q->closed))
+        {
+            ret = QCLOSED;
+            break;
+        }
+        switch (q->wait) {
+            case QUEUE_WAIT_YIELD:
+                sched_yield();
+                atomic_fetch_add_explicit(&q->stats.yields, 1, memory_order_relaxed);
+                break;
+            case QUEUE_WAIT_PARK:
+                if(queue_strategy_park(q, elem, push, deadline))
+                {
+                    ret = QSUCCESS;
+                    goto wait_end;
+                }
+                break;
+            default:
+                for (int i = 0; i < QUEUE_SPINS_PER_CLOCK_READ; i++)
+                    queue_cpu_relax();
+                break;
+        }
+        if(queue_try_op(q, elem, push))
+        {
+            ret = QSUCCESS;
+            break;
+        }
+    } while(queue_now_ns() < deadline);
+
+    wait_end:
+        queue_record_wait(q, begin);
+        return ret;
+}
+
+/**
+ * Enqueue or dequeue for queues with a wait strategy other than QUEUE_WAIT_BLOCK.
+ */
+static QueueErrorCode queue_strategy_op(Queue* restrict const q, void* restrict const elem, const bool push,
+                                        const uint8_t timeout)
+{
+    if(!queue_try_op(q, elem, push))
+    {
+        const QueueErrorCode ret = queue_strategy_wait(q, elem, push, timeout);
+        if(ret != QSUCCESS)
+            return ret;
+    }
+    queue_strategy_wake(q, !push);
+    return QSUCCESS;
+}
+
+/**
+ * Closes the queue - every waiting thread wakes up at once. Dequeue still returns elements left in the queue,
+ * waits on empty (or full) queue return QCLOSED immediately.
+ */
+void queue_close(Queue* const q)
+{
+    if(queue_is_corrupted(q))
+        return;
+    atomic_store(&q->closed, true);
+    pthread_mutex_lock(&q->mutex);
+    pthread_cond_broadcast(&q->more_cv);
+    pthread_cond_broadcast(&q->less_cv);
+    pthread_mutex_unlock(&q->mutex);
+    atomic_fetch_add(&q->push_futex, 1);
+    atomic_fetch_add(&q->pop_futex, 1);
+    syscall(SYS_futex, (void*)&q->push_futex, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+    syscall(SYS_futex, (void*)&q->pop_futex, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
 /**
  * Deletes the queue and frees memory.
  * @param q - queue to delete
@@ -88,6 +548,12 @@ bool queue_is_full(const Queue * q)
     if(queue_is_corrupted(q))
         return false;
 
+    if(q->kind == QUEUE_LOCKFREE)
+    {
+        Queue* const lq = (Queue*)q;    // only atomic loads
+        const size_t pos = atomic_load(&lq->enqueue_pos);
+        return queue_slot_diff(lq, pos, pos) < 0;
+    }
     if(q->cur_no_elements == q->capacity)
         return true;
     return false;
@@ -117,6 +583,12 @@ bool queue_is_empty(const Queue* q)
     if(queue_is_corrupted(q))
         return false;
 
+    if(q->kind == QUEUE_LOCKFREE)
+    {
+        Queue* const lq = (Queue*)q;    // only atomic loads
+        const size_t pos = atomic_load(&lq->dequeue_pos);
+        return queue_slot_diff(lq, pos, pos + 1) < 0;
+    }
     if(q->cur_no_elements == 0)
         return true;
     return false;
@@ -128,7 +600,7 @@ bool queue_is_empty(const Queue* q)
  * @param q - queue
  * @param elem - element to add
  * param timeout - max time in seconds to wait for enqueue
- * @return QSUCCESS if added successfully, QTIMEOUT on timeout and QERROR on different error.
+ * @return QSUCCESS if added successfully, QTIMEOUT on timeout, QCLOSED if queue is full and closed and QERROR on different error.
  */
 QueueErrorCode queue_enqueue(Queue* restrict const q, void* restrict const elem, uint8_t timeout)
 {
@@ -136,6 +608,10 @@ QueueErrorCode queue_enqueue(Queue* restrict const q, void* restrict const elem,
         return QERROR;
     if(elem == NULL)
         return QERROR;
+    if(q->wait != QUEUE_WAIT_BLOCK)
+        return queue_strategy_op(q, elem, true, timeout);
+    if(q->kind == QUEUE_LOCKFREE)
+        return queue_lockfree_enqueue(q, elem, timeout);
     struct timespec time;
     struct timeval now;
 
@@ -144,19 +620,25 @@ QueueErrorCode queue_enqueue(Queue* restrict const q, void* restrict const elem,
     time.tv_nsec = now.tv_usec * 1000;
     pthread_mutex_lock(&q->mutex);
 
+    uint64_t wait_begin = 0;
     while(queue_is_full(q)) {
+        wait_begin = wait_begin == 0 ? queue_now_ns() : wait_begin;
+        if(atomic_load(&q->closed)) {
+            pthread_mutex_unlock(&q->mutex);
+            queue_record_wait(q, wait_begin);
+            return QCLOSED;
+        }
+        atomic_fetch_add_explicit(&q->stats.parks, 1, memory_order_relaxed);
         if (pthread_cond_timedwait(&q->less_cv, &q->mutex, &time) != 0) {
             pthread_mutex_unlock(&q->mutex);
+            queue_record_wait(q, wait_begin);
             return QTIMEOUT;
         }
     }
+    if(wait_begin != 0)
+        queue_record_wait(q, wait_begin);
 
-
-    uint8_t* const ptr = &q->buffer[q->head*q->elem_size];
-    memcpy(ptr, elem, q->elem_size);
-
-    q->cur_no_elements++;
-    q->head = (q->head + 1) % q->capacity;
+    queue_put(q, elem);
 
     pthread_cond_signal(&q->more_cv);
     pthread_mutex_unlock(&q->mutex);
@@ -168,7 +650,7 @@ QueueErrorCode queue_enqueue(Queue* restrict const q, void* restrict const elem,
  * @param q - queue
  * @param elem - element to delete
  * @param timeout - max time in seconds to wait for dequeue
- * @return QSUCCESS if removed successfully, QTIMEOUT on timeout and QERROR on different error.
+ * @return QSUCCESS if removed successfully, QTIMEOUT on timeout, QCLOSED if queue is empty and closed and QERROR on different error.
  */
 QueueErrorCode queue_dequeue(Queue* restrict const q, void* restrict elem, uint8_t timeout)
 {
@@ -178,6 +660,10 @@ QueueErrorCode queue_dequeue(Queue* restrict const q, void* restrict elem, uint8
         return QERROR;
     if(queue_is_corrupted(q))
         return QERROR;
+    if(q->wait != QUEUE_WAIT_BLOCK)
+        return queue_strategy_op(q, elem, false, timeout);
+    if(q->kind == QUEUE_LOCKFREE)
+        return queue_lockfree_dequeue(q, elem, timeout);
 
     struct timespec time;
     struct timeval now;
@@ -187,18 +673,25 @@ QueueErrorCode queue_dequeue(Queue* restrict const q, void* restrict elem, uint8
     time.tv_nsec = now.tv_usec * 1000;
 
     pthread_mutex_lock(&q->mutex);
+    uint64_t wait_begin = 0;
     while (queue_is_empty(q)) {
+        wait_begin = wait_begin == 0 ? queue_now_ns() : wait_begin;
+        if(atomic_load(&q->closed)) {
+            pthread_mutex_unlock(&q->mutex);
+            queue_record_wait(q, wait_begin);
+            return QCLOSED;
+        }
+        atomic_fetch_add_explicit(&q->stats.parks, 1, memory_order_relaxed);
         if(pthread_cond_timedwait(&q->more_cv, &q->mutex, &time)!=0){
             pthread_mutex_unlock(&q->mutex);
+            queue_record_wait(q, wait_begin);
             return QTIMEOUT;
         }
     }
+    if(wait_begin != 0)
+        queue_record_wait(q, wait_begin);
 
-    uint8_t * const ptr = &q->buffer[q->tail * q->elem_size];
-    memcpy(elem, ptr, q->elem_size);
-
-    q->cur_no_elements--;
-    q->tail = (q->tail + 1) % q->capacity;
+    queue_take(q, elem);
 
     pthread_cond_signal(&q->less_cv);
     pthread_mutex_unlock(&q->mutex);
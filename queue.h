@@ -3,23 +3,55 @@
 #define CPU_USAGE_TRACKER_QUEUE_H
 
 #include <stddef.h>
+#include <stdint.h>
 #include <stdbool.h>
 
 typedef enum{
     QSUCCESS = 0,
     QTIMEOUT = 1,
-    QERROR = 2
+    QERROR = 2,
+    QCLOSED = 3     // queue was closed - nothing more to dequeue, no space will be freed
 }QueueErrorCode;
 
+typedef enum{
+    QUEUE_MUTEX = 0,    // every operation under one mutex
+    QUEUE_LOCKFREE = 1  // bounded MPMC with per-slot sequence numbers, mutex only to sleep on full/empty queue
+}QueueKind;
+
+// How a thread waits on a full or empty queue
+typedef enum{
+    QUEUE_WAIT_BLOCK = 0,   // condition variable (default)
+    QUEUE_WAIT_SPIN = 1,    // busy-spin - lowest latency, burns a cpu while waiting
+    QUEUE_WAIT_YIELD = 2,   // spin budget, then sched_yield between retries
+    QUEUE_WAIT_PARK = 3     // spin budget, then sleep on a futex - a syscall only when the queue stays idle
+}QueueWaitStrategy;
+
+#define QUEUE_DEFAULT_SPIN_BUDGET 1000
+
+// Waits on full or empty queue since its creation
+typedef struct QueueWaitStats{
+    uint64_t waits;         // operations which found the queue full or empty
+    uint64_t wait_ns;       // total time they waited
+    uint64_t max_wait_ns;
+    uint64_t spin_hits;     // waits which ended within the spin budget - no syscall
+    uint64_t yields;        // sched_yield calls
+    uint64_t parks;         // futex or condition variable sleeps
+}QueueWaitStats;
+
 typedef struct Queue Queue; // Forward declaration
 
 Queue* queue_create_new(size_t capacity, size_t data_size);
+Queue* queue_create(QueueKind kind, size_t capacity, size_t data_size);
 void queue_delete(Queue* q);
+void queue_close(Queue* q);
 
 bool queue_is_full(const Queue * q);
 bool queue_is_empty(const Queue* q);
 bool queue_is_corrupted(const Queue* q);
 
+bool queue_set_wait(Queue* q, QueueWaitStrategy strategy, uint32_t spin_budget);
+void queue_get_wait_stats(const Queue* q, QueueWaitStats* stats);
+
 QueueErrorCode queue_enqueue(Queue* restrict q, void* restrict elem, u_int8_t timeout);
 QueueErrorCode queue_dequeue(Queue* restrict q, void* restrict elem, u_int8_t timeout);
 
@@ -85,6 +85,78 @@ size_t reader_get_no_cpus(void)
     return cpus - 1;
 }
 
+/**
+ * Groups cpus by the physical package (socket) in cpuN/topology/physical_package_id. Package ids are not
+ * necessarily 0 .. N-1 - sockets are numbered in the order their first cpu appears.
+ * @param root - READER_SYSFS_CPU_ROOT or a tree of the same layout
+ * @param socket_of - socket of every cpu, written here, a cpu without topology joins the socket of cpu0
+ * @param no_cpus - num of cpus, cpu0 .. cpuN-1
+ * @return Number of sockets, 0 if the topology is not available.
+ */
+size_t reader_get_sockets(const char* const root, uint16_t* const socket_of, const size_t no_cpus)
+{
+    if(root == NULL || socket_of == NULL || no_cpus == 0)
+        return 0;
+    long* const ids = malloc(sizeof(long) * no_cpus);     // package id of every socket found so far
+    if(ids == NULL)
+        return 0;
+    size_t no_sockets = 0;
+    bool found = false;
+    char path[256];
+    for (size_t j = 0; j < no_cpus; j++)
+    {
+        long id = no_sockets != 0 ? ids[0] : 0;
+        snprintf(path, sizeof(path), "%s/cpu%zu/topology/physical_package_id", root, j);
+        FILE* const file = fopen(path, "r");
+        if(file != NULL)
+        {
+            found |= fscanf(file, "%ld", &id) == 1;
+            fclose(file);
+        }
+        size_t s = 0;
+        while(s < no_sockets && ids[s] != id)
+            s++;
+        if(s == no_sockets)
+            ids[no_sockets++] = id;
+        socket_of[j] = (uint16_t)s;
+    }
+    free(ids);
+    return found ? no_sockets : 0;
+}
+
+/**
+ * Parses cpu lines of /proc/stat content. Buffer is not modified.
+ * @param buffer - null terminated content of /proc/stat
+ * @param data - structure with cpus allocated for no_cpus cores
+ * @param no_cpus - num of cpus to load
+ */
+static void reader_parse(const char* buffer, CPURawStats* const data, const size_t no_cpus)
+{
+    const char* line = buffer;
+    size_t cpu_num = 0;
+    unsigned int tmp;
+    while (line != NULL && strncmp(line, "cpu", 3) == 0)
+    {
+        Stats* const st = cpu_num == 0 ? &data->total : &data->cpus[cpu_num - 1];
+        if(cpu_num == 0)
+        {
+            sscanf(line, "cpu %u %u %u %u %u %u %u %u", &st->user, &st->nice,
+                   &st->system, &st->idle, &st->iowait,
+                   &st->irq, &st->sortirq, &st->steal);
+        }
+        else{
+            sscanf(line, "cpu%u %u %u %u %u %u %u %u %u", &tmp, &st->user, &st->nice,
+                   &st->system, &st->idle, &st->iowait,
+                   &st->irq, &st->sortirq, &st->steal);
+        }
+        if (cpu_num == no_cpus) break;
+        cpu_num++;
+        line = strchr(line, '\n');
+        if(line != NULL)
+            line++;
+    }
+}
+
 /**
  * Reads data from /proc/stat and stores it in a structure.
  * @param no_cpus - num of cpus to load
@@ -92,33 +164,62 @@ size_t reader_get_no_cpus(void)
  */
 CPURawStats reader_load_data(size_t const no_cpus)
 {
-    CPURawStats data;
-    data.cpus = malloc(sizeof(Stats)*no_cpus);
+    CPURawStats data = {0};
+    data.cpus = calloc(no_cpus, sizeof(Stats));
 
     char* buffer = reader_load_to_buffer();
-    // divide into lines
-    char* line = strtok(buffer, "\n");
-    size_t cpu_num = 0;
-    int tmp;
-    while (line != NULL)
-    {
-        if(strstr(line, "cpu")!=NULL) {
-            if(cpu_num == 0)
-            {
-                sscanf(line, "cpu %d %d %d %d %d %d %d %d", &(data.total.user), &(data.total.nice),
-                       &(data.total.system), &(data.total.idle), &(data.total.iowait),
-                       &(data.total.irq), &(data.total.sortirq), &(data.total.steal));
-            }
-            else{
-                sscanf(line, "cpu%d %d %d %d %d %d %d %d %d", &tmp, &(data.cpus[cpu_num - 1].user), &(data.cpus[cpu_num - 1].nice),
-                       &(data.cpus[cpu_num - 1].system), &(data.cpus[cpu_num - 1].idle), &(data.cpus[cpu_num - 1].iowait),
-                       &(data.cpus[cpu_num - 1].irq), &(data.cpus[cpu_num - 1].sortirq), &(data.cpus[cpu_num - 1].steal));
-            }
-            if (cpu_num == no_cpus) break;
-            cpu_num++;
-        } else break;
-        line = strtok(NULL, "\n");
-    }
+    if(buffer != NULL && data.cpus != NULL)
+        reader_parse(buffer, &data, no_cpus);
     free(buffer);
     return data;
 }
+
+static bool reader_collector_parse(Collector* const c)
+{
+    ReaderProcStat* const out = c->data;
+    reader_parse(c->buffer, &out->stats, out->no_cpus);
+    return true;
+}
+
+/**
+ * Sets up /proc/stat collector. Parsed data is kept in out until the next run.
+ * @param c - collector to set up
+ * @param out - where to parse data, its cpus array is allocated here
+ * @param no_cpus - num of cpus to load
+ * @return True on success.
+ */
+bool reader_collector_init(Collector* const c, ReaderProcStat* const out, const size_t no_cpus)
+{
+    *c = (Collector){.name = "stat",
+                     .path = "/proc/stat",
+                     .interval_ms = 1000,
+                     .parse = reader_collector_parse,
+                     .fd = -1,
+                     .event_fd = -1,
+                     .data = out
+                    };
+    *out = (ReaderProcStat){.no_cpus = no_cpus};
+    out->stats.cpus = calloc(no_cpus, sizeof(Stats));
+    if(out->stats.cpus == NULL)
+        return false;
+    if(!collector_open(c))
+    {
+        free(out->stats.cpus);
+        out->stats.cpus = NULL;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Closes /proc/stat collector and frees its data.
+ */
+void reader_collector_destroy(Collector* const c)
+{
+    if(c == NULL || c->data == NULL)
+        return;
+    ReaderProcStat* const out = c->data;
+    free(out->stats.cpus);
+    out->stats.cpus = NULL;
+    collector_close(c);
+}
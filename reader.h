@@ -3,10 +3,24 @@
 #define CPU_USAGE_TRACKER_READER_H
 
 #include <stddef.h>
+#include <stdint.h>
 #include "CPURawStats.h"
+#include "collector.h"
+
+#define READER_SYSFS_CPU_ROOT "/sys/devices/system/cpu"
+
+// Latest /proc/stat sample parsed by the collector
+typedef struct ReaderProcStat{
+    CPURawStats stats;
+    size_t no_cpus;
+} ReaderProcStat;
 
 size_t reader_get_no_cpus(void);
+size_t reader_get_sockets(const char* root, uint16_t* socket_of, size_t no_cpus);
 
 CPURawStats reader_load_data(size_t no_cpus);
 
+bool reader_collector_init(Collector* c, ReaderProcStat* out, size_t no_cpus);
+void reader_collector_destroy(Collector* c);
+
 #endif //CPU_USAGE_TRACKER_READER_H
@@ -0,0 +1,64 @@
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdlib.h>
+
+#include "recorder.h"
+
+struct Recorder{
+    FILE* file;
+    size_t no_cpus;
+};
+
+/**
+ * Creates a CSV recording of every sample - one line with timestamp, total and every core.
+ * Existing file is truncated.
+ * @param path - file to write
+ * @param no_cpus - number of cores in every sample
+ * @return Pointer to the recorder, NULL on error.
+ */
+Recorder* recorder_create(const char* const path, const size_t no_cpus)
+{
+    if(path == NULL)
+        return NULL;
+    Recorder* const rec = malloc(sizeof(*rec));
+    if(rec == NULL)
+        return NULL;
+    *rec = (Recorder){.file = fopen(path, "we"), .no_cpus = no_cpus};
+    if(rec->file == NULL)
+    {
+        free(rec);
+        return NULL;
+    }
+    fprintf(rec->file, "timestamp_ms,total");
+    for (size_t j = 0; j < no_cpus; j++)
+        fprintf(rec->file, ",cpu%zu", j+1);
+    fprintf(rec->file, "\n");
+    return rec;
+}
+
+/**
+ * Flushes and closes the recording.
+ */
+void recorder_delete(Recorder* rec)
+{
+    if(rec == NULL)
+        return;
+    fclose(rec->file);
+    free(rec);
+}
+
+/**
+ * Appends one sample. The line is flushed, so the recording is complete up to the last sample even after a crash.
+ * @param timestamp_ns - CLOCK_REALTIME of the sample
+ * @return False on write error.
+ */
+bool recorder_write(Recorder* const rec, const uint64_t timestamp_ns, const UsagePercentage* const data)
+{
+    if(rec == NULL || data == NULL)
+        return false;
+    fprintf(rec->file, "%" PRIu64 ",%.2f", timestamp_ns / 1000000u, usage_bp_to_pr(data->total_bp));
+    for (size_t j = 0; j < rec->no_cpus; j++)
+        fprintf(rec->file, ",%.2f", usage_bp_to_pr(data->cores_bp[j]));
+    fprintf(rec->file, "\n");
+    return fflush(rec->file) == 0 && !ferror(rec->file);
+}
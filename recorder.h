@@ -0,0 +1,17 @@
+
+#ifndef CPU_USAGE_TRACKER_RECORDER_H
+#define CPU_USAGE_TRACKER_RECORDER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "analyzer.h"
+
+typedef struct Recorder Recorder;   // Forward declaration
+
+Recorder* recorder_create(const char* path, size_t no_cpus);
+void recorder_delete(Recorder* rec);
+
+bool recorder_write(Recorder* rec, uint64_t timestamp_ns, const UsagePercentage* data);
+
+#endif //CPU_USAGE_TRACKER_RECORDER_H
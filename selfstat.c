@@ -0,0 +1,188 @@
+#define _GNU_SOURCE  // sched_setaffinity, SCHED_IDLE, SCHED_BATCH
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "selfstat.h"
+#include "collector.h"
+
+struct SelfStat{
+    int statm_fd;           // /proc/self/statm
+    size_t page_kb;
+    uint64_t prev_ns;
+    uint64_t prev_cpu_ns;
+    long prev_vol_cs;
+    long prev_invol_cs;
+    char buffer[128];
+};
+
+/**
+ * Parses cpu list like "0,2-3" into a set.
+ * @return False on invalid list or empty set.
+ */
+static bool selfstat_parse_cpus(const char* list, cpu_set_t* const set)
+{
+    CPU_ZERO(set);
+    while(*list != '\0')
+    {
+        char* end;
+        const unsigned long first = strtoul(list, &end, 10);
+        if(end == list)
+            return false;
+        unsigned long last = first;
+        if(*end == '-')
+        {
+            list = end + 1;
+            last = strtoul(list, &end, 10);
+            if(end == list || last < first)
+                return false;
+        }
+        if(last >= CPU_SETSIZE)
+            return false;
+        for (unsigned long cpu = first; cpu <= last; cpu++)
+            CPU_SET(cpu, set);
+        if(*end == ',')
+            end++;
+        else if(*end != '\0')
+            return false;
+        list = end;
+    }
+    return CPU_COUNT(set) != 0;
+}
+
+/**
+ * Moves the calling thread to the housekeeping cpus and lowers its scheduling class or priority.
+ * Threads created afterwards inherit all of it, so it has to be called before any other thread is started.
+ * @param cpu_list - housekeeping cpus e.g. "0" or "0,2-3", NULL to keep current affinity
+ * @param policy - "idle", "batch" or "other", NULL to keep current policy
+ * @param nice - nice level, 0 to keep current one (ignored by SCHED_IDLE)
+ * @return False if any of the settings could not be applied.
+ */
+bool selfstat_apply_placement(const char* const cpu_list, const char* const policy, const int nice)
+{
+    if(cpu_list != NULL)
+    {
+        cpu_set_t set;
+        if(!selfstat_parse_cpus(cpu_list, &set))
+        {
+            fprintf(stderr, "Invalid cpu list: %s\n", cpu_list);
+            return false;
+        }
+        if(sched_setaffinity(0, sizeof(set), &set) != 0)
+        {
+            perror("sched_setaffinity");
+            return false;
+        }
+    }
+    if(policy != NULL)
+    {
+        int sched;
+        if(strcmp(policy, "idle") == 0)
+            sched = SCHED_IDLE;
+        else if(strcmp(policy, "batch") == 0)
+            sched = SCHED_BATCH;
+        else if(strcmp(policy, "other") == 0)
+            sched = SCHED_OTHER;
+        else
+        {
+            fprintf(stderr, "Invalid scheduling policy: %s\n", policy);
+            return false;
+        }
+        const struct sched_param param = {.sched_priority = 0};
+        if(sched_setscheduler(0, sched, &param) != 0)
+        {
+            perror("sched_setscheduler");
+            return false;
+        }
+    }
+    if(nice != 0 && setpriority(PRIO_PROCESS, 0, nice) != 0)
+    {
+        perror("setpriority");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @return Cpu time of every thread of the process in nanoseconds.
+ */
+static uint64_t selfstat_cpu_ns(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &t);
+    return (uint64_t)t.tv_sec * 1000000000u + (uint64_t)t.tv_nsec;
+}
+
+/**
+ * Opens /proc/self/statm once, the first sample is taken here.
+ * @return Pointer to the new SelfStat, NULL on error.
+ */
+SelfStat* selfstat_create(void)
+{
+    SelfStat* const ss = malloc(sizeof(*ss));
+    if(ss == NULL)
+        return NULL;
+    *ss = (SelfStat){.statm_fd = open("/proc/self/statm", O_RDONLY | O_CLOEXEC),
+                     .page_kb = (size_t)sysconf(_SC_PAGESIZE) / 1024
+                    };
+    SelfUsage first;
+    if(ss->statm_fd < 0 || !selfstat_sample(ss, &first))
+    {
+        selfstat_delete(ss);
+        return NULL;
+    }
+    return ss;
+}
+
+void selfstat_delete(SelfStat* ss)
+{
+    if(ss == NULL)
+        return;
+    if(ss->statm_fd >= 0)
+        close(ss->statm_fd);
+    free(ss);
+}
+
+/**
+ * Measures tracker's own cpu time, RSS and context switches since the previous call.
+ * RSS comes from /proc/self/statm. Cpu time (CLOCK_PROCESS_CPUTIME_ID) and context switches (getrusage) are
+ * taken from the kernel directly - /proc/self/stat has only clock tick resolution and /proc/self/status counts
+ * context switches of the main thread only.
+ * @return False on read error.
+ */
+bool selfstat_sample(SelfStat* const ss, SelfUsage* const out)
+{
+    if(ss == NULL || out == NULL)
+        return false;
+    const uint64_t cpu_ns = selfstat_cpu_ns();
+    const ssize_t n = pread(ss->statm_fd, ss->buffer, sizeof(ss->buffer) - 1, 0);
+    if(n <= 0)
+        return false;
+    ss->buffer[n] = '\0';
+    unsigned long size, resident;
+    if(sscanf(ss->buffer, "%lu %lu", &size, &resident) != 2)
+        return false;
+    struct rusage usage;
+    if(getrusage(RUSAGE_SELF, &usage) != 0)
+        return false;
+
+    const uint64_t now = collector_now_ns();
+    const double elapsed_s = ss->prev_ns != 0 ? (double)(now - ss->prev_ns) / 1e9 : 0;
+    const double cpu_s = (double)(cpu_ns - ss->prev_cpu_ns) / 1e9;
+    *out = (SelfUsage){.cpu_pr = elapsed_s > 0 ? cpu_s * 100 / elapsed_s : 0,
+                       .cpu_ms = (double)cpu_ns / 1e6,
+                       .rss_kb = resident * ss->page_kb,
+                       .vol_cs_s = elapsed_s > 0 ? (double)(usage.ru_nvcsw - ss->prev_vol_cs) / elapsed_s : 0,
+                       .invol_cs_s = elapsed_s > 0 ? (double)(usage.ru_nivcsw - ss->prev_invol_cs) / elapsed_s : 0
+                      };
+    ss->prev_ns = now;
+    ss->prev_cpu_ns = cpu_ns;
+    ss->prev_vol_cs = usage.ru_nvcsw;
+    ss->prev_invol_cs = usage.ru_nivcsw;
+    return true;
+}
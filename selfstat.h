@@ -0,0 +1,26 @@
+
+#ifndef CPU_USAGE_TRACKER_SELFSTAT_H
+#define CPU_USAGE_TRACKER_SELFSTAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Tracker's own footprint since the previous sample
+typedef struct SelfUsage{
+    double cpu_pr;          // cpu time of all threads in % of one cpu
+    double cpu_ms;          // cpu time since start
+    size_t rss_kb;
+    double vol_cs_s;        // voluntary context switches per second
+    double invol_cs_s;      // involuntary context switches per second
+} SelfUsage;
+
+typedef struct SelfStat SelfStat;   // Forward declaration
+
+bool selfstat_apply_placement(const char* cpu_list, const char* policy, int nice);
+
+SelfStat* selfstat_create(void);
+void selfstat_delete(SelfStat* ss);
+bool selfstat_sample(SelfStat* ss, SelfUsage* out);
+
+#endif //CPU_USAGE_TRACKER_SELFSTAT_H
@@ -0,0 +1,91 @@
+#include <stdlib.h>
+#include <time.h>
+
+#include "shmpub.h"
+#include "cutshm.h"
+
+struct ShmPublisher{
+    const char* name;
+    CutShmHeader* hdr;
+    size_t map_size;
+};
+
+/**
+ * Creates shared memory segment with the latest sample. Existing segment of the same name is replaced.
+ * @param name - shared memory name, e.g. "/cut"
+ * @param no_cpus - number of cores in every sample
+ * @return Pointer to the publisher, NULL on error.
+ */
+ShmPublisher* shmpub_create(const char* const name, const size_t no_cpus)
+{
+    if(name == NULL)
+        return NULL;
+    ShmPublisher* const pub = malloc(sizeof(*pub));
+    if(pub == NULL)
+        return NULL;
+    pub->name = name;
+    pub->map_size = sizeof(CutShmHeader) + sizeof(double) * no_cpus;
+
+    shm_unlink(name);
+    const int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0644);
+    if(fd < 0)
+    {
+        free(pub);
+        return NULL;
+    }
+    void* const map = ftruncate(fd, (off_t)pub->map_size) == 0 ?
+                      mmap(NULL, pub->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if(map == MAP_FAILED)
+    {
+        shm_unlink(name);
+        free(pub);
+        return NULL;
+    }
+    pub->hdr = map;
+    // ftruncate zero-filled the segment - sample_no 0 means nothing published yet
+    pub->hdr->no_cpus = (uint32_t)no_cpus;
+    pub->hdr->version = CUTSHM_VERSION;
+    atomic_thread_fence(memory_order_release);
+    pub->hdr->magic = CUTSHM_MAGIC;
+    return pub;
+}
+
+/**
+ * Unmaps and removes the segment. Clients that still have it mapped keep the last sample.
+ */
+void shmpub_delete(ShmPublisher* pub)
+{
+    if(pub == NULL)
+        return;
+    munmap(pub->hdr, pub->map_size);
+    shm_unlink(pub->name);
+    free(pub);
+}
+
+/**
+ * Writes new sample under the seqlock. Single writer - the analyzer.
+ * @param pub - publisher, NULL if disabled
+ * @param data - analyzed sample with no_cpus cores
+ */
+void shmpub_publish(ShmPublisher* const pub, const UsagePercentage* const data)
+{
+    if(pub == NULL || data == NULL)
+        return;
+    CutShmHeader* const hdr = pub->hdr;
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    const uint64_t seq = atomic_load_explicit(&hdr->seq, memory_order_relaxed);
+    atomic_store_explicit(&hdr->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    hdr->sample_no++;
+    hdr->timestamp_ns = (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+    hdr->total_pr = usage_bp_to_pr(data->total_bp);
+    hdr->effective_pr = usage_bp_to_pr(data->effective_bp);
+    for (size_t j = 0; j < hdr->no_cpus; j++)
+        hdr->cores_pr[j] = usage_bp_to_pr(data->cores_bp[j]);
+
+    atomic_store_explicit(&hdr->seq, seq + 2, memory_order_release);
+}
@@ -0,0 +1,15 @@
+
+#ifndef CPU_USAGE_TRACKER_SHMPUB_H
+#define CPU_USAGE_TRACKER_SHMPUB_H
+
+#include <stddef.h>
+#include "analyzer.h"
+
+typedef struct ShmPublisher ShmPublisher;   // Forward declaration
+
+ShmPublisher* shmpub_create(const char* name, size_t no_cpus);
+void shmpub_delete(ShmPublisher* pub);
+
+void shmpub_publish(ShmPublisher* pub, const UsagePercentage* data);
+
+#endif //CPU_USAGE_TRACKER_SHMPUB_H
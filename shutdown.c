@@ -0,0 +1,229 @@
+#include <stdint.h>
+#include <unistd.h>
+#include <signal.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+
+#include "shutdown.h"
+
+/**
+ *  SHUTDOWN IS ANNOUNCED ONCE FOR THE WHOLE PROCESS. SIGTERM AND SIGINT ARE BLOCKED IN EVERY THREAD AND READ
+ *  FROM A SIGNALFD, SO NO CODE RUNS IN SIGNAL CONTEXT. A REQUEST RUNS REGISTERED HOOKS (SET FLAGS, CLOSE QUEUES,
+ *  WAKE CONDITION VARIABLES) AND MAKES THE EVENTFD READABLE FOR EVERY THREAD SLEEPING IN POLL OR EPOLL.
+ *  SIGWINCH COMES THROUGH THE SAME SIGNALFD - IT DOES NOT SHUT DOWN, IT RUNS ITS SIGNAL HOOKS ON THE THREAD
+ *  THAT READ IT.
+ */
+typedef struct ShutdownHook{
+    void (*hook)(void* arg);    // NULL if slot is free
+    void* arg;
+    int signum;                 // signal of a signal hook
+} ShutdownHook;
+
+static int g_event_fd = -1;
+static int g_signal_fd = -1;
+static atomic_bool g_requested = ATOMIC_VAR_INIT(false);
+static pthread_mutex_t g_hooks_mutex = PTHREAD_MUTEX_INITIALIZER;
+static ShutdownHook g_hooks[SHUTDOWN_MAX_HOOKS];
+static ShutdownHook g_signal_hooks[SHUTDOWN_MAX_HOOKS];
+
+/**
+ * Blocks SIGTERM, SIGINT and SIGWINCH and creates the shutdown eventfd and signalfd.
+ * Has to be called by the main thread before any other thread is created - threads inherit the signal mask.
+ * @return False on error.
+ */
+bool shutdown_init(void)
+{
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGTERM);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGWINCH);
+    if(pthread_sigmask(SIG_BLOCK, &set, NULL) != 0)
+        return false;
+    g_event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    g_signal_fd = signalfd(-1, &set, SFD_CLOEXEC | SFD_NONBLOCK);
+    if(g_event_fd < 0 || g_signal_fd < 0)
+    {
+        shutdown_cleanup();
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Closes the descriptors. Nobody may wait on them anymore.
+ */
+void shutdown_cleanup(void)
+{
+    if(g_event_fd >= 0)
+        close(g_event_fd);
+    if(g_signal_fd >= 0)
+        close(g_signal_fd);
+    g_event_fd = -1;
+    g_signal_fd = -1;
+}
+
+/**
+ * @return Eventfd which becomes readable (POLLIN) after shutdown was requested and stays readable, -1 before init.
+ */
+int shutdown_fd(void)
+{
+    return g_event_fd;
+}
+
+/**
+ * @return Signalfd readable when SIGTERM, SIGINT or SIGWINCH is pending, -1 before init.
+ */
+int shutdown_signal_fd(void)
+{
+    return g_signal_fd;
+}
+
+/**
+ * Consumes pending signals from the signalfd up to the first SIGTERM/SIGINT. SIGWINCH on the way runs its signal
+ * hooks.
+ * @return SIGTERM or SIGINT, 0 if neither is pending.
+ */
+int shutdown_read_signal(void)
+{
+    struct signalfd_siginfo info;
+    while(g_signal_fd >= 0 && read(g_signal_fd, &info, sizeof(info)) == (ssize_t)sizeof(info))
+    {
+        const int signum = (int)info.ssi_signo;
+        if(signum != SIGWINCH)
+            return signum;
+        pthread_mutex_lock(&g_hooks_mutex);
+        for (int i = 0; i < SHUTDOWN_MAX_HOOKS; i++)
+        {
+            if(g_signal_hooks[i].hook != NULL && g_signal_hooks[i].signum == signum)
+                g_signal_hooks[i].hook(g_signal_hooks[i].arg);
+        }
+        pthread_mutex_unlock(&g_hooks_mutex);
+    }
+    return 0;
+}
+
+/**
+ * Registers function run whenever a signal that does not shut down is read from the signalfd.
+ * Hooks run on the thread reading the signalfd and must not block.
+ * @param signum - SIGWINCH
+ * @return Id for shutdown_remove_signal_hook, -1 for another signal or if there is no free slot.
+ */
+int shutdown_add_signal_hook(const int signum, void (*hook)(void* arg), void* arg)
+{
+    int id = -1;
+    if(signum != SIGWINCH || hook == NULL)
+        return -1;
+    pthread_mutex_lock(&g_hooks_mutex);
+    for (int i = 0; i < SHUTDOWN_MAX_HOOKS && id < 0; i++)
+    {
+        if(g_signal_hooks[i].hook != NULL)
+            continue;
+        g_signal_hooks[i] = (ShutdownHook){.hook = hook, .arg = arg, .signum = signum};
+        id = i;
+    }
+    pthread_mutex_unlock(&g_hooks_mutex);
+    return id;
+}
+
+/**
+ * Unregisters signal hook - e.g. before its argument is freed.
+ */
+void shutdown_remove_signal_hook(const int id)
+{
+    if(id < 0 || id >= SHUTDOWN_MAX_HOOKS)
+        return;
+    pthread_mutex_lock(&g_hooks_mutex);
+    g_signal_hooks[id] = (ShutdownHook){.hook = NULL, .arg = NULL};
+    pthread_mutex_unlock(&g_hooks_mutex);
+}
+
+/**
+ * Registers function run once when shutdown is requested. If it already was, the function runs right away.
+ * Hooks run on the requesting thread in the order of registration and must not block.
+ * @return Id for shutdown_remove_hook, -1 if there is no free slot.
+ */
+int shutdown_add_hook(void (*hook)(void* arg), void* arg)
+{
+    int id = -1;
+    pthread_mutex_lock(&g_hooks_mutex);
+    for (int i = 0; i < SHUTDOWN_MAX_HOOKS && id < 0; i++)
+    {
+        if(g_hooks[i].hook != NULL)
+            continue;
+        g_hooks[i] = (ShutdownHook){.hook = hook, .arg = arg};
+        id = i;
+    }
+    // Hooks registered after the request still have to run
+    if(id >= 0 && atomic_load(&g_requested))
+        hook(arg);
+    pthread_mutex_unlock(&g_hooks_mutex);
+    return id;
+}
+
+/**
+ * Unregisters hook - e.g. before its argument is freed.
+ */
+void shutdown_remove_hook(const int id)
+{
+    if(id < 0 || id >= SHUTDOWN_MAX_HOOKS)
+        return;
+    pthread_mutex_lock(&g_hooks_mutex);
+    g_hooks[id] = (ShutdownHook){.hook = NULL, .arg = NULL};
+    pthread_mutex_unlock(&g_hooks_mutex);
+}
+
+/**
+ * Requests shutdown - runs every hook and wakes every thread polling shutdown_fd. Only the first call has an effect.
+ */
+void shutdown_request(void)
+{
+    pthread_mutex_lock(&g_hooks_mutex);
+    if(!atomic_exchange(&g_requested, true))
+    {
+        for (int i = 0; i < SHUTDOWN_MAX_HOOKS; i++)
+        {
+            if(g_hooks[i].hook != NULL)
+                g_hooks[i].hook(g_hooks[i].arg);
+        }
+        const uint64_t one = 1;
+        if(g_event_fd >= 0)
+        {
+            const ssize_t written = write(g_event_fd, &one, sizeof(one));
+            (void)written;  // only the first request writes - the counter cannot overflow
+        }
+    }
+    pthread_mutex_unlock(&g_hooks_mutex);
+}
+
+/**
+ * @return True once shutdown was requested.
+ */
+bool shutdown_requested(void)
+{
+    return atomic_load(&g_requested);
+}
+
+/**
+ * Sleeps until SIGTERM/SIGINT arrives or another thread requests shutdown. A signal requests shutdown.
+ * @return Signal number, 0 if shutdown was requested by a thread.
+ */
+int shutdown_wait(void)
+{
+    struct pollfd fds[2] = {{.fd = g_signal_fd, .events = POLLIN}, {.fd = g_event_fd, .events = POLLIN}};
+    while(!shutdown_requested())
+    {
+        if(poll(fds, 2, -1) < 0)
+            continue;
+        const int signum = shutdown_read_signal();
+        if(signum != 0)
+        {
+            shutdown_request();
+            return signum;
+        }
+    }
+    return 0;
+}
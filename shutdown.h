@@ -0,0 +1,26 @@
+
+#ifndef CPU_USAGE_TRACKER_SHUTDOWN_H
+#define CPU_USAGE_TRACKER_SHUTDOWN_H
+
+#include <stdbool.h>
+
+#define SHUTDOWN_MAX_HOOKS 16
+
+bool shutdown_init(void);
+void shutdown_cleanup(void);
+
+int shutdown_fd(void);
+int shutdown_signal_fd(void);
+int shutdown_read_signal(void);
+
+int shutdown_add_signal_hook(int signum, void (*hook)(void* arg), void* arg);
+void shutdown_remove_signal_hook(int id);
+
+int shutdown_add_hook(void (*hook)(void* arg), void* arg);
+void shutdown_remove_hook(int id);
+
+void shutdown_request(void);
+bool shutdown_requested(void);
+int shutdown_wait(void);
+
+#endif //CPU_USAGE_TRACKER_SHUTDOWN_H
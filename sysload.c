@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "sysload.h"
+
+// PSI trigger - wake the pipeline when tasks stall for 200ms within a 2s window.
+// Unprivileged users may only use windows that are multiples of 2s.
+#define SYSLOAD_PSI_TRIGGER "some 200000 2000000"
+
+static bool sysload_loadavg_parse(Collector* const c)
+{
+    LoadAvg* const out = c->data;
+    return sscanf(c->buffer, "%lf %lf %lf %u/%u", &out->avg[0], &out->avg[1], &out->avg[2],
+                  &out->runnable, &out->threads) == 5;
+}
+
+static bool sysload_psi_parse(Collector* const c)
+{
+    Pressure* const out = c->data;
+    if(sscanf(c->buffer, "some avg10=%lf avg60=%lf avg300=%lf total=%" SCNu64, &out->some_avg[0], &out->some_avg[1],
+              &out->some_avg[2], &out->some_total) != 4)
+        return false;
+    // "full" line is missing on older kernels
+    const char* const full = strstr(c->buffer, "full");
+    if(full != NULL)
+        sscanf(full, "full avg10=%lf avg60=%lf avg300=%lf total=%" SCNu64, &out->full_avg[0], &out->full_avg[1],
+               &out->full_avg[2], &out->full_total);
+    return true;
+}
+
+/**
+ * Registers PSI trigger on a separate fd, kernel marks it with POLLPRI when the threshold is exceeded.
+ */
+static bool sysload_psi_arm(Collector* const c)
+{
+    const int fd = open(c->path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if(fd < 0)
+        return false;
+    if(write(fd, SYSLOAD_PSI_TRIGGER, strlen(SYSLOAD_PSI_TRIGGER) + 1) < 0)
+    {
+        close(fd);
+        return false;
+    }
+    c->event_fd = fd;
+    return true;
+}
+
+static bool sysload_schedstat_parse(Collector* const c)
+{
+    SchedStat* const out = c->data;
+    const char* line = c->buffer;
+    while(line != NULL)
+    {
+        size_t cpu;
+        uint64_t run_delay;
+        // cpuN yld_count legacy sched_count sched_goidle ttwu_count ttwu_local rq_cpu_time run_delay pcount
+        if(sscanf(line, "cpu%zu %*u %*u %*u %*u %*u %*u %*u %" SCNu64, &cpu, &run_delay) == 2 && cpu < out->no_cpus)
+            out->run_delay[cpu] = run_delay;
+        line = strchr(line, '\n');
+        if(line != NULL)
+            line++;
+    }
+    return true;
+}
+
+/**
+ * Sets up /proc/loadavg collector. Kernel updates load average every 5 seconds.
+ * @return True if source is available.
+ */
+bool sysload_loadavg_init(Collector* const c, LoadAvg* const out)
+{
+    *c = (Collector){.name = "loadavg",
+                     .path = "/proc/loadavg",
+                     .interval_ms = 5000,
+                     .parse = sysload_loadavg_parse,
+                     .fd = -1,
+                     .event_fd = -1,
+                     .data = out
+                    };
+    return collector_open(c);
+}
+
+/**
+ * Sets up /proc/pressure/cpu collector.
+ * @param wakes - collector run immediately on pressure event, may be NULL
+ * @return True if source is available.
+ */
+bool sysload_psi_init(Collector* const c, Pressure* const out, Collector* const wakes)
+{
+    *c = (Collector){.name = "psi",
+                     .path = "/proc/pressure/cpu",
+                     .interval_ms = 2000,
+                     .parse = sysload_psi_parse,
+                     .arm = sysload_psi_arm,
+                     .wakes = wakes,
+                     .fd = -1,
+                     .event_fd = -1,
+                     .data = out
+                    };
+    return collector_open(c);
+}
+
+/**
+ * Sets up /proc/schedstat collector.
+ * @param out - run_delay array is allocated here
+ * @return True if source is available.
+ */
+bool sysload_schedstat_init(Collector* const c, SchedStat* const out, const size_t no_cpus)
+{
+    *c = (Collector){.name = "schedstat",
+                     .path = "/proc/schedstat",
+                     .interval_ms = 1000,
+                     .parse = sysload_schedstat_parse,
+                     .fd = -1,
+                     .event_fd = -1,
+                     .data = out
+                    };
+    *out = (SchedStat){.no_cpus = no_cpus};
+    out->run_delay = calloc(no_cpus, sizeof(uint64_t));
+    if(out->run_delay == NULL)
+        return false;
+    if(!collector_open(c))
+    {
+        free(out->run_delay);
+        out->run_delay = NULL;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Closes /proc/schedstat collector and frees its data.
+ */
+void sysload_schedstat_destroy(Collector* const c)
+{
+    if(c == NULL || c->data == NULL)
+        return;
+    SchedStat* const out = c->data;
+    free(out->run_delay);
+    out->run_delay = NULL;
+    collector_close(c);
+}
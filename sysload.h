@@ -0,0 +1,20 @@
+
+#ifndef CPU_USAGE_TRACKER_SYSLOAD_H
+#define CPU_USAGE_TRACKER_SYSLOAD_H
+
+#include <stddef.h>
+#include "CPURawStats.h"
+#include "collector.h"
+
+// Run-queue wait per cpu parsed from /proc/schedstat
+typedef struct SchedStat{
+    uint64_t* run_delay;    // [no_cpus] ns
+    size_t no_cpus;
+} SchedStat;
+
+bool sysload_loadavg_init(Collector* c, LoadAvg* out);
+bool sysload_psi_init(Collector* c, Pressure* out, Collector* wakes);
+bool sysload_schedstat_init(Collector* c, SchedStat* out, size_t no_cpus);
+void sysload_schedstat_destroy(Collector* c);
+
+#endif //CPU_USAGE_TRACKER_SYSLOAD_H
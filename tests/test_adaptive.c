@@ -0,0 +1,62 @@
+#include <assert.h>
+#include <stddef.h>
+
+#include "../adaptive.h"
+#include "test_adaptive.h"
+
+/*
+ * TESTS:
+ * - Invalid limits
+ * - Exponential back off while stable
+ * - Jump to the minimum on change
+ */
+static void test_adaptive_invalid(void);
+static void test_adaptive_backoff(void);
+static void test_adaptive_jump(void);
+
+static void test_adaptive_invalid(void)
+{
+    AdaptiveRate ar;
+    assert(!adaptive_init(&ar, 0, 100, 1000));
+    assert(!adaptive_init(&ar, 2, 0, 1000));
+    assert(!adaptive_init(&ar, 2, 1000, 100));
+    assert(adaptive_init(&ar, 2, 2000, 8000));
+    assert(ar.interval_ms == 2000);     // start clamped into limits
+    adaptive_destroy(&ar);
+    adaptive_destroy(NULL);
+}
+
+static void test_adaptive_backoff(void)
+{
+    AdaptiveRate ar;
+    assert(adaptive_init(&ar, 2, 100, 8000));
+    const uint16_t cores[2] = {3000, 5000};
+    assert(adaptive_update(&ar, cores) == 1000);
+    assert(adaptive_update(&ar, cores) == 2000);
+    assert(adaptive_update(&ar, cores) == 4000);
+    assert(adaptive_update(&ar, cores) == 8000);
+    assert(adaptive_update(&ar, cores) == 8000);
+    adaptive_destroy(&ar);
+}
+
+static void test_adaptive_jump(void)
+{
+    AdaptiveRate ar;
+    assert(adaptive_init(&ar, 2, 100, 8000));
+    uint16_t cores[2] = {1000, 1000};
+    adaptive_update(&ar, cores);
+    assert(adaptive_update(&ar, cores) == 2000);
+    cores[1] = 9000;
+    assert(adaptive_update(&ar, cores) == 100);
+    // At 100 ms one clock tick is a big step - small noise does not keep the rate up
+    cores[1] = 9500;
+    assert(adaptive_update(&ar, cores) == 200);
+    adaptive_destroy(&ar);
+}
+
+void test_adaptive_main(void)
+{
+    test_adaptive_invalid();
+    test_adaptive_backoff();
+    test_adaptive_jump();
+}
@@ -0,0 +1,7 @@
+
+#ifndef CPU_USAGE_TRACKER_TEST_ADAPTIVE_H
+#define CPU_USAGE_TRACKER_TEST_ADAPTIVE_H
+
+void test_adaptive_main(void);
+
+#endif //CPU_USAGE_TRACKER_TEST_ADAPTIVE_H
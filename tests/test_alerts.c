@@ -0,0 +1,173 @@
+#include <assert.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "../alerts.h"
+#include "test_alerts.h"
+
+/*
+ * TESTS:
+ * - Invalid rules
+ * - Alert fires after N samples and resolves with hysteresis
+ * - Cooldown
+ * - Averaged rule - mean of the last W seconds weighted by the intervals
+ * - Effective usage rule - scaled cores when the sample carries them, plain usage otherwise
+ * - Delivery without the dispatcher thread - FIFO line written by alerts_evaluate, FIFO reader gone, hooks in order
+ *   one at a time, awaited by alerts_delete
+ */
+static void test_alerts_invalid(void);
+static void test_alerts_for_hysteresis(void);
+static void test_alerts_cooldown(void);
+static void test_alerts_avg(void);
+static void test_alerts_effective(void);
+static void test_alerts_inline(void);
+
+static size_t test_alerts_push(AlertEngine* ae, double total, double core0, double core1)
+{
+    uint16_t cores[2] = {(uint16_t)(core0 * 100), (uint16_t)(core1 * 100)};
+    UsagePercentage usage = {.total_bp = (uint16_t)(total * 100), .cores_bp = cores};
+    return alerts_evaluate(ae, &usage, NULL, 1.0);
+}
+
+static void test_alerts_invalid(void)
+{
+    const char* bad[] = {"cpu3>90", "load>5", "total<5", "total>101", "total>50,for=0", "total>50,clear=60",
+                         "total>50,foo=1", "total>50x"};
+    for (size_t i = 0; i < sizeof(bad)/sizeof(bad[0]); i++)
+        assert(alerts_create(&bad[i], 1, 2, 1.0, NULL, NULL, true) == NULL);
+    assert(alerts_create(bad, 0, 2, 1.0, NULL, NULL, true) == NULL);
+    alerts_delete(NULL);
+    assert(alerts_evaluate(NULL, NULL, NULL, 1.0) == 0);
+}
+
+static void test_alerts_for_hysteresis(void)
+{
+    const char* rules[] = {"cpu>90,for=3", "cpu2>50,clear=20"};
+    AlertEngine* ae = alerts_create(rules, 2, 2, 1.0, NULL, NULL, true);
+    assert(ae != NULL);
+
+    assert(test_alerts_push(ae, 0, 95, 0) == 0);
+    assert(test_alerts_push(ae, 0, 95, 0) == 0);
+    assert(test_alerts_push(ae, 0, 95, 0) == 1);   // cpu1 third sample
+    assert(alerts_active(ae) == 1);
+    assert(test_alerts_push(ae, 0, 88, 60) == 1);  // cpu2 > 50, cpu1 still above default clear 85
+    assert(alerts_active(ae) == 2);
+    assert(test_alerts_push(ae, 0, 80, 30) == 1);  // cpu1 resolves, cpu2 stays above clear 20
+    assert(test_alerts_push(ae, 0, 80, 10) == 1);
+    assert(alerts_active(ae) == 0);
+    alerts_delete(ae);
+}
+
+static void test_alerts_cooldown(void)
+{
+    const char* rules[] = {"total>50,cooldown=3"};
+    AlertEngine* ae = alerts_create(rules, 1, 2, 1.0, NULL, NULL, true);
+    assert(test_alerts_push(ae, 60, 0, 0) == 1);
+    assert(test_alerts_push(ae, 10, 0, 0) == 1);
+    assert(test_alerts_push(ae, 60, 0, 0) == 0);
+    assert(test_alerts_push(ae, 60, 0, 0) == 0);
+    assert(test_alerts_push(ae, 60, 0, 0) == 1);
+    alerts_delete(ae);
+}
+
+static void test_alerts_avg(void)
+{
+    const char* rules[] = {"total>50,avg=10"};
+    AlertEngine* ae = alerts_create(rules, 1, 2, 1.0, NULL, NULL, true);
+    for (int i = 0; i < 10; i++)
+        assert(test_alerts_push(ae, 0, 0, 0) == 0);
+    // Every second of 100% adds 10% to the mean of the last 10 s - above 50% after the sixth
+    for (int i = 0; i < 5; i++)
+        assert(test_alerts_push(ae, 100, 0, 0) == 0);
+    assert(test_alerts_push(ae, 100, 0, 0) == 1);
+    // Zeros replace the zeros older than the busy seconds first - 60% for 4 s, 50%, then 40% below clear 45%
+    for (int i = 0; i < 5; i++)
+        assert(test_alerts_push(ae, 0, 0, 0) == 0);
+    assert(test_alerts_push(ae, 0, 0, 0) == 1 && alerts_active(ae) == 0);
+    alerts_delete(ae);
+
+    // Samples weigh by their interval, the oldest leaves once the newer ones span the window
+    ae = alerts_create(rules, 1, 2, 0.5, NULL, NULL, true);
+    uint16_t cores[2] = {0, 0};
+    UsagePercentage usage = {.total_bp = USAGE_FULL_BP, .cores_bp = cores};
+    assert(alerts_evaluate(ae, &usage, NULL, 9.0) == 1);
+    usage.total_bp = 0;
+    assert(alerts_evaluate(ae, &usage, NULL, 1.0) == 0 && alerts_active(ae) == 1);    // (900 + 0) / 10
+    assert(alerts_evaluate(ae, &usage, NULL, 9.5) == 1 && alerts_active(ae) == 0);    // 9 s at 100% left
+    alerts_delete(ae);
+    assert(alerts_create(rules, 1, 2, 0, NULL, NULL, true) == NULL);
+}
+
+static void test_alerts_effective(void)
+{
+    const char* rules[] = {"eff_cpu2>50", "eff_total>40"};
+    AlertEngine* ae = alerts_create(rules, 2, 2, 1.0, NULL, NULL, true);
+    assert(ae != NULL);
+    // Busy core at a low frequency - usage is high, its effective usage is not
+    uint16_t cores[2] = {0, 9000};
+    uint16_t effective[2] = {0, 4000};
+    UsagePercentage usage = {.total_bp = 4500, .cores_bp = cores, .effective_bp = 2000,
+                             .effective_cores_bp = effective};
+    assert(alerts_evaluate(ae, &usage, NULL, 1.0) == 0);
+    effective[1] = 9000;
+    usage.effective_bp = 4500;
+    assert(alerts_evaluate(ae, &usage, NULL, 1.0) == 2);
+    // No frequencies in the sample - the cores stand for themselves
+    usage.effective_cores_bp = NULL;
+    assert(alerts_evaluate(ae, &usage, NULL, 1.0) == 0 && alerts_active(ae) == 2);
+    alerts_delete(ae);
+}
+
+static void test_alerts_inline(void)
+{
+    const char* const fifo = "/tmp/cut_test_alerts_fifo";
+    const char* const out = "/tmp/cut_test_alerts_hook";
+    const char* rules[] = {"total>50"};
+    unlink(fifo);
+    unlink(out);
+    assert(mkfifo(fifo, 0600) == 0);
+    const int fd = open(fifo, O_RDONLY | O_NONBLOCK);
+    assert(fd >= 0);
+    AlertEngine* ae = alerts_create(rules, 1, 2, 1.0, "echo $CUT_ALERT_STATE >> /tmp/cut_test_alerts_hook", fifo,
+                                    false);
+    assert(ae != NULL);
+    assert(test_alerts_push(ae, 60, 0, 0) == 1);
+    // Written before alerts_evaluate returned
+    char line[128];
+    const ssize_t n = read(fd, line, sizeof(line) - 1);
+    assert(n > 0);
+    line[n] = '\0';
+    assert(strcmp(line, "FIRED total>50 total 60.0%\n") == 0);
+    // Reader went away - the write fails, SIGPIPE neither kills us nor stays blocked
+    close(fd);
+    assert(test_alerts_push(ae, 10, 0, 0) == 1);
+    sigset_t mask;
+    pthread_sigmask(SIG_BLOCK, NULL, &mask);
+    assert(!sigismember(&mask, SIGPIPE));
+    alerts_delete(ae);
+
+    FILE* const f = fopen(out, "r");
+    assert(f != NULL);
+    char states[2][16];
+    assert(fscanf(f, "%15s %15s", states[0], states[1]) == 2);
+    fclose(f);
+    assert(strcmp(states[0], "fired") == 0 && strcmp(states[1], "resolved") == 0);
+    unlink(fifo);
+    unlink(out);
+}
+
+void test_alerts_main(void)
+{
+    test_alerts_invalid();
+    test_alerts_for_hysteresis();
+    test_alerts_cooldown();
+    test_alerts_avg();
+    test_alerts_effective();
+    test_alerts_inline();
+}
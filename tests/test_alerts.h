@@ -0,0 +1,7 @@
+
+#ifndef CPU_USAGE_TRACKER_TEST_ALERTS_H
+#define CPU_USAGE_TRACKER_TEST_ALERTS_H
+
+void test_alerts_main(void);
+
+#endif //CPU_USAGE_TRACKER_TEST_ALERTS_H
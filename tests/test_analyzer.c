@@ -0,0 +1,255 @@
+#include <assert.h>
+#include <string.h>
+
+#include "../analyzer.h"
+#include "test_analyzer.h"
+
+/*
+ * TESTS:
+ * - Usage of a tick - rounding to basis points at the 0.005% boundaries
+ * - Counters - 32-bit wraparound, going backwards, idle moving faster than total, no time passed
+ * - Steal - 32-bit wraparound, going backwards, steal moving faster than total
+ * - Even load - no spread, no flags
+ * - One core pinned, the rest idle - Gini (n-1)/n, imbalance at once, hot core after the streak
+ * - Saturation streak in time - shorter interval takes more samples, no wraparound
+ * - Every core saturated - not a hot core, not an imbalance
+ * - Sockets - load on one socket, imbalance within one socket, more sockets than reported
+ * - Invalid input
+ * - Effective usage - scaled by frequency, clamped above the maximal frequency, unknown frequency, rounded mean
+ */
+static void test_analyzer_rounding(void);
+static void test_analyzer_counters(void);
+static void test_analyzer_steal(void);
+static void test_analyzer_even(void);
+static void test_analyzer_hot_core(void);
+static void test_analyzer_streak_time(void);
+static void test_analyzer_busy(void);
+static void test_analyzer_sockets(void);
+static void test_analyzer_invalid(void);
+static void test_analyzer_effective(void);
+
+enum{TEST_ANALYZER_CPUS = 8};
+
+/**
+ * @return Usage of the first tick of a core that was busy and idle for given jiffies.
+ */
+static uint16_t test_analyzer_tick(const uint32_t busy, const uint32_t idle)
+{
+    uint64_t prev_total = 0, prev_idle = 0;
+    return analyzer_analyze(&prev_total, &prev_idle, (Stats){.user = busy, .idle = idle});
+}
+
+static void test_analyzer_rounding(void)
+{
+    assert(test_analyzer_tick(1, 19999) == 1);              // 0.005% rounds up
+    assert(test_analyzer_tick(1, 20000) == 0);              // just below 0.005%
+    assert(test_analyzer_tick(3, 19997) == 2);              // 0.015%
+    assert(test_analyzer_tick(19999, 1) == USAGE_FULL_BP);  // 99.995% rounds up
+    assert(test_analyzer_tick(19998, 1) == 9999);           // just below 99.995%
+    assert(test_analyzer_tick(0, 100) == 0 && test_analyzer_tick(100, 0) == USAGE_FULL_BP);
+}
+
+static void test_analyzer_counters(void)
+{
+    uint64_t prev_total = 0, prev_idle = 0;
+    // Fields near the top of uint32_t - their sum does not fit it either
+    Stats data = {.user = UINT32_MAX - 99, .system = UINT32_MAX - 99, .idle = UINT32_MAX - 199};
+    analyzer_analyze(&prev_total, &prev_idle, data);
+    assert(prev_total == 3ull * UINT32_MAX - 397 && prev_idle == UINT32_MAX - 199);
+    // Every field wraps around - 400 busy and 400 idle jiffies
+    data.user = 100;
+    data.system = 100;
+    data.idle = 200;
+    assert(analyzer_analyze(&prev_total, &prev_idle, data) == 5000);
+
+    // No time passed - nothing to measure, nothing changes
+    assert(analyzer_analyze(&prev_total, &prev_idle, data) == 0);
+    assert(prev_total == 400 && prev_idle == 200);
+
+    // Idle moved by more than total - clamped to idle
+    data.user = 0;
+    data.idle = 350;
+    assert(analyzer_analyze(&prev_total, &prev_idle, data) == 0);
+
+    // A counter went backwards - no usage, the next tick measures from the new values
+    data.system = 0;
+    assert(analyzer_analyze(&prev_total, &prev_idle, data) == 0);
+    assert(prev_total == 350 && prev_idle == 350);
+    data.user = 30;
+    data.idle = 360;
+    assert(analyzer_analyze(&prev_total, &prev_idle, data) == 7500);
+}
+
+static void test_analyzer_steal(void)
+{
+    uint64_t prev_sum = 0, prev_steal = 0;
+    Stats data = {.user = UINT32_MAX - 49, .idle = UINT32_MAX - 99, .steal = UINT32_MAX - 49};
+    analyzer_steal(&prev_sum, &prev_steal, data);
+    // Every field wraps around - 100 of 400 jiffies stolen
+    data.user = 50;
+    data.idle = 100;
+    data.steal = 50;
+    assert(analyzer_steal(&prev_sum, &prev_steal, data) == 25.0);
+    assert(analyzer_steal(&prev_sum, &prev_steal, data) == 0);
+
+    // Steal went backwards - no steal, the next tick measures from the new values
+    data.steal = 10;
+    data.user = 100;
+    assert(analyzer_steal(&prev_sum, &prev_steal, data) == 0);
+    data.steal = 20;
+    data.idle = 110;
+    assert(analyzer_steal(&prev_sum, &prev_steal, data) == 50.0);
+
+    // Steal moved by more than total - clamped to 100%
+    data.steal = 60;
+    data.idle = 80;
+    assert(analyzer_steal(&prev_sum, &prev_steal, data) == 100.0);
+    // Total went backwards
+    data.user = 0;
+    assert(analyzer_steal(&prev_sum, &prev_steal, data) == 0);
+}
+
+static void test_analyzer_even(void)
+{
+    uint16_t cores[TEST_ANALYZER_CPUS];
+    uint32_t streaks[TEST_ANALYZER_CPUS] = {0};
+    Balance b;
+    for (size_t j = 0; j < TEST_ANALYZER_CPUS; j++)
+        cores[j] = 5000;
+    analyzer_balance(cores, NULL, 0, TEST_ANALYZER_CPUS, 1.0, streaks, &b);
+    assert(b.min_bp == 5000 && b.max_bp == 5000 && b.stddev_bp == 0 && b.gini_bp == 0);
+    assert(b.no_saturated == 0 && !b.hot && !b.imbalance && b.no_sockets == 0 && !b.socket_imbalance);
+}
+
+static void test_analyzer_hot_core(void)
+{
+    uint16_t cores[TEST_ANALYZER_CPUS] = {0};
+    uint32_t streaks[TEST_ANALYZER_CPUS] = {0};
+    Balance b;
+    cores[3] = USAGE_FULL_BP;
+    for (uint32_t ms = 1000; ms < ANALYZER_HOT_STREAK_MS; ms += 1000)
+    {
+        analyzer_balance(cores, NULL, 0, TEST_ANALYZER_CPUS, 1.0, streaks, &b);
+        assert(b.imbalance && !b.hot && b.hot_cpu == 3 && b.hot_streak_ms == ms);
+    }
+    analyzer_balance(cores, NULL, 0, TEST_ANALYZER_CPUS, 1.0, streaks, &b);
+    assert(b.hot && b.hot_cpu == 3 && b.hot_streak_ms == ANALYZER_HOT_STREAK_MS);
+    assert(b.gini_bp == 8750);      // (n - 1) / n
+    assert(b.stddev_bp == 3307);    // sqrt(10000^2 / 8 - 1250^2)
+    assert(b.min_bp == 0 && b.max_bp == USAGE_FULL_BP && b.no_saturated == 1);
+
+    // The thread moved - the streak starts over on the new core
+    cores[3] = 0;
+    cores[5] = 9600;
+    analyzer_balance(cores, NULL, 0, TEST_ANALYZER_CPUS, 1.0, streaks, &b);
+    assert(!b.hot && b.hot_cpu == 5 && b.hot_streak_ms == 1000 && streaks[3] == 0);
+}
+
+static void test_analyzer_streak_time(void)
+{
+    uint16_t cores[TEST_ANALYZER_CPUS] = {0};
+    uint32_t streaks[TEST_ANALYZER_CPUS] = {0};
+    Balance b;
+    cores[0] = USAGE_FULL_BP;
+    // Sampled twice as often the core has to stay saturated for twice as many samples
+    for (int s = 1; s < 2 * ANALYZER_HOT_STREAK_MS / 1000; s++)
+    {
+        analyzer_balance(cores, NULL, 0, TEST_ANALYZER_CPUS, 0.5, streaks, &b);
+        assert(!b.hot && b.hot_streak_ms == (uint32_t)s * 500);
+    }
+    analyzer_balance(cores, NULL, 0, TEST_ANALYZER_CPUS, 0.5, streaks, &b);
+    assert(b.hot && b.hot_streak_ms == ANALYZER_HOT_STREAK_MS);
+
+    // Saturated for longer than uint32_t milliseconds stays saturated
+    streaks[0] = UINT32_MAX - 10;
+    analyzer_balance(cores, NULL, 0, TEST_ANALYZER_CPUS, 1.0, streaks, &b);
+    assert(b.hot && b.hot_streak_ms == UINT32_MAX);
+}
+
+static void test_analyzer_busy(void)
+{
+    uint16_t cores[TEST_ANALYZER_CPUS];
+    uint32_t streaks[TEST_ANALYZER_CPUS] = {0};
+    Balance b;
+    for (size_t j = 0; j < TEST_ANALYZER_CPUS; j++)
+        cores[j] = (uint16_t)(9900 - j * 10);
+    for (int s = 0; s < 2 * ANALYZER_HOT_STREAK_MS / 1000; s++)
+        analyzer_balance(cores, NULL, 0, TEST_ANALYZER_CPUS, 1.0, streaks, &b);
+    assert(b.no_saturated == TEST_ANALYZER_CPUS && b.hot_streak_ms == 2 * ANALYZER_HOT_STREAK_MS);
+    assert(!b.hot && !b.imbalance && b.gini_bp < 100);
+}
+
+static void test_analyzer_sockets(void)
+{
+    const uint16_t socket_of[TEST_ANALYZER_CPUS] = {0, 0, 0, 0, 1, 1, 1, 1};
+    uint32_t streaks[TEST_ANALYZER_CPUS] = {0};
+    Balance b;
+    // Socket 0 does everything, evenly across its cores
+    const uint16_t split[TEST_ANALYZER_CPUS] = {9000, 9000, 9000, 9000, 0, 0, 0, 0};
+    analyzer_balance(split, socket_of, 2, TEST_ANALYZER_CPUS, 1.0, streaks, &b);
+    assert(b.no_sockets == 2 && b.socket_imbalance);
+    assert(b.sockets[0].mean_bp == 9000 && b.sockets[0].gini_bp == 0 && !b.sockets[0].imbalance);
+    assert(b.sockets[1].mean_bp == 0 && b.sockets[1].max_bp == 0 && !b.sockets[1].imbalance);
+
+    // Sockets equally busy, one core of socket 0 does its work
+    const uint16_t pinned[TEST_ANALYZER_CPUS] = {9000, 0, 0, 0, 2000, 2500, 2000, 2500};
+    analyzer_balance(pinned, socket_of, 2, TEST_ANALYZER_CPUS, 1.0, streaks, &b);
+    assert(!b.socket_imbalance && b.sockets[0].mean_bp == 2250 && b.sockets[1].mean_bp == 2250);
+    assert(b.sockets[0].imbalance && b.sockets[0].gini_bp == 7500 && b.sockets[0].min_bp == 0);
+    assert(!b.sockets[1].imbalance && b.sockets[1].min_bp == 2000 && b.sockets[1].max_bp == 2500);
+
+    // Sockets above the limit count to the last one, a socket without cores does not count to the spread
+    uint16_t many_of[TEST_ANALYZER_CPUS];
+    for (size_t j = 0; j < TEST_ANALYZER_CPUS; j++)
+        many_of[j] = (uint16_t)(j + 4);
+    analyzer_balance(split, many_of, TEST_ANALYZER_CPUS + 4, TEST_ANALYZER_CPUS, 1.0, streaks, &b);
+    assert(b.no_sockets == ANALYZER_MAX_SOCKETS && b.sockets[0].mean_bp == 0 && b.sockets[3].min_bp == 0);
+    assert(b.sockets[4].mean_bp == 9000 && b.sockets[ANALYZER_MAX_SOCKETS - 1].mean_bp == 1800);
+    assert(b.socket_imbalance);
+}
+
+static void test_analyzer_invalid(void)
+{
+    uint16_t cores[1] = {USAGE_FULL_BP};
+    uint32_t streaks[1] = {0};
+    Balance b;
+    memset(&b, 0xff, sizeof(b));
+    analyzer_balance(NULL, NULL, 0, 1, 1.0, streaks, &b);
+    assert(b.max_bp == 0 && !b.hot);
+    // A single core has nothing to be imbalanced against
+    for (int s = 0; s < ANALYZER_HOT_STREAK_MS / 1000; s++)
+        analyzer_balance(cores, NULL, 0, 1, 1.0, streaks, &b);
+    assert(!b.hot && !b.imbalance && b.gini_bp == 0);
+}
+
+static void test_analyzer_effective(void)
+{
+    assert(analyzer_effective(8000, 1200000, 2400000) == 4000);
+    assert(analyzer_effective(9000, 3000000, 2400000) == USAGE_FULL_BP);   // turbo above cpuinfo_max_freq
+    assert(analyzer_effective(7000, 0, 2400000) == 7000 && analyzer_effective(7000, 1200000, 0) == 7000);
+
+    const uint16_t cores[3] = {USAGE_FULL_BP, 3333, 1};
+    const uint32_t cur_khz[3] = {1000000, 0, 2000000};
+    const uint32_t max_khz[3] = {3000000, 2000000, 2000000};
+    uint16_t effective[3];
+    // 3333 + 3333 + 1 = 6667 over 3 cores rounds to 2222
+    assert(analyzer_effective_cores(cores, cur_khz, max_khz, 3, effective) == 2222);
+    assert(effective[0] == 3333 && effective[1] == 3333 && effective[2] == 1);
+    assert(analyzer_effective_cores(cores, cur_khz, max_khz, 2, effective) == 3333);
+    assert(analyzer_effective_cores(NULL, cur_khz, max_khz, 3, effective) == 0);
+    assert(analyzer_effective_cores(cores, cur_khz, max_khz, 0, effective) == 0);
+}
+
+void test_analyzer_main(void)
+{
+    test_analyzer_rounding();
+    test_analyzer_counters();
+    test_analyzer_steal();
+    test_analyzer_even();
+    test_analyzer_hot_core();
+    test_analyzer_streak_time();
+    test_analyzer_busy();
+    test_analyzer_sockets();
+    test_analyzer_invalid();
+    test_analyzer_effective();
+}
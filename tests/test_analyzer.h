@@ -0,0 +1,7 @@
+
+#ifndef CPU_USAGE_TRACKER_TEST_ANALYZER_H
+#define CPU_USAGE_TRACKER_TEST_ANALYZER_H
+
+void test_analyzer_main(void);
+
+#endif //CPU_USAGE_TRACKER_TEST_ANALYZER_H
@@ -0,0 +1,200 @@
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "../broadcast.h"
+#include "test_broadcast.h"
+
+/*
+ * TESTS:
+ * - Invalid arguments
+ * - Every consumer reads the same slot in place
+ * - Blocking consumer stops the producer a ring ahead
+ * - Skipping consumer reads in order while less than a ring behind, a whole ring behind it jumps to the latest
+ *   element and counts the loss
+ * - Closed ring is drained before consumers see it closed
+ * - Producer and blocking consumer in separate threads - nothing lost, order kept
+ */
+static void test_broadcast_invalid(void);
+static void test_broadcast_zero_copy(void);
+static void test_broadcast_block(void);
+static void test_broadcast_skip(void);
+static void test_broadcast_close(void);
+static void test_broadcast_threads(void);
+
+enum{TEST_BROADCAST_ELEMENTS = 10000};
+
+static void publish_value(Broadcast* const b, const uint64_t value)
+{
+    void* slot;
+    assert(broadcast_claim(b, &slot, 0) == BSUCCESS);
+    *(uint64_t*)slot = value;
+    broadcast_publish(b);
+}
+
+static void test_broadcast_invalid(void)
+{
+    assert(broadcast_create(1, sizeof(uint64_t)) == NULL);
+    assert(broadcast_create(4, 0) == NULL);
+    Broadcast* const b = broadcast_create(4, sizeof(uint64_t));
+    assert(b != NULL);
+    const void* slot;
+    assert(broadcast_wait(b, 0, &slot, 0) == BERROR);   // not registered
+    for (int i = 0; i < BROADCAST_MAX_CONSUMERS; i++)
+        assert(broadcast_add_consumer(b, BROADCAST_SKIP) == i);
+    assert(broadcast_add_consumer(b, BROADCAST_SKIP) == -1);
+    assert(broadcast_wait(b, 0, &slot, 0) == BTIMEOUT);
+    broadcast_delete(b);
+    broadcast_delete(NULL);
+}
+
+static void test_broadcast_zero_copy(void)
+{
+    Broadcast* const b = broadcast_create(4, sizeof(uint64_t));
+    const int first = broadcast_add_consumer(b, BROADCAST_BLOCK);
+    const int second = broadcast_add_consumer(b, BROADCAST_SKIP);
+    void* written;
+    assert(broadcast_claim(b, &written, 0) == BSUCCESS);
+    *(uint64_t*)written = 42;
+    broadcast_publish(b);
+
+    const void* read_first;
+    const void* read_second;
+    assert(broadcast_wait(b, first, &read_first, 0) == BSUCCESS);
+    assert(broadcast_wait(b, second, &read_second, 0) == BSUCCESS);
+    assert(read_first == written && read_second == written);
+    assert(*(const uint64_t*)read_first == 42);
+    broadcast_release(b, first);
+    broadcast_release(b, second);
+    broadcast_delete(b);
+}
+
+static void test_broadcast_block(void)
+{
+    Broadcast* const b = broadcast_create(4, sizeof(uint64_t));
+    const int c = broadcast_add_consumer(b, BROADCAST_BLOCK);
+    for (uint64_t i = 0; i < 4; i++)
+        publish_value(b, i);
+    void* slot;
+    assert(broadcast_claim(b, &slot, 0) == BTIMEOUT);  // would overwrite the unread element 0
+
+    const void* read;
+    assert(broadcast_wait(b, c, &read, 0) == BSUCCESS);
+    assert(*(const uint64_t*)read == 0);
+    broadcast_release(b, c);
+    publish_value(b, 4);
+    for (uint64_t i = 1; i <= 4; i++)
+    {
+        assert(broadcast_wait(b, c, &read, 0) == BSUCCESS);
+        assert(*(const uint64_t*)read == i);
+        broadcast_release(b, c);
+    }
+    assert(broadcast_lost(b, c) == 0);
+    broadcast_delete(b);
+}
+
+static void test_broadcast_skip(void)
+{
+    Broadcast* const b = broadcast_create(4, sizeof(uint64_t));
+    const int c = broadcast_add_consumer(b, BROADCAST_SKIP);
+    for (uint64_t i = 0; i < 10; i++)
+        publish_value(b, i);   // never blocked by a skipping consumer
+
+    const void* read;
+    assert(broadcast_wait(b, c, &read, 0) == BSUCCESS);
+    assert(*(const uint64_t*)read == 9);
+    assert(broadcast_lost(b, c) == 9);
+    // The held slot is protected - the producer can go around the ring once
+    for (uint64_t i = 10; i < 13; i++)
+        publish_value(b, i);
+    void* slot;
+    assert(broadcast_claim(b, &slot, 0) == BTIMEOUT);
+    assert(*(const uint64_t*)read == 9);
+    broadcast_release(b, c);
+    publish_value(b, 13);
+
+    // Less than a ring behind - nothing is skipped
+    for (uint64_t i = 10; i < 14; i++)
+    {
+        assert(broadcast_wait(b, c, &read, 0) == BSUCCESS);
+        assert(*(const uint64_t*)read == i);
+        broadcast_release(b, c);
+    }
+    assert(broadcast_lost(b, c) == 9);
+    publish_value(b, 14);
+    publish_value(b, 15);
+    assert(broadcast_wait(b, c, &read, 0) == BSUCCESS);
+    assert(*(const uint64_t*)read == 14);
+    broadcast_release(b, c);
+    assert(broadcast_wait(b, c, &read, 0) == BSUCCESS);
+    assert(*(const uint64_t*)read == 15);
+    broadcast_release(b, c);
+    assert(broadcast_lost(b, c) == 9);
+    assert(broadcast_wait(b, c, &read, 0) == BTIMEOUT);
+    broadcast_delete(b);
+}
+
+static void test_broadcast_close(void)
+{
+    Broadcast* const b = broadcast_create(4, sizeof(uint64_t));
+    const int c = broadcast_add_consumer(b, BROADCAST_BLOCK);
+    publish_value(b, 7);
+    broadcast_close(b);
+    void* slot;
+    assert(broadcast_claim(b, &slot, 0) == BCLOSED);
+    const void* read;
+    assert(broadcast_wait(b, c, &read, 0) == BSUCCESS);
+    assert(*(const uint64_t*)read == 7);
+    broadcast_release(b, c);
+    assert(broadcast_wait(b, c, &read, 0) == BCLOSED);
+    broadcast_delete(b);
+}
+
+static void* test_broadcast_producer(void* args)
+{
+    Broadcast* const b = args;
+    for (uint64_t i = 0; i < TEST_BROADCAST_ELEMENTS; i++)
+    {
+        void* slot;
+        assert(broadcast_claim(b, &slot, 2) == BSUCCESS);
+        *(uint64_t*)slot = i;
+        broadcast_publish(b);
+    }
+    broadcast_close(b);
+    return NULL;
+}
+
+static void test_broadcast_threads(void)
+{
+    Broadcast* const b = broadcast_create(8, sizeof(uint64_t));
+    const int block = broadcast_add_consumer(b, BROADCAST_BLOCK);
+    const int skip = broadcast_add_consumer(b, BROADCAST_SKIP);
+    pthread_t producer;
+    assert(pthread_create(&producer, NULL, test_broadcast_producer, b) == 0);
+
+    uint64_t expected = 0;
+    const void* read;
+    while(broadcast_wait(b, block, &read, 2) == BSUCCESS)
+    {
+        assert(*(const uint64_t*)read == expected);
+        expected++;
+        broadcast_release(b, block);
+        // Skipping consumer reads now and then - it must never see an element going backwards
+        if(expected % 16 == 0 && broadcast_wait(b, skip, &read, 0) == BSUCCESS)
+            broadcast_release(b, skip);
+    }
+    assert(expected == TEST_BROADCAST_ELEMENTS);
+    assert(pthread_join(producer, NULL) == 0);
+    broadcast_delete(b);
+}
+
+void test_broadcast_main(void)
+{
+    test_broadcast_invalid();
+    test_broadcast_zero_copy();
+    test_broadcast_block();
+    test_broadcast_skip();
+    test_broadcast_close();
+    test_broadcast_threads();
+}
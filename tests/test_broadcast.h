@@ -0,0 +1,7 @@
+
+#ifndef CPU_USAGE_TRACKER_TEST_BROADCAST_H
+#define CPU_USAGE_TRACKER_TEST_BROADCAST_H
+
+void test_broadcast_main(void);
+
+#endif //CPU_USAGE_TRACKER_TEST_BROADCAST_H
@@ -0,0 +1,152 @@
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "../cgroup.h"
+#include "test_cgroup.h"
+
+/*
+ * TESTS:
+ * - Invalid arguments, missing hierarchy
+ * - Fixture hierarchy - cpu.stat deltas, cpu.max quota and "max", cpuset.cpus.effective lists, the hottest relative
+ *   to their limit first, a cgroup without cpu.stat takes the usage of its children, throttling summed bottom-up,
+ *   long paths shortened from the left
+ * - Cgroups created and removed between ticks are seen through inotify
+ */
+static void test_cgroup_invalid(void);
+static void test_cgroup_fixture(void);
+
+#define TEST_CGROUP_LONG "service-with-a-really-long-name-that-does-not-fit.scope"
+
+// Directories of the fixture, parents first
+static const char* const g_cgroup_dirs[] = {"a", "a/x", "b", "b/" TEST_CGROUP_LONG};
+static const char* const g_cgroup_files[] = {
+    "cpu.stat", "a/cpu.stat", "a/cpu.max", "a/cpuset.cpus.effective", "a/x/cpu.stat", "a/x/cpu.max",
+    "a/x/cpuset.cpus.effective", "b/cpuset.cpus.effective", "b/" TEST_CGROUP_LONG "/cpu.stat",
+    "b/" TEST_CGROUP_LONG "/cpuset.cpus.effective"
+};
+
+static void test_cgroup_write(const char* const root, const char* const file, const char* const content)
+{
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s", root, file);
+    // Rewritten in place - the cached cpu.stat fd reads the new content
+    FILE* const f = fopen(path, "w");
+    assert(f != NULL);
+    fputs(content, f);
+    fclose(f);
+}
+
+static void test_cgroup_stat(const char* const root, const char* const dir, const unsigned long usage,
+                             const unsigned long throttled)
+{
+    char file[128], content[256];
+    snprintf(file, sizeof(file), "%s%scpu.stat", dir, dir[0] != '\0' ? "/" : "");
+    snprintf(content, sizeof(content), "usage_usec %lu\nuser_usec %lu\nsystem_usec 0\nnr_periods 10\n"
+                                       "nr_throttled 1\nthrottled_usec %lu\n", usage, usage, throttled);
+    test_cgroup_write(root, file, content);
+}
+
+static void test_cgroup_invalid(void)
+{
+    Collector c;
+    assert(cgroup_create(0) == NULL);
+    CgroupTracker* const ct = cgroup_create(2);
+    assert(ct != NULL);
+    assert(!cgroup_collector_init(&c, NULL, "/tmp"));
+    assert(!cgroup_collector_init(&c, ct, "/tmp/cut_test_cgroup_missing"));
+    CgroupTopEntry top[2];
+    assert(cgroup_get_top(ct, top, 2, NULL) == 0 && cgroup_get_top(NULL, top, 2, NULL) == 0);
+    cgroup_delete(ct);
+    cgroup_delete(NULL);
+}
+
+static void test_cgroup_fixture(void)
+{
+    char root[] = "/tmp/cut_test_cgroup_XXXXXX";
+    char path[256];
+    assert(mkdtemp(root) != NULL);
+    for (size_t i = 0; i < sizeof(g_cgroup_dirs)/sizeof(g_cgroup_dirs[0]); i++)
+    {
+        snprintf(path, sizeof(path), "%s/%s", root, g_cgroup_dirs[i]);
+        assert(mkdir(path, 0755) == 0);
+    }
+    // a - half a cpu of quota within 2 cpus, a/x - no quota on 5 cpus, b - no cpu.stat, 2 cpus, its child 1 cpu
+    test_cgroup_write(root, "a/cpu.max", "50000 100000\n");
+    test_cgroup_write(root, "a/cpuset.cpus.effective", "0-1\n");
+    test_cgroup_write(root, "a/x/cpu.max", "max 100000\n");
+    test_cgroup_write(root, "a/x/cpuset.cpus.effective", "0-3,8\n");
+    test_cgroup_write(root, "b/cpuset.cpus.effective", "2,3\n");
+    test_cgroup_write(root, "b/" TEST_CGROUP_LONG "/cpuset.cpus.effective", "5\n");
+    test_cgroup_stat(root, "", 0, 0);
+    test_cgroup_stat(root, "a", 0, 0);
+    test_cgroup_stat(root, "a/x", 0, 0);
+    test_cgroup_stat(root, "b/" TEST_CGROUP_LONG, 0, 0);
+
+    Collector c;
+    CgroupTracker* const ct = cgroup_create(4);
+    assert(ct != NULL);
+    assert(cgroup_collector_init(&c, ct, root));
+    assert(c.collect(&c));
+    CgroupTopEntry top[5];
+    size_t no_cgroups = 0;
+    assert(cgroup_get_top(ct, top, 5, &no_cgroups) == 0 && no_cgroups == 5);   // nothing to compare with yet
+
+    // Usage relative to the limit: a/x 20000/5, the long one 3000/1, a 1000/0.5, b 3000/2
+    test_cgroup_stat(root, "", 30000, 0);
+    test_cgroup_stat(root, "a", 1000, 1000);
+    test_cgroup_stat(root, "a/x", 20000, 2000);
+    test_cgroup_stat(root, "b/" TEST_CGROUP_LONG, 3000, 0);
+    usleep(20000);
+    assert(c.collect(&c));
+    assert(cgroup_get_top(ct, top, 5, &no_cgroups) == 4 && no_cgroups == 5);
+    assert(strcmp(top[0].path, "a/x") == 0 && top[0].limit_cpus == 5);
+    assert(strlen(top[1].path) == CGROUP_PATH_LEN - 1 && strncmp(top[1].path, "...", 3) == 0);
+    assert(strcmp(top[1].path + CGROUP_PATH_LEN - 6, "scope") == 0 && top[1].limit_cpus == 1);
+    assert(strcmp(top[2].path, "a") == 0 && top[2].limit_cpus == 0.5);
+    assert(strcmp(top[3].path, "b") == 0 && top[3].limit_cpus == 2);
+    assert(top[0].usage_cpus > 0 && fabs(top[0].usage_cpus / top[2].usage_cpus - 20.0) < 1e-9);
+    assert(fabs(top[0].usage_limit_pr / top[1].usage_limit_pr - 4.0 / 3.0) < 1e-9);
+    assert(top[3].usage_cpus == top[1].usage_cpus);
+    assert(fabs(top[2].throttled_ms / top[0].throttled_ms - 0.5) < 1e-9);
+    assert(fabs(top[2].subtree_throttled_ms - top[2].throttled_ms - top[0].subtree_throttled_ms) < 1e-9);
+    assert(top[0].subtree_throttled_ms == top[0].throttled_ms && top[3].subtree_throttled_ms == 0);
+    assert(cgroup_get_top(ct, top, 2, NULL) == 2 && strcmp(top[0].path, "a/x") == 0);
+
+    // New cgroup, then removed again
+    snprintf(path, sizeof(path), "%s/c", root);
+    assert(mkdir(path, 0755) == 0);
+    test_cgroup_stat(root, "c", 0, 0);
+    assert(c.collect(&c));
+    assert(cgroup_get_top(ct, top, 5, &no_cgroups) == 0 && no_cgroups == 6);
+    snprintf(path, sizeof(path), "%s/c/cpu.stat", root);
+    assert(unlink(path) == 0);
+    snprintf(path, sizeof(path), "%s/c", root);
+    assert(rmdir(path) == 0);
+    assert(c.collect(&c));
+    assert(cgroup_get_top(ct, top, 5, &no_cgroups) == 0 && no_cgroups == 5);
+
+    collector_close(&c);
+    cgroup_delete(ct);
+    for (size_t i = 0; i < sizeof(g_cgroup_files)/sizeof(g_cgroup_files[0]); i++)
+    {
+        snprintf(path, sizeof(path), "%s/%s", root, g_cgroup_files[i]);
+        assert(unlink(path) == 0);
+    }
+    for (size_t i = sizeof(g_cgroup_dirs)/sizeof(g_cgroup_dirs[0]); i > 0; i--)
+    {
+        snprintf(path, sizeof(path), "%s/%s", root, g_cgroup_dirs[i - 1]);
+        assert(rmdir(path) == 0);
+    }
+    assert(rmdir(root) == 0);
+}
+
+void test_cgroup_main(void)
+{
+    test_cgroup_invalid();
+    test_cgroup_fixture();
+}
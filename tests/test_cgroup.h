@@ -0,0 +1,7 @@
+
+#ifndef CPU_USAGE_TRACKER_TEST_CGROUP_H
+#define CPU_USAGE_TRACKER_TEST_CGROUP_H
+
+void test_cgroup_main(void);
+
+#endif //CPU_USAGE_TRACKER_TEST_CGROUP_H
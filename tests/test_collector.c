@@ -0,0 +1,66 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../collector.h"
+#include "test_collector.h"
+
+/*
+ * TESTS:
+ * - File several times bigger than the initial buffer is read whole
+ * - seq_file bigger than a page - returns a page per read, the short reads go on until the end
+ * - Emptied file
+ */
+static void test_collector_read_file(void);
+static void test_collector_read_seq_file(void);
+
+static bool test_collector_parse(Collector* const c)
+{
+    (void) c;
+    return true;
+}
+
+static void test_collector_read_file(void)
+{
+    char path[] = "/tmp/cut_test_collector_XXXXXX";
+    const int fd = mkstemp(path);
+    assert(fd >= 0);
+    Collector c = {.name = "file", .path = path, .interval_ms = 1000, .parse = test_collector_parse};
+    assert(collector_open(&c));
+
+    const size_t len = 3 * c.buff_size + 17;
+    char* const content = malloc(len);
+    for (size_t i = 0; i < len; i++)
+        content[i] = (char)('a' + i % 26);
+    assert(pwrite(fd, content, len, 0) == (ssize_t)len);
+    assert(collector_read(&c));
+    assert(c.len == len && memcmp(c.buffer, content, len) == 0 && c.buffer[len] == '\0');
+
+    assert(ftruncate(fd, 0) == 0);
+    assert(collector_read(&c));
+    assert(c.len == 0 && c.buffer[0] == '\0');
+
+    collector_close(&c);
+    free(content);
+    close(fd);
+    unlink(path);
+}
+
+static void test_collector_read_seq_file(void)
+{
+    // A mapping takes over 1 KB of smaps - every process has enough of them for several pages
+    Collector c = {.name = "smaps", .path = "/proc/self/smaps", .interval_ms = 1000, .parse = test_collector_parse};
+    if(!collector_open(&c))
+        return;     // no procfs
+    assert(collector_read(&c));
+    assert(c.len > 2 * 4096 && strlen(c.buffer) == c.len && c.buffer[c.len - 1] == '\n');
+    collector_close(&c);
+}
+
+void test_collector_main(void)
+{
+    test_collector_read_file();
+    test_collector_read_seq_file();
+}
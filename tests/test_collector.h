@@ -0,0 +1,7 @@
+
+#ifndef CPU_USAGE_TRACKER_TEST_COLLECTOR_H
+#define CPU_USAGE_TRACKER_TEST_COLLECTOR_H
+
+void test_collector_main(void);
+
+#endif //CPU_USAGE_TRACKER_TEST_COLLECTOR_H
@@ -0,0 +1,209 @@
+#include <assert.h>
+#include <math.h>
+
+#include "../corestats.h"
+#include "test_corestats.h"
+
+/*
+ * TESTS:
+ * - Create / delete
+ * - Mean and stddev over the sliding window
+ * - Old samples leave the window
+ * - Window spans the same time when the interval changes, a settled series leaves it too
+ * - Percentiles and merged histograms
+ * - Averaged history of a group of series
+ * - Sparse pushes give the same statistics as dense ones, moving averages match the per-sample recurrence
+ */
+static void test_corestats_create(void);
+static void test_corestats_mean_stddev(void);
+static void test_corestats_window(void);
+static void test_corestats_window_time(void);
+static void test_corestats_percentile(void);
+static void test_corestats_history(void);
+static void test_corestats_sparse(void);
+
+enum{TEST_CORESTATS_CORES = 130, TEST_CORESTATS_SAMPLES = 40};
+
+static void test_corestats_create(void)
+{
+    assert(corestats_create(0, 10.0, 1.0) == NULL);
+    assert(corestats_create(3, 0, 1.0) == NULL);
+
+    CoreStats* cs = corestats_create(3, 10.0, 1.0);
+    assert(cs != NULL);
+    assert(corestats_mean(cs, 0) == 0);
+    assert(corestats_percentile(cs, 0, 50) == 0);
+    corestats_delete(cs);
+    corestats_delete(NULL);
+}
+
+static void test_corestats_mean_stddev(void)
+{
+    CoreStats* cs = corestats_create(2, 10.0, 1.0);
+    uint16_t core = 1000;
+    corestats_push(cs, 2000, &core, 1.0);
+    core = 3000;
+    corestats_push(cs, 4000, &core, 1.0);
+
+    assert(fabs(corestats_mean(cs, 0) - 30) < 1e-9);
+    assert(fabs(corestats_mean(cs, 1) - 20) < 1e-9);
+    assert(fabs(corestats_stddev(cs, 1) - 10) < 1e-9);
+    // First sample initializes the average, second moves it only a bit
+    assert(corestats_ewma(cs, 1, 0) > 10 && corestats_ewma(cs, 1, 0) < 30);
+    assert(corestats_ewma(cs, 1, 2) < corestats_ewma(cs, 1, 0));
+    corestats_delete(cs);
+}
+
+static void test_corestats_window(void)
+{
+    CoreStats* cs = corestats_create(2, 2.0, 1.0);
+    uint16_t core = 10000;
+    corestats_push(cs, 10000, &core, 1.0);
+    core = 0;
+    corestats_push(cs, 0, &core, 1.0);
+    corestats_push(cs, 0, &core, 1.0);
+
+    assert(corestats_mean(cs, 1) == 0);
+    assert(corestats_stddev(cs, 1) == 0);
+    assert(corestats_percentile(cs, 1, 99) == 0);
+    corestats_delete(cs);
+}
+
+static void test_corestats_window_time(void)
+{
+    CoreStats* cs = corestats_create(3, 10.0, 0.5);
+    uint16_t cores[2] = {10000, 5000};
+    for (size_t i = 0; i < 20; i++)
+        corestats_push(cs, 0, cores, 0.5);
+    assert(cs->filled == 20);
+    // Core 0 settled at 100%, longer interval keeps 10 seconds - 5 new samples and the 10 newest old ones
+    cores[1] = 0;
+    for (size_t i = 0; i < 5; i++)
+        corestats_push(cs, 0, cores, 1.0);
+    assert(cs->filled == 15);
+    assert(corestats_mean(cs, 1) == 100);
+    assert(fabs(corestats_mean(cs, 2) - 50.0 * 10 / 15) < 1e-9);
+    assert(corestats_percentile(cs, 2, 50) == 50);
+    uint32_t merged[CORESTATS_NO_BUCKETS] = {0};
+    corestats_hist_merge(merged, cs, 1);
+    assert(merged[100] == 15);
+
+    // Settled series changes - its window holds the old value for the samples before the change
+    cores[0] = 0;
+    for (size_t i = 0; i < 3; i++)
+        corestats_push(cs, 0, cores, 2.0);
+    // Samples up to 11 s leave - 4 samples of 1 s and 3 of 2 s stay
+    assert(cs->filled == 7);
+    assert(fabs(corestats_mean(cs, 1) - 100.0 * 4 / 7) < 1e-9);
+    assert(corestats_mean(cs, 2) == 0);
+    // Interval back at its minimum - the window holds 20 samples again
+    for (size_t i = 0; i < 40; i++)
+        corestats_push(cs, 0, cores, 0.5);
+    assert(cs->filled == 20);
+    assert(corestats_mean(cs, 1) == 0 && corestats_stddev(cs, 1) == 0);
+    corestats_delete(cs);
+}
+
+static void test_corestats_percentile(void)
+{
+    CoreStats* cs = corestats_create(2, 100.0, 1.0);
+    for (size_t i = 1; i <= 100; i++)
+    {
+        uint16_t core = (uint16_t)(i * 100);
+        corestats_push(cs, 0, &core, 1.0);
+    }
+    assert(corestats_percentile(cs, 1, 50) == 50);
+    assert(corestats_percentile(cs, 1, 95) == 95);
+    assert(corestats_percentile(cs, 1, 100) == 100);
+
+    uint32_t merged[CORESTATS_NO_BUCKETS] = {0};
+    corestats_hist_merge(merged, cs, 0);
+    corestats_hist_merge(merged, cs, 1);
+    // 100 zeros from total and 1..100 from the core
+    assert(corestats_hist_percentile(merged, 50) == 0);
+    assert(corestats_hist_percentile(merged, 75) == 50);
+    corestats_delete(cs);
+}
+
+static void test_corestats_history(void)
+{
+    CoreStats* cs = corestats_create(3, 4.0, 1.0);
+    const size_t entries[2] = {1, 2};
+    uint16_t out[8];
+    assert(corestats_history_mean(cs, entries, 2, out, 8) == 0);
+    for (uint16_t i = 1; i <= 6; i++)
+    {
+        const uint16_t cores[2] = {(uint16_t)(i * 1000), (uint16_t)(i * 3000 > 10000 ? 10000 : i * 3000)};
+        corestats_push(cs, 0, cores, 1.0);
+    }
+    // Window keeps samples 3 - 6, oldest first
+    assert(corestats_history_mean(cs, entries, 2, out, 8) == 4);
+    assert(out[0] == (3000 + 9000) / 2 && out[3] == (6000 + 10000) / 2);
+    assert(corestats_history_mean(cs, entries, 1, out, 2) == 2);
+    assert(out[0] == 5000 && out[1] == 6000);
+    corestats_delete(cs);
+}
+
+static void test_corestats_sparse(void)
+{
+    CoreStats* const dense = corestats_create(TEST_CORESTATS_CORES + 1, 8.0, 0.5);
+    CoreStats* const sparse = corestats_create(TEST_CORESTATS_CORES + 1, 8.0, 0.5);
+    uint16_t cores[TEST_CORESTATS_CORES] = {0};
+    double reference[TEST_CORESTATS_CORES];
+    for (size_t i = 0; i < TEST_CORESTATS_SAMPLES; i++)
+    {
+        uint64_t changed[(TEST_CORESTATS_CORES + 63) / 64] = {0};
+        uint16_t values[TEST_CORESTATS_CORES];
+        size_t no_changed = 0;
+        const double interval_s = i % 3 == 0 ? 0.5 : 1.0;
+        for (size_t j = 0; j < TEST_CORESTATS_CORES; j++)
+        {
+            // Every 7th core busy, the others change only in the first samples
+            const uint16_t value = j % 7 == 0 ? (uint16_t)((i * 37 + j * 11) % 10001) :
+                                   (i < 3 ? (uint16_t)(j * 50 + i) : cores[j]);
+            if(value != cores[j] || i == 0)
+            {
+                changed[j / 64] |= (uint64_t)1 << (j % 64);
+                values[no_changed++] = value;
+            }
+            cores[j] = value;
+            const double x = (double)value / 100;
+            reference[j] = i == 0 ? x : reference[j] + (1.0 - exp(-interval_s / 60.0)) * (x - reference[j]);
+        }
+        corestats_push(dense, 5000, cores, interval_s);
+        corestats_push_delta(sparse, 5000, changed, values, interval_s);
+    }
+    const size_t entries[3] = {1, 8, 100};
+    uint16_t dense_history[8], sparse_history[8];
+    assert(corestats_history_mean(dense, entries, 3, dense_history, 8) == 8);
+    assert(corestats_history_mean(sparse, entries, 3, sparse_history, 8) == 8);
+    for (size_t i = 0; i < 8; i++)
+        assert(dense_history[i] == sparse_history[i]);
+    for (size_t e = 0; e <= TEST_CORESTATS_CORES; e++)
+    {
+        assert(corestats_mean(dense, e) == corestats_mean(sparse, e));
+        assert(corestats_stddev(dense, e) == corestats_stddev(sparse, e));
+        assert(corestats_percentile(dense, e, 90) == corestats_percentile(sparse, e, 90));
+        for (size_t k = 0; k < CORESTATS_NO_EWMA; k++)
+            assert(fabs(corestats_ewma(dense, e, k) - corestats_ewma(sparse, e, k)) < 1e-9);
+        if(e != 0)
+            assert(fabs(corestats_ewma(sparse, e, 0) - reference[e - 1]) < 1e-9);
+    }
+    // Idle cores settled - their windows are not touched anymore
+    assert((sparse->unsettled[0] & 0x4) == 0);     // core 1
+    assert((sparse->unsettled[0] & 0x1) == 0);      // total is constant too
+    assert(sparse->unsettled[0] & ((uint64_t)1 << 1 << 7));   // core 7 is busy
+    corestats_delete(dense);
+    corestats_delete(sparse);
+}
+
+void test_corestats_main(void)
+{
+    test_corestats_create();
+    test_corestats_mean_stddev();
+    test_corestats_window();
+    test_corestats_window_time();
+    test_corestats_percentile();
+    test_corestats_history();
+    test_corestats_sparse();
+}
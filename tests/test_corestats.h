@@ -0,0 +1,7 @@
+
+#ifndef CPU_USAGE_TRACKER_TEST_CORESTATS_H
+#define CPU_USAGE_TRACKER_TEST_CORESTATS_H
+
+void test_corestats_main(void);
+
+#endif //CPU_USAGE_TRACKER_TEST_CORESTATS_H
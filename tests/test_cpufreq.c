@@ -0,0 +1,126 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "../cpufreq.h"
+#include "../analyzer.h"
+#include "test_cpufreq.h"
+
+/*
+ * TESTS:
+ * - Missing sysfs tree
+ * - Fixture tree - idle state names of cpu0, frequencies, a cpu without cpufreq, collector follows the interval
+ * - Residency - unchanged counter, counter beyond the interval, counter going backwards, unparsable file
+ * - Effective usage of the cores from the frequencies read
+ */
+static void test_cpufreq_missing(void);
+static void test_cpufreq_fixture(void);
+
+// Directories of the fixture, parents first
+static const char* const g_cpufreq_dirs[] = {
+    "cpu0", "cpu0/cpufreq", "cpu0/cpuidle", "cpu0/cpuidle/state0", "cpu0/cpuidle/state1",
+    "cpu1", "cpu1/cpuidle", "cpu1/cpuidle/state0", "cpu1/cpuidle/state1"
+};
+static const char* const g_cpufreq_files[] = {
+    "cpu0/cpufreq/scaling_cur_freq", "cpu0/cpufreq/cpuinfo_max_freq",
+    "cpu0/cpuidle/state0/name", "cpu0/cpuidle/state0/time", "cpu0/cpuidle/state1/name", "cpu0/cpuidle/state1/time",
+    "cpu1/cpuidle/state0/time", "cpu1/cpuidle/state1/time"
+};
+
+static void test_cpufreq_write(const char* const root, const char* const file, const char* const content)
+{
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s", root, file);
+    FILE* const f = fopen(path, "w");
+    assert(f != NULL);
+    fputs(content, f);
+    fclose(f);
+}
+
+static void test_cpufreq_missing(void)
+{
+    Collector c;
+    CpuFreq* const cf = cpufreq_create(2);
+    assert(cf != NULL && cpufreq_create(0) == NULL);
+    assert(!cpufreq_collector_init(&c, cf, "/tmp/cut_test_cpufreq_missing", 1000));
+    assert(!cpufreq_collector_init(&c, NULL, CPUFREQ_SYSFS_ROOT, 1000));
+    CpuFreqCore core;
+    uint32_t khz[4];
+    assert(!cpufreq_get_core(cf, 0, &core) && !cpufreq_get_khz(cf, khz, khz + 2));
+    cpufreq_delete(cf);
+    cpufreq_delete(NULL);
+}
+
+static void test_cpufreq_fixture(void)
+{
+    char root[] = "/tmp/cut_test_cpufreq_XXXXXX";
+    char path[256];
+    assert(mkdtemp(root) != NULL);
+    for (size_t i = 0; i < sizeof(g_cpufreq_dirs)/sizeof(g_cpufreq_dirs[0]); i++)
+    {
+        snprintf(path, sizeof(path), "%s/%s", root, g_cpufreq_dirs[i]);
+        assert(mkdir(path, 0755) == 0);
+    }
+    test_cpufreq_write(root, "cpu0/cpufreq/scaling_cur_freq", "1200000\n");
+    test_cpufreq_write(root, "cpu0/cpufreq/cpuinfo_max_freq", "2400000\n");
+    test_cpufreq_write(root, "cpu0/cpuidle/state0/name", "POLL\n");
+    test_cpufreq_write(root, "cpu0/cpuidle/state0/time", "100\n");
+    test_cpufreq_write(root, "cpu0/cpuidle/state1/name", "C6\n");
+    test_cpufreq_write(root, "cpu0/cpuidle/state1/time", "5000\n");
+    test_cpufreq_write(root, "cpu1/cpuidle/state0/time", "7\n");
+    test_cpufreq_write(root, "cpu1/cpuidle/state1/time", "1000\n");
+
+    Collector c;
+    CpuFreq* const cf = cpufreq_create(2);
+    assert(cpufreq_collector_init(&c, cf, root, 250));
+    assert(c.interval_ms == 250);
+    assert(cpufreq_no_states(cf) == 2);
+    assert(strcmp(cpufreq_state_name(cf, 0), "POLL") == 0 && strcmp(cpufreq_state_name(cf, 1), "C6") == 0);
+    assert(strcmp(cpufreq_state_name(cf, 2), "") == 0);
+
+    // 100 s in C6 is more than the interval, cpu1 counters went backwards or are unreadable
+    test_cpufreq_write(root, "cpu0/cpufreq/scaling_cur_freq", "1800000\n");
+    test_cpufreq_write(root, "cpu0/cpuidle/state1/time", "100005000\n");
+    test_cpufreq_write(root, "cpu1/cpuidle/state0/time", "3\n");
+    test_cpufreq_write(root, "cpu1/cpuidle/state1/time", "x\n");
+    assert(c.collect(&c));
+    CpuFreqCore core;
+    assert(cpufreq_get_core(cf, 0, &core));
+    assert(core.cur_khz == 1800000 && core.max_khz == 2400000);
+    assert(core.residency_bp[0] == 0 && core.residency_bp[1] == USAGE_FULL_BP);
+    assert(cpufreq_get_core(cf, 1, &core));
+    assert(core.cur_khz == 0 && core.max_khz == 0 && core.residency_bp[0] == 0 && core.residency_bp[1] == 0);
+    assert(!cpufreq_get_core(cf, 2, &core));
+
+    // cpu0 runs at 3/4 of its capacity, cpu1 has no frequency - its usage stands
+    uint32_t khz[4];
+    assert(cpufreq_get_khz(cf, khz, khz + 2));
+    assert(khz[0] == 1800000 && khz[1] == 0 && khz[2] == 2400000 && khz[3] == 0);
+    const uint16_t cores[2] = {8000, 6001};
+    uint16_t effective[2];
+    assert(analyzer_effective_cores(cores, khz, khz + 2, 2, effective) == 6001);
+    assert(effective[0] == 6000 && effective[1] == 6001);
+
+    collector_close(&c);
+    cpufreq_delete(cf);
+    for (size_t i = 0; i < sizeof(g_cpufreq_files)/sizeof(g_cpufreq_files[0]); i++)
+    {
+        snprintf(path, sizeof(path), "%s/%s", root, g_cpufreq_files[i]);
+        assert(unlink(path) == 0);
+    }
+    for (size_t i = sizeof(g_cpufreq_dirs)/sizeof(g_cpufreq_dirs[0]); i > 0; i--)
+    {
+        snprintf(path, sizeof(path), "%s/%s", root, g_cpufreq_dirs[i - 1]);
+        assert(rmdir(path) == 0);
+    }
+    assert(rmdir(root) == 0);
+}
+
+void test_cpufreq_main(void)
+{
+    test_cpufreq_missing();
+    test_cpufreq_fixture();
+}
@@ -0,0 +1,7 @@
+
+#ifndef CPU_USAGE_TRACKER_TEST_CPUFREQ_H
+#define CPU_USAGE_TRACKER_TEST_CPUFREQ_H
+
+void test_cpufreq_main(void);
+
+#endif //CPU_USAGE_TRACKER_TEST_CPUFREQ_H
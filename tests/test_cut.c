@@ -0,0 +1,82 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../cut.h"
+#include "../reader.h"
+#include "test_cut.h"
+
+/*
+ * TESTS:
+ * - Invalid arguments
+ * - Samples with caller buffers
+ * - Independent contexts
+ */
+static void test_cut_invalid(void);
+static void test_cut_sample(void);
+static void test_cut_contexts(void);
+
+static void test_cut_invalid(void)
+{
+    CutSample s = {0};
+    assert(cut_sample(NULL, &s) == CUT_ERROR);
+    assert(cut_no_cpus(NULL) == 0);
+    assert(cut_event_fd(NULL) == -1);
+    cut_close(NULL);
+
+    CutContext* ctx = cut_open();
+    assert(ctx != NULL);
+    assert(cut_sample(ctx, NULL) == CUT_ERROR);
+    assert(cut_sample(ctx, &s) == CUT_ERROR);     // no cores buffer
+    cut_close(ctx);
+}
+
+static void test_cut_sample(void)
+{
+    CutContext* ctx = cut_open();
+    const size_t no_cpus = cut_no_cpus(ctx);
+    assert(no_cpus == reader_get_no_cpus());
+
+    uint16_t* cores = malloc(sizeof(uint16_t) * no_cpus);
+    double* steal = malloc(sizeof(double) * (no_cpus + 1));
+    CutSample s = {.usage.cores_bp = cores, .steal_pr = steal};
+    const struct timespec pause = {0, 20000000};
+    for (int i = 0; i < 3; i++)
+    {
+        nanosleep(&pause, NULL);
+        assert(cut_sample(ctx, &s) == CUT_SUCCESS);
+        assert(s.interval_s > 0.01 && s.interval_s < 1.0);
+        assert(s.usage.total_bp <= USAGE_FULL_BP);
+        for (size_t j = 0; j < no_cpus; j++)
+            assert(cores[j] <= USAGE_FULL_BP);
+        for (size_t j = 0; j <= no_cpus; j++)
+            assert(steal[j] >= 0 && steal[j] <= 100);
+    }
+    // Steal buffer is optional
+    s.steal_pr = NULL;
+    assert(cut_sample(ctx, &s) == CUT_SUCCESS);
+    free(cores);
+    free(steal);
+    cut_close(ctx);
+}
+
+static void test_cut_contexts(void)
+{
+    CutContext* a = cut_open();
+    CutContext* b = cut_open();
+    assert(a != NULL && b != NULL && a != b);
+    cut_close(a);
+
+    uint16_t* cores = malloc(sizeof(uint16_t) * cut_no_cpus(b));
+    CutSample s = {.usage.cores_bp = cores};
+    assert(cut_sample(b, &s) == CUT_SUCCESS);
+    free(cores);
+    cut_close(b);
+}
+
+void test_cut_main(void)
+{
+    test_cut_invalid();
+    test_cut_sample();
+    test_cut_contexts();
+}
@@ -0,0 +1,7 @@
+
+#ifndef CPU_USAGE_TRACKER_TEST_CUT_H
+#define CPU_USAGE_TRACKER_TEST_CUT_H
+
+void test_cut_main(void);
+
+#endif //CPU_USAGE_TRACKER_TEST_CUT_H
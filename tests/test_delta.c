@@ -0,0 +1,197 @@
+#include <assert.h>
+#include <string.h>
+
+#include "../delta.h"
+#include "../broadcast.h"
+#include "test_delta.h"
+
+/*
+ * TESTS:
+ * - First encode sends every core, then only cores that moved beyond the threshold
+ * - Small moves do not drift - a core is sent once it is beyond the threshold from what receivers have
+ * - Receiver state follows the sender's shadow, keyframe sends every core
+ * - Copies get only the cores changed since they were brought up to date
+ * - Skipping ring consumer that missed updates ends with the exact state - the slot it jumps to carries them
+ */
+static void test_delta_encode(void);
+static void test_delta_drift(void);
+static void test_delta_copies(void);
+static void test_delta_log(void);
+
+enum{TEST_DELTA_CORES = 200};
+
+static void test_delta_encode(void)
+{
+    uint16_t cores[TEST_DELTA_CORES], shadow[TEST_DELTA_CORES], state[TEST_DELTA_CORES] = {0};
+    uint64_t changed[DELTA_WORDS(TEST_DELTA_CORES)];
+    uint16_t values[TEST_DELTA_CORES];
+    for (size_t j = 0; j < TEST_DELTA_CORES; j++)
+    {
+        cores[j] = (uint16_t)(j * 50);
+        shadow[j] = DELTA_UNKNOWN_BP;
+    }
+    assert(delta_encode(cores, shadow, TEST_DELTA_CORES, 10, changed, values) == TEST_DELTA_CORES);
+    assert(changed[0] == UINT64_MAX && changed[3] == 0xff);
+    delta_apply(state, changed, values, TEST_DELTA_CORES);
+    assert(memcmp(state, cores, sizeof(cores)) == 0);
+
+    // Nothing moved
+    assert(delta_encode(cores, shadow, TEST_DELTA_CORES, 10, changed, values) == 0);
+    assert(changed[0] == 0 && changed[1] == 0 && changed[2] == 0 && changed[3] == 0);
+
+    cores[3] += 10;      // within the threshold
+    cores[64] += 11;
+    cores[199] -= 500;
+    assert(delta_encode(cores, shadow, TEST_DELTA_CORES, 10, changed, values) == 2);
+    assert(changed[0] == 0 && changed[1] == 1 && changed[3] == (uint64_t)1 << 7);
+    assert(values[0] == cores[64] && values[1] == cores[199]);
+    delta_apply(state, changed, values, TEST_DELTA_CORES);
+    assert(state[64] == cores[64] && state[199] == cores[199] && state[3] == shadow[3] && shadow[3] == 150);
+    assert(memcmp(state, shadow, sizeof(shadow)) == 0);
+
+    // Threshold 0 sends every change
+    cores[5]++;
+    assert(delta_encode(cores, shadow, TEST_DELTA_CORES, 0, changed, values) == 2);     // cores 3 and 5
+
+    assert(delta_keyframe(shadow, TEST_DELTA_CORES, changed, values) == TEST_DELTA_CORES);
+    assert(changed[0] == UINT64_MAX && changed[3] == 0xff);
+    memset(state, 0, sizeof(state));
+    delta_apply(state, changed, values, TEST_DELTA_CORES);
+    assert(memcmp(state, shadow, sizeof(shadow)) == 0);
+}
+
+static void test_delta_drift(void)
+{
+    uint16_t core = 1000, shadow = DELTA_UNKNOWN_BP;
+    uint64_t changed;
+    uint16_t value;
+    assert(delta_encode(&core, &shadow, 1, 10, &changed, &value) == 1);
+    size_t sent = 0;
+    for (int i = 0; i < 20; i++)
+    {
+        core += 3;
+        sent += delta_encode(&core, &shadow, 1, 10, &changed, &value);
+        assert(core - shadow <= 10);
+    }
+    assert(sent == 5);      // every 4th step of 3 is beyond 10
+}
+
+static void test_delta_copies(void)
+{
+    uint16_t state[TEST_DELTA_CORES], copy_a[TEST_DELTA_CORES], copy_b[TEST_DELTA_CORES];
+    uint64_t changed[DELTA_WORDS(TEST_DELTA_CORES)] = {0};
+    DeltaCopies dc;
+    assert(delta_copies_init(&dc, TEST_DELTA_CORES));
+    for (size_t j = 0; j < TEST_DELTA_CORES; j++)
+        state[j] = (uint16_t)j;
+    memset(copy_a, 0xff, sizeof(copy_a));
+    memset(copy_b, 0xff, sizeof(copy_b));
+    delta_copies_sync(&dc, copy_a, state);      // new copy - written whole
+    assert(memcmp(copy_a, state, sizeof(state)) == 0);
+
+    state[10] = 9999;
+    changed[0] = (uint64_t)1 << 10;
+    delta_copies_mark(&dc, changed);
+    delta_copies_sync(&dc, copy_b, state);
+    assert(memcmp(copy_b, state, sizeof(state)) == 0);
+
+    // Core the copy did not get as changed is not written
+    copy_a[20] = 7;
+    state[130] = 1;
+    changed[0] = 0;
+    changed[2] = (uint64_t)1 << 2;
+    delta_copies_mark(&dc, changed);
+    delta_copies_sync(&dc, copy_a, state);
+    assert(copy_a[10] == 9999 && copy_a[130] == 1 && copy_a[20] == 7);
+    copy_b[10] = 0;
+    delta_copies_sync(&dc, copy_b, state);     // only core 130 was stale
+    assert(copy_b[130] == 1 && copy_b[10] == 0);
+    delta_copies_destroy(&dc);
+}
+
+/**
+ * Publishes one update of the given cores the way the analyzer does.
+ */
+static void test_delta_log_publish(Broadcast* const b, DeltaLog* const dl, const uint64_t seq,
+                                   const uint16_t* const cores, uint16_t* const shadow)
+{
+    void* slot;
+    assert(broadcast_claim(b, &slot, 1) == BSUCCESS);
+    uint64_t* const changed = slot;
+    uint16_t* const values = (uint16_t*)(void*)&changed[DELTA_WORDS(TEST_DELTA_CORES)];
+    delta_encode(cores, shadow, TEST_DELTA_CORES, 0, changed, values);
+    delta_log_since(dl, seq, broadcast_oldest_unread(b), shadow, changed, values);
+    broadcast_publish(b);
+}
+
+/**
+ * Reads everything the consumer gets without waiting, applies it to its state.
+ */
+static void test_delta_log_read(Broadcast* const b, const int consumer, uint16_t* const state)
+{
+    const void* slot;
+    while(broadcast_wait(b, consumer, &slot, 0) == BSUCCESS)
+    {
+        const uint64_t* const changed = slot;
+        delta_apply(state, changed, (const uint16_t*)(const void*)&changed[DELTA_WORDS(TEST_DELTA_CORES)],
+                    TEST_DELTA_CORES);
+        broadcast_release(b, consumer);
+    }
+}
+
+static void test_delta_log(void)
+{
+    enum{CAPACITY = 4};
+    uint16_t cores[TEST_DELTA_CORES] = {0}, shadow[TEST_DELTA_CORES], state[TEST_DELTA_CORES] = {0};
+    Broadcast* const b = broadcast_create(CAPACITY, sizeof(uint64_t) * DELTA_WORDS(TEST_DELTA_CORES) +
+                                                    sizeof(uint16_t) * TEST_DELTA_CORES);
+    const int consumer = broadcast_add_consumer(b, BROADCAST_SKIP);
+    DeltaLog dl;
+    assert(b != NULL && consumer >= 0 && delta_log_init(&dl, TEST_DELTA_CORES, CAPACITY));
+    for (size_t j = 0; j < TEST_DELTA_CORES; j++)
+        shadow[j] = DELTA_UNKNOWN_BP;
+    uint64_t seq = 0;
+    test_delta_log_publish(b, &dl, seq++, cores, shadow);
+    test_delta_log_read(b, consumer, state);
+    assert(memcmp(state, cores, sizeof(cores)) == 0);
+
+    // Every update moves a different core - the consumer catches up on each of them
+    cores[1] = 100;
+    test_delta_log_publish(b, &dl, seq++, cores, shadow);
+    cores[70] = 200;
+    test_delta_log_publish(b, &dl, seq++, cores, shadow);
+    cores[199] = 300;
+    test_delta_log_publish(b, &dl, seq++, cores, shadow);
+    test_delta_log_read(b, consumer, state);
+    assert(memcmp(state, cores, sizeof(cores)) == 0);
+
+    // More than a whole ring behind - the slot it jumps to carries every core
+    for (size_t i = 0; i < 3 * CAPACITY; i++)
+    {
+        cores[i * 13] = (uint16_t)(1000 + i);
+        test_delta_log_publish(b, &dl, seq++, cores, shadow);
+    }
+    test_delta_log_read(b, consumer, state);
+    assert(broadcast_lost(b, consumer) != 0);
+    assert(memcmp(state, cores, sizeof(cores)) == 0);
+
+    // Up to date consumer gets only the update of the sample
+    cores[2] = 5;
+    test_delta_log_publish(b, &dl, seq++, cores, shadow);
+    const void* slot;
+    assert(broadcast_wait(b, consumer, &slot, 0) == BSUCCESS);
+    const uint64_t* const changed = slot;
+    assert(changed[0] == 0x4 && changed[1] == 0 && changed[2] == 0 && changed[3] == 0);
+    broadcast_release(b, consumer);
+
+    delta_log_destroy(&dl);
+    broadcast_delete(b);
+}
+
+void test_delta_main(void)
+{
+    test_delta_encode();
+    test_delta_drift();
+    test_delta_copies();
+    test_delta_log();
+}
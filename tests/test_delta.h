@@ -0,0 +1,7 @@
+
+#ifndef CPU_USAGE_TRACKER_TEST_DELTA_H
+#define CPU_USAGE_TRACKER_TEST_DELTA_H
+
+void test_delta_main(void);
+
+#endif //CPU_USAGE_TRACKER_TEST_DELTA_H
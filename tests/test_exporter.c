@@ -0,0 +1,187 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/resource.h>
+
+#include "../exporter.h"
+#include "test_exporter.h"
+
+/*
+ * TESTS:
+ * - Invalid arguments, a file at the socket path is not replaced
+ * - Scrape before the first sample, unknown path
+ * - Sample rendered in Prometheus format - cores numbered from 1, effective usage, load average only when read
+ * - Body longer than expected - the snapshot grows, later ones keep the size
+ * - Out of fds a pending scrape is dropped instead of keeping the listener readable
+ */
+static void test_exporter_invalid(void);
+static void test_exporter_usage(void);
+static void test_exporter_growth(void);
+static void test_exporter_out_of_fds(void);
+
+enum{TEST_EXPORTER_RESPONSE = 65536};
+
+static int test_exporter_connect(const char* const path)
+{
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    strcpy(addr.sun_path, path);
+    const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    assert(fd >= 0 && connect(fd, (const struct sockaddr*)&addr, sizeof(addr)) == 0);
+    return fd;
+}
+
+/**
+ * Sends the request and reads the whole response, the exporter closes the connection after it.
+ * @return Response, static buffer.
+ */
+static const char* test_exporter_get(const char* const path, const char* const request)
+{
+    static char response[TEST_EXPORTER_RESPONSE];
+    const int fd = test_exporter_connect(path);
+    assert(send(fd, request, strlen(request), 0) == (ssize_t)strlen(request));
+    size_t len = 0;
+    ssize_t n;
+    while((n = recv(fd, response + len, sizeof(response) - 1 - len, 0)) > 0)
+        len += (size_t)n;
+    assert(n == 0);
+    response[len] = '\0';
+    close(fd);
+    return response;
+}
+
+/**
+ * @return Body of a 200 response after checking its Content-Length.
+ */
+static const char* test_exporter_body(const char* const response)
+{
+    assert(strncmp(response, "HTTP/1.1 200 OK\r\n", 17) == 0);
+    const char* const length = strstr(response, "Content-Length: ");
+    const char* const body = strstr(response, "\r\n\r\n");
+    assert(length != NULL && body != NULL);
+    assert(strtoul(length + 16, NULL, 10) == strlen(body + 4));
+    return body + 4;
+}
+
+static size_t test_exporter_render(char* const body, const size_t size, const void* const ctx)
+{
+    const size_t len = *(const size_t*)ctx;
+    for (size_t i = 0; i < len && i + 1 < size; i++)
+        body[i] = (char)('a' + i % 26);
+    if(size != 0)
+        body[len < size ? len : size - 1] = '\0';
+    return len;
+}
+
+static void test_exporter_invalid(void)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/cut_test_exporter_%d.sock", (int)getpid());
+    assert(exporter_create(NULL, 0) == NULL);
+    FILE* const file = fopen(path, "w");
+    assert(file != NULL);
+    fclose(file);
+    assert(exporter_create(path, 0) == NULL && access(path, F_OK) == 0);
+    unlink(path);
+    exporter_publish(NULL, NULL, 0);
+    exporter_delete(NULL);
+}
+
+static void test_exporter_usage(void)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/cut_test_exporter_%d.sock", (int)getpid());
+    Exporter* const e = exporter_create(path, 0);
+    assert(e != NULL);
+    assert(strncmp(test_exporter_get(path, "GET /metrics HTTP/1.1\r\n\r\n"), "HTTP/1.1 503 ", 13) == 0);
+    assert(strncmp(test_exporter_get(path, "GET /other HTTP/1.1\r\n\r\n"), "HTTP/1.1 404 ", 13) == 0);
+
+    uint16_t cores[2] = {1234, 10000};
+    uint16_t effective[2] = {617, 5000};
+    UsagePercentage usage = {.total_bp = 5617, .cores_bp = cores, .effective_bp = 2809,
+                             .effective_cores_bp = effective};
+    usage.sys.sources = SYSLOAD_LOADAVG;
+    usage.sys.load.avg[0] = 1.5;
+    exporter_publish(e, &usage, 2);
+    const char* body = test_exporter_body(test_exporter_get(path, "GET /metrics HTTP/1.0\r\n\r\n"));
+    assert(strstr(body, "cut_cpu_usage_percent{cpu=\"total\"} 56.17\n") != NULL);
+    assert(strstr(body, "cut_cpu_usage_percent{cpu=\"1\"} 12.34\n") != NULL);
+    assert(strstr(body, "cut_cpu_usage_percent{cpu=\"2\"} 100.00\n") != NULL);
+    assert(strstr(body, "cpu=\"0\"") == NULL && strstr(body, "cpu=\"3\"") == NULL);
+    assert(strstr(body, "cut_cpu_effective_percent{cpu=\"total\"} 28.09\n") != NULL);
+    assert(strstr(body, "cut_cpu_effective_percent{cpu=\"2\"} 50.00\n") != NULL);
+    assert(strstr(body, "cut_load_average{period=\"1m\"} 1.50\n") != NULL);
+    assert(strstr(body, "cut_cpu_pressure") == NULL && strstr(body, "cut_runqueue") == NULL);
+
+    // The newest sample is served, a query string is ignored
+    cores[0] = 0;
+    exporter_publish(e, &usage, 2);
+    body = test_exporter_body(test_exporter_get(path, "GET /metrics?x=1 HTTP/1.1\r\n\r\n"));
+    assert(strstr(body, "cut_cpu_usage_percent{cpu=\"1\"} 0.00\n") != NULL);
+    exporter_delete(e);
+    assert(access(path, F_OK) != 0);
+}
+
+static void test_exporter_growth(void)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/cut_test_exporter_%d.sock", (int)getpid());
+    Exporter* const e = exporter_create(path, 0);
+    assert(e != NULL);
+    // Expected 16 bytes, rendered 40000 - nothing is cut off
+    size_t len = 40000;
+    exporter_publish_with(e, 16, test_exporter_render, &len);
+    const char* body = test_exporter_body(test_exporter_get(path, "GET /metrics HTTP/1.1\r\n\r\n"));
+    assert(strlen(body) == 40000 && body[39999] == (char)('a' + 39999 % 26));
+    // Later snapshots are allocated for the longest body, shorter and longer ones fit
+    len = 100;
+    exporter_publish_with(e, 16, test_exporter_render, &len);
+    body = test_exporter_body(test_exporter_get(path, "GET /metrics HTTP/1.1\r\n\r\n"));
+    assert(strlen(body) == 100);
+    len = 50000;
+    exporter_publish_with(e, 16, test_exporter_render, &len);
+    body = test_exporter_body(test_exporter_get(path, "GET /metrics HTTP/1.1\r\n\r\n"));
+    assert(strlen(body) == 50000);
+    exporter_delete(e);
+}
+
+static void test_exporter_out_of_fds(void)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/cut_test_exporter_%d.sock", (int)getpid());
+    Exporter* const e = exporter_create(path, 0);
+    assert(e != NULL);
+    struct rlimit saved, lim;
+    assert(getrlimit(RLIMIT_NOFILE, &saved) == 0);
+    const int scrape = test_exporter_connect(path);
+
+    // No fd left for the exporter to accept the scrape with - it is dropped, not left pending
+    const int next_fd = dup(scrape);
+    assert(next_fd >= 0);
+    close(next_fd);
+    lim = saved;
+    lim.rlim_cur = (rlim_t)next_fd;
+    assert(setrlimit(RLIMIT_NOFILE, &lim) == 0);
+    struct pollfd pfd = {.fd = scrape, .events = POLLIN};
+    const int ready = poll(&pfd, 1, 1000);
+    assert(setrlimit(RLIMIT_NOFILE, &saved) == 0);
+    char byte;
+    assert(ready == 1 && recv(scrape, &byte, 1, MSG_DONTWAIT) == 0);
+    close(scrape);
+
+    // Fds are back - scrapes are served again
+    assert(strncmp(test_exporter_get(path, "GET /metrics HTTP/1.1\r\n\r\n"), "HTTP/1.1 503 ", 13) == 0);
+    exporter_delete(e);
+}
+
+void test_exporter_main(void)
+{
+    test_exporter_invalid();
+    test_exporter_usage();
+    test_exporter_growth();
+    test_exporter_out_of_fds();
+}
@@ -0,0 +1,7 @@
+
+#ifndef CPU_USAGE_TRACKER_TEST_EXPORTER_H
+#define CPU_USAGE_TRACKER_TEST_EXPORTER_H
+
+void test_exporter_main(void);
+
+#endif //CPU_USAGE_TRACKER_TEST_EXPORTER_H
@@ -0,0 +1,229 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/resource.h>
+
+#include "../wire.h"
+#include "../agent.h"
+#include "../fleet.h"
+#include "test_fleet.h"
+
+/*
+ * TESTS:
+ * - Wire - key frame, delta frames of a steady stream are one byte per value, decoded values match
+ * - Wire - incomplete and malformed frames
+ * - Fleet - a file at the socket path is not replaced
+ * - Fleet - many local agents over a unix socket fill the host table and the aggregates, disconnects are seen
+ * - Fleet - out of fds a pending agent is dropped instead of keeping the listener readable
+ */
+static void test_fleet_wire_roundtrip(void);
+static void test_fleet_wire_malformed(void);
+static void test_fleet_many_agents(void);
+static void test_fleet_out_of_fds(void);
+
+enum{TEST_FLEET_CPUS = 4, TEST_FLEET_AGENTS = 200, TEST_FLEET_SAMPLES = 3};
+
+static void test_fleet_wire_roundtrip(void)
+{
+    WireEncoder enc;
+    uint8_t frame[256];
+    uint16_t cores[TEST_FLEET_CPUS] = {0, 5000, 10000, 1234};
+    uint16_t values[TEST_FLEET_CPUS + 1];
+    WireMessage msg;
+
+    assert(!wire_encoder_init(&enc, 7, 0));
+    assert(wire_encoder_init(&enc, 7, TEST_FLEET_CPUS));
+    const size_t hello_len = wire_encode_hello(&enc, "node-a", 250, frame, sizeof(frame));
+    assert(wire_decode(frame, hello_len, &msg) == (long)hello_len);
+    assert(msg.type == WIRE_HELLO && msg.host_id == 7 && msg.no_values == TEST_FLEET_CPUS && msg.interval_ms == 250);
+    assert(strcmp(msg.name, "node-a") == 0);
+
+    const size_t key_len = wire_encode_sample(&enc, 1700000000000u, 4058, 3100, cores, frame, sizeof(frame));
+    assert(key_len != 0);
+    assert(wire_decode(frame, key_len, &msg) == (long)key_len);
+    assert(msg.type == WIRE_SAMPLE && msg.key && msg.timestamp == 1700000000000u && msg.effective_bp == 3100);
+    assert(wire_apply_values(&msg, values, TEST_FLEET_CPUS + 1));
+    assert(values[0] == 4058 && memcmp(values + 1, cores, sizeof(cores)) == 0);
+
+    // Steady stream - header plus one byte per value
+    const size_t steady_len = wire_encode_sample(&enc, 1700000001000u, 4058, 100, cores, frame, sizeof(frame));
+    assert(wire_decode(frame, steady_len, &msg) == (long)steady_len);
+    assert(!msg.key && msg.timestamp == 1000);
+    assert(msg.values_len == TEST_FLEET_CPUS + 1);
+    assert(steady_len < key_len);
+
+    cores[0] = 10000;
+    cores[2] = 0;
+    const size_t delta_len = wire_encode_sample(&enc, 1700000002000u, 4100, 3200, cores, frame, sizeof(frame));
+    assert(wire_decode(frame, delta_len, &msg) == (long)delta_len);
+    assert(wire_apply_values(&msg, values, TEST_FLEET_CPUS + 1));
+    assert(values[0] == 4100 && memcmp(values + 1, cores, sizeof(cores)) == 0);
+
+    // Frame that does not fit leaves the encoder where it was - the next delta is still against cores
+    assert(wire_encode_sample(&enc, 1700000003000u, 0, 0, cores, frame, 4) == 0);
+    wire_encoder_reset(&enc);
+    const size_t reset_len = wire_encode_sample(&enc, 1700000003000u, 4100, 3200, cores, frame, sizeof(frame));
+    assert(wire_decode(frame, reset_len, &msg) == (long)reset_len && msg.key);
+    wire_encoder_destroy(&enc);
+}
+
+static void test_fleet_wire_malformed(void)
+{
+    WireEncoder enc;
+    uint8_t frame[256];
+    uint16_t cores[TEST_FLEET_CPUS] = {100, 200, 300, 400};
+    uint16_t values[TEST_FLEET_CPUS + 1] = {0};
+    WireMessage msg;
+
+    assert(wire_encoder_init(&enc, 1, TEST_FLEET_CPUS));
+    const size_t len = wire_encode_sample(&enc, 1000, 250, 250, cores, frame, sizeof(frame));
+    assert(wire_decode(frame, 2, &msg) == 0);
+    assert(wire_decode(frame, len - 1, &msg) == 0);
+    assert(wire_decode(frame, len, &msg) == (long)len);
+    assert(!wire_apply_values(&msg, values, TEST_FLEET_CPUS));     // wrong number of cpus
+
+    frame[2] = 99;   // unknown type
+    assert(wire_decode(frame, len, &msg) == -1);
+    wire_encoder_destroy(&enc);
+
+    // Delta below zero is rejected without touching the table
+    assert(wire_encoder_init(&enc, 1, TEST_FLEET_CPUS));
+    wire_encode_sample(&enc, 1000, 250, 250, cores, frame, sizeof(frame));
+    cores[0] = 0;
+    const size_t delta_len = wire_encode_sample(&enc, 2000, 250, 250, cores, frame, sizeof(frame));
+    assert(wire_decode(frame, delta_len, &msg) == (long)delta_len);
+    assert(!wire_apply_values(&msg, values, TEST_FLEET_CPUS + 1));
+    assert(values[0] == 0 && values[1] == 0);
+    wire_encoder_destroy(&enc);
+}
+
+static void test_fleet_poll_until(Fleet* f, size_t frames, size_t connected)
+{
+    FleetSummary sum;
+    for (int i = 0; i < 500; i++)
+    {
+        fleet_summarize(f, &sum);
+        if(sum.frames >= frames && sum.no_connected == connected)
+            return;
+        fleet_poll(f, 10);
+    }
+    assert(0 && "fleet did not receive every frame");
+}
+
+static void test_fleet_many_agents(void)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/cut_test_fleet_%d.sock", (int)getpid());
+    FILE* const file = fopen(path, "w");
+    assert(file != NULL);
+    fclose(file);
+    assert(fleet_create(path) == NULL && access(path, F_OK) == 0);
+    unlink(path);
+    Fleet* f = fleet_create(path);
+    assert(f != NULL);
+    assert(fleet_create(NULL) == NULL);
+
+    static Agent* agents[TEST_FLEET_AGENTS];
+    uint16_t cores[TEST_FLEET_CPUS];
+    for (size_t i = 0; i < TEST_FLEET_AGENTS; i++)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "node-%zu", i);
+        agents[i] = agent_create(path, (uint32_t)(i + 1), name, TEST_FLEET_CPUS, 1000);
+        assert(agents[i] != NULL);
+    }
+    for (size_t s = 0; s < TEST_FLEET_SAMPLES; s++)
+    {
+        for (size_t i = 0; i < TEST_FLEET_AGENTS; i++)
+        {
+            // Host i runs at i * 0.5%, its last cpu is hot, the others at half of that
+            for (size_t j = 0; j < TEST_FLEET_CPUS; j++)
+                cores[j] = (uint16_t)(j == TEST_FLEET_CPUS - 1 ? 9500 : i * 25 + s);
+            const UsagePercentage usage = {.total_bp = (uint16_t)(i * 50), .cores_bp = cores,
+                                           .effective_bp = (uint16_t)(i * 25)};
+            assert(agent_publish(agents[i], 1700000000000u + s * 1000, &usage));
+        }
+        fleet_poll(f, 0);
+    }
+    test_fleet_poll_until(f, TEST_FLEET_AGENTS * TEST_FLEET_SAMPLES, TEST_FLEET_AGENTS);
+
+    assert(fleet_no_hosts(f) == TEST_FLEET_AGENTS);
+    const FleetHost* host = fleet_find(f, 101);
+    assert(host != NULL && strcmp(host->name, "node-100") == 0);
+    assert(host->no_cpus == TEST_FLEET_CPUS && host->connections == 1);
+    assert(host->values[0] == 5000 && host->values[1] == 2500 + TEST_FLEET_SAMPLES - 1);
+    assert(host->values[TEST_FLEET_CPUS] == 9500 && host->effective_bp == 2500);
+    assert(host->timestamp_ms == 1700000000000u + (TEST_FLEET_SAMPLES - 1) * 1000);
+    assert(fleet_find(f, 100000) == NULL);
+
+    FleetSummary sum;
+    fleet_summarize(f, &sum);
+    assert(sum.no_hosts == TEST_FLEET_AGENTS && sum.no_fresh == TEST_FLEET_AGENTS);
+    assert(sum.no_cpus == TEST_FLEET_AGENTS * TEST_FLEET_CPUS);
+    assert(sum.no_hot_cores == TEST_FLEET_AGENTS);
+    assert(sum.max_pr > 99.4 && sum.max_pr < 99.6);
+    assert(sum.mean_pr > 49.0 && sum.mean_pr < 50.5);
+    assert(sum.effective_pr > 24.5 && sum.effective_pr < 25.25);
+    assert(sum.p95_pr >= 94 && sum.p95_pr <= 96);
+
+    const char* frame;
+    const size_t len = fleet_render(f, &frame);
+    assert(len != 0 && strstr(frame, "hosts 200") != NULL && strstr(frame, "node-199") != NULL);
+    char body[64 * 1024];
+    const size_t body_len = fleet_render_metrics(body, sizeof(body), f);
+    assert(body_len < fleet_metrics_size(f));
+    assert(strstr(body, "cut_fleet_hosts{state=\"connected\"} 200\n") != NULL);
+    assert(strstr(body, "cut_host_usage_percent{host=\"node-100\",id=\"101\",cpu=\"total\"} 50.00\n") != NULL);
+    assert(strstr(body, "cut_host_usage_percent{host=\"node-100\",id=\"101\",cpu=\"effective\"} 25.00\n") != NULL);
+
+    for (size_t i = 0; i < TEST_FLEET_AGENTS; i++)
+        agent_delete(agents[i]);
+    test_fleet_poll_until(f, 0, 0);
+    assert(fleet_find(f, 101)->connections == 0);
+    fleet_delete(f);
+    assert(access(path, F_OK) != 0);
+}
+
+static void test_fleet_out_of_fds(void)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/cut_test_fleet_fds_%d.sock", (int)getpid());
+    Fleet* f = fleet_create(path);
+    assert(f != NULL);
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    strcpy(addr.sun_path, path);
+    const int agent = socket(AF_UNIX, SOCK_STREAM, 0);
+    assert(agent >= 0 && connect(agent, (const struct sockaddr*)&addr, sizeof(addr)) == 0);
+
+    // No fd left for the collector to accept the agent with
+    struct rlimit saved, lim;
+    assert(getrlimit(RLIMIT_NOFILE, &saved) == 0);
+    const int next_fd = dup(agent);
+    assert(next_fd >= 0);
+    close(next_fd);
+    lim = saved;
+    lim.rlim_cur = (rlim_t)next_fd;
+    assert(setrlimit(RLIMIT_NOFILE, &lim) == 0);
+    assert(fleet_poll(f, 100) == 0);
+    assert(setrlimit(RLIMIT_NOFILE, &saved) == 0);
+
+    // Dropped - the agent sees the connection closed, the listener is not readable anymore
+    char byte;
+    assert(recv(agent, &byte, 1, MSG_DONTWAIT) == 0);
+    FleetSummary sum;
+    fleet_summarize(f, &sum);
+    assert(sum.no_connected == 0);
+    close(agent);
+    fleet_delete(f);
+}
+
+void test_fleet_main(void)
+{
+    test_fleet_wire_roundtrip();
+    test_fleet_wire_malformed();
+    test_fleet_many_agents();
+    test_fleet_out_of_fds();
+}
@@ -0,0 +1,7 @@
+
+#ifndef CPU_USAGE_TRACKER_TEST_FLEET_H
+#define CPU_USAGE_TRACKER_TEST_FLEET_H
+
+void test_fleet_main(void);
+
+#endif //CPU_USAGE_TRACKER_TEST_FLEET_H
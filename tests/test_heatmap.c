@@ -0,0 +1,85 @@
+#include <assert.h>
+#include <string.h>
+
+#include "../heatmap.h"
+#include "test_heatmap.h"
+
+/*
+ * TESTS:
+ * - Create / delete
+ * - Frame - one write of home, grid, sparklines and the busiest cpus
+ * - Narrow terminal wraps the grid into more rows
+ */
+static void test_heatmap_create(void);
+static void test_heatmap_frame(void);
+static void test_heatmap_wrap(void);
+
+enum{TEST_HEATMAP_CPUS = 64};
+
+static size_t test_heatmap_count(const char* frame, size_t len, const char* what)
+{
+    size_t count = 0;
+    const size_t what_len = strlen(what);
+    for (size_t i = 0; i + what_len <= len; i++)
+        count += memcmp(frame + i, what, what_len) == 0;
+    return count;
+}
+
+static void test_heatmap_create(void)
+{
+    assert(heatmap_create(0) == NULL);
+    Heatmap* hm = heatmap_create(4);
+    assert(hm != NULL);
+    heatmap_delete(hm);
+    heatmap_delete(NULL);
+}
+
+static void test_heatmap_frame(void)
+{
+    uint16_t cores[TEST_HEATMAP_CPUS] = {0};
+    cores[5] = 10000;
+    cores[9] = 9000;
+    cores[1] = 8000;
+    UsagePercentage usage = {.total_bp = 420, .cores_bp = cores};
+    CoreStats* cs = corestats_create(TEST_HEATMAP_CPUS + 1, 10.0, 1.0);
+    corestats_push(cs, usage.total_bp, cores, 1.0);
+    corestats_push(cs, usage.total_bp, cores, 1.0);
+
+    Heatmap* hm = heatmap_create(TEST_HEATMAP_CPUS);
+    heatmap_resize(hm, 40, 200);
+    const char* frame;
+    const size_t len = heatmap_render(hm, &usage, cs, &frame);
+    assert(len > 0 && strlen(frame) == len);
+    assert(strncmp(frame, "\033[H", 3) == 0);
+    assert(strstr(frame, "64 cpus") != NULL && strstr(frame, "total   4.2%") != NULL);
+    // Busiest first, numbered like the bars
+    const char* top = strstr(frame, "top: cpu6 100.0% cpu10  90.0% cpu2  80.0%");
+    assert(top != NULL);
+    // Two samples of history in every sparkline
+    assert(test_heatmap_count(frame, len, "▁") >= 2);
+    heatmap_delete(hm);
+    corestats_delete(cs);
+}
+
+static void test_heatmap_wrap(void)
+{
+    uint16_t cores[TEST_HEATMAP_CPUS] = {0};
+    UsagePercentage usage = {.total_bp = 0, .cores_bp = cores};
+    Heatmap* hm = heatmap_create(TEST_HEATMAP_CPUS);
+    const char* frame;
+
+    heatmap_resize(hm, 40, 200);
+    size_t len = heatmap_render(hm, &usage, NULL, &frame);
+    const size_t wide_lines = test_heatmap_count(frame, len, "\n");
+    heatmap_resize(hm, 40, 40);
+    len = heatmap_render(hm, &usage, NULL, &frame);
+    assert(test_heatmap_count(frame, len, "\n") > wide_lines);
+    heatmap_delete(hm);
+}
+
+void test_heatmap_main(void)
+{
+    test_heatmap_create();
+    test_heatmap_frame();
+    test_heatmap_wrap();
+}
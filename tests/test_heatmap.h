@@ -0,0 +1,7 @@
+
+#ifndef CPU_USAGE_TRACKER_TEST_HEATMAP_H
+#define CPU_USAGE_TRACKER_TEST_HEATMAP_H
+
+void test_heatmap_main(void);
+
+#endif //CPU_USAGE_TRACKER_TEST_HEATMAP_H
@@ -0,0 +1,212 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../iobatch.h"
+#include "../collector.h"
+#include "test_iobatch.h"
+
+/*
+ * TESTS:
+ * - Files of a tick are read by one submit - one io_uring_enter per round, or one pread per file and round in
+ *   the fallback. The second round sees the end of the files
+ * - File that filled its slot is seen and read whole after resize
+ * - Collectors - file collectors and their parse run from the batch, a file outgrowing the buffer is reread
+ * - seq_file bigger than a page - short reads are continued in the next rounds until the end
+ * - Invalid slots and fds
+ */
+static void test_iobatch_submit(bool uring);
+static void test_iobatch_resize(void);
+static void test_iobatch_collectors(void);
+static void test_iobatch_seq_file(bool uring);
+static void test_iobatch_invalid(void);
+
+enum{TEST_IOBATCH_FILES = 8};
+
+static int test_iobatch_file(char* const path, const size_t size, const char* const content)
+{
+    snprintf(path, size, "/tmp/cut_test_iobatch_XXXXXX");
+    const int fd = mkstemp(path);
+    assert(fd >= 0);
+    assert(write(fd, content, strlen(content)) == (ssize_t)strlen(content));
+    return fd;
+}
+
+static void test_iobatch_submit(const bool uring)
+{
+    char paths[TEST_IOBATCH_FILES][64];
+    int fds[TEST_IOBATCH_FILES];
+    int slots[TEST_IOBATCH_FILES];
+    IoBatch* const b = iobatch_create(TEST_IOBATCH_FILES, uring);
+    assert(b != NULL);
+    assert(uring || !iobatch_uses_uring(b));
+    for (int i = 0; i < TEST_IOBATCH_FILES; i++)
+    {
+        char content[32];
+        snprintf(content, sizeof(content), "file %d\n", i);
+        fds[i] = test_iobatch_file(paths[i], sizeof(paths[i]), content);
+        slots[i] = iobatch_add(b, fds[i], 64);
+        assert(slots[i] == i);
+    }
+
+    for (int tick = 0; tick < 3; tick++)
+    {
+        IoBatchStats before, after;
+        iobatch_stats(b, &before);
+        for (int i = 0; i < TEST_IOBATCH_FILES; i++)
+            assert(iobatch_queue(b, slots[i]));
+        assert(iobatch_submit(b) == TEST_IOBATCH_FILES);
+        iobatch_stats(b, &after);
+        assert(after.syscalls - before.syscalls == (iobatch_uses_uring(b) ? 2 : 2 * TEST_IOBATCH_FILES));
+        assert(after.reads - before.reads == TEST_IOBATCH_FILES && after.ticks - before.ticks == 1);
+        for (int i = 0; i < TEST_IOBATCH_FILES; i++)
+        {
+            char expected[32];
+            const char* data;
+            snprintf(expected, sizeof(expected), i == 0 && tick > 0 ? "changed" : "file %d\n", i);
+            assert(iobatch_result(b, slots[i], &data) == (long)strlen(expected));
+            assert(strcmp(data, expected) == 0);
+        }
+        // Rewritten file is read again from offset 0
+        assert(pwrite(fds[0], "changed", 7, 0) == 7);
+    }
+    assert(iobatch_submit(b) == 0);     // nothing queued
+
+    iobatch_delete(b);
+    for (int i = 0; i < TEST_IOBATCH_FILES; i++)
+    {
+        close(fds[i]);
+        unlink(paths[i]);
+    }
+}
+
+static void test_iobatch_resize(void)
+{
+    char path[64];
+    const int fd = test_iobatch_file(path, sizeof(path), "0123456789abcdef");
+    IoBatch* const b = iobatch_create(1, true);
+    const int slot = iobatch_add(b, fd, 8);
+    const char* data;
+    iobatch_queue(b, slot);
+    iobatch_submit(b);
+    assert(iobatch_result(b, slot, &data) == 7 && strcmp(data, "0123456") == 0);     // slot is full
+
+    // Slots added after the first tick register the table and the grown arena again
+    assert(iobatch_resize(b, slot, 128 * 1024));
+    assert(iobatch_slot_size(b, slot) == 128 * 1024);
+    const int other = iobatch_add(b, fd, 4);
+    iobatch_queue(b, slot);
+    iobatch_queue(b, other);
+    assert(iobatch_submit(b) == 2);
+    assert(iobatch_result(b, slot, &data) == 16 && strcmp(data, "0123456789abcdef") == 0);
+    assert(iobatch_result(b, other, &data) == 3 && strcmp(data, "012") == 0);
+    iobatch_delete(b);
+    close(fd);
+    unlink(path);
+}
+
+static bool test_iobatch_parse(Collector* const c)
+{
+    int* const parsed = c->data;
+    (*parsed)++;
+    return c->len != 0;
+}
+
+static void test_iobatch_collectors(void)
+{
+    char small_path[64], big_path[64];
+    const int small_fd = test_iobatch_file(small_path, sizeof(small_path), "10 20 30\n");
+    const int big_fd = test_iobatch_file(big_path, sizeof(big_path), "x");
+    int parsed = 0;
+    Collector small_c = {.name = "small", .path = small_path, .interval_ms = 1000, .parse = test_iobatch_parse,
+                         .data = &parsed};
+    Collector big_c = {.name = "big", .path = big_path, .interval_ms = 1000, .parse = test_iobatch_parse,
+                       .data = &parsed};
+    Collector* const collectors[] = {&small_c, &big_c};
+    assert(collector_open(&small_c) && collector_open(&big_c));
+
+    // Bigger than the initial buffer of the collector
+    const size_t big_len = 3 * big_c.buff_size;
+    char* const content = malloc(big_len);
+    memset(content, 'y', big_len);
+    assert(pwrite(big_fd, content, big_len, 0) == (ssize_t)big_len);
+
+    IoBatch* const b = iobatch_create(2, true);
+    assert(collector_run_due_batch(collectors, 2, b) == 2);
+    assert(parsed == 2);
+    assert(strcmp(small_c.buffer, "10 20 30\n") == 0 && small_c.len == 9);
+    assert(big_c.len == big_len && big_c.buffer[big_len - 1] == 'y' && big_c.buff_size > big_len);
+    assert(iobatch_slot_size(b, big_c.batch_slot) == big_c.buff_size);
+
+    // Next tick reads the big file whole from its resized slot
+    small_c.next_due_ns = big_c.next_due_ns = 0;
+    assert(collector_run_due_batch(collectors, 2, b) == 2);
+    assert(big_c.len == big_len && parsed == 4);
+
+    // Not due - nothing is read
+    IoBatchStats stats;
+    iobatch_stats(b, &stats);
+    assert(collector_run_due_batch(collectors, 2, b) == 0);
+    IoBatchStats after;
+    iobatch_stats(b, &after);
+    assert(after.reads == stats.reads && parsed == 4);
+
+    iobatch_delete(b);
+    collector_close(&small_c);
+    collector_close(&big_c);
+    free(content);
+    close(small_fd);
+    close(big_fd);
+    unlink(small_path);
+    unlink(big_path);
+}
+
+static void test_iobatch_seq_file(const bool uring)
+{
+    // A mapping takes over 1 KB of smaps - every process has enough of them for several pages
+    int parsed = 0;
+    Collector c = {.name = "smaps", .path = "/proc/self/smaps", .interval_ms = 1000, .parse = test_iobatch_parse,
+                   .data = &parsed};
+    Collector* const collectors[] = {&c};
+    if(!collector_open(&c))
+        return;     // no procfs
+    IoBatch* const b = iobatch_create(1, uring);
+    for (int tick = 0; tick < 2; tick++)
+    {
+        // The first tick outgrows the initial buffer, the second one reads the resized slot in rounds
+        c.next_due_ns = 0;
+        assert(collector_run_due_batch(collectors, 1, b) == 1);
+        assert(c.len > 2 * 4096 && strlen(c.buffer) == c.len && c.buffer[c.len - 1] == '\n');
+    }
+    assert(iobatch_slot_size(b, c.batch_slot) > c.len + 1);
+    iobatch_delete(b);
+    collector_close(&c);
+}
+
+static void test_iobatch_invalid(void)
+{
+    IoBatch* const b = iobatch_create(4, true);
+    assert(iobatch_add(b, -1, 64) == -1);
+    assert(iobatch_add(NULL, 0, 64) == -1);
+    assert(!iobatch_queue(b, 0));
+    assert(!iobatch_queue(b, -1));
+    assert(iobatch_result(b, 3, NULL) < 0);
+    assert(iobatch_slot_size(b, 0) == 0);
+    assert(!iobatch_resize(b, 0, 64));
+    assert(iobatch_submit(NULL) == 0);
+    iobatch_delete(b);
+    iobatch_delete(NULL);
+}
+
+void test_iobatch_main(void)
+{
+    test_iobatch_submit(true);
+    test_iobatch_submit(false);
+    test_iobatch_resize();
+    test_iobatch_collectors();
+    test_iobatch_seq_file(true);
+    test_iobatch_seq_file(false);
+    test_iobatch_invalid();
+}
@@ -0,0 +1,7 @@
+
+#ifndef CPU_USAGE_TRACKER_TEST_IOBATCH_H
+#define CPU_USAGE_TRACKER_TEST_IOBATCH_H
+
+void test_iobatch_main(void);
+
+#endif //CPU_USAGE_TRACKER_TEST_IOBATCH_H
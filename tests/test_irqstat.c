@@ -0,0 +1,137 @@
+#include <assert.h>
+#include <string.h>
+
+#include "../irqstat.h"
+#include "test_irqstat.h"
+
+/*
+ * TESTS:
+ * - Rates per cpu and source from two ticks of /proc/interrupts, global rows (ERR) are skipped
+ * - Top sources of a cpu mix interrupts and softirqs, busiest first
+ * - Changed layout - new irq row and hotplugged cpu column
+ * - Not a table
+ */
+static void test_irqstat_rates(void);
+static void test_irqstat_top(void);
+static void test_irqstat_layout(void);
+static void test_irqstat_invalid(void);
+
+static const char g_interrupts_0[] =
+    "           CPU0       CPU1       \n"
+    "  0:         22          0   IO-APIC   2-edge      timer\n"
+    " 24:       1000        500   PCI-MSI 512000-edge      eth0-rx-0\n"
+    "LOC:      10000      20000   Local timer interrupts\n"
+    "ERR:          0\n";
+static const char g_interrupts_1[] =
+    "           CPU0       CPU1       \n"
+    "  0:         22          0   IO-APIC   2-edge      timer\n"
+    " 24:       3000        600   PCI-MSI 512000-edge      eth0-rx-0\n"
+    "LOC:      10500      21000   Local timer interrupts\n"
+    "ERR:          7\n";
+static const char g_softirqs_0[] =
+    "                    CPU0       CPU1       \n"
+    "          HI:          0          0\n"
+    "      NET_RX:        100         10\n"
+    "       TIMER:        200        300\n";
+static const char g_softirqs_1[] =
+    "                    CPU0       CPU1       \n"
+    "          HI:          0          0\n"
+    "      NET_RX:       4100         10\n"
+    "       TIMER:        300        300\n";
+
+#define TEST_IRQSTAT_SECOND 1000000000ull
+
+static void test_irqstat_rates(void)
+{
+    IrqStat* is = irqstat_create(2);
+    assert(is != NULL);
+    assert(irqstat_parse(is, IRQSTAT_HARD, g_interrupts_0, TEST_IRQSTAT_SECOND));
+    assert(irqstat_cpu_rate(is, 0, IRQSTAT_HARD) == 0);     // no previous tick
+    assert(irqstat_parse(is, IRQSTAT_HARD, g_interrupts_1, 3 * TEST_IRQSTAT_SECOND));
+    assert(irqstat_cpu_rate(is, 0, IRQSTAT_HARD) == 1000 + 250);
+    assert(irqstat_cpu_rate(is, 1, IRQSTAT_HARD) == 50 + 500);
+    assert(irqstat_cpu_rate(is, 2, IRQSTAT_HARD) == 0);
+
+    IrqTop top[4];
+    assert(irqstat_top(is, 0, top, 4) == 2);
+    assert(strcmp(top[0].name, "eth0-rx-0") == 0 && top[0].rate == 1000 && top[0].kind == IRQSTAT_HARD);
+    assert(strcmp(top[1].name, "LOC") == 0 && top[1].rate == 250);
+    irqstat_delete(is);
+}
+
+static void test_irqstat_top(void)
+{
+    IrqStat* is = irqstat_create(2);
+    irqstat_parse(is, IRQSTAT_HARD, g_interrupts_0, TEST_IRQSTAT_SECOND);
+    irqstat_parse(is, IRQSTAT_SOFT, g_softirqs_0, TEST_IRQSTAT_SECOND);
+    irqstat_parse(is, IRQSTAT_HARD, g_interrupts_1, 2 * TEST_IRQSTAT_SECOND);
+    irqstat_parse(is, IRQSTAT_SOFT, g_softirqs_1, 2 * TEST_IRQSTAT_SECOND);
+
+    IrqTop top[IRQSTAT_TOP_N];
+    assert(irqstat_top(is, 0, top, IRQSTAT_TOP_N) == IRQSTAT_TOP_N);
+    assert(strcmp(top[0].name, "NET_RX") == 0 && top[0].rate == 4000 && top[0].kind == IRQSTAT_SOFT);
+    assert(strcmp(top[1].name, "eth0-rx-0") == 0 && top[1].rate == 2000);
+    assert(strcmp(top[2].name, "LOC") == 0 && top[2].rate == 500);
+    assert(irqstat_top(is, 0, top, 1) == 1 && top[0].rate == 4000);
+    assert(irqstat_cpu_rate(is, 0, IRQSTAT_SOFT) == 4100);
+    irqstat_delete(is);
+}
+
+static void test_irqstat_layout(void)
+{
+    static const char new_irq[] =
+        "           CPU0       CPU1       \n"
+        "  0:         22          0   IO-APIC   2-edge      timer\n"
+        " 24:       3000        600   PCI-MSI 512000-edge      eth0-rx-0\n"
+        " 25:          5          5   PCI-MSI 512001-edge      eth0-rx-1\n"
+        "LOC:      10500      21000   Local timer interrupts\n";
+    static const char new_irq_next[] =
+        "           CPU0       CPU1       \n"
+        "  0:         22          0   IO-APIC   2-edge      timer\n"
+        " 24:       3000        600   PCI-MSI 512000-edge      eth0-rx-0\n"
+        " 25:          5        805   PCI-MSI 512001-edge      eth0-rx-1\n"
+        "LOC:      10500      21000   Local timer interrupts\n";
+    static const char hotplug[] =
+        "           CPU0       CPU2       \n"
+        " 24:       3000         50   PCI-MSI 512000-edge      eth0-rx-0\n";
+    static const char hotplug_next[] =
+        "           CPU0       CPU2       \n"
+        " 24:       3100        150   PCI-MSI 512000-edge      eth0-rx-0\n";
+
+    IrqStat* is = irqstat_create(3);
+    IrqTop top[2];
+    irqstat_parse(is, IRQSTAT_HARD, g_interrupts_1, TEST_IRQSTAT_SECOND);
+    assert(irqstat_parse(is, IRQSTAT_HARD, new_irq, 2 * TEST_IRQSTAT_SECOND));
+    assert(irqstat_parse(is, IRQSTAT_HARD, new_irq_next, 3 * TEST_IRQSTAT_SECOND));
+    assert(irqstat_top(is, 1, top, 2) == 1);
+    assert(strcmp(top[0].name, "eth0-rx-1") == 0 && top[0].rate == 800);
+
+    // Columns are remapped - cpu1 went offline, counters of the old layout are not compared
+    assert(irqstat_parse(is, IRQSTAT_HARD, hotplug, 4 * TEST_IRQSTAT_SECOND));
+    assert(irqstat_cpu_rate(is, 2, IRQSTAT_HARD) == 0);
+    assert(irqstat_parse(is, IRQSTAT_HARD, hotplug_next, 5 * TEST_IRQSTAT_SECOND));
+    assert(irqstat_cpu_rate(is, 2, IRQSTAT_HARD) == 100);
+    assert(irqstat_cpu_rate(is, 0, IRQSTAT_HARD) == 100);
+    assert(irqstat_cpu_rate(is, 1, IRQSTAT_HARD) == 0);
+    irqstat_delete(is);
+}
+
+static void test_irqstat_invalid(void)
+{
+    assert(irqstat_create(0) == NULL);
+    IrqStat* is = irqstat_create(2);
+    assert(!irqstat_parse(is, IRQSTAT_HARD, "", 1));
+    assert(!irqstat_parse(is, IRQSTAT_HARD, "no header\n 0: 1 2\n", 1));
+    assert(!irqstat_parse(NULL, IRQSTAT_HARD, g_interrupts_0, 1));
+    assert(irqstat_top(is, 0, NULL, 1) == 0);
+    irqstat_delete(is);
+    irqstat_delete(NULL);
+}
+
+void test_irqstat_main(void)
+{
+    test_irqstat_rates();
+    test_irqstat_top();
+    test_irqstat_layout();
+    test_irqstat_invalid();
+}
@@ -0,0 +1,7 @@
+
+#ifndef CPU_USAGE_TRACKER_TEST_IRQSTAT_H
+#define CPU_USAGE_TRACKER_TEST_IRQSTAT_H
+
+void test_irqstat_main(void);
+
+#endif //CPU_USAGE_TRACKER_TEST_IRQSTAT_H
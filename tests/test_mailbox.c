@@ -0,0 +1,115 @@
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "../mailbox.h"
+#include "test_mailbox.h"
+
+/*
+ * TESTS:
+ * - Invalid arguments, nothing published yet
+ * - Reader gets the latest element, older ones are replaced, taken element stays until a newer one
+ * - Writer never gets the buffer the reader holds
+ * - Writer and reader in separate threads - reader sees whole elements in increasing order, writer never waits
+ */
+static void test_mailbox_invalid(void);
+static void test_mailbox_latest(void);
+static void test_mailbox_buffers(void);
+static void test_mailbox_threads(void);
+
+enum{TEST_MAILBOX_ELEMENTS = 200000, TEST_MAILBOX_WORDS = 16};
+
+static void publish_value(Mailbox* const m, const uint64_t value)
+{
+    uint64_t* const buffer = mailbox_back(m);
+    for (size_t i = 0; i < TEST_MAILBOX_WORDS; i++)
+        buffer[i] = value;
+    mailbox_publish(m);
+}
+
+static void test_mailbox_invalid(void)
+{
+    assert(mailbox_create(0) == NULL);
+    assert(mailbox_back(NULL) == NULL);
+    assert(mailbox_latest(NULL, NULL) == NULL);
+    mailbox_publish(NULL);
+    mailbox_delete(NULL);
+    Mailbox* const m = mailbox_create(sizeof(uint64_t));
+    bool fresh = true;
+    assert(mailbox_latest(m, &fresh) == NULL && !fresh);
+    assert(mailbox_published(m) == 0 && mailbox_taken(m) == 0);
+    mailbox_delete(m);
+}
+
+static void test_mailbox_latest(void)
+{
+    Mailbox* const m = mailbox_create(sizeof(uint64_t) * TEST_MAILBOX_WORDS);
+    bool fresh;
+    publish_value(m, 1);
+    publish_value(m, 2);
+    publish_value(m, 3);
+    const uint64_t* value = mailbox_latest(m, &fresh);
+    assert(fresh && *value == 3);
+    // Same element until a newer one is published
+    assert(mailbox_latest(m, &fresh) == value && !fresh && *value == 3);
+    publish_value(m, 4);
+    assert(*value == 3);      // writer does not touch the taken element
+    value = mailbox_latest(m, &fresh);
+    assert(fresh && *value == 4);
+    assert(mailbox_published(m) == 4 && mailbox_taken(m) == 2);
+    mailbox_delete(m);
+}
+
+static void test_mailbox_buffers(void)
+{
+    Mailbox* const m = mailbox_create(sizeof(uint64_t) * TEST_MAILBOX_WORDS);
+    for (uint64_t i = 0; i < 10; i++)
+    {
+        publish_value(m, i);
+        const void* const taken = mailbox_latest(m, NULL);
+        for (int j = 0; j < 3; j++)
+        {
+            assert(mailbox_back(m) != taken);
+            publish_value(m, i);
+        }
+    }
+    mailbox_delete(m);
+}
+
+static void* test_mailbox_writer(void* args)
+{
+    Mailbox* const m = args;
+    for (uint64_t i = 1; i <= TEST_MAILBOX_ELEMENTS; i++)
+        publish_value(m, i);
+    return NULL;
+}
+
+static void test_mailbox_threads(void)
+{
+    Mailbox* const m = mailbox_create(sizeof(uint64_t) * TEST_MAILBOX_WORDS);
+    pthread_t writer;
+    assert(pthread_create(&writer, NULL, test_mailbox_writer, m) == 0);
+    uint64_t last = 0;
+    while(last < TEST_MAILBOX_ELEMENTS)
+    {
+        const uint64_t* const value = mailbox_latest(m, NULL);
+        if(value == NULL)
+            continue;
+        for (size_t i = 1; i < TEST_MAILBOX_WORDS; i++)
+            assert(value[i] == value[0]);   // never torn
+        assert(value[0] >= last);
+        last = value[0];
+    }
+    assert(pthread_join(writer, NULL) == 0);
+    assert(mailbox_published(m) == TEST_MAILBOX_ELEMENTS);
+    mailbox_delete(m);
+}
+
+void test_mailbox_main(void)
+{
+    test_mailbox_invalid();
+    test_mailbox_latest();
+    test_mailbox_buffers();
+    test_mailbox_threads();
+}
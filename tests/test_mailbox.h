@@ -0,0 +1,7 @@
+
+#ifndef CPU_USAGE_TRACKER_TEST_MAILBOX_H
+#define CPU_USAGE_TRACKER_TEST_MAILBOX_H
+
+void test_mailbox_main(void);
+
+#endif //CPU_USAGE_TRACKER_TEST_MAILBOX_H
@@ -2,6 +2,25 @@
 
 #include "test_queue.h"
 #include "test_reader.h"
+#include "test_corestats.h"
+#include "test_shm.h"
+#include "test_alerts.h"
+#include "test_cut.h"
+#include "test_adaptive.h"
+#include "test_broadcast.h"
+#include "test_heatmap.h"
+#include "test_fleet.h"
+#include "test_irqstat.h"
+#include "test_cpufreq.h"
+#include "test_collector.h"
+#include "test_iobatch.h"
+#include "test_analyzer.h"
+#include "test_trace.h"
+#include "test_mailbox.h"
+#include "test_delta.h"
+#include "test_proctop.h"
+#include "test_cgroup.h"
+#include "test_exporter.h"
 
 
 int main(void)
@@ -9,6 +28,63 @@ int main(void)
     printf("Testing queue...");
     test_queue_main();
     printf("SUCCESS\n");
+    printf("Testing core statistics...");
+    test_corestats_main();
+    printf("SUCCESS\n");
+    printf("Testing shared memory publication...");
+    test_shm_main();
+    printf("SUCCESS\n");
+    printf("Testing alert rules...");
+    test_alerts_main();
+    printf("SUCCESS\n");
+    printf("Testing libcut sampling...");
+    test_cut_main();
+    printf("SUCCESS\n");
+    printf("Testing adaptive interval...");
+    test_adaptive_main();
+    printf("SUCCESS\n");
+    printf("Testing broadcast ring...");
+    test_broadcast_main();
+    printf("SUCCESS\n");
+    printf("Testing heatmap...");
+    test_heatmap_main();
+    printf("SUCCESS\n");
+    printf("Testing fleet agents and collector...");
+    test_fleet_main();
+    printf("SUCCESS\n");
+    printf("Testing interrupt rates...");
+    test_irqstat_main();
+    printf("SUCCESS\n");
+    printf("Testing cpufreq and cpuidle...");
+    test_cpufreq_main();
+    printf("SUCCESS\n");
+    printf("Testing collector reads...");
+    test_collector_main();
+    printf("SUCCESS\n");
+    printf("Testing batched reads...");
+    test_iobatch_main();
+    printf("SUCCESS\n");
+    printf("Testing load balance...");
+    test_analyzer_main();
+    printf("SUCCESS\n");
+    printf("Testing pipeline trace...");
+    test_trace_main();
+    printf("SUCCESS\n");
+    printf("Testing printer mailbox...");
+    test_mailbox_main();
+    printf("SUCCESS\n");
+    printf("Testing sparse core updates...");
+    test_delta_main();
+    printf("SUCCESS\n");
+    printf("Testing per-process top...");
+    test_proctop_main();
+    printf("SUCCESS\n");
+    printf("Testing cgroup accounting...");
+    test_cgroup_main();
+    printf("SUCCESS\n");
+    printf("Testing metrics exporter...");
+    test_exporter_main();
+    printf("SUCCESS\n");
     printf("Testing reader...");
     test_reader_main();
     printf("SUCCESS\n");
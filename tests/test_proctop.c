@@ -0,0 +1,136 @@
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "../proctop.h"
+#include "test_proctop.h"
+
+/*
+ * TESTS:
+ * - Invalid arguments, missing /proc tree
+ * - Fixture tree scanned by the worker pool and inline - top N of every shard merged busiest first,
+ *   name with spaces and parentheses, processes seen twice keep their stat fd until they disappear
+ */
+static void test_proctop_invalid(void);
+static void test_proctop_fixture(size_t no_workers);
+
+enum{TEST_PROCTOP_PIDS = 7, TEST_PROCTOP_TOP = 3};
+
+static void test_proctop_write(const char* const root, const int pid, const char* const comm, const unsigned long utime,
+                               const unsigned long stime)
+{
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%d/stat", root, pid);
+    // Rewritten in place - a cached fd reads the new content
+    FILE* const f = fopen(path, "w");
+    assert(f != NULL);
+    fprintf(f, "%d (%s) S 1 %d %d 0 -1 4194560 100 0 0 0 %lu %lu 0 0 20 0 1 0 100 1000 10\n", pid, comm, pid, pid,
+            utime, stime);
+    fclose(f);
+}
+
+/**
+ * @return Number of fds open in this process.
+ */
+static size_t test_proctop_no_fds(void)
+{
+    DIR* const dir = opendir("/proc/self/fd");
+    assert(dir != NULL);
+    size_t n = 0;
+    for (const struct dirent* d = readdir(dir); d != NULL; d = readdir(dir))
+        n += d->d_name[0] != '.';
+    closedir(dir);
+    return n - 1;   // the listed directory
+}
+
+static void test_proctop_invalid(void)
+{
+    Collector c;
+    assert(proctop_create(0, 2) == NULL);
+    ProcTop* const pt = proctop_create(TEST_PROCTOP_TOP, 0);
+    assert(pt != NULL);
+    assert(!proctop_collector_init(&c, NULL, PROCTOP_PROC_ROOT));
+    assert(!proctop_collector_init(&c, pt, NULL));
+    assert(!proctop_collector_init(&c, pt, "/tmp/cut_test_proctop_missing"));
+    ProcTopEntry top[TEST_PROCTOP_TOP];
+    assert(proctop_get(pt, top, TEST_PROCTOP_TOP) == 0 && proctop_get(NULL, top, TEST_PROCTOP_TOP) == 0);
+    proctop_delete(pt);
+    proctop_delete(NULL);
+}
+
+static void test_proctop_fixture(const size_t no_workers)
+{
+    char root[] = "/tmp/cut_test_proctop_XXXXXX";
+    char path[256];
+    assert(mkdtemp(root) != NULL);
+    // Pids 11..17, pid 17 has a name that looks like the end of the field, "sys" is not a process
+    for (int pid = 11; pid < 11 + TEST_PROCTOP_PIDS; pid++)
+    {
+        snprintf(path, sizeof(path), "%s/%d", root, pid);
+        assert(mkdir(path, 0755) == 0);
+        test_proctop_write(root, pid, pid == 17 ? "a) (b" : "worker", 100, 100);
+    }
+    snprintf(path, sizeof(path), "%s/sys", root);
+    assert(mkdir(path, 0755) == 0);
+
+    Collector c;
+    ProcTop* const pt = proctop_create(TEST_PROCTOP_TOP, no_workers);
+    assert(pt != NULL);
+    assert(proctop_collector_init(&c, pt, root));
+    assert(c.collect(&c));
+    ProcTopEntry top[TEST_PROCTOP_TOP + 1];
+    assert(proctop_get(pt, top, TEST_PROCTOP_TOP) == 0);    // nothing to compare with yet
+
+    // Pid 10 + k used k ticks, pid 17 none - the three busiest are spread over the shards
+    for (int pid = 11; pid < 17; pid++)
+        test_proctop_write(root, pid, "worker", 100 + (unsigned long)(pid - 10), 100);
+    const size_t no_fds = test_proctop_no_fds();
+    usleep(20000);
+    assert(c.collect(&c));
+    assert(test_proctop_no_fds() == no_fds + TEST_PROCTOP_PIDS);
+    assert(proctop_get(pt, top, TEST_PROCTOP_TOP + 1) == TEST_PROCTOP_TOP);
+    assert(top[0].pid == 16 && top[1].pid == 15 && top[2].pid == 14);
+    assert(strcmp(top[0].comm, "worker") == 0);
+    assert(top[0].cpu_pr > 0 && fabs(top[0].cpu_pr / top[2].cpu_pr - 6.0 / 4.0) < 1e-9);
+    assert(proctop_get(pt, top, 1) == 1 && top[0].pid == 16);
+
+    // Pid 16 is gone, its fd is closed - pid 17 took the most
+    snprintf(path, sizeof(path), "%s/16/stat", root);
+    assert(unlink(path) == 0);
+    snprintf(path, sizeof(path), "%s/16", root);
+    assert(rmdir(path) == 0);
+    test_proctop_write(root, 17, "a) (b", 150, 150);
+    usleep(20000);
+    assert(c.collect(&c));
+    assert(test_proctop_no_fds() == no_fds + TEST_PROCTOP_PIDS - 1);
+    assert(proctop_get(pt, top, TEST_PROCTOP_TOP) == 1);
+    assert(top[0].pid == 17 && strcmp(top[0].comm, "a) (b") == 0);
+
+    collector_close(&c);
+    proctop_delete(pt);
+    assert(test_proctop_no_fds() == no_fds - 1);   // the /proc fd of the collector
+    for (int pid = 11; pid < 11 + TEST_PROCTOP_PIDS; pid++)
+    {
+        if(pid == 16)
+            continue;
+        snprintf(path, sizeof(path), "%s/%d/stat", root, pid);
+        assert(unlink(path) == 0);
+        snprintf(path, sizeof(path), "%s/%d", root, pid);
+        assert(rmdir(path) == 0);
+    }
+    snprintf(path, sizeof(path), "%s/sys", root);
+    assert(rmdir(path) == 0);
+    assert(rmdir(root) == 0);
+}
+
+void test_proctop_main(void)
+{
+    test_proctop_invalid();
+    test_proctop_fixture(2);
+    test_proctop_fixture(0);
+}
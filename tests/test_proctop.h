@@ -0,0 +1,7 @@
+
+#ifndef CPU_USAGE_TRACKER_TEST_PROCTOP_H
+#define CPU_USAGE_TRACKER_TEST_PROCTOP_H
+
+void test_proctop_main(void);
+
+#endif //CPU_USAGE_TRACKER_TEST_PROCTOP_H
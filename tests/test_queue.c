@@ -1,5 +1,8 @@
 #include <assert.h>
 #include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "../reader.h"
 #include "../queue.h"
@@ -14,6 +17,10 @@
  * - Dequeue
  * - Multiple enqueue and dequeue
  * - Behaviour when enqueueing and dequeue structure used in program
+ * - Lock-free queue - order, full/empty and timeouts
+ * - Lock-free queue with many producers and consumers - every element exactly once
+ * - Every wait strategy on both kinds - every element exactly once, waits measured
+ * - Close - waiting dequeue wakes up, queued elements are still drained
  */
 static void test_queue_create(void);
 static void test_queue_delete(void);
@@ -22,8 +29,19 @@ static void test_queue_dequeue(void);
 static void test_queue_enqueue(void);
 static void test_queue_multiple_enqueue_dequeue(void);
 static void test_queue_with_cpurawstats(void);
+static void test_queue_lockfree(void);
+static void test_queue_lockfree_mpmc(void);
+static void test_queue_wait_strategies(void);
+static void test_queue_close(void);
+static void test_queue_run_mpmc(Queue* q, size_t no_elements);
 
 enum{timeout=2};
+enum{MPMC_PRODUCERS = 4, MPMC_CONSUMERS = 2, MPMC_ELEMENTS = 20000, STRATEGY_ELEMENTS = 200};
+
+typedef struct MpmcTest{
+    Queue* q;
+    size_t no_elements;     // per producer
+} MpmcTest;
 
 static void test_queue_create(void)
 {
@@ -196,6 +214,169 @@ static void test_queue_with_cpurawstats(void)
     queue_delete(q);
 }
 
+static void test_queue_lockfree(void)
+{
+    Queue* const q = queue_create(QUEUE_LOCKFREE, 3, sizeof(size_t));
+    assert(q != NULL);
+    assert(queue_create(QUEUE_LOCKFREE, 0, sizeof(size_t)) == NULL);
+    size_t val = 0;
+
+    assert(queue_is_empty(q));
+    assert(!queue_is_full(q));
+    assert(queue_dequeue(q, &val, 0) == QTIMEOUT);
+    // Go around the buffer a few times
+    for (size_t lap = 0; lap < 3; lap++)
+    {
+        for (size_t i = 0; i < 3; i++)
+        {
+            const size_t in = lap * 10 + i;
+            assert(queue_enqueue(q, (void*)&in, timeout) == QSUCCESS);
+        }
+        assert(queue_is_full(q));
+        assert(queue_enqueue(q, &val, 0) == QTIMEOUT);
+        for (size_t i = 0; i < 3; i++)
+        {
+            assert(queue_dequeue(q, &val, timeout) == QSUCCESS);
+            assert(val == lap * 10 + i);
+        }
+        assert(queue_is_empty(q));
+    }
+    queue_delete(q);
+}
+
+static void* test_queue_mpmc_producer(void* args)
+{
+    const MpmcTest* const t = args;
+    for (size_t i = 1; i <= t->no_elements; i++)
+        assert(queue_enqueue(t->q, &i, timeout) == QSUCCESS);
+    return NULL;
+}
+
+static void* test_queue_mpmc_consumer(void* args)
+{
+    const MpmcTest* const t = args;
+    size_t* const sum = malloc(sizeof(*sum));
+    assert(sum != NULL);
+    *sum = 0;
+    size_t val;
+    for (size_t i = 0; i < MPMC_PRODUCERS * t->no_elements / MPMC_CONSUMERS; i++)
+    {
+        assert(queue_dequeue(t->q, &val, timeout) == QSUCCESS);
+        *sum += val;
+    }
+    return sum;
+}
+
+static void test_queue_lockfree_mpmc(void)
+{
+    Queue* const q = queue_create(QUEUE_LOCKFREE, 8, sizeof(size_t));
+    test_queue_run_mpmc(q, MPMC_ELEMENTS);
+    queue_delete(q);
+}
+
+static void test_queue_run_mpmc(Queue* const q, const size_t no_elements)
+{
+    MpmcTest t = {.q = q, .no_elements = no_elements};
+    pthread_t producers[MPMC_PRODUCERS];
+    pthread_t consumers[MPMC_CONSUMERS];
+    for (size_t i = 0; i < MPMC_CONSUMERS; i++)
+        assert(pthread_create(&consumers[i], NULL, test_queue_mpmc_consumer, &t) == 0);
+    for (size_t i = 0; i < MPMC_PRODUCERS; i++)
+        assert(pthread_create(&producers[i], NULL, test_queue_mpmc_producer, &t) == 0);
+    for (size_t i = 0; i < MPMC_PRODUCERS; i++)
+        assert(pthread_join(producers[i], NULL) == 0);
+    size_t total = 0;
+    for (size_t i = 0; i < MPMC_CONSUMERS; i++)
+    {
+        void* sum;
+        assert(pthread_join(consumers[i], &sum) == 0);
+        total += *(size_t*)sum;
+        free(sum);
+    }
+    assert(total == MPMC_PRODUCERS * no_elements * (no_elements + 1) / 2);
+    assert(queue_is_empty(q));
+}
+
+static void test_queue_wait_strategies(void)
+{
+    const QueueWaitStrategy strategies[] = {QUEUE_WAIT_BLOCK, QUEUE_WAIT_SPIN, QUEUE_WAIT_YIELD, QUEUE_WAIT_PARK};
+    const QueueKind kinds[] = {QUEUE_MUTEX, QUEUE_LOCKFREE};
+    QueueWaitStats stats;
+
+    assert(!queue_set_wait(NULL, QUEUE_WAIT_PARK, 10));
+    for (size_t k = 0; k < 2; k++)
+    {
+        for (size_t i = 0; i < sizeof(strategies)/sizeof(strategies[0]); i++)
+        {
+            Queue* const q = queue_create(kinds[k], 8, sizeof(size_t));
+            assert(queue_set_wait(q, strategies[i], 100));
+            queue_get_wait_stats(q, &stats);
+            assert(stats.waits == 0);
+
+            // Empty queue - the wait times out and is measured
+            size_t val;
+            assert(queue_dequeue(q, &val, 0) == QTIMEOUT);
+            queue_get_wait_stats(q, &stats);
+            assert(stats.waits == 1);
+
+            // Busy-spinning threads share the cpu with the ones they wait for - fewer elements
+            test_queue_run_mpmc(q, STRATEGY_ELEMENTS);
+            queue_delete(q);
+        }
+    }
+}
+
+static void* test_queue_close_consumer(void* args)
+{
+    Queue* const q = args;
+    int value;
+    QueueErrorCode* const ret = malloc(sizeof(*ret));
+    assert(ret != NULL);
+    *ret = queue_dequeue(q, &value, 10);
+    return ret;
+}
+
+static void test_queue_close(void)
+{
+    const QueueKind kinds[] = {QUEUE_MUTEX, QUEUE_LOCKFREE};
+    const QueueWaitStrategy strategies[] = {QUEUE_WAIT_BLOCK, QUEUE_WAIT_PARK};
+    for (size_t k = 0; k < 2; k++)
+    {
+        for (size_t s = 0; s < 2; s++)
+        {
+            Queue* q = queue_create(kinds[k], 4, sizeof(int));
+            assert(q != NULL);
+            assert(queue_set_wait(q, strategies[s], 100));
+
+            // Waiting consumer wakes up long before its 10 s timeout
+            pthread_t consumer;
+            assert(pthread_create(&consumer, NULL, test_queue_close_consumer, q) == 0);
+            usleep(20000);
+            const time_t start = time(NULL);
+            queue_close(q);
+            QueueErrorCode* ret;
+            assert(pthread_join(consumer, (void**)&ret) == 0);
+            assert(*ret == QCLOSED);
+            assert(time(NULL) - start <= 1);
+            free(ret);
+            queue_delete(q);
+
+            // Queued elements are still drained after close
+            q = queue_create(kinds[k], 4, sizeof(int));
+            assert(q != NULL);
+            int value = 1;
+            assert(queue_enqueue(q, &value, 1) == QSUCCESS);
+            value = 2;
+            assert(queue_enqueue(q, &value, 1) == QSUCCESS);
+            queue_close(q);
+            assert(queue_dequeue(q, &value, 1) == QSUCCESS && value == 1);
+            assert(queue_dequeue(q, &value, 1) == QSUCCESS && value == 2);
+            assert(queue_dequeue(q, &value, 1) == QCLOSED);
+            queue_delete(q);
+        }
+    }
+}
+
 void test_queue_main(void)
 {
     test_queue_create();
@@ -205,4 +386,8 @@ void test_queue_main(void)
     test_queue_dequeue();
     test_queue_multiple_enqueue_dequeue();
     test_queue_with_cpurawstats();
+    test_queue_lockfree();
+    test_queue_lockfree_mpmc();
+    test_queue_wait_strategies();
+    test_queue_close();
 }
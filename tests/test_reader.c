@@ -1,16 +1,62 @@
 #include <assert.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include "test_reader.h"
 #include "../reader.h"
 
 static void test_reader_get_no_cpus(void);
+static void test_reader_get_sockets(void);
 
 static void test_reader_get_no_cpus(void){
     // AMD Ryzen 7 4800HS - 1 socket * 8 cores per socket * 2 threads per core = 16 CPU(s)
     assert(reader_get_no_cpus() == 16);
 }
 
+static void test_reader_get_sockets(void)
+{
+    // Package ids 3 and 0, cpu3 has no topology and joins the socket of cpu0
+    const char* const ids[3] = {"3\n", "3\n", "0\n"};
+    char root[] = "/tmp/cut_test_topology_XXXXXX";
+    char path[256];
+    assert(mkdtemp(root) != NULL);
+    for (size_t j = 0; j < 4; j++)
+    {
+        snprintf(path, sizeof(path), "%s/cpu%zu", root, j);
+        assert(mkdir(path, 0755) == 0);
+        if(j == 3)
+            continue;
+        snprintf(path, sizeof(path), "%s/cpu%zu/topology", root, j);
+        assert(mkdir(path, 0755) == 0);
+        snprintf(path, sizeof(path), "%s/cpu%zu/topology/physical_package_id", root, j);
+        FILE* const f = fopen(path, "w");
+        assert(f != NULL);
+        fputs(ids[j], f);
+        fclose(f);
+    }
+    uint16_t socket_of[4];
+    assert(reader_get_sockets(root, socket_of, 4) == 2);
+    assert(socket_of[0] == 0 && socket_of[1] == 0 && socket_of[2] == 1 && socket_of[3] == 0);
+    assert(reader_get_sockets("/tmp/cut_test_topology_missing", socket_of, 4) == 0);
+    assert(reader_get_sockets(root, NULL, 4) == 0 && reader_get_sockets(root, socket_of, 0) == 0);
+
+    for (size_t j = 0; j < 4; j++)
+    {
+        if(j != 3)
+        {
+            snprintf(path, sizeof(path), "%s/cpu%zu/topology/physical_package_id", root, j);
+            assert(unlink(path) == 0);
+            snprintf(path, sizeof(path), "%s/cpu%zu/topology", root, j);
+            assert(rmdir(path) == 0);
+        }
+        snprintf(path, sizeof(path), "%s/cpu%zu", root, j);
+        assert(rmdir(path) == 0);
+    }
+    assert(rmdir(root) == 0);
+}
+
 static void test_reader_load_data(void)
 {
     CPURawStats data = reader_load_data(reader_get_no_cpus()); // Just checking if it won't crash
@@ -18,6 +64,7 @@ static void test_reader_load_data(void)
 }
 
 void test_reader_main(void){
+    test_reader_get_sockets();
     test_reader_get_no_cpus();
     test_reader_load_data();
 }
@@ -0,0 +1,59 @@
+#include <assert.h>
+#include <stdio.h>
+
+#include "../shmpub.h"
+#include "../cutshm.h"
+#include "test_shm.h"
+
+/*
+ * TESTS:
+ * - Open of not existing segment
+ * - Nothing published yet
+ * - Publish and read back
+ */
+static void test_shm_open_missing(void);
+static void test_shm_publish_read(void);
+
+static void test_shm_open_missing(void)
+{
+    CutShmClient client;
+    assert(cutshm_open(&client, "/cut_test_missing") == -1);
+    assert(shmpub_create(NULL, 2) == NULL);
+    shmpub_delete(NULL);
+}
+
+static void test_shm_publish_read(void)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "/cut_test_%d", (int)getpid());
+    ShmPublisher* pub = shmpub_create(name, 2);
+    assert(pub != NULL);
+
+    CutShmClient client;
+    CutShmSample sample;
+    double cores[4] = {0};
+    assert(cutshm_open(&client, name) == 0);
+    assert(!cutshm_read(&client, &sample, cores, 4));
+
+    uint16_t published[2] = {1250, 9900};
+    UsagePercentage data = {.total_bp = 5575, .cores_bp = published, .effective_bp = 4100};
+    shmpub_publish(pub, &data);
+    shmpub_publish(pub, &data);
+
+    assert(cutshm_read(&client, &sample, cores, 4));
+    assert(sample.sample_no == 2);
+    assert(sample.no_cpus == 2);
+    assert(sample.total_pr == 55.75 && sample.effective_pr == 41.0);
+    assert(cores[0] == 12.5 && cores[1] == 99.0 && cores[2] == 0);
+    assert(sample.timestamp_ns != 0);
+
+    cutshm_close(&client);
+    shmpub_delete(pub);
+    assert(cutshm_open(&client, name) == -1);
+}
+
+void test_shm_main(void)
+{
+    test_shm_open_missing();
+    test_shm_publish_read();
+}
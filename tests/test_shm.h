@@ -0,0 +1,7 @@
+
+#ifndef CPU_USAGE_TRACKER_TEST_SHM_H
+#define CPU_USAGE_TRACKER_TEST_SHM_H
+
+void test_shm_main(void);
+
+#endif //CPU_USAGE_TRACKER_TEST_SHM_H
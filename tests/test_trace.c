@@ -0,0 +1,110 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "../trace.h"
+#include "test_trace.h"
+
+/*
+ * TESTS:
+ * - Spans and flows of two threads are written with thread names, flow ends share the id
+ * - Events before start and after finish are not recorded
+ * - Without -DCUT_TRACE=ON trace does not start and the macros compile to nothing
+ */
+#ifdef CUT_TRACE
+static void test_trace_record(void);
+static void test_trace_off(void);
+
+static void* test_trace_consumer(void* args)
+{
+    const uint64_t id = *(const uint64_t*)args;
+    TRACE_THREAD("consumer");
+    TRACE_BEGIN(span);
+    TRACE_FLOW_END("item", id);
+    TRACE_END(span, "consume");
+    return NULL;
+}
+
+static char* test_trace_load(const char* const path)
+{
+    FILE* const f = fopen(path, "r");
+    assert(f != NULL);
+    char* const text = calloc(1, 1 << 16);
+    assert(fread(text, 1, (1 << 16) - 1, f) > 0);
+    fclose(f);
+    return text;
+}
+
+static size_t test_trace_count(const char* text, const char* const needle)
+{
+    size_t n = 0;
+    while((text = strstr(text, needle)) != NULL)
+    {
+        n++;
+        text++;
+    }
+    return n;
+}
+
+static void test_trace_record(void)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/cut_test_trace_%d.json", getpid());
+    TRACE_BEGIN(early);
+    assert(TRACE_START(path));
+    assert(!TRACE_START(path));      // already started
+    TRACE_END(early, "early");        // begun before the start
+
+    uint64_t id = 0x1234abcdull;
+    TRACE_THREAD("producer");
+    TRACE_BEGIN(span);
+    TRACE_FLOW_START("item", id);
+    TRACE_END(span, "produce");
+    pthread_t th;
+    assert(pthread_create(&th, NULL, test_trace_consumer, &id) == 0);
+    assert(pthread_join(th, NULL) == 0);
+    TRACE_FINISH();
+    TRACE_BEGIN(late);
+    TRACE_END(late, "late");
+
+    char* const text = test_trace_load(path);
+    assert(strncmp(text, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", 38) == 0);
+    assert(strstr(text, "\n]}\n") != NULL);
+    assert(test_trace_count(text, "\"ph\":\"X\"") == 2);
+    assert(strstr(text, "\"name\":\"produce\"") != NULL && strstr(text, "\"name\":\"consume\"") != NULL);
+    assert(strstr(text, "\"args\":{\"name\":\"producer\"}") != NULL);
+    assert(strstr(text, "\"args\":{\"name\":\"consumer\"}") != NULL);
+    assert(test_trace_count(text, "\"id\":\"0x1234abcd\"") == 2);
+    assert(strstr(text, "\"ph\":\"s\",\"id\"") != NULL && strstr(text, "\"ph\":\"f\",\"bp\":\"e\",\"id\"") != NULL);
+    assert(strstr(text, "early") == NULL && strstr(text, "late") == NULL);
+    free(text);
+    unlink(path);
+}
+
+static void test_trace_off(void)
+{
+    // Not started - nothing recorded, nothing written
+    TRACE_BEGIN(span);
+    TRACE_END(span, "off");
+    TRACE_FINISH();
+    assert(trace_now_ns() == 0);
+}
+
+void test_trace_main(void)
+{
+    test_trace_off();
+    test_trace_record();
+}
+#else
+void test_trace_main(void)
+{
+    TRACE_BEGIN(span);
+    TRACE_FLOW_START("item", 1);
+    TRACE_END(span, "off");
+    assert(!TRACE_START("/tmp/cut_test_trace.json"));
+    TRACE_FINISH();
+}
+#endif //CUT_TRACE
@@ -0,0 +1,7 @@
+
+#ifndef CPU_USAGE_TRACKER_TEST_TRACE_H
+#define CPU_USAGE_TRACKER_TEST_TRACE_H
+
+void test_trace_main(void);
+
+#endif //CPU_USAGE_TRACKER_TEST_TRACE_H
@@ -0,0 +1,203 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "trace.h"
+
+enum{TRACE_BUFFER_EVENTS = 1 << 15};    // per thread, power of two - the oldest events are overwritten
+enum{TRACE_MAX_THREADS = 64};
+
+typedef enum TraceKind{
+    TRACE_KIND_SPAN,
+    TRACE_KIND_FLOW_START,
+    TRACE_KIND_FLOW_END
+} TraceKind;
+
+typedef struct TraceEvent{
+    const char* name;       // string literal of the call site
+    uint64_t ts_ns;
+    uint64_t arg;           // duration of a span, id of a flow
+    TraceKind kind;
+} TraceEvent;
+
+typedef struct TraceBuffer{
+    const char* thread_name;
+    long tid;
+    uint64_t next;          // events recorded, next & (TRACE_BUFFER_EVENTS - 1) is written next
+    TraceEvent events[TRACE_BUFFER_EVENTS];
+} TraceBuffer;
+
+static atomic_bool g_trace_on;
+static pthread_mutex_t g_trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+static TraceBuffer* g_trace_buffers[TRACE_MAX_THREADS];
+static size_t g_trace_no_buffers;
+static char* g_trace_path;
+static uint64_t g_trace_base_ns;
+
+static __thread TraceBuffer* t_trace_buffer;
+static __thread const char* t_trace_name;
+
+/**
+ * @return CLOCK_MONOTONIC time in nanoseconds, 0 when tracing is off.
+ */
+uint64_t trace_now_ns(void)
+{
+    if(!atomic_load_explicit(&g_trace_on, memory_order_relaxed))
+        return 0;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+/**
+ * Buffer of the calling thread, registered on its first event.
+ * @return NULL if allocation failed or too many threads.
+ */
+static TraceBuffer* trace_buffer(void)
+{
+    if(t_trace_buffer != NULL)
+        return t_trace_buffer;
+    TraceBuffer* const b = malloc(sizeof(TraceBuffer));
+    if(b == NULL)
+        return NULL;
+    b->thread_name = t_trace_name;
+    b->tid = syscall(SYS_gettid);
+    b->next = 0;
+    pthread_mutex_lock(&g_trace_mutex);
+    if(g_trace_no_buffers < TRACE_MAX_THREADS)
+        g_trace_buffers[g_trace_no_buffers++] = b;
+    else
+    {
+        free(b);
+        pthread_mutex_unlock(&g_trace_mutex);
+        return NULL;
+    }
+    pthread_mutex_unlock(&g_trace_mutex);
+    t_trace_buffer = b;
+    return b;
+}
+
+static void trace_record(const char* const name, const uint64_t ts_ns, const uint64_t arg, const TraceKind kind)
+{
+    TraceBuffer* const b = trace_buffer();
+    if(b == NULL)
+        return;
+    b->events[b->next++ & (TRACE_BUFFER_EVENTS - 1)] = (TraceEvent){.name = name, .ts_ns = ts_ns, .arg = arg,
+                                                                    .kind = kind};
+}
+
+/**
+ * Names the calling thread in the trace, may be called before trace_start.
+ * @param name - string literal
+ */
+void trace_thread(const char* const name)
+{
+    t_trace_name = name;
+    if(t_trace_buffer != NULL)
+        t_trace_buffer->thread_name = name;
+}
+
+/**
+ * Records a span that ends now.
+ * @param name - string literal
+ * @param begin_ns - trace_now_ns at the beginning, spans begun while tracing was off are dropped
+ */
+void trace_span(const char* const name, const uint64_t begin_ns)
+{
+    const uint64_t end_ns = trace_now_ns();
+    if(begin_ns < g_trace_base_ns || end_ns == 0)
+        return;
+    trace_record(name, begin_ns, end_ns - begin_ns, TRACE_KIND_SPAN);
+}
+
+/**
+ * Records one end of a flow, binds to the span of the calling thread that encloses this moment.
+ * @param name - string literal, start and end of one flow use the same
+ * @param id - identifies the item passed between the threads
+ * @param start - true at the sending side, false at the receiving side
+ */
+void trace_flow(const char* const name, const uint64_t id, const bool start)
+{
+    const uint64_t now = trace_now_ns();
+    if(now == 0)
+        return;
+    trace_record(name, now, id, start ? TRACE_KIND_FLOW_START : TRACE_KIND_FLOW_END);
+}
+
+/**
+ * Starts recording, the trace is written by trace_finish.
+ * @param path - output JSON file
+ * @return False on allocation error or if already started.
+ */
+bool trace_start(const char* const path)
+{
+    if(path == NULL || g_trace_path != NULL)
+        return false;
+    g_trace_path = malloc(strlen(path) + 1);
+    if(g_trace_path == NULL)
+        return false;
+    strcpy(g_trace_path, path);
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    g_trace_base_ns = (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+    atomic_store(&g_trace_on, true);
+    return true;
+}
+
+static void trace_write_event(FILE* const f, const pid_t pid, const TraceBuffer* const b, const TraceEvent* const e)
+{
+    const double ts_us = (double)(e->ts_ns - g_trace_base_ns) / 1e3;
+    if(e->kind == TRACE_KIND_SPAN)
+        fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"cut\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%ld}",
+                e->name, ts_us, (double)e->arg / 1e3, pid, b->tid);
+    else
+        fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%s,\"id\":\"0x%" PRIx64 "\",\"ts\":%.3f,\"pid\":%d,"
+                "\"tid\":%ld}", e->name, e->name, e->kind == TRACE_KIND_FLOW_START ? "s\"" : "f\",\"bp\":\"e\"",
+                e->arg, ts_us, pid, b->tid);
+}
+
+/**
+ * Stops recording and writes the trace of every thread. Threads that recorded must not record anymore -
+ * call after they are joined.
+ */
+void trace_finish(void)
+{
+    if(g_trace_path == NULL)
+        return;
+    atomic_store(&g_trace_on, false);
+    FILE* const f = fopen(g_trace_path, "w");
+    const pid_t pid = getpid();
+    if(f != NULL)
+        fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n"
+                   "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"CUT\"}}", pid);
+    pthread_mutex_lock(&g_trace_mutex);
+    for (size_t i = 0; i < g_trace_no_buffers; i++)
+    {
+        TraceBuffer* const b = g_trace_buffers[i];
+        if(f != NULL && b->thread_name != NULL)
+            fprintf(f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%ld,\"args\":{\"name\":\"%s\"}}",
+                    pid, b->tid, b->thread_name);
+        const uint64_t first = b->next > TRACE_BUFFER_EVENTS ? b->next - TRACE_BUFFER_EVENTS : 0;
+        for (uint64_t j = first; f != NULL && j < b->next; j++)
+            trace_write_event(f, pid, b, &b->events[j & (TRACE_BUFFER_EVENTS - 1)]);
+        free(b);
+    }
+    g_trace_no_buffers = 0;
+    pthread_mutex_unlock(&g_trace_mutex);
+    t_trace_buffer = NULL;
+    if(f != NULL)
+    {
+        fprintf(f, "\n]}\n");
+        fclose(f);
+    }
+    else
+        perror("Trace file open error");
+    free(g_trace_path);
+    g_trace_path = NULL;
+}
@@ -0,0 +1,46 @@
+
+#ifndef CPU_USAGE_TRACKER_TRACE_H
+#define CPU_USAGE_TRACKER_TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Pipeline trace in the Chrome trace event format - the dump loads in Perfetto (ui.perfetto.dev) and
+ * chrome://tracing. Compiled in only with -DCUT_TRACE=ON, otherwise every TRACE_ macro expands to nothing.
+ *
+ * Every thread records into its own buffer - no lock and no shared cache line on the hot path, an event is one
+ * clock read and one store. A sample handed to the next stage is tied to it by a flow event, the id of the flow
+ * is the timestamp the sample already carries.
+ */
+
+#ifdef CUT_TRACE
+
+bool trace_start(const char* path);
+void trace_finish(void);
+void trace_thread(const char* name);
+uint64_t trace_now_ns(void);
+void trace_span(const char* name, uint64_t begin_ns);
+void trace_flow(const char* name, uint64_t id, bool start);
+
+#define TRACE_START(path) trace_start(path)
+#define TRACE_FINISH() trace_finish()
+#define TRACE_THREAD(name) trace_thread(name)
+#define TRACE_BEGIN(span) const uint64_t span = trace_now_ns()
+#define TRACE_END(span, name) trace_span(name, span)
+#define TRACE_FLOW_START(name, id) trace_flow(name, id, true)
+#define TRACE_FLOW_END(name, id) trace_flow(name, id, false)
+
+#else
+
+#define TRACE_START(path) false
+#define TRACE_FINISH() ((void)0)
+#define TRACE_THREAD(name) ((void)0)
+#define TRACE_BEGIN(span) ((void)0)
+#define TRACE_END(span, name) ((void)0)
+#define TRACE_FLOW_START(name, id) ((void)0)
+#define TRACE_FLOW_END(name, id) ((void)0)
+
+#endif //CUT_TRACE
+
+#endif //CPU_USAGE_TRACKER_TRACE_H
@@ -0,0 +1,454 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+
+#include "wire.h"
+
+enum{WIRE_VARINT_MAX = 10};
+enum{WIRE_VALUE_MAX = 3};       // zigzag of a basis point difference fits in 21 bits
+
+/**
+ *  VARINTS ARE WRITTEN THROUGH A CURSOR THAT STOPS AT THE END OF THE OUTPUT - AN ENCODER CHECKS THE CURSOR
+ *  ONCE AT THE END INSTEAD OF AFTER EVERY FIELD. THE BODY LENGTH IS PATCHED INTO THE HEADER WHEN THE FRAME IS
+ *  COMPLETE.
+ */
+typedef struct WireCursor{
+    uint8_t* pos;
+    uint8_t* end;
+    bool overflow;
+} WireCursor;
+
+static void wire_put_byte(WireCursor* const c, const uint8_t byte)
+{
+    if(c->pos == c->end)
+    {
+        c->overflow = true;
+        return;
+    }
+    *c->pos++ = byte;
+}
+
+static void wire_put_varint(WireCursor* const c, uint64_t value)
+{
+    while(value >= 0x80)
+    {
+        wire_put_byte(c, (uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    wire_put_byte(c, (uint8_t)value);
+}
+
+static uint32_t wire_zigzag(const int32_t value)
+{
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static int32_t wire_unzigzag(const uint32_t value)
+{
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+/**
+ * Reads one varint.
+ * @return False if the varint is truncated or longer than 64 bits.
+ */
+static bool wire_get_varint(const uint8_t** const pos, const uint8_t* const end, uint64_t* const value)
+{
+    *value = 0;
+    for (unsigned shift = 0; shift < 64 && *pos < end; shift += 7)
+    {
+        const uint8_t byte = *(*pos)++;
+        *value |= (uint64_t)(byte & 0x7f) << shift;
+        if((byte & 0x80) == 0)
+            return true;
+    }
+    return false;
+}
+
+/**
+ * Writes frame header, the body length is filled in by wire_finish.
+ */
+static WireCursor wire_start(uint8_t* const out, const size_t size, const WireType type)
+{
+    WireCursor c = {.pos = out, .end = out + size};
+    wire_put_byte(&c, 0);
+    wire_put_byte(&c, 0);
+    wire_put_byte(&c, (uint8_t)type);
+    return c;
+}
+
+/**
+ * @return Length of the complete frame, 0 if it did not fit.
+ */
+static size_t wire_finish(const WireCursor* const c, uint8_t* const out)
+{
+    const size_t len = (size_t)(c->pos - out);
+    if(c->overflow || len - WIRE_HEADER_LEN > UINT16_MAX)
+        return 0;
+    out[0] = (uint8_t)((len - WIRE_HEADER_LEN) & 0xff);
+    out[1] = (uint8_t)((len - WIRE_HEADER_LEN) >> 8);
+    return len;
+}
+
+/**
+ * @return Size of the buffer that fits any frame of a host with no_cpus cpus.
+ */
+size_t wire_max_frame(const size_t no_cpus)
+{
+    return WIRE_HEADER_LEN + 1 + 4 * WIRE_VARINT_MAX + 1 + WIRE_NAME_LEN + (no_cpus + 1) * WIRE_VALUE_MAX;
+}
+
+/**
+ * Initializes encoder of one stream, first frame is a key frame.
+ * @param host_id - identifier of the host in the fleet
+ * @param no_cpus - number of cpus in every sample, up to WIRE_MAX_CPUS
+ * @return False on invalid arguments or allocation failure.
+ */
+bool wire_encoder_init(WireEncoder* const enc, const uint32_t host_id, const size_t no_cpus)
+{
+    if(enc == NULL || no_cpus == 0 || no_cpus > WIRE_MAX_CPUS)
+        return false;
+    *enc = (WireEncoder){.host_id = host_id, .no_values = no_cpus + 1, .need_key = true};
+    enc->prev = calloc(enc->no_values, sizeof(uint16_t));
+    return enc->prev != NULL;
+}
+
+void wire_encoder_destroy(WireEncoder* const enc)
+{
+    if(enc == NULL)
+        return;
+    free(enc->prev);
+    enc->prev = NULL;
+}
+
+/**
+ * Next frame is a key frame - used when the receiver lost the stream (reconnect).
+ */
+void wire_encoder_reset(WireEncoder* const enc)
+{
+    enc->need_key = true;
+}
+
+/**
+ * Encodes HELLO frame introducing the host.
+ * @param name - host name, truncated to WIRE_NAME_LEN - 1 bytes
+ * @param interval_ms - longest interval between samples of the host - the collector sees a silent host by it
+ * @return Length of the frame, 0 if out is too small.
+ */
+size_t wire_encode_hello(const WireEncoder* const enc, const char* const name, const uint32_t interval_ms,
+                         uint8_t* const out, const size_t size)
+{
+    size_t name_len = strlen(name);
+    if(name_len > WIRE_NAME_LEN - 1)
+        name_len = WIRE_NAME_LEN - 1;
+    WireCursor c = wire_start(out, size, WIRE_HELLO);
+    wire_put_varint(&c, enc->host_id);
+    wire_put_varint(&c, enc->no_values - 1);
+    wire_put_varint(&c, interval_ms);
+    wire_put_byte(&c, (uint8_t)name_len);
+    for (size_t i = 0; i < name_len; i++)
+        wire_put_byte(&c, (uint8_t)name[i]);
+    return wire_finish(&c, out);
+}
+
+/**
+ * Encodes SAMPLE frame, differences to the previous frame unless a key frame is due.
+ * The encoder state only advances when the frame fits, a frame that is not sent must not be encoded.
+ * @param timestamp_ms - wall clock time of the sample
+ * @param total_bp - total usage
+ * @param effective_bp - total usage scaled by the frequency of the cores
+ * @param cores_bp - usage of every cpu
+ * @return Length of the frame, 0 if out is too small.
+ */
+size_t wire_encode_sample(WireEncoder* const enc, const uint64_t timestamp_ms, const uint16_t total_bp,
+                          const uint16_t effective_bp, const uint16_t* const cores_bp, uint8_t* const out,
+                          const size_t size)
+{
+    const bool key = enc->need_key || enc->since_key + 1 >= WIRE_KEY_INTERVAL || timestamp_ms < enc->prev_ms;
+    WireCursor c = wire_start(out, size, WIRE_SAMPLE);
+    wire_put_byte(&c, key ? WIRE_KEY : 0);
+    wire_put_varint(&c, enc->host_id);
+    wire_put_varint(&c, key ? timestamp_ms : timestamp_ms - enc->prev_ms);
+    wire_put_varint(&c, effective_bp);
+    wire_put_varint(&c, enc->no_values);
+    for (size_t i = 0; i < enc->no_values; i++)
+    {
+        const uint16_t value = i == 0 ? total_bp : cores_bp[i - 1];
+        const int32_t base = key ? 0 : enc->prev[i];
+        wire_put_varint(&c, wire_zigzag((int32_t)value - base));
+    }
+    const size_t len = wire_finish(&c, out);
+    if(len == 0)
+        return 0;
+
+    enc->prev[0] = total_bp;
+    memcpy(enc->prev + 1, cores_bp, sizeof(uint16_t) * (enc->no_values - 1));
+    enc->prev_ms = timestamp_ms;
+    enc->since_key = key ? 0 : enc->since_key + 1;
+    enc->need_key = false;
+    return len;
+}
+
+/**
+ * Decodes one frame from the start of a receive buffer.
+ * @param in - received bytes
+ * @param len - number of received bytes
+ * @param msg - decoded frame, values point into in
+ * @return Length of the frame, 0 if it is not complete yet, -1 if the stream is malformed.
+ */
+long wire_decode(const uint8_t* const in, const size_t len, WireMessage* const msg)
+{
+    if(len < WIRE_HEADER_LEN)
+        return 0;
+    const size_t body_len = (size_t)in[0] | (size_t)in[1] << 8;
+    if(len < WIRE_HEADER_LEN + body_len)
+        return 0;
+    const uint8_t* pos = in + WIRE_HEADER_LEN;
+    const uint8_t* const end = pos + body_len;
+    uint64_t host_id, value, interval_ms, effective_bp;
+
+    *msg = (WireMessage){.type = (WireType)in[2]};
+    switch(msg->type)
+    {
+        case WIRE_HELLO:
+            if(!wire_get_varint(&pos, end, &host_id) || !wire_get_varint(&pos, end, &value) ||
+               value == 0 || value > WIRE_MAX_CPUS || !wire_get_varint(&pos, end, &interval_ms) ||
+               interval_ms > UINT32_MAX || pos == end)
+                return -1;
+            msg->no_values = (uint32_t)value;
+            msg->interval_ms = (uint32_t)interval_ms;
+            const size_t name_len = *pos++;
+            if(name_len >= WIRE_NAME_LEN || (size_t)(end - pos) < name_len)
+                return -1;
+            memcpy(msg->name, pos, name_len);
+            msg->name[name_len] = '\0';
+            break;
+        case WIRE_SAMPLE:
+            if(pos == end)
+                return -1;
+            msg->key = (*pos++ & WIRE_KEY) != 0;
+            if(!wire_get_varint(&pos, end, &host_id) || !wire_get_varint(&pos, end, &msg->timestamp) ||
+               !wire_get_varint(&pos, end, &effective_bp) || effective_bp > UINT16_MAX ||
+               !wire_get_varint(&pos, end, &value) || value < 2 || value > WIRE_MAX_CPUS + 1)
+                return -1;
+            msg->effective_bp = (uint16_t)effective_bp;
+            msg->no_values = (uint32_t)value;
+            msg->values = pos;
+            msg->values_len = (size_t)(end - pos);
+            break;
+        default:
+            return -1;
+    }
+    if(host_id > UINT32_MAX)
+        return -1;
+    msg->host_id = (uint32_t)host_id;
+    return (long)(WIRE_HEADER_LEN + body_len);
+}
+
+/**
+ * Applies values of a decoded sample to the previous values of its stream.
+ * @param values - values of the previous frame (anything for a key frame), total first; updated in place
+ * @param no_values - size of values, must match the frame
+ * @return False if the values are malformed, values are left unchanged then.
+ */
+bool wire_apply_values(const WireMessage* const msg, uint16_t* const values, const size_t no_values)
+{
+    if(msg->type != WIRE_SAMPLE || msg->no_values != no_values)
+        return false;
+    // Validate first - a malformed frame must not leave the table half updated
+    const uint8_t* pos = msg->values;
+    const uint8_t* const end = msg->values + msg->values_len;
+    uint64_t value;
+    for (size_t i = 0; i < no_values; i++)
+    {
+        if(!wire_get_varint(&pos, end, &value) || value > UINT32_MAX)
+            return false;
+        const int32_t next = (msg->key ? 0 : values[i]) + wire_unzigzag((uint32_t)value);
+        if(next < 0 || next > UINT16_MAX)
+            return false;
+    }
+    pos = msg->values;
+    for (size_t i = 0; i < no_values; i++)
+    {
+        wire_get_varint(&pos, end, &value);
+        values[i] = (uint16_t)((msg->key ? 0 : values[i]) + wire_unzigzag((uint32_t)value));
+    }
+    return true;
+}
+
+/**
+ * Splits "HOST:PORT" or ":PORT"/"PORT" into host and port, anything containing '/' is a unix socket path.
+ * @return False if addr is a unix socket path.
+ */
+static bool wire_split(const char* const addr, char* const host, const size_t size, const char** const port)
+{
+    if(strchr(addr, '/') != NULL)
+        return false;
+    const char* const colon = strrchr(addr, ':');
+    host[0] = '\0';
+    *port = addr;
+    if(colon != NULL)
+    {
+        const size_t len = (size_t)(colon - addr) < size - 1 ? (size_t)(colon - addr) : size - 1;
+        memcpy(host, addr, len);
+        host[len] = '\0';
+        *port = colon + 1;
+    }
+    return true;
+}
+
+/**
+ * Resolves a unix path or the first address of host and port. Name lookup may block - done once at startup.
+ * @param addr - unix socket path or HOST:PORT
+ * @return False if the address cannot be resolved.
+ */
+bool wire_resolve(const char* const addr, WireAddr* const out)
+{
+    char host[256];
+    const char* port;
+    if(addr == NULL || addr[0] == '\0' || out == NULL)
+        return false;
+    memset(out, 0, sizeof(*out));
+    if(!wire_split(addr, host, sizeof(host), &port))
+    {
+        struct sockaddr_un* const sun = (struct sockaddr_un*)&out->addr;
+        if(strlen(addr) >= sizeof(sun->sun_path))
+            return false;
+        sun->sun_family = AF_UNIX;
+        strcpy(sun->sun_path, addr);
+        out->len = sizeof(*sun);
+        return true;
+    }
+    struct addrinfo hints = {.ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM};
+    struct addrinfo* list;
+    if(getaddrinfo(host[0] != '\0' ? host : NULL, port, &hints, &list) != 0)
+        return false;
+    const bool ok = list->ai_addrlen <= sizeof(out->addr);
+    if(ok)
+    {
+        memcpy(&out->addr, list->ai_addr, list->ai_addrlen);
+        out->len = list->ai_addrlen;
+    }
+    freeaddrinfo(list);
+    return ok;
+}
+
+/**
+ * Starts a non-blocking connect to the collector, it never waits for the peer.
+ * @param addr - resolved by wire_resolve
+ * @param pending - set to true if the connect goes on in the background, see wire_connect_result
+ * @return Non-blocking socket, -1 on error.
+ */
+int wire_connect(const WireAddr* const addr, bool* const pending)
+{
+    *pending = false;
+    const int fd = socket(addr->addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(fd < 0)
+        return -1;
+    if(connect(fd, (const struct sockaddr*)&addr->addr, addr->len) == 0)
+        return fd;
+    if(errno == EINPROGRESS)
+    {
+        *pending = true;
+        return fd;
+    }
+    close(fd);      // EAGAIN of a unix socket - the backlog of the listener is full
+    return -1;
+}
+
+/**
+ * Checks a pending connect without waiting.
+ * @return 0 once connected, EINPROGRESS while pending, errno of the failed connect otherwise.
+ */
+int wire_connect_result(const int fd)
+{
+    struct pollfd pfd = {.fd = fd, .events = POLLOUT};
+    if(poll(&pfd, 1, 0) == 0)
+        return EINPROGRESS;
+    int err = 0;
+    socklen_t len = sizeof(err);
+    if(getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) != 0)
+        return errno;
+    return err;
+}
+
+/**
+ * Removes a socket left at the path by a previous run. Anything else stays - a mistyped path must not delete a file.
+ * @return False if the path exists and is not a socket.
+ */
+static bool wire_unlink_socket(const char* const path)
+{
+    struct stat st;
+    if(lstat(path, &st) != 0)
+        return errno == ENOENT;
+    if(!S_ISSOCK(st.st_mode))
+    {
+        errno = EEXIST;
+        return false;
+    }
+    return unlink(path) == 0 || errno == ENOENT;
+}
+
+/**
+ * Creates non-blocking listening socket of the collector, bound to the first usable address.
+ * @param addr - unix socket path (replaced if it is a socket, other files are not touched), PORT for every
+ *               interface or HOST:PORT
+ * @return Socket, -1 on error.
+ */
+int wire_listen(const char* const addr)
+{
+    char host[256];
+    const char* port;
+    if(addr == NULL || addr[0] == '\0')
+        return -1;
+    int fd = -1;
+    if(!wire_split(addr, host, sizeof(host), &port))
+    {
+        WireAddr sun;
+        if(!wire_resolve(addr, &sun))
+            return -1;
+        if(!wire_unlink_socket(addr))
+            return -1;
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if(fd < 0)
+            return -1;
+        if(bind(fd, (const struct sockaddr*)&sun.addr, sun.len) != 0)
+        {
+            close(fd);
+            return -1;
+        }
+    }
+    else
+    {
+        struct addrinfo hints = {.ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM, .ai_flags = AI_PASSIVE};
+        struct addrinfo* list;
+        if(getaddrinfo(host[0] != '\0' ? host : NULL, port, &hints, &list) != 0)
+            return -1;
+        for (const struct addrinfo* ai = list; ai != NULL && fd < 0; ai = ai->ai_next)
+        {
+            fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, ai->ai_protocol);
+            if(fd < 0)
+                continue;
+            const int one = 1;
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            if(bind(fd, ai->ai_addr, ai->ai_addrlen) != 0)
+            {
+                close(fd);
+                fd = -1;
+            }
+        }
+        freeaddrinfo(list);
+    }
+    if(fd >= 0 && listen(fd, 512) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
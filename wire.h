@@ -0,0 +1,80 @@
+
+#ifndef CPU_USAGE_TRACKER_WIRE_H
+#define CPU_USAGE_TRACKER_WIRE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/socket.h>
+
+/**
+ * Binary protocol between agents and the fleet collector. Every frame is
+ *     [u16 body length, little endian][u8 type][body]
+ * Integers in the body are LEB128 varints, signed ones zigzag encoded.
+ *     HELLO:  host id, number of cpus, longest interval between samples in ms, u8 name length, name
+ *     SAMPLE: u8 flags, host id, timestamp, effective usage, number of values, values
+ * Values are usage in basis points, total first. Effective usage is the total scaled by the frequency of the
+ * cores, in basis points as it is. A key frame (WIRE_KEY flag) carries the timestamp in ms since
+ * the epoch and the values themselves, other frames carry differences to the previous frame of the stream -
+ * an idle or steady core costs one byte.
+ */
+
+#define WIRE_MAX_CPUS 8192
+#define WIRE_NAME_LEN 64
+#define WIRE_KEY_INTERVAL 60    // every 60th frame is a key frame
+#define WIRE_HEADER_LEN 3
+#define WIRE_KEY 0x01
+
+typedef enum{
+    WIRE_HELLO = 1,
+    WIRE_SAMPLE = 2
+} WireType;
+
+// Sender side of one stream - remembers the previous frame
+typedef struct WireEncoder{
+    uint32_t host_id;
+    size_t no_values;       // no_cpus + 1
+    uint16_t* prev;         // values of the previous frame, total first
+    uint64_t prev_ms;
+    uint32_t since_key;     // frames since the last key frame
+    bool need_key;
+} WireEncoder;
+
+// Decoded frame - values of a sample stay encoded until wire_apply_values
+typedef struct WireMessage{
+    WireType type;
+    uint32_t host_id;
+    uint32_t no_values;     // HELLO - number of cpus, SAMPLE - number of values
+    uint32_t interval_ms;   // HELLO - longest interval between samples, 0 if not known
+    bool key;
+    uint64_t timestamp;     // key frame - ms since the epoch, other frames - ms since the previous frame
+    uint16_t effective_bp;  // SAMPLE - total usage scaled by the frequency of the cores
+    char name[WIRE_NAME_LEN];
+    const uint8_t* values;
+    size_t values_len;
+} WireMessage;
+
+// Collector address resolved once - reconnects do not resolve it again
+typedef struct WireAddr{
+    struct sockaddr_storage addr;
+    socklen_t len;
+} WireAddr;
+
+size_t wire_max_frame(size_t no_cpus);
+
+bool wire_encoder_init(WireEncoder* enc, uint32_t host_id, size_t no_cpus);
+void wire_encoder_destroy(WireEncoder* enc);
+void wire_encoder_reset(WireEncoder* enc);
+size_t wire_encode_hello(const WireEncoder* enc, const char* name, uint32_t interval_ms, uint8_t* out, size_t size);
+size_t wire_encode_sample(WireEncoder* enc, uint64_t timestamp_ms, uint16_t total_bp, uint16_t effective_bp,
+                          const uint16_t* cores_bp, uint8_t* out, size_t size);
+
+long wire_decode(const uint8_t* in, size_t len, WireMessage* msg);
+bool wire_apply_values(const WireMessage* msg, uint16_t* values, size_t no_values);
+
+bool wire_resolve(const char* addr, WireAddr* out);
+int wire_connect(const WireAddr* addr, bool* pending);
+int wire_connect_result(int fd);
+int wire_listen(const char* addr);
+
+#endif //CPU_USAGE_TRACKER_WIRE_H